@@ -10,6 +10,9 @@
 // • The built-in (HW) Serial interface is used for debugging and visualization. In case the debugging is not needed,
 //   it is recommended to use the built-in Serial interface for full speed perfomace.
 // • The data packaging includes a Start Frame, checksum, and re-syncronization capability for reliable communication
+// • With PROTOCOL_V2 the frames use a CRC-16 instead of the XOR checksum and carry sequence numbers. The hoverboard
+//   answers a v2 command with v2 feedback (SERIAL_PROTOCOL_V2 in config.h), which adds the board time, the sequence
+//   number of the last command received and the number of commands received, to measure loss and latency
 // 
 // The code starts with zero speed and moves towards +
 //
@@ -28,6 +31,8 @@
 #define HOVER_SERIAL_BAUD   115200      // [-] Baud rate for HoverSerial (used to communicate with the hoverboard)
 #define SERIAL_BAUD         115200      // [-] Baud rate for built-in Serial (used for the Serial Monitor)
 #define START_FRAME         0xABCD     	// [-] Start frme definition for reliable serial communication
+#define START_FRAME_V2      0xABCE      // [-] Start frame of the protocol v2 frames
+// #define PROTOCOL_V2                     // [-] Send protocol v2 commands and decode the v2 feedback (comment-out for the legacy frames)
 #define TIME_SEND           100         // [ms] Sending time interval
 #define SPEED_MAX_TEST      300         // [-] Maximum speed for testing
 #define SPEED_STEP          20          // [-] Speed step
@@ -59,11 +64,60 @@ typedef struct{
    int16_t  speedL_meas;
    int16_t  batVoltage;
    int16_t  boardTemp;
-   uint16_t cmdLed;
+   uint16_t cmdLed;        // low byte: sideboard LEDs, high byte: 0x01 motor ISR overrun, 0x02 left motor error, 0x04 right motor error
    uint16_t checksum;
 } SerialFeedback;
-SerialFeedback Feedback;
-SerialFeedback NewFeedback;
+
+typedef struct{
+   uint16_t start;
+   uint16_t seq;           // command sequence number
+   int16_t  steer;
+   int16_t  speed;
+   uint16_t crc;           // CRC-16/CCITT-FALSE from seq to speed
+} SerialCommandV2;
+
+typedef struct{
+   uint16_t start;
+   uint16_t seq;           // feedback sequence number
+   uint32_t time;          // [ms] board time
+   uint16_t cmdSeq;        // sequence number of the last command received
+   uint16_t cmdCnt;        // commands received
+   int16_t  cmd1;
+   int16_t  cmd2;
+   int16_t  speedR_meas;
+   int16_t  speedL_meas;
+   int16_t  batVoltage;
+   int16_t  boardTemp;
+   uint16_t cmdLed;
+   uint16_t crc;           // CRC-16/CCITT-FALSE from seq to cmdLed
+} SerialFeedbackV2;
+
+#ifdef PROTOCOL_V2
+  #define FEEDBACK_START    START_FRAME_V2
+  SerialCommandV2 CommandV2;
+  SerialFeedbackV2 Feedback;
+  SerialFeedbackV2 NewFeedback;
+  uint16_t cmdSeq;                      // sequence number of the next command
+  uint16_t cmdSent;                     // commands sent
+  unsigned long cmdTime[16];            // send time of the last 16 commands, by sequence number
+#else
+  #define FEEDBACK_START    START_FRAME
+  SerialFeedback Feedback;
+  SerialFeedback NewFeedback;
+#endif
+
+// CRC-16/CCITT-FALSE, the same as calcCRC16 on the hoverboard
+uint16_t crc16(const uint8_t *data, uint16_t len)
+{
+  uint16_t crc = 0xFFFF;
+  while (len--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+  return crc;
+}
 
 // ########################## SETUP ##########################
 void setup() 
@@ -78,6 +132,20 @@ void setup()
 // ########################## SEND ##########################
 void Send(int16_t uSteer, int16_t uSpeed)
 {
+#ifdef PROTOCOL_V2
+  // Create command
+  CommandV2.start  = (uint16_t)START_FRAME_V2;
+  CommandV2.seq    = cmdSeq;
+  CommandV2.steer  = (int16_t)uSteer;
+  CommandV2.speed  = (int16_t)uSpeed;
+  CommandV2.crc    = crc16((uint8_t *)&CommandV2.seq, sizeof(CommandV2) - 4);
+  cmdTime[cmdSeq & 0x0F] = millis();
+  cmdSeq++;
+  cmdSent++;
+
+  // Write to Serial
+  HoverSerial.write((uint8_t *) &CommandV2, sizeof(CommandV2));
+#else
   // Create command
   Command.start    = (uint16_t)START_FRAME;
   Command.steer    = (int16_t)uSteer;
@@ -86,6 +154,7 @@ void Send(int16_t uSteer, int16_t uSpeed)
 
   // Write to Serial
   HoverSerial.write((uint8_t *) &Command, sizeof(Command)); 
+#endif
 }
 
 // ########################## RECEIVE ##########################
@@ -107,26 +176,32 @@ void Receive()
     #endif
 
     // Copy received data
-    if (bufStartFrame == START_FRAME) {	                    // Initialize if new data is detected
+    if (bufStartFrame == FEEDBACK_START) {	                // Initialize if new data is detected
         p       = (byte *)&NewFeedback;
         *p++    = incomingBytePrev;
         *p++    = incomingByte;
         idx     = 2;	
-    } else if (idx >= 2 && idx < sizeof(SerialFeedback)) {  // Save the new received data
+    } else if (idx >= 2 && idx < sizeof(Feedback)) {        // Save the new received data
         *p++    = incomingByte; 
         idx++;
     }	
     
     // Check if we reached the end of the package
-    if (idx == sizeof(SerialFeedback)) {
+    if (idx == sizeof(Feedback)) {
+#ifdef PROTOCOL_V2
+        uint16_t checksum = crc16((uint8_t *)&NewFeedback.seq, sizeof(NewFeedback) - 4);
+        uint16_t received = NewFeedback.crc;
+#else
         uint16_t checksum;
         checksum = (uint16_t)(NewFeedback.start ^ NewFeedback.cmd1 ^ NewFeedback.cmd2 ^ NewFeedback.speedR_meas ^ NewFeedback.speedL_meas
                             ^ NewFeedback.batVoltage ^ NewFeedback.boardTemp ^ NewFeedback.cmdLed);
+        uint16_t received = NewFeedback.checksum;
+#endif
 
         // Check validity of the new data
-        if (NewFeedback.start == START_FRAME && checksum == NewFeedback.checksum) {
+        if (NewFeedback.start == FEEDBACK_START && checksum == received) {
             // Copy the new data
-            memcpy(&Feedback, &NewFeedback, sizeof(SerialFeedback));
+            memcpy(&Feedback, &NewFeedback, sizeof(Feedback));
 
             // Print data to built-in Serial
             Serial.print("1: ");   Serial.print(Feedback.cmd1);
@@ -135,7 +210,15 @@ void Receive()
             Serial.print(" 4: ");  Serial.print(Feedback.speedL_meas);
             Serial.print(" 5: ");  Serial.print(Feedback.batVoltage);
             Serial.print(" 6: ");  Serial.print(Feedback.boardTemp);
+#ifdef PROTOCOL_V2
+            Serial.print(" 7: ");  Serial.print(Feedback.cmdLed);
+            Serial.print(" seq: "); Serial.print(Feedback.seq);
+            Serial.print(" t: ");   Serial.print(Feedback.time);
+            Serial.print(" lost: "); Serial.print((uint16_t)(cmdSent - Feedback.cmdCnt));                     // includes the commands still on the way
+            Serial.print(" age: "); Serial.println(millis() - cmdTime[Feedback.cmdSeq & 0x0F]);              // [ms] since the last command that reached the board was sent
+#else
             Serial.print(" 7: ");  Serial.println(Feedback.cmdLed);
+#endif
         } else {
           Serial.println("Non-valid data skipped");
         }
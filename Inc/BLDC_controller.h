@@ -20,6 +20,7 @@
 #ifndef RTW_HEADER_BLDC_controller_h_
 #define RTW_HEADER_BLDC_controller_h_
 #include "rtwtypes.h"
+#include "config.h"                    /* CTRL_DIV_FREE */
 #ifndef BLDC_controller_COMMON_INCLUDES_
 # define BLDC_controller_COMMON_INCLUDES_
 #include "rtwtypes.h"
@@ -376,12 +377,38 @@ struct P_ {
 /* Parameters (auto storage) */
 typedef struct P_ P;
 
+#ifdef CTRL_DIV_FREE
+
+/* Reciprocal of a divisor (CTRL_DIV_FREE in config.h): n / d = ((mulhi(n, m) +
+ * ((n - mulhi(n, m)) >> sh1)) >> sh2 for all 32-bit n, see recip_get() */
+typedef struct {
+  int32_T d;                           /* divisor the reciprocal was computed for */
+  uint32_T m;                          /* multiplier */
+  uint8_T sh1;                         /* shifts */
+  uint8_T sh2;
+  boolean_T neg;                       /* d < 0 */
+} Recip;
+
+/* Reciprocals of the divisors in the step, recomputed when the divisor changes */
+typedef struct {
+  Recip fieldWeakRange;                /* '<S42>/Divide14': r_fieldWeakHi - r_fieldWeakLo */
+  Recip fieldWeakAuth;                 /* '<S42>/Divide1': n_fieldWeakAuthHi - n_fieldWeakAuthLo */
+  Recip iMax;                          /* '<S80>/Divide4': i_max */
+  Recip vqMaxSpace;                    /* '<S80>/Vq_max_XA': breakpoint spacing */
+  Recip iqMaxScaSpace;                 /* '<S80>/iq_maxSca_XA': breakpoint spacing */
+} RT_Recip;
+
+#endif                                 /* CTRL_DIV_FREE */
+
 /* Real-time Model Data Structure */
 struct tag_RTM {
   P *defaultParam;
   ExtU *inputs;
   ExtY *outputs;
   DW *dwork;
+#ifdef CTRL_DIV_FREE
+  RT_Recip recip;
+#endif
 };
 
 /* Constant parameters (auto storage) */
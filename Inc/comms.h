@@ -22,40 +22,19 @@
 #define COMMS_H
 
 #include "stm32f1xx_hal.h"
+#include "params.h"
 
 #if defined(DEBUG_SERIAL_PROTOCOL)
 
-enum types {UINT8_T,UINT16_T,UINT32_T,INT8_T,INT16_T,INT32_T,INT,FLOAT};
-#define typename(x) _Generic((x), \
-    uint8_t:    UINT8_T, \
-    uint16_t:   UINT16_T, \
-    uint32_t:   UINT32_T, \
-    int8_t:     INT8_T, \
-    int16_t:    INT16_T, \
-    int32_t:    INT32_T, \
-    int:        INT, \
-    float:      FLOAT)
-
-#define PARAM_SIZE(param) sizeof(param) / sizeof(parameter_entry)
 #define COMMAND_SIZE(command) sizeof(command) / sizeof(command_entry)
 
-#define SIZEP(x) ((char*)(&(x) + 1) - (char*)&(x))
-#define ADD_PARAM(var) typename(var),&var
-
-
-int32_t extToInt(uint8_t index,int32_t value);
 int8_t  setParamValInt(uint8_t index, int32_t newValue);
 int8_t  setParamValExt(uint8_t index, int32_t newValue);
-int32_t intToExt(uint8_t index,int32_t value);
-int32_t getParamValInt(uint8_t index);
-int32_t getParamValExt(uint8_t index);
 
 int8_t initParamVal(uint8_t index);
 int8_t incrParamVal(uint8_t index);
 
 int8_t saveAllParamVal();
-int16_t getParamInitInt(uint8_t index);
-int32_t getParamInitExt(uint8_t index);
 int8_t printCommandHelp(uint8_t index);
 int8_t printParamHelp(uint8_t index);
 int8_t printAllParamHelp();
@@ -66,10 +45,46 @@ void printError(uint8_t errornum );
 int8_t watchParamVal(uint8_t index);
 
 int8_t findCommand(uint8_t *userCommand, uint32_t len);
-int8_t findParam(uint8_t *userCommand, uint32_t len);
 void handle_input(uint8_t *userCommand, uint32_t len);
 void process_debug();
 
+/* Binary parameter requests (DEBUG_SERIAL_BINARY in config.h), on the debug port next to the ASCII commands.
+ * The parameters are addressed by their index in params[], DESC tells the name and the metadata of an index.
+ * The values are in the external format of the ASCII protocol (value = internal * mul / div >> fix),
+ * packed with the size given by DESC: 1, 2 or 4 bytes, signed or not as the datatype, little endian.
+ *
+ * Request and response frame (little endian):
+ *   uint16_t start       PRM_START_FRAME
+ *   uint8_t  cmd         PRM_CMD_, the response has the same cmd, or cmd | PRM_ERR with one byte: the ASCII ErrN number
+ *   uint8_t  len         payload bytes
+ *   uint8_t  payload[len]
+ *   uint16_t crc         CRC-16/CCITT-FALSE from cmd to the end of payload
+ *
+ *   cmd    request payload             response payload
+ *   INFO   -                           uint8 version, uint8 number of params
+ *   DESC   uint8 index                 uint8 index, type (0:PARAMETER 1:VARIABLE), datatype (enum types), size,
+ *                                      int32 min, int32 max, uint8 div, mul, fix, char name[] (rest of the payload)
+ *   GET    uint8 index[n], n <= 32     the n values, packed in request order
+ *   SET    uint8 index, int32 value    uint8 index, the value read back, packed. No beep, the callback runs as for $SET
+ *
+ * Up to PRM_QUEUE requests wait for the main loop, which answers one per loop (5 ms).
+*/
+#ifdef DEBUG_SERIAL_BINARY
+#define PRM_START_FRAME     0xA55C
+#define PRM_VERSION         1
+#define PRM_REQ_MAX         32          // [bytes] longest request payload, so at most 32 values per GET
+#define PRM_RESP_MAX        (PRM_REQ_MAX * 4)   // [bytes] longest response payload
+#define PRM_QUEUE           4           // [-] power of 2, requests waiting for the main loop
+#define PRM_ERR             0x80        // error flag in the response cmd
+
+enum { PRM_CMD_INFO = 1, PRM_CMD_DESC, PRM_CMD_GET, PRM_CMD_SET };
+
+extern uint32_t paramRxErrors;
+
+uint8_t paramRx(const uint8_t *data, uint32_t len);
+void    paramProcess(void);
+#endif
+
 
 typedef struct debug_command_struct debug_command;
 struct debug_command_struct {
@@ -90,24 +105,5 @@ struct command_entry_struct {
   const char *help;
 };
 
-typedef struct parameter_entry_struct parameter_entry;
-struct parameter_entry_struct {
-  const uint8_t type;
-  const char *name;
-  const uint8_t datatype;
-  void *valueL;
-  void *valueR;
-  const uint16_t addr;
-  const int32_t init;
-  const uint8_t initFormat;
-  const int32_t min;
-  const int32_t max;
-  const uint8_t div;
-  const uint8_t mul;
-  const uint8_t fix;
-  void (*callback_function)();
-  const char *help;
-};
-
 #endif  // DEBUG_SERIAL_PROTOCOL
 #endif  // COMMS_H
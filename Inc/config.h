@@ -34,7 +34,7 @@
 #endif
 #define TIMEOUT                20     // number of wrong / missing input commands before emergency off
 #define A2BIT_CONV             50     // A to bit for current conversion on ADC. Example: 1 A = 50, 2 A = 100, etc
-// #define PRINTF_FLOAT_SUPPORT          // [-] Uncomment this for printf to support float on Serial Debug. It will increase code size! Better to avoid it!
+// #define PRINTF_FLOAT_SUPPORT          // [-] Uncomment this for printf to support float on Serial Debug. Uses the newlib printf instead of the built-in integer formatter, it will increase code size! Better to avoid it!
 
 // ADC conversion time definitions
 #define ADC_CONV_TIME_1C5       (14)  //Total ADC clock cycles / conversion = (  1.5+12.5)
@@ -148,6 +148,8 @@
 
 // Control selections
 #define CTRL_TYP_SEL    FOC_CTRL        // [-] Control type selection: COM_CTRL, SIN_CTRL, FOC_CTRL (default)
+// #define CTRL_TYP_FIXED                  // [-] Build the controller for CTRL_TYP_SEL only: the other control types are removed from BLDC_controller_step (fewer cycles, less flash). The control type can then not be changed at runtime
+// #define CTRL_DIV_FREE                   // [-] Replace the divisions of BLDC_controller_step by a parameter (field weakening, i_max, Vq_max and iq_maxSca lookups) by a multiply with a reciprocal, recomputed only after the parameter changed. Bit-exact with the generated code
 #define CTRL_MOD_REQ    SPD_MODE        // [-] Control mode request: OPEN_MODE, VLT_MODE (default), SPD_MODE, TRQ_MODE. Note: SPD_MODE and TRQ_MODE are only available for CTRL_FOC!
 #define DIAG_ENA        1               // [-] Motor Diagnostics enable flag: 0 = Disabled, 1 = Enabled (default)
 
@@ -163,6 +165,10 @@
 #define FIELD_WEAK_HI   1000            // (1000, 1500] Input target High threshold for reaching maximum Field Weakening / Phase Advance. Do NOT set this higher than 1500.
 #define FIELD_WEAK_LO   750             // ( 500, 1000] Input target Low threshold for starting Field Weakening / Phase Advance. Do NOT set this higher than 1000.
 
+// FOC controller gains in raw controller units, as in BLDC_controller_data.c. Runtime: $SET IQ_KP, $SET N_KP
+#define IQ_KP           1229            // [-] Torque (iq) PI proportional gain, generated default
+#define N_KP            4833            // [-] Speed PI proportional gain, generated default
+
 // Extra functionality
 // #define STANDSTILL_HOLD_ENABLE          // [-] Flag to hold the position when standtill is reached. Only available and makes sense for VOLTAGE or TORQUE mode.
 // #define ELECTRIC_BRAKE_ENABLE           // [-] Flag to enable electric brake and replace the motor "freewheel" with a constant braking when the input torque request is 0. Only available and makes sense for TORQUE mode.
@@ -180,6 +186,9 @@
 #define ADC_PROTECT_TIMEOUT       100     // ADC Protection: number of wrong / missing input commands before safety state is taken
 #define ADC_PROTECT_THRESH        200     // ADC Protection threshold below/above the MIN/MAX ADC values
 #define AUTO_CALIBRATION_ENA              // Enable/Disable input auto-calibration by holding power button pressed. Un-comment this if auto-calibration is not needed.
+// #define ADC_OFFSET_STORE                // Keep the current sensor ADC offsets in the EEPROM: at power-on they are used if a 4 ms measurement agrees, instead of the 64 ms calibration
+#define ADC_OFFSET_TOL            20      // [ADC counts] Max. difference between a stored ADC offset and the power-on measurement
+// #define SILENT_START                    // No power-on melody and no motor enable beeps. With ADC_OFFSET_STORE the motors can be enabled about 10 ms after power-on
 
 /* FILTER is in fixdt(0,16,16): VAL_fixedPoint = VAL_floatingPoint * 2^16. In this case 6553 = 0.1 * 2^16
  * Value of COEFFICIENT is in fixdt(1,16,14)
@@ -252,16 +261,51 @@
 // #define DEBUG_SERIAL_USART2          // left sensor board cable, disable if ADC or PPM is used!
 #define DEBUG_SERIAL_USART3          // right sensor board cable, disable if I2C (nunchuk or lcd) is used!
 #define DEBUG_SERIAL_PROTOCOL        // uncomment this to send user commands to the board, change parameters and print specific signals (see comms.c for the user commands)
+// #define DEBUG_SERIAL_BINARY          // uncomment for binary parameter requests next to the ASCII $ commands: get/set by index, many values per request (see comms.h). Needs DEBUG_SERIAL_PROTOCOL
+// #define DEBUG_SERIAL_HELP            // uncomment for the $HELP texts of the parameters and variables (see params.h), about 2.5 kB of flash
+#define DEBUG_TX_BUF_SIZE     512    // [bytes] power of 2, printf buffer sent with DMA in the background. printf only waits when a single burst is larger
+
+/* Binary telemetry replaces the ASCII output above with a framed stream sampled in the motor ISR (see telemetry.h).
+ * Decode on the PC: g++ -O2 -o telem_decode Tools/telem_decode.cpp && ./telem_decode /dev/ttyUSB0 -b 460800 -o trace.csv
+ * Bytes per second ~= (2 * signals + 1) * PWM_FREQ / TELEM_DIV. At 115200 baud (11.5 kB/s) 500 Hz with the default 7 signals fits,
+ * for 1 kHz set USART2_BAUD / USART3_BAUD to 460800. With DEBUG_SERIAL_PROTOCOL set TLM_ENA, TLM_DIV and TLM_MASK at runtime.
+*/
+// #define DEBUG_SERIAL_TELEMETRY       // uncomment to stream binary telemetry on the debug serial port
+#define TELEM_DIV       32              // [-] PWM periods per sample: 16 = 1 kHz, 32 = 500 Hz (default), 160 = 100 Hz
+#define TELEM_MASK      0x0177          // [-] signals, bit n = signal n: 0:iqL 1:idL 2:nL 3:angL 4:iqR 5:idR 6:nR 7:angR 8:bat 9:iLA 10:iLB 11:iLDC 12:iRB 13:iRC 14:iRDC 15:err
+
+/* Triggered scope: records one motor every PWM period (16 kHz) into RAM around a trigger, then sends the capture slowly
+ * on the debug serial port (see scope.h). Triggers: error code change, phase/DC current above SCOPE_THR, or $SET SCP_CMD 2.
+ * Arm with $SET SCP_CMD 1 (single) or 3 (re-arm after each capture). Decode with telem_decode ... -s scope.csv
+ * RAM used: SCOPE_DEPTH * 18 bytes.
+*/
+// #define DEBUG_SCOPE                  // uncomment to enable the triggered scope on the debug serial port
+// #define SCOPE_ARM_AT_BOOT            // uncomment to arm the scope (normal mode) at power on, to catch faults without a serial command
+#define SCOPE_DEPTH     512             // [samples] power of 2, capture length: 512 = 32 ms @ 16 kHz
+#define SCOPE_PRE       128             // [samples] pre-trigger window, the rest of SCOPE_DEPTH is post-trigger
+#define SCOPE_TRIG      3               // [-] trigger mask: 1 = error code change, 2 = current above SCOPE_THR
+#define SCOPE_THR       (30 * A2BIT_CONV) // [-] current trigger threshold: 30 A
 // ########################### END OF DEBUG SERIAL ############################
 
 
 
 // ############################### DEBUG LCD ###############################
-// #define DEBUG_I2C_LCD                // standard 16x2 or larger text-lcd via i2c-converter on right sensor board cable
+// #define DEBUG_I2C_LCD                // standard 16x2 or larger text-lcd via i2c-converter on right sensor board cable. The I2C bus then runs at 100 kHz, the limit of the PCF8574
 // ########################### END OF DEBUG LCD ############################
 
 
 
+// ############################### DEBUG ISR PROFILER ###############################
+/* Measures the motor ISR (DMA1_Channel1_IRQHandler in bldc.c) stage by stage with the DWT cycle counter:
+ * offset/current reading, current chopping, buzzer, left motor and right motor, plus the whole ISR.
+ * Times are CPU cycles @64MHz: 64 cycles = 1 us, 4000 cycles = one PWM period.
+ * With DEBUG_SERIAL_PROTOCOL select the stage with "$SET PRF_SEL n" and read PRF_MIN, PRF_MAX, PRF_MEAN, PRF_H0..PRF_H7
+*/
+// #define DEBUG_ISR_PROFILER           // uncomment to profile the motor ISR. Adds a few cycles per stage
+// ########################### END OF DEBUG ISR PROFILER ############################
+
+
+
 // ################################# VARIANT_ADC SETTINGS ############################
 #ifdef VARIANT_ADC
 /* CONTROL VIA TWO POTENTIOMETERS
@@ -641,16 +685,28 @@
 #if defined(FEEDBACK_SERIAL_USART2) || defined(CONTROL_SERIAL_USART2) || defined(DEBUG_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2) || \
     defined(FEEDBACK_SERIAL_USART3) || defined(CONTROL_SERIAL_USART3) || defined(DEBUG_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
   #define SERIAL_START_FRAME      0xABCD                  // [-] Start frame definition for serial commands
-  #define SERIAL_BUFFER_SIZE      64                      // [bytes] Size of Serial Rx buffer. Make sure it is always larger than the structure size
+  #define SERIAL_START_FRAME_V2   0xABCE                  // [-] Start frame of the protocol v2 command and feedback frames
+  #ifndef CONTROL_IBUS
+    #define SERIAL_PROTOCOL_V2                            // Accept protocol v2 commands (CRC-16, sequence number) next to the legacy ones. A port answers with v2 feedback (adds sequence numbers and board time) after a v2 command and with legacy feedback after a legacy one. Comment-out to save flash
+  #endif
+  #define SERIAL_BUFFER_SIZE      64                      // [bytes] Size of Serial Rx buffer. Make sure it is at least twice the structure size (frames are decoded every half buffer)
   #define SERIAL_TIMEOUT          160                     // [-] Serial timeout duration for the received data. 160 ~= 0.8 sec. Calculation: 0.8 sec / 0.005 sec
+  #define SERIAL_START_FRAME_DIRECT 0xABD0                // [-] Start frame of the direct mode frame, see SERIAL_DIRECT
+  //#define SERIAL_DIRECT                                 // Direct mode (opt-in): a direct frame (per wheel targets, CRC-16) on the active control port sets rtU_Left/rtU_Right.r_inpTgt at the next PWM period, bypassing the rate limiter, filter and mixer. Units as r_inpTgt in the mode of CTRL_MOD_REQ ([-1000, 1000], torque or speed). Any other command frame ends it. Needs SERIAL_PROTOCOL_V2
+  #define SERIAL_DIRECT_TIMEOUT   (PWM_FREQ / 20)         // [PWM periods] Direct mode targets older than this are replaced by 0 (50 ms). The SERIAL_TIMEOUT still applies on top
+  #define SERIAL_START_FRAME_POLL 0xABCF                  // [-] Start frame of the poll frame: a feedback port that receives it sends a feedback frame right away
+  #define FEEDBACK_PERIOD         60                      // [-] Feedback period in main loops: 60 = 300 ms, 1 = every loop (5 ms), 0 = only on poll frames. Runtime: $SET FDBK_PER
+  #define FEEDBACK_ISR_DIV        0                       // [-] If not 0, the motor ISR requests the feedback every FEEDBACK_ISR_DIV PWM periods instead of FEEDBACK_PERIOD, e.g. 80 = 200 Hz @ 16 kHz. The frames follow as fast as the baud rate allows (v2: about 400 Hz @ 115200). Runtime: $SET FDBK_DIV
 #endif
 #if defined(FEEDBACK_SERIAL_USART2) || defined(CONTROL_SERIAL_USART2) || defined(DEBUG_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2)
+  #define SERIAL_USART2                                   // USART2 channel in use, see serialCh[] in util.c
   #ifndef USART2_BAUD
     #define USART2_BAUD           115200                  // UART2 baud rate (long wired cable)
   #endif
   #define USART2_WORDLENGTH       UART_WORDLENGTH_8B      // UART_WORDLENGTH_8B or UART_WORDLENGTH_9B
 #endif
 #if defined(FEEDBACK_SERIAL_USART3) || defined(CONTROL_SERIAL_USART3) || defined(DEBUG_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
+  #define SERIAL_USART3                                   // USART3 channel in use, see serialCh[] in util.c
   #ifndef USART3_BAUD
     #define USART3_BAUD           115200                  // UART3 baud rate (short wired cable)
   #endif
@@ -710,6 +766,22 @@
   #error DEBUG_SERIAL_USART2 and DEBUG_SERIAL_USART3 not allowed, choose one.
 #endif
 
+#if defined(SERIAL_DIRECT) && !defined(SERIAL_PROTOCOL_V2)
+  #error SERIAL_DIRECT needs SERIAL_PROTOCOL_V2.
+#endif
+
+#if defined(DEBUG_SERIAL_BINARY) && !defined(DEBUG_SERIAL_PROTOCOL)
+  #error DEBUG_SERIAL_BINARY needs DEBUG_SERIAL_PROTOCOL.
+#endif
+
+#if defined(DEBUG_SERIAL_TELEMETRY) && !defined(DEBUG_SERIAL_USART2) && !defined(DEBUG_SERIAL_USART3)
+  #error DEBUG_SERIAL_TELEMETRY needs DEBUG_SERIAL_USART2 or DEBUG_SERIAL_USART3.
+#endif
+
+#if defined(DEBUG_SCOPE) && !defined(DEBUG_SERIAL_USART2) && !defined(DEBUG_SERIAL_USART3)
+  #error DEBUG_SCOPE needs DEBUG_SERIAL_USART2 or DEBUG_SERIAL_USART3.
+#endif
+
 #if defined(CONTROL_PPM_LEFT) && defined(CONTROL_PPM_RIGHT)
   #error CONTROL_PPM_LEFT and CONTROL_PPM_RIGHT not allowed, choose one.
 #endif
@@ -229,6 +229,22 @@ typedef struct {
   uint16_t l_rx2;
 } adc_buf_t;
 
+// Current sensor ADC offset calibration at power-on, see DMA1_Channel1_IRQHandler()
+#define ADC_OFFSET_SAMPLES  1024        // offsets = mean of the first samples, 64 ms @ 16 kHz
+#define ADC_OFFSET_CHECK    64          // samples compared with the stored offsets (ADC_OFFSET_STORE), 4 ms
+#define ADC_OFFSET_CAL      0           // adcOffsetState: calibrating, the motor ISR skips the control
+#define ADC_OFFSET_STORED   1           // stored offsets confirmed by the measurement
+#define ADC_OFFSET_MEASURED 2           // offsets measured
+
+// Buzzer sequencer, see beepTick()
+#define BEEP_QUEUE          32          // [-] queued tones, power of 2
+#define BEEP_WINDOW_MS      312         // [ms] tone window of the warning patterns, 5000 PWM periods
+
+typedef struct {
+  uint8_t  freq;                        // buzzerFreq, 0: silence
+  uint16_t ms;                          // [ms] duration
+} BeepStep;
+
 typedef enum {
   NUNCHUK_CONNECTING,
   NUNCHUK_DISCONNECTED,
@@ -255,6 +271,15 @@ void PWM_ISR_CH2_Callback(void);
 #define SENSOR2_SET         (0x02)
 #define SENSOR_MPU          (0x04)
 
+// Motor ISR diagnostics (isrErrCode), latched until cleared with $SET ISR_ERR 0
+#define ISR_ERR_OVERRUN     (0x01)     // the motor ISR did not finish within one PWM period
+#define ISR_PERIOD_CYCLES   (64000000 / PWM_FREQ)  // [cycles] one motor ISR period @64MHz, for the lost period count
+
+// Feedback diagnostics, sent in the upper byte of SerialFeedback.cmdLed (the lower byte holds the sideboard LEDs)
+#define FDBK_ISR_OVERRUN    (0x0100)   // isrErrCode & ISR_ERR_OVERRUN: CPU starvation
+#define FDBK_MOT_ERR_L      (0x0200)   // rtY_Left.z_errCode != 0: hall or current fault on the left motor
+#define FDBK_MOT_ERR_R      (0x0400)   // rtY_Right.z_errCode != 0: hall or current fault on the right motor
+
 // RC iBUS switch definitions. Flysky FS-i6S has [SWA, SWB, SWC, SWD] = [2, 3, 3, 2] positions switch
 #define SWA_SET             (0x0100)   //  0000 0001 0000 0000
 #define SWB_SET             (0x0600)   //  0000 0110 0000 0000
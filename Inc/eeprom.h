@@ -42,6 +42,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f1xx_hal.h"
+#include "params.h"
 
 /* Exported constants --------------------------------------------------------*/
 /* Base address of the Flash sectors */
@@ -180,18 +181,12 @@
 /* EEPROM start address in Flash */
 #define EEPROM_START_ADDRESS  ((uint32_t)ADDR_FLASH_PAGE_64) /* EEPROM emulation start address */
 
-/* Pages 0 and 1 base and end addresses */
-#define PAGE0_BASE_ADDRESS    ((uint32_t)(EEPROM_START_ADDRESS + 0x0000))
+/* Pages 0 and 1 base and end addresses, two consecutive flash pages */
+#define PAGE0_BASE_ADDRESS    ((uint32_t)(EEPROM_START_ADDRESS))
 #define PAGE0_END_ADDRESS     ((uint32_t)(EEPROM_START_ADDRESS + (PAGE_SIZE - 1)))
-#define PAGE0_ID               ADDR_FLASH_PAGE_64
 
-#define PAGE1_BASE_ADDRESS    ((uint32_t)(EEPROM_START_ADDRESS + 0x10000))
-#define PAGE1_END_ADDRESS     ((uint32_t)(EEPROM_START_ADDRESS + 0x10000 + PAGE_SIZE - 1))
-#define PAGE1_ID               ADDR_FLASH_PAGE_96
-
-/* Used Flash pages for EEPROM emulation */
-#define PAGE0                 ((uint16_t)0x0000)
-#define PAGE1                 ((uint16_t)0x0040)
+#define PAGE1_BASE_ADDRESS    ((uint32_t)(EEPROM_START_ADDRESS + PAGE_SIZE))
+#define PAGE1_END_ADDRESS     ((uint32_t)(EEPROM_START_ADDRESS + (2 * PAGE_SIZE - 1)))
 
 /* No valid page define */
 #define NO_VALID_PAGE         ((uint16_t)0x00AB)
@@ -201,22 +196,41 @@
 #define RECEIVE_DATA          ((uint16_t)0xEEEE)     /* Page is marked to receive data */
 #define VALID_PAGE            ((uint16_t)0x0000)     /* Page containing valid data */
 
-/* Valid pages in read and write defines */
-#define READ_FROM_VALID_PAGE  ((uint8_t)0x00)
-#define WRITE_IN_VALID_PAGE   ((uint8_t)0x01)
-
 /* Page full define */
 #define PAGE_FULL             ((uint8_t)0x80)
 
+/* Log entries: one 32-bit word per entry after the page header word, data in the low and the
+ * virtual address in the high halfword, programmed in this order. A write is the entries of the
+ * changed variables followed by a commit entry, EE_Init discards entries without commit.
+ * Virtual addresses 0x0000, 0xFFFD and 0xFFFF are reserved. */
+#define EE_ENTRIES            ((uint16_t)(PAGE_SIZE / 4 - 1))   /* Entries per page */
+#define EE_COMMIT_VADDR       ((uint16_t)0x0000)     /* Commit, data = number of entries before it. A partly programmed address never reads 0x0000 */
+#define EE_WEAR_VADDR         ((uint16_t)0xFFFD)     /* First entry of a page, data = page transfers since the EEPROM was formatted */
+
 /* Variables' number */
-#define NB_OF_VAR             ((uint8_t)0x13)       /* 19 Variables */
+#ifdef PARAM_EEPROM
+  #define NB_OF_VAR           ((uint8_t)EE_SLOTS)   /* FLASH_WRITE_KEY and the EE parameters of params.h */
+#else
+  #define NB_OF_VAR           ((uint8_t)0x01)       /* 1 Variable */
+#endif
 
 /* Exported types ------------------------------------------------------------*/
+typedef struct {
+  uint16_t transfers;   /* Page transfers since the EEPROM was formatted, each one erases a page */
+  uint16_t used;        /* Entries used in the active page */
+  uint16_t writes;      /* Entries programmed since boot */
+  uint16_t skipped;     /* Writes skipped since boot, the value was already stored */
+  uint16_t torn;        /* Writes without commit discarded by EE_Init (power lost while writing) */
+} EE_StatsTypeDef;
+
+extern EE_StatsTypeDef eeStats;
+
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 uint16_t EE_Init(void);
 uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t* Data);
 uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data);
+uint16_t EE_WriteRecord(const uint16_t* Data, const uint8_t* Valid);
 
 #endif /* __EEPROM_H */
 
@@ -18,9 +18,7 @@
  * @brief	Header file for communication with the HD44780 LCD driver.
  * To use it you will have to create a variable of type LCD_PCF8574_HandleTypeDef (e.g. "lcd") and then
  * set the I2C address based on the address pins on your PCF8574 (0-7) (lcd.pcf8574.PCF_I2C_ADDRESS),
- * set the I2C timeout (in milliseconds) (lcd.pcf8574.PCF_I2C_TIMEOUT),
- * set the I2C instance (e.g. I2C1 or I2C2) (lcd.pcf8574.i2c.Instance),
- * set the I2C clock speed (in Hertz) (lcd.pcf8574.i2c.Init.ClockSpeed),
+ * initialise the I2C bus (I2C_Init(), the writes are queued in i2cbus.c),
  * set the number of lines (has to be type of LCD_NUMBER_OF_LINES) (lcd.NUMBER_OF_LINES),
  * set the interface type (has to be type of LCD_TYPE) (lcd.type).
  *
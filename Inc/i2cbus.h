@@ -0,0 +1,62 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Interrupt driven transfer queue on I2C2 (right sensor board cable), shared
+  * by the Nunchuk and the PCF8574 LCD. The main loop queues transfers and
+  * returns at once; the I2C interrupt runs them one after the other, so the
+  * devices never meet on the bus. SysTick (i2cTick) pends the I2C error
+  * interrupt every ms to time the pauses a device needs between transfers
+  * and to catch a hung transfer; the main loop (i2cPoll) then recovers the
+  * bus and resets the peripheral.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Define to prevent recursive inclusion
+#ifndef I2CBUS_H
+#define I2CBUS_H
+
+#include <stdint.h>
+#include "stm32f1xx_hal.h"
+#include "config.h"
+
+#if defined(CONTROL_NUNCHUK) || defined(SUPPORT_NUNCHUK) || defined(DEBUG_I2C_LCD) || defined(SUPPORT_LCD)
+  #define I2C_BUS                         // I2C2 is in use
+#endif
+
+#if defined(DEBUG_I2C_LCD) || defined(SUPPORT_LCD)
+  #define I2C_CLOCK         100000      // [Hz] standard mode: the PCF8574 of the LCD backpacks is rated for 100 kHz only
+#else
+  #define I2C_CLOCK         400000      // [Hz] fast mode, supported by the Nunchuk
+#endif
+#define I2C_QUEUE           32          // [-] queued transfers, power of 2
+#define I2C_JOB_DATA        16          // [bytes] max write length, back to back writes to a device are merged up to this
+#define I2C_TIMEOUT_MS      5           // [ms] a transfer not finished after this is dropped and the bus recovered
+#define I2C_RECOVER_US      5           // [us] half period of the recovery clocks, 100 kHz
+#define I2C_SCL_PIN         GPIO_PIN_10 // PB10
+#define I2C_SDA_PIN         GPIO_PIN_11 // PB11
+#define I2C_FAIL            0xFF        // transaction counter after a failed transfer
+
+/* Transfers of a transaction share a counter set by the caller to the number of
+ * transfers: each successful one decrements it, a failed one sets I2C_FAIL.
+ * The transaction is over when it reads 0 or I2C_FAIL. hold is the bus idle
+ * time before the transfer starts, counted from the end of the previous one. */
+uint8_t i2cWrite(uint8_t addr, const uint8_t *data, uint8_t len, uint8_t hold, volatile uint8_t *pend);
+uint8_t i2cRead(uint8_t addr, uint8_t *rx, uint8_t len, uint8_t hold, volatile uint8_t *pend);
+void    i2cTick(void);
+void    i2cErrorIrq(void);
+void    i2cPoll(void);
+
+#endif // I2CBUS_H
+
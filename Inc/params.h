@@ -0,0 +1,364 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Parameter schema: every parameter and variable reachable with the debug serial
+  * commands, defined once below. The lists generate the params[] table (params.c),
+  * the EEPROM slots and their virtual addresses (eeprom.h, util.c) and the defaults
+  * applied at boot by paramInit().
+  *
+  * Columns of a row X(Type, Name, Var, VarR, Store, Init, Fmt, Min, Max, Div, Mul, Fix, Callback, Help):
+  *   Type      PARAMETER (read/write) or VARIABLE (read only)
+  *   Name      command name, written without quotes
+  *   Var       ADD_PARAM(variable), or NO_PARAM for a constant that only shows its Init value
+  *   VarR      second variable written with the same value (Right motor), or NULL
+  *   Store     EE: saved to EEPROM by $SAVE and the calibration at power off, restored at boot. RAM: not saved
+  *   Init      default value, Fmt 0: internal format, 1: external format (e.g. A, RPM, deg)
+  *   Min, Max  range of the external value accepted by $SET
+  *   Div, Mul, Fix   external = internal * Mul / Div >> Fix
+  *   Callback  called after the value is written, or NULL
+  *   Help      $HELP text, only in the firmware with DEBUG_SERIAL_PROTOCOL and DEBUG_SERIAL_HELP
+  *
+  * EEPROM slots are numbered in PARAM_STORE_LIST order, not in table order, so that
+  * the values saved by older firmware stay valid: add new stored groups at the end.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Define to prevent recursive inclusion
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <stdint.h>
+#include "config.h"
+
+#ifdef CTRL_TYP_FIXED
+  #define CTRL_TYP_MIN CTRL_TYP_SEL
+  #define CTRL_TYP_MAX CTRL_TYP_SEL
+#else
+  #define CTRL_TYP_MIN 0
+  #define CTRL_TYP_MAX 2
+#endif
+
+#ifdef CONTROL_ADC
+  #define RAW_MIN 0
+  #define RAW_MAX 4095
+#else
+  #define RAW_MIN -1000
+  #define RAW_MAX 1000
+#endif
+
+// Fields of the ***_INPUT defines in config.h: TYPE, MIN, MID, MAX, DEADBAND. The type default is 0,
+// Input_Init() resolves the TYPE field (3: auto) when the EEPROM holds no calibration
+#define INPUT_MIN_(typ, min, mid, max, dband)   min
+#define INPUT_MID_(typ, min, mid, max, dband)   mid
+#define INPUT_MAX_(typ, min, mid, max, dband)   max
+#define INPUT_MIN(in)   INPUT_MIN_(in)
+#define INPUT_MID(in)   INPUT_MID_(in)
+#define INPUT_MAX(in)   INPUT_MAX_(in)
+
+enum types {UINT8_T,UINT16_T,UINT32_T,INT8_T,INT16_T,INT32_T,INT,FLOAT};
+#define typename(x) _Generic((x), \
+    uint8_t:    UINT8_T, \
+    uint16_t:   UINT16_T, \
+    uint32_t:   UINT32_T, \
+    int8_t:     INT8_T, \
+    int16_t:    INT16_T, \
+    int32_t:    INT32_T, \
+    int:        INT, \
+    float:      FLOAT)
+
+#define PARAM_SIZE(param) sizeof(param) / sizeof(parameter_entry)
+
+#define SIZEP(x) ((char*)(&(x) + 1) - (char*)&(x))
+#define ADD_PARAM(var) typename(var),&var
+#define NO_PARAM       0,NULL
+
+enum paramTypes {PARAMETER,VARIABLE};
+
+#if defined(DEBUG_SERIAL_PROTOCOL) && defined(DEBUG_SERIAL_HELP)
+  #define PARAM_HELP                    // keep the Help column in params[]
+#endif
+
+#if !defined(VARIANT_HOVERBOARD) && !defined(VARIANT_TRANSPOTTER)
+  #define PARAM_EEPROM                  // the EE parameters are kept in the emulated EEPROM
+#endif
+
+
+/* =========================== Schema =========================== */
+
+// CONTROL PARAMETERS
+//  Type       ,Name                 ,Var                                  ,VarR                      ,Store ,Init              ,Fmt ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback           ,Help
+#define PARAMS_MODE(X) \
+  X(PARAMETER  ,CTRL_MOD             ,ADD_PARAM(ctrlModReqRaw)              ,NULL                      ,EE    ,CTRL_MOD_REQ      ,0   ,1      ,3      ,0               ,0    ,0     ,NULL               ,"Ctrl mode 1:VLT 2:SPD 3:TRQ") \
+  X(PARAMETER  ,CTRL_TYP             ,ADD_PARAM(rtP_Left.z_ctrlTypSel)      ,&rtP_Right.z_ctrlTypSel   ,EE    ,CTRL_TYP_SEL      ,0   ,CTRL_TYP_MIN,CTRL_TYP_MAX,0          ,0    ,0     ,NULL               ,"Ctrl type 0:COM 1:SIN 2:FOC")
+
+#define PARAMS_LIMITS(X) \
+  X(PARAMETER  ,I_MOT_MAX            ,ADD_PARAM(rtP_Left.i_max)             ,&rtP_Right.i_max          ,EE    ,I_MOT_MAX         ,1   ,1      ,40     ,A2BIT_CONV      ,0    ,4     ,NULL               ,"Max phase current A") \
+  X(PARAMETER  ,N_MOT_MAX            ,ADD_PARAM(rtP_Left.n_max)             ,&rtP_Right.n_max          ,EE    ,N_MOT_MAX         ,1   ,10     ,2000   ,0               ,0    ,4     ,NULL               ,"Max motor RPM")
+
+#define PARAMS_FIELD_WEAK(X) \
+  X(PARAMETER  ,FI_WEAK_ENA          ,ADD_PARAM(rtP_Left.b_fieldWeakEna)    ,&rtP_Right.b_fieldWeakEna ,EE    ,FIELD_WEAK_ENA    ,0   ,0      ,1      ,0               ,0    ,0     ,NULL               ,"Enable field weak") \
+  X(PARAMETER  ,FI_WEAK_HI           ,ADD_PARAM(rtP_Left.r_fieldWeakHi)     ,&rtP_Right.r_fieldWeakHi  ,EE    ,FIELD_WEAK_HI     ,1   ,0      ,1500   ,0               ,0    ,4     ,Input_Lim_Init     ,"Field weak high RPM") \
+  X(PARAMETER  ,FI_WEAK_LO           ,ADD_PARAM(rtP_Left.r_fieldWeakLo)     ,&rtP_Right.r_fieldWeakLo  ,EE    ,FIELD_WEAK_LO     ,1   ,0      ,1000   ,0               ,0    ,4     ,Input_Lim_Init     ,"Field weak low RPM") \
+  X(PARAMETER  ,FI_WEAK_MAX          ,ADD_PARAM(rtP_Left.id_fieldWeakMax)   ,&rtP_Right.id_fieldWeakMax,EE    ,FIELD_WEAK_MAX    ,1   ,0      ,20     ,A2BIT_CONV      ,0    ,4     ,NULL               ,"Field weak max current A(FOC)") \
+  X(PARAMETER  ,PHA_ADV_MAX          ,ADD_PARAM(rtP_Left.a_phaAdvMax)       ,&rtP_Right.a_phaAdvMax    ,EE    ,PHASE_ADV_MAX     ,1   ,0      ,55     ,0               ,0    ,4     ,NULL               ,"Max Phase Adv angle Deg(SIN)")
+
+#define PARAMS_GAINS(X) \
+  X(PARAMETER  ,IQ_KP                ,ADD_PARAM(rtP_Left.cf_iqKp)           ,&rtP_Right.cf_iqKp        ,EE    ,IQ_KP             ,0   ,0      ,32767  ,0               ,0    ,0     ,NULL               ,"Torque (iq) PI P gain, raw(FOC)") \
+  X(PARAMETER  ,N_KP                 ,ADD_PARAM(rtP_Left.cf_nKp)            ,&rtP_Right.cf_nKp         ,EE    ,N_KP              ,0   ,0      ,32767  ,0               ,0    ,0     ,NULL               ,"Speed PI P gain, raw(FOC)")
+
+// INPUT PARAMETERS
+//  Type       ,Name                 ,Var                                  ,VarR                      ,Store ,Init              ,Fmt ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback           ,Help
+#define PARAMS_INPUT(X) \
+  X(VARIABLE   ,IN1_RAW              ,ADD_PARAM(input1[0].raw)              ,NULL                      ,RAM   ,0                 ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Input1 raw") \
+  X(PARAMETER  ,IN1_TYP              ,ADD_PARAM(input1[0].typ)              ,NULL                      ,EE    ,0                 ,0   ,0      ,3      ,0               ,0    ,0     ,NULL               ,"Input1 type") \
+  X(PARAMETER  ,IN1_MIN              ,ADD_PARAM(input1[0].min)              ,NULL                      ,EE    ,INPUT_MIN(PRI_INPUT1) ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Input1 min") \
+  X(PARAMETER  ,IN1_MID              ,ADD_PARAM(input1[0].mid)              ,NULL                      ,EE    ,INPUT_MID(PRI_INPUT1) ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Input1 mid") \
+  X(PARAMETER  ,IN1_MAX              ,ADD_PARAM(input1[0].max)              ,NULL                      ,EE    ,INPUT_MAX(PRI_INPUT1) ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Input1 max") \
+  X(VARIABLE   ,IN1_CMD              ,ADD_PARAM(input1[0].cmd)              ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Input1 cmd") \
+  X(VARIABLE   ,IN2_RAW              ,ADD_PARAM(input2[0].raw)              ,NULL                      ,RAM   ,0                 ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Input2 raw") \
+  X(PARAMETER  ,IN2_TYP              ,ADD_PARAM(input2[0].typ)              ,NULL                      ,EE    ,0                 ,0   ,0      ,3      ,0               ,0    ,0     ,NULL               ,"Input2 type") \
+  X(PARAMETER  ,IN2_MIN              ,ADD_PARAM(input2[0].min)              ,NULL                      ,EE    ,INPUT_MIN(PRI_INPUT2) ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Input2 min") \
+  X(PARAMETER  ,IN2_MID              ,ADD_PARAM(input2[0].mid)              ,NULL                      ,EE    ,INPUT_MID(PRI_INPUT2) ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Input2 mid") \
+  X(PARAMETER  ,IN2_MAX              ,ADD_PARAM(input2[0].max)              ,NULL                      ,EE    ,INPUT_MAX(PRI_INPUT2) ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Input2 max") \
+  X(VARIABLE   ,IN2_CMD              ,ADD_PARAM(input2[0].cmd)              ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Input2 cmd")
+
+#define PARAMS_AUX_INPUT_ROWS(X) \
+  X(VARIABLE   ,AUX_IN1_RAW          ,ADD_PARAM(input1[1].raw)              ,NULL                      ,RAM   ,0                 ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Aux. input1 raw") \
+  X(PARAMETER  ,AUX_IN1_TYP          ,ADD_PARAM(input1[1].typ)              ,NULL                      ,EE    ,0                 ,0   ,0      ,3      ,0               ,0    ,0     ,NULL               ,"Aux. input1 type") \
+  X(PARAMETER  ,AUX_IN1_MIN          ,ADD_PARAM(input1[1].min)              ,NULL                      ,EE    ,INPUT_MIN(AUX_INPUT1) ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Aux. input1 min") \
+  X(PARAMETER  ,AUX_IN1_MID          ,ADD_PARAM(input1[1].mid)              ,NULL                      ,EE    ,INPUT_MID(AUX_INPUT1) ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Aux. input1 mid") \
+  X(PARAMETER  ,AUX_IN1_MAX          ,ADD_PARAM(input1[1].max)              ,NULL                      ,EE    ,INPUT_MAX(AUX_INPUT1) ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Aux. input1 max") \
+  X(VARIABLE   ,AUX_IN1_CMD          ,ADD_PARAM(input1[1].cmd)              ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Aux. input1 cmd") \
+  X(VARIABLE   ,AUX_IN2_RAW          ,ADD_PARAM(input2[1].raw)              ,NULL                      ,RAM   ,0                 ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Aux. input2 raw") \
+  X(PARAMETER  ,AUX_IN2_TYP          ,ADD_PARAM(input2[1].typ)              ,NULL                      ,EE    ,0                 ,0   ,0      ,3      ,0               ,0    ,0     ,NULL               ,"Aux. input2 type") \
+  X(PARAMETER  ,AUX_IN2_MIN          ,ADD_PARAM(input2[1].min)              ,NULL                      ,EE    ,INPUT_MIN(AUX_INPUT2) ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Aux. input2 min") \
+  X(PARAMETER  ,AUX_IN2_MID          ,ADD_PARAM(input2[1].mid)              ,NULL                      ,EE    ,INPUT_MID(AUX_INPUT2) ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Aux. input2 mid") \
+  X(PARAMETER  ,AUX_IN2_MAX          ,ADD_PARAM(input2[1].max)              ,NULL                      ,EE    ,INPUT_MAX(AUX_INPUT2) ,0   ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,NULL               ,"Aux. input2 max") \
+  X(VARIABLE   ,AUX_IN2_CMD          ,ADD_PARAM(input2[1].cmd)              ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Aux. input2 cmd")
+#if defined(PRI_INPUT1) && defined(PRI_INPUT2) && defined(AUX_INPUT1) && defined(AUX_INPUT2)
+#define PARAMS_AUX_INPUT(X) PARAMS_AUX_INPUT_ROWS(X)
+#else
+#define PARAMS_AUX_INPUT(X)
+#endif
+
+// FEEDBACK
+//  Type       ,Name                 ,Var                                  ,VarR                      ,Store ,Init              ,Fmt ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback           ,Help
+#define PARAMS_FEEDBACK(X) \
+  X(VARIABLE   ,DC_CURR              ,ADD_PARAM(dc_curr)                    ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Total DC Link current A *100") \
+  X(VARIABLE   ,RDC_CURR             ,ADD_PARAM(right_dc_curr)              ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Right DC Link current A *100") \
+  X(VARIABLE   ,LDC_CURR             ,ADD_PARAM(left_dc_curr)               ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Left DC Link current A *100") \
+  X(VARIABLE   ,CMDL                 ,ADD_PARAM(cmdL)                       ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Left Motor Command") \
+  X(VARIABLE   ,CMDR                 ,ADD_PARAM(cmdR)                       ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Right Motor Command") \
+  X(VARIABLE   ,SPD_AVG              ,ADD_PARAM(speedAvg)                   ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Motor Measured Avg RPM") \
+  X(VARIABLE   ,SPDL                 ,ADD_PARAM(rtY_Left.n_mot)             ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Left Motor Measured RPM") \
+  X(VARIABLE   ,SPDR                 ,ADD_PARAM(rtY_Right.n_mot)            ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Right Motor Measured RPM") \
+  X(VARIABLE   ,RATE                 ,NO_PARAM                              ,NULL                      ,RAM   ,RATE              ,0   ,0      ,0      ,0               ,0    ,4     ,NULL               ,"Rate *10") \
+  X(VARIABLE   ,SPD_COEF             ,NO_PARAM                              ,NULL                      ,RAM   ,SPEED_COEFFICIENT ,0   ,0      ,0      ,0               ,10   ,14    ,NULL               ,"Speed Coefficient *10") \
+  X(VARIABLE   ,STR_COEF             ,NO_PARAM                              ,NULL                      ,RAM   ,STEER_COEFFICIENT ,0   ,0      ,0      ,0               ,10   ,14    ,NULL               ,"Steer Coefficient *10") \
+  X(VARIABLE   ,BATV                 ,ADD_PARAM(batVoltageCalib)            ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Calibrated Battery voltage *100") \
+  X(VARIABLE   ,TEMP                 ,ADD_PARAM(board_temp_deg_c)           ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Calibrated Temperature °C *10")
+
+// DIAGNOSTICS
+//  Type       ,Name                 ,Var                                  ,VarR                      ,Store ,Init              ,Fmt ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback           ,Help
+#define PARAMS_DIAG(X) \
+  X(PARAMETER  ,ISR_ERR              ,ADD_PARAM(isrErrCode)                 ,NULL                      ,RAM   ,0                 ,0   ,0      ,1      ,0               ,0    ,0     ,NULL               ,"Motor ISR overrun latched, set 0 to clear") \
+  X(VARIABLE   ,OVR_CNT              ,ADD_PARAM(isrOverrunCnt)              ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Motor ISR control periods lost") \
+  X(VARIABLE   ,OVR_STREAK           ,ADD_PARAM(isrOverrunStreakMax)        ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Motor ISR longest overrun streak") \
+  X(VARIABLE   ,PRM_SWAP             ,ADD_PARAM(ctrlParamSwaps)             ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Controller parameter sets applied") \
+  X(VARIABLE   ,BOOT_MS              ,ADD_PARAM(bootTime)                   ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Time from power-on to motors enabled ms") \
+  X(VARIABLE   ,OFS_STATE            ,ADD_PARAM(adcOffsetState)             ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"ADC offsets 0:CAL 1:STORED 2:MEASURED")
+
+// ADC OFFSETS, measured at power-on and stored with ADC_OFFSET_STORE. Loaded without FLASH_WRITE_KEY
+//  Type       ,Name                 ,Var                                  ,VarR                      ,Store ,Init              ,Fmt ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback           ,Help
+#define PARAMS_ADC_OFFSET_ROWS(X) \
+  X(VARIABLE   ,OFS_RLA              ,ADD_PARAM(offsetrlA)                  ,NULL                      ,EE    ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"ADC offset left phase A") \
+  X(VARIABLE   ,OFS_RLB              ,ADD_PARAM(offsetrlB)                  ,NULL                      ,EE    ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"ADC offset left phase B") \
+  X(VARIABLE   ,OFS_RRB              ,ADD_PARAM(offsetrrB)                  ,NULL                      ,EE    ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"ADC offset right phase B") \
+  X(VARIABLE   ,OFS_RRC              ,ADD_PARAM(offsetrrC)                  ,NULL                      ,EE    ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"ADC offset right phase C") \
+  X(VARIABLE   ,OFS_DCL              ,ADD_PARAM(offsetdcl)                  ,NULL                      ,EE    ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"ADC offset left DC link") \
+  X(VARIABLE   ,OFS_DCR              ,ADD_PARAM(offsetdcr)                  ,NULL                      ,EE    ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"ADC offset right DC link")
+#if defined(ADC_OFFSET_STORE) && defined(PARAM_EEPROM)
+#define PARAMS_ADC_OFFSET(X) PARAMS_ADC_OFFSET_ROWS(X)
+#else
+#define PARAMS_ADC_OFFSET(X)
+#endif
+
+#ifdef DEBUG_SERIAL_BINARY
+#define PARAMS_BINARY(X) \
+  X(VARIABLE   ,PRM_ERR              ,ADD_PARAM(paramRxErrors)              ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Binary requests dropped")
+#else
+#define PARAMS_BINARY(X)
+#endif
+
+#if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+#define PARAMS_DEBUG_TX(X) \
+  X(VARIABLE   ,TX_DROP              ,ADD_PARAM(dbgTxDrops)                 ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"printf characters dropped on a full ring")
+#else
+#define PARAMS_DEBUG_TX(X)
+#endif
+
+// SERIAL FEEDBACK
+//  Type       ,Name                 ,Var                                  ,VarR                      ,Store ,Init              ,Fmt ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback           ,Help
+#define PARAMS_SERIAL_FEEDBACK_ROWS(X) \
+  X(PARAMETER  ,FDBK_PER             ,ADD_PARAM(fdbkPeriod)                 ,NULL                      ,EE    ,FEEDBACK_PERIOD   ,0   ,0      ,1000   ,0               ,0    ,0     ,NULL               ,"Feedback period in loops of 5ms, 0:POLL ONLY") \
+  X(PARAMETER  ,FDBK_DIV             ,ADD_PARAM(fdbkDiv)                    ,NULL                      ,EE    ,FEEDBACK_ISR_DIV  ,0   ,0      ,16000  ,0               ,0    ,0     ,serialFeedbackDiv  ,"Feedback PWM periods per frame, 0:USE FDBK_PER 80:200Hz")
+#if defined(FEEDBACK_SERIAL_USART2) || defined(FEEDBACK_SERIAL_USART3)
+#define PARAMS_SERIAL_FEEDBACK(X) PARAMS_SERIAL_FEEDBACK_ROWS(X)
+#else
+#define PARAMS_SERIAL_FEEDBACK(X)
+#endif
+
+// TELEMETRY
+//  Type       ,Name                 ,Var                                  ,VarR                      ,Store ,Init              ,Fmt ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback           ,Help
+#define PARAMS_TELEMETRY_ROWS(X) \
+  X(PARAMETER  ,TLM_ENA              ,ADD_PARAM(telemEna)                   ,NULL                      ,EE    ,1                 ,0   ,0      ,1      ,0               ,0    ,0     ,NULL               ,"Telemetry stream 0:OFF 1:ON") \
+  X(PARAMETER  ,TLM_DIV              ,ADD_PARAM(telemDiv)                   ,NULL                      ,EE    ,TELEM_DIV         ,0   ,TELEM_DIV_MIN,16000,0             ,0    ,0     ,NULL               ,"Telemetry PWM periods per sample, 16:1kHz") \
+  X(PARAMETER  ,TLM_MASK             ,ADD_PARAM(telemMask)                  ,NULL                      ,EE    ,TELEM_MASK        ,0   ,1      ,65535  ,0               ,0    ,0     ,NULL               ,"Telemetry signal mask, see config.h") \
+  X(VARIABLE   ,TLM_DROP             ,ADD_PARAM(telemDrops)                 ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Telemetry samples dropped")
+#ifdef DEBUG_SERIAL_TELEMETRY
+#define PARAMS_TELEMETRY(X) PARAMS_TELEMETRY_ROWS(X)
+#else
+#define PARAMS_TELEMETRY(X)
+#endif
+
+// SCOPE
+//  Type       ,Name                 ,Var                                  ,VarR                      ,Store ,Init              ,Fmt ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback           ,Help
+#ifdef DEBUG_SCOPE
+#define PARAMS_SCOPE(X) \
+  X(PARAMETER  ,SCP_CMD              ,ADD_PARAM(scopeCmd)                   ,NULL                      ,RAM   ,0                 ,0   ,0      ,3      ,0               ,0    ,0     ,scopeCommand       ,"Scope 0:STOP 1:SINGLE 2:FORCE 3:NORMAL") \
+  X(PARAMETER  ,SCP_TRIG             ,ADD_PARAM(scopeTrig)                  ,NULL                      ,RAM   ,SCOPE_TRIG        ,0   ,0      ,3      ,0               ,0    ,0     ,NULL               ,"Scope trigger mask 1:ERR 2:CURRENT") \
+  X(PARAMETER  ,SCP_THR              ,ADD_PARAM(scopeThr)                   ,NULL                      ,RAM   ,SCOPE_THR         ,0   ,0      ,600    ,A2BIT_CONV      ,0    ,0     ,NULL               ,"Scope current trigger threshold A") \
+  X(PARAMETER  ,SCP_PRE              ,ADD_PARAM(scopePre)                   ,NULL                      ,RAM   ,SCOPE_PRE         ,0   ,0      ,SCOPE_DEPTH-1,0         ,0    ,0     ,NULL               ,"Scope pre-trigger samples") \
+  X(PARAMETER  ,SCP_MOT              ,ADD_PARAM(scopeMotor)                 ,NULL                      ,RAM   ,0                 ,0   ,0      ,1      ,0               ,0    ,0     ,NULL               ,"Scope motor 0:LEFT 1:RIGHT") \
+  X(VARIABLE   ,SCP_STATE            ,ADD_PARAM(scopeState)                 ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Scope state 0:IDLE 1:ARMED 2:TRIGGERED 3:SENDING")
+#else
+#define PARAMS_SCOPE(X)
+#endif
+
+// ISR PROFILER
+//  Type       ,Name                 ,Var                                  ,VarR                      ,Store ,Init              ,Fmt ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback           ,Help
+#ifdef DEBUG_ISR_PROFILER
+#define PARAMS_PROFILER(X) \
+  X(PARAMETER  ,PRF_SEL              ,ADD_PARAM(profSel)                    ,NULL                      ,RAM   ,PRF_TOTAL         ,0   ,0      ,5      ,0               ,0    ,0     ,profSelect         ,"Profiler stage 0:OFFS 1:CHOP 2:BUZ 3:LEFT 4:RIGHT 5:ISR") \
+  X(VARIABLE   ,PRF_MIN              ,ADD_PARAM(profMin)                    ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Profiler min cycles @64MHz") \
+  X(VARIABLE   ,PRF_MAX              ,ADD_PARAM(profMax)                    ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Profiler max cycles @64MHz") \
+  X(VARIABLE   ,PRF_MEAN             ,ADD_PARAM(profMean)                   ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Profiler filtered mean cycles @64MHz") \
+  X(VARIABLE   ,PRF_H0               ,ADD_PARAM(profHist[0])                ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Profiler count <64 cycles") \
+  X(VARIABLE   ,PRF_H1               ,ADD_PARAM(profHist[1])                ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Profiler count 64-127 cycles") \
+  X(VARIABLE   ,PRF_H2               ,ADD_PARAM(profHist[2])                ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Profiler count 128-255 cycles") \
+  X(VARIABLE   ,PRF_H3               ,ADD_PARAM(profHist[3])                ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Profiler count 256-511 cycles") \
+  X(VARIABLE   ,PRF_H4               ,ADD_PARAM(profHist[4])                ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Profiler count 512-1023 cycles") \
+  X(VARIABLE   ,PRF_H5               ,ADD_PARAM(profHist[5])                ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Profiler count 1024-2047 cycles") \
+  X(VARIABLE   ,PRF_H6               ,ADD_PARAM(profHist[6])                ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Profiler count 2048-4095 cycles") \
+  X(VARIABLE   ,PRF_H7               ,ADD_PARAM(profHist[7])                ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Profiler count >=4096 cycles")
+#else
+#define PARAMS_PROFILER(X)
+#endif
+
+// MAIN LOOP SCHEDULER
+//  Type       ,Name                 ,Var                                  ,VarR                      ,Store ,Init              ,Fmt ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback           ,Help
+#define PARAMS_SCHED(X) \
+  X(PARAMETER  ,TSK_SEL              ,ADD_PARAM(schedSel)                   ,NULL                      ,RAM   ,TASK_CONTROL      ,0   ,0      ,5      ,0               ,0    ,0     ,schedSelect        ,"Task 0:CTRL 1:COMMS 2:TEMP 3:DEBUG 4:LCD 5:SAVE") \
+  X(VARIABLE   ,TSK_RUNS             ,ADD_PARAM(schedRuns)                  ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Task runs") \
+  X(VARIABLE   ,TSK_MISS             ,ADD_PARAM(schedMisses)                ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Task runs ended after the next period started") \
+  X(VARIABLE   ,TSK_EXEC             ,ADD_PARAM(schedExec)                  ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Task filtered mean run time in us, interrupts included") \
+  X(VARIABLE   ,TSK_EXMAX            ,ADD_PARAM(schedExecMax)               ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Task max run time in us, interrupts included") \
+  X(VARIABLE   ,TSK_LATE             ,ADD_PARAM(schedLate)                  ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Task max start delay in us") \
+  X(VARIABLE   ,TSK_SLACK            ,ADD_PARAM(schedSlack)                 ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Task min time left to the next period in us") \
+  X(VARIABLE   ,CPU_LOAD             ,ADD_PARAM(schedLoad)                  ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Main loop CPU load in % over 1 s")
+
+// EEPROM EMULATION statistics
+//  Type       ,Name                 ,Var                                  ,VarR                      ,Store ,Init              ,Fmt ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback           ,Help
+#ifdef PARAM_EEPROM
+#define PARAMS_EEPROM_STATS(X) \
+  X(VARIABLE   ,EEP_XFER             ,ADD_PARAM(eeStats.transfers)          ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"EEPROM page transfers (erases) since format") \
+  X(VARIABLE   ,EEP_USED             ,ADD_PARAM(eeStats.used)               ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"EEPROM entries used in the active page") \
+  X(VARIABLE   ,EEP_WR               ,ADD_PARAM(eeStats.writes)             ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"EEPROM entries written since boot") \
+  X(VARIABLE   ,EEP_SKIP             ,ADD_PARAM(eeStats.skipped)            ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"EEPROM unchanged writes skipped since boot") \
+  X(VARIABLE   ,EEP_TORN             ,ADD_PARAM(eeStats.torn)               ,NULL                      ,RAM   ,0                 ,0   ,0      ,0      ,0               ,0    ,0     ,NULL               ,"EEPROM interrupted records discarded at boot")
+#else
+#define PARAMS_EEPROM_STATS(X)
+#endif
+
+// Table order: the order of $GET, $HELP and of the binary protocol indexes
+#define PARAM_LIST(X) \
+  PARAMS_MODE(X) PARAMS_LIMITS(X) PARAMS_FIELD_WEAK(X) PARAMS_GAINS(X) PARAMS_INPUT(X) PARAMS_AUX_INPUT(X) \
+  PARAMS_FEEDBACK(X) PARAMS_DIAG(X) PARAMS_BINARY(X) PARAMS_DEBUG_TX(X) PARAMS_SERIAL_FEEDBACK(X) PARAMS_TELEMETRY(X) PARAMS_SCOPE(X) PARAMS_PROFILER(X) \
+  PARAMS_EEPROM_STATS(X) PARAMS_ADC_OFFSET(X) PARAMS_SCHED(X)
+
+// EEPROM order: slot 0 is FLASH_WRITE_KEY, then the Store EE rows of these groups. Append only.
+// The optional groups keep their slots (_ROWS) when they are not built, so the slots do not depend on config.h
+#define PARAM_STORE_LIST(X) \
+  PARAMS_LIMITS(X) PARAMS_INPUT(X) PARAMS_AUX_INPUT_ROWS(X) PARAMS_MODE(X) PARAMS_FIELD_WEAK(X) PARAMS_GAINS(X) \
+  PARAMS_SERIAL_FEEDBACK_ROWS(X) PARAMS_TELEMETRY_ROWS(X) PARAMS_ADC_OFFSET_ROWS(X)
+
+
+/* =========================== Generated =========================== */
+
+// Row of each parameter in params[]: IDX_<Name>, and the number of rows
+#define PARAM_X_IDX(type, name, ...)    IDX_##name,
+enum { PARAM_LIST(PARAM_X_IDX) PARAM_COUNT };
+
+// EEPROM slots: EE_<Name>
+#define PARAM_X_SLOT(type, name, var, varR, store, ...)   PARAM_SLOT_##store(EE_##name)
+#define PARAM_SLOT_EE(slot)     slot,
+#define PARAM_SLOT_RAM(slot)
+enum { EE_KEY, PARAM_STORE_LIST(PARAM_X_SLOT) EE_SLOTS };
+
+// Virtual EEPROM addresses of the slots, for VirtAddVarTab
+#define PARAM_EE_VADDR          1000    // slot 0, 0xFFFF is prohibited
+#define PARAM_X_VADDR(type, name, var, varR, store, ...)  PARAM_VADDR_##store(EE_##name)
+#define PARAM_VADDR_EE(slot)    PARAM_EE_VADDR + slot,
+#define PARAM_VADDR_RAM(slot)
+#define PARAM_EE_VADDR_LIST     PARAM_EE_VADDR, PARAM_STORE_LIST(PARAM_X_VADDR)
+
+typedef struct parameter_entry_struct parameter_entry;
+struct parameter_entry_struct {
+  const uint8_t type;
+  const char *name;
+  const uint8_t datatype;
+  void *valueL;
+  void *valueR;
+  const uint16_t addr;                  // EEPROM slot, 0 = not stored
+  const int32_t init;
+  const uint8_t initFormat;
+  const int32_t min;
+  const int32_t max;
+  const uint8_t div;
+  const uint8_t mul;
+  const uint8_t fix;
+  void (*callback_function)();
+  #ifdef PARAM_HELP
+  const char *help;
+  #endif
+};
+
+extern const parameter_entry params[PARAM_COUNT];
+
+void    paramInit(void);
+uint8_t paramLoad(void);
+void    paramSave(void);
+void    paramSaveRange(uint8_t first, uint8_t last);
+uint8_t paramWrite(uint8_t index, int32_t newValue);
+
+int32_t extToInt(uint8_t index,int32_t value);
+int32_t intToExt(uint8_t index,int32_t value);
+int32_t getParamValInt(uint8_t index);
+int32_t getParamValExt(uint8_t index);
+int32_t getParamInitInt(uint8_t index);
+int32_t getParamInitExt(uint8_t index);
+int8_t  findParam(uint8_t *userCommand, uint32_t len);
+
+#endif  // PARAMS_H
@@ -40,8 +40,7 @@ typedef enum{
  */
 typedef struct{
 	uint8_t				PCF_I2C_ADDRESS;	/**< address of the chip you want to communicate with */
-	uint32_t			PCF_I2C_TIMEOUT;	/**< timeout value for the communication in milliseconds */
-	I2C_HandleTypeDef 	i2c;				/**< I2C_HandleTypeDef structure */
+	uint8_t				hold;				/**< bus idle time before the next transfer in milliseconds */
 	void				(*errorCallback)(PCF8574_RESULT);
 } PCF8574_HandleTypeDef;
 
@@ -57,26 +56,34 @@ extern uint32_t PCF8574_Type0Pins[];
 PCF8574_RESULT PCF8574_Init(PCF8574_HandleTypeDef* handle);
 
 /**
- * Deinitializes the I2C
+ * Deinitializes the handle, the I2C bus is shared and stays up
  * @param	handle - a pointer to the PCF8574 handle
  * @return	whether the function was successful or not
  */
 PCF8574_RESULT PCF8574_DeInit(PCF8574_HandleTypeDef* handle);
 
 /**
- * Writes a given value to the port of PCF8574
+ * Queues a given value for the port of PCF8574 on the I2C bus (i2cbus.c), returns at once
  * @param	handle - a pointer to the PCF8574 handle
  * @param	val - a value to be written to the port
- * @return	whether the function was successful or not
+ * @return	whether the value was queued or not
  */
 PCF8574_RESULT PCF8574_Write(PCF8574_HandleTypeDef* handle, uint8_t val);
 
 /**
- * Reads the current state of the port of PCF8574
+ * Queues a read of the port of PCF8574 after the queued writes, returns at once
  * @param	handle - a pointer to the PCF8574 handle
- * @param	val - a pointer to the variable that will be assigned a value from the chip
- * @return	whether the function was successful or not
+ * @param	val - a pointer to the variable that will be assigned a value from the chip, valid until the read is over
+ * @param	pend - set to 1, the read is over when it reads 0 (val is valid) or I2C_FAIL
+ * @return	whether the read was queued or not
+ */
+PCF8574_RESULT PCF8574_Read(PCF8574_HandleTypeDef* handle, uint8_t* val, volatile uint8_t* pend);
+
+/**
+ * Keeps the bus idle before the next transfer, for the execution time of the chip behind the port
+ * @param	handle - a pointer to the PCF8574 handle
+ * @param	ms - idle time in milliseconds
  */
-PCF8574_RESULT PCF8574_Read(PCF8574_HandleTypeDef* handle, uint8_t* val);
+void PCF8574_Delay(PCF8574_HandleTypeDef* handle, uint8_t ms);
 
 #endif /* INC_PCF8574_H_ */
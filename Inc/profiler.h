@@ -0,0 +1,81 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Per-stage cycle profiler for the motor ISR (DMA1_Channel1_IRQHandler).
+  * Timestamps are taken from the DWT cycle counter (64 cycles = 1 us at 64 MHz,
+  * 4000 cycles = one 16 kHz PWM period). Enabled with DEBUG_ISR_PROFILER in config.h,
+  * otherwise all PROF_ macros compile to nothing.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Define to prevent recursive inclusion
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include "stm32f1xx_hal.h"
+#include "config.h"
+
+#ifdef DEBUG_ISR_PROFILER
+
+// ISR stages, in execution order. PRF_TOTAL spans the whole ISR.
+enum { PRF_OFFSET, PRF_CHOP, PRF_BUZZER, PRF_LEFT, PRF_RIGHT, PRF_TOTAL, PRF_STAGES };
+
+#define PRF_HIST_BINS   8           // bin 0: < 64 cycles, bin k: [32 << k, 64 << k) cycles, bin 7: >= 4096 cycles (PWM period overrun)
+#define PRF_MEAN_SHIFT  4           // mean filter: 1/16 of the new sample
+
+typedef struct {
+  uint16_t min;                     // [cycles]
+  uint16_t max;                     // [cycles]
+  uint32_t meanAcc;                 // [cycles << PRF_MEAN_SHIFT] filtered mean
+  uint32_t hist[PRF_HIST_BINS];     // [-] sample count per bin
+} ProfStage;
+
+extern ProfStage        profStages[PRF_STAGES];
+extern volatile uint8_t profResetReq;
+
+void profInit(void);
+void profReset(void);
+void profSelect(void);
+void profExport(void);
+
+static inline void profRecord(uint8_t stage, uint32_t cycles) {
+  ProfStage *s = &profStages[stage];
+  uint32_t  bin;
+
+  if (cycles > 0xFFFF)   cycles = 0xFFFF;
+  if (cycles < s->min)   s->min = (uint16_t)cycles;
+  if (cycles > s->max)   s->max = (uint16_t)cycles;
+  s->meanAcc += cycles - (s->meanAcc >> PRF_MEAN_SHIFT);
+
+  bin = (cycles < 64) ? 0 : (uint32_t)(26 - __CLZ(cycles));   // log2 binning, a single CLZ instruction
+  if (bin >= PRF_HIST_BINS) bin = PRF_HIST_BINS - 1;
+  s->hist[bin]++;
+}
+
+// Usage: PROF_BEGIN() once at ISR entry, PROF_MARK(stage) at the end of each stage, PROF_END() before every return
+#define PROF_BEGIN()      uint32_t profStart = DWT->CYCCNT; uint32_t profLast = profStart
+#define PROF_MARK(stage)  do { uint32_t profNow = DWT->CYCCNT; profRecord((stage), profNow - profLast); profLast = profNow; } while (0)
+#define PROF_END()        do { profRecord(PRF_TOTAL, DWT->CYCCNT - profStart); if (profResetReq) { profReset(); } } while (0)
+
+#else
+
+#define PROF_BEGIN()
+#define PROF_MARK(stage)
+#define PROF_END()
+
+#endif // DEBUG_ISR_PROFILER
+
+#endif // PROFILER_H
@@ -0,0 +1,39 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Placement of the motor control fast path in SRAM.
+  * At 64 MHz the flash runs with FLASH_LATENCY_2, so every taken branch in the
+  * motor ISR can stall on a prefetch refill. With RAMFUNC_ENA (make RAMFUNC=1)
+  * the functions marked RAM_FUNC and the tables marked RAM_CONST are linked
+  * into the .data section (.RamFunc / .RamData, see STM32F103RCTx_FLASH.ld)
+  * and copied to SRAM by the startup code. The Makefile builds the objects
+  * holding RAM_FUNC code with -mlong-calls, because SRAM is out of BL range
+  * from flash and vice versa.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Define to prevent recursive inclusion
+#ifndef RAMFUNC_H
+#define RAMFUNC_H
+
+#if defined(RAMFUNC_ENA) && defined(__GNUC__) && !defined(SIM_HOST)
+  #define RAM_FUNC    __attribute__((section(".RamFunc")))
+  #define RAM_CONST   __attribute__((section(".RamData")))
+#else
+  #define RAM_FUNC
+  #define RAM_CONST
+#endif
+
+#endif // RAMFUNC_H
@@ -0,0 +1,65 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Cooperative multi-rate scheduler for the main loop. The time base is
+  * buzzerTimer, counted by the motor ISR (16 ticks = 1 ms). Tasks run to
+  * completion in the order of the task table (first = highest priority); when
+  * no task is due the CPU sleeps until the next interrupt. Execution times
+  * are taken from the DWT cycle counter and include the interrupts that
+  * preempted the task.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Define to prevent recursive inclusion
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include "stm32f1xx_hal.h"
+#include "config.h"
+
+#define SCHED_TICKS_MS      (PWM_FREQ / 1000)         // buzzerTimer ticks per ms
+#define SCHED_CYCLES_TICK   (64000000 / PWM_FREQ)     // CPU cycles per tick @64MHz
+#define SCHED_LOAD_WINDOW   PWM_FREQ                  // [ticks] CPU load measured over 1 s
+#define SCHED_MEAN_SHIFT    4                         // mean filter: 1/16 of the new sample
+
+// Main loop tasks, in priority order. A task a variant does not need has no function
+enum { TASK_CONTROL, TASK_COMMS, TASK_TEMP, TASK_DEBUG, TASK_LCD, TASK_SAVE, TASK_COUNT };
+
+typedef struct {
+  void     (*run)(void);
+  uint16_t period;                  // [ticks] 0: background task, runs on schedTrigger() when no periodic task is due
+  uint32_t release;                 // [ticks] start of the current period
+  uint8_t  trig;                    // background task requested
+  // Statistics
+  uint32_t runs;                    // [-]
+  uint32_t misses;                  // [-] runs that ended after the next release
+  uint32_t execMax;                 // [cycles]
+  uint32_t execAcc;                 // [cycles << SCHED_MEAN_SHIFT] filtered mean
+  uint16_t lateMax;                 // [ticks] release to start
+  int16_t  slackMin;                // [ticks] end to the next release, < 0: deadline missed
+} SchedTask;
+
+// Task table entry, period in ms, 0: background task
+#define SCHED_TASK(fn, ms)   {(fn), (uint16_t)((ms) * SCHED_TICKS_MS), 0, 0, 0, 0, 0, 0, 0, INT16_MAX}
+
+void    schedInit(SchedTask *tasks);
+uint8_t schedDispatch(void);
+void    schedTrigger(uint8_t id);
+void    schedSelect(void);
+void    schedExport(void);
+
+#endif // SCHED_H
+
@@ -0,0 +1,101 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Triggered scope capture at the full PWM rate (DEBUG_SCOPE in config.h).
+  * Once armed, the motor ISR records the signals of one motor every period into
+  * a RAM ring. On a trigger (error code change, phase or DC current above a
+  * threshold, or a serial command) it records the post-trigger window and stops.
+  * The main loop then drains the capture over the debug serial port, a few
+  * samples per loop, in frames decoded by Tools/telem_decode.cpp.
+  *
+  * Commands ($SET SCP_CMD n): 0 stop, 1 arm single, 2 force trigger, 3 arm normal (re-arm after each drain)
+  * Capture: SCP_PRE samples before the trigger sample, SCOPE_DEPTH - 1 - SCP_PRE after it.
+  * If the trigger comes before the pre-trigger window is full, the capture is shorter.
+  *
+  * Frame (little endian):
+  *   uint16_t start       SCOPE_START_FRAME
+  *   uint8_t  version     SCOPE_VERSION
+  *   uint8_t  nSamples    samples in this frame
+  *   uint16_t capture     capture number
+  *   int16_t  offset      position of the first sample relative to the trigger sample [PWM periods]
+  *   uint16_t length      samples in the whole capture
+  *   uint8_t  trigger     SCOPE_TRIG_ source that fired
+  *   uint8_t  motor       0 = left, 1 = right
+  *   int16_t  data[nSamples][SCP_SIGNALS]
+  *   uint16_t crc         CRC-16/CCITT-FALSE from version to the end of data
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Define to prevent recursive inclusion
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include <stdint.h>
+#include "config.h"
+
+#ifdef DEBUG_SCOPE
+
+#define SCOPE_START_FRAME   0xA55B
+#define SCOPE_VERSION       1
+#define SCOPE_FRAME_SAMPLES 16          // [samples] per frame, one frame per main loop
+#define SCOPE_HEADER_SIZE   12          // [bytes] start to motor
+
+// Trigger sources, SCP_TRIG is a mask of the first two, SCP_CMD 2 always triggers
+#define SCOPE_TRIG_ERR      0x01        // z_errCode changed since arming
+#define SCOPE_TRIG_CUR      0x02        // |i_phaAB|, |i_phaBC| or |i_DCLink| above SCP_THR
+#define SCOPE_TRIG_CMD      0x04        // forced with SCP_CMD 2
+
+// States
+enum { SCOPE_IDLE, SCOPE_ARMED, SCOPE_TRIGGERED, SCOPE_DONE };
+
+// Commands
+enum { SCOPE_CMD_STOP, SCOPE_CMD_SINGLE, SCOPE_CMD_FORCE, SCOPE_CMD_NORMAL };
+
+// Signals per sample. Keep in sync with Tools/telem_decode.cpp
+enum {
+  SCP_I_AB,       // rtU.i_phaAB
+  SCP_I_BC,       // rtU.i_phaBC
+  SCP_I_DC,       // rtU.i_DCLink
+  SCP_HALL,       // rtU.b_hallA | b_hallB << 1 | b_hallC << 2 | rtY.z_errCode << 8
+  SCP_DC_A,       // rtY.DC_phaA
+  SCP_DC_B,       // rtY.DC_phaB
+  SCP_DC_C,       // rtY.DC_phaC
+  SCP_IQ,         // rtY.iq
+  SCP_ID,         // rtY.id
+  SCP_SIGNALS
+};
+
+extern uint8_t  scopeState;
+extern uint8_t  scopeCmd;
+extern uint8_t  scopeTrig;
+extern uint16_t scopeThr;
+extern uint16_t scopePre;
+extern uint8_t  scopeMotor;
+
+void scopeInit(void);
+void scopeCommand(void);
+void scopeSample(void);
+void scopeProcess(void);
+
+// Call once per motor ISR, after the controller steps
+static inline void scopeTick(void) {
+  if (scopeState == SCOPE_ARMED || scopeState == SCOPE_TRIGGERED) {
+    scopeSample();
+  }
+}
+
+#endif // DEBUG_SCOPE
+
+#endif // SCOPE_H
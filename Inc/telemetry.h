@@ -0,0 +1,96 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Binary telemetry stream on the debug serial port (DEBUG_SERIAL_TELEMETRY in config.h).
+  * The motor ISR samples the signals every telemDiv PWM periods into a RAM ring,
+  * the main loop packs the buffered samples into frames and sends them with DMA,
+  * so neither side ever waits for the UART.
+  *
+  * Frame (little endian):
+  *   uint16_t start       TELEM_START_FRAME
+  *   uint8_t  version     TELEM_VERSION
+  *   uint8_t  nSamples    samples in this frame
+  *   uint16_t mask        signals per sample, bit n = signal n of the TLM_ enum, in bit order
+  *   uint16_t div         PWM periods per sample (PWM_FREQ / div = sample rate)
+  *   uint16_t index       sample index of the first sample, gaps mean dropped samples
+  *   int16_t  data[nSamples][popcount(mask)]
+  *   uint16_t crc         CRC-16/CCITT-FALSE from version to the end of data
+  *
+  * Decode on the PC with Tools/telem_decode.cpp
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Define to prevent recursive inclusion
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "config.h"
+
+#ifdef DEBUG_SERIAL_TELEMETRY
+
+#define TELEM_START_FRAME   0xA55A
+#define TELEM_VERSION       1
+#define TELEM_RING_SIZE     64          // [samples] power of 2, 64 ms @ 1 kHz
+#define TELEM_FRAME_SAMPLES 16          // [samples] max samples per frame
+#define TELEM_HEADER_SIZE   10          // [bytes] start to index
+#define TELEM_DIV_MIN       16          // [-] 1 kHz @ 16 kHz PWM
+
+// Signals, the bit number in the mask. Keep in sync with Tools/telem_decode.cpp
+enum {
+  TLM_IQ_L,       // rtY_Left.iq
+  TLM_ID_L,       // rtY_Left.id
+  TLM_N_L,        // rtY_Left.n_mot
+  TLM_ANG_L,      // rtY_Left.a_elecAngle
+  TLM_IQ_R,       // rtY_Right.iq
+  TLM_ID_R,       // rtY_Right.id
+  TLM_N_R,        // rtY_Right.n_mot
+  TLM_ANG_R,      // rtY_Right.a_elecAngle
+  TLM_BAT,        // batVoltage, filtered ADC counts
+  TLM_CUR_L_A,    // curL_phaA, ADC counts
+  TLM_CUR_L_B,    // curL_phaB
+  TLM_CUR_L_DC,   // curL_DC
+  TLM_CUR_R_B,    // curR_phaB
+  TLM_CUR_R_C,    // curR_phaC
+  TLM_CUR_R_DC,   // curR_DC
+  TLM_ERR,        // rtY_Left.z_errCode | rtY_Right.z_errCode << 8
+  TLM_SIGNALS
+};
+
+typedef struct {
+  uint16_t index;                       // sample index
+  int16_t  sig[TLM_SIGNALS];
+} TelemSample;
+
+extern uint8_t  telemEna;
+extern uint16_t telemDiv;
+extern uint16_t telemMask;
+extern uint32_t telemDrops;
+extern uint16_t telemCnt;
+
+void telemInit(void);
+void telemSample(void);
+void telemProcess(void);
+
+// Call once per motor ISR
+static inline void telemTick(void) {
+  if (--telemCnt == 0) {
+    telemSample();
+  }
+}
+
+#endif // DEBUG_SERIAL_TELEMETRY
+
+#endif // TELEMETRY_H
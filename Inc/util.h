@@ -25,34 +25,191 @@
 
 
 // Rx Structures USART
-#if defined(CONTROL_SERIAL_USART2) || defined(CONTROL_SERIAL_USART3)
-  #ifdef CONTROL_IBUS
-    typedef struct{
-      uint8_t  start;
-      uint8_t  type; 
-      uint8_t  channels[IBUS_NUM_CHANNELS*2];
-      uint8_t  checksuml;
-      uint8_t  checksumh;
-    } SerialCommand;
-  #else
-    typedef struct{
-      uint16_t  start;
-      int16_t   steer;
-      int16_t   speed;
-      uint16_t  checksum;
-    } SerialCommand;
+#ifdef CONTROL_IBUS
+  typedef struct{
+    uint8_t  start;
+    uint8_t  type; 
+    uint8_t  channels[IBUS_NUM_CHANNELS*2];
+    uint8_t  checksuml;
+    uint8_t  checksumh;
+  } SerialCommand;
+#else
+  typedef struct{
+    uint16_t  start;
+    int16_t   steer;
+    int16_t   speed;
+    uint16_t  checksum;
+  } SerialCommand;
+#endif
+typedef struct{
+  uint16_t  start;
+  int16_t   pitch;      // Angle
+  int16_t   dPitch;     // Angle derivative
+  int16_t   cmd1;       // RC Channel 1
+  int16_t   cmd2;       // RC Channel 2
+  uint16_t  sensors;    // RC Switches and Optical sideboard sensors
+  uint16_t  checksum;
+} SerialSideboard;
+
+// Protocol v2 command, see SERIAL_PROTOCOL_V2 in config.h
+typedef struct{
+  uint16_t  start;      // SERIAL_START_FRAME_V2
+  uint16_t  seq;        // host sequence number, echoed in the feedback
+  int16_t   steer;
+  int16_t   speed;
+  uint16_t  crc;        // CRC-16/CCITT-FALSE from seq to speed
+} SerialCommandV2;
+
+// Direct mode command, see SERIAL_DIRECT in config.h
+typedef struct{
+  uint16_t  start;      // SERIAL_START_FRAME_DIRECT
+  uint16_t  seq;        // host sequence number, echoed in the feedback
+  int16_t   tgtL;       // left wheel target, r_inpTgt units, positive = forward
+  int16_t   tgtR;       // right wheel target
+  uint16_t  crc;        // CRC-16/CCITT-FALSE from seq to tgtR
+} SerialDirect;
+
+// Tx Structure USART
+typedef struct{
+  uint16_t  start;
+  int16_t   cmd1;
+  int16_t   cmd2;
+  int16_t   speedR_meas;
+  int16_t   speedL_meas;
+  int16_t   batVoltage;
+  int16_t   boardTemp;
+  uint16_t  cmdLed;
+  uint16_t  checksum;
+} SerialFeedback;
+
+// Protocol v2 feedback, sent on a port after a v2 command
+typedef struct{
+  uint16_t  start;      // SERIAL_START_FRAME_V2
+  uint16_t  seq;        // feedback sequence number, a gap means lost feedback frames
+  uint32_t  time;       // [ms] board time when the frame was built
+  uint16_t  cmdSeq;     // seq of the last valid command: latency = arrival of this frame - sending of that command
+  uint16_t  cmdCnt;     // valid command frames received (modulo 2^16): lost commands = commands sent - cmdCnt
+  int16_t   cmd1;
+  int16_t   cmd2;
+  int16_t   speedR_meas;
+  int16_t   speedL_meas;
+  int16_t   batVoltage;
+  int16_t   boardTemp;
+  uint16_t  cmdLed;
+  uint16_t  crc;        // CRC-16/CCITT-FALSE from seq to cmdLed
+} SerialFeedbackV2;
+
+// Poll frame: the host asks for a feedback frame now, see FEEDBACK_PERIOD in config.h
+typedef struct{
+  uint16_t  start;      // SERIAL_START_FRAME_POLL
+  uint16_t  seq;        // free for the host
+  uint16_t  crc;        // CRC-16/CCITT-FALSE of seq
+} SerialPoll;
+
+// Rx frame parser on the USART Rx DMA circular buffer
+#define SERIAL_CHK_XOR16  0               // checksum: XOR of all 16-bit words before it
+#define SERIAL_CHK_IBUS   1               // checksum: 0xFFFF minus the sum of all bytes before it
+#define SERIAL_CHK_CRC16  2               // checksum: CRC-16/CCITT-FALSE of the bytes between the start frame and it
+#ifdef CONTROL_IBUS
+  #define SERIAL_CMD_START  (IBUS_LENGTH | (IBUS_COMMAND << 8))
+  #define SERIAL_CMD_CHK    SERIAL_CHK_IBUS
+#else
+  #define SERIAL_CMD_START  SERIAL_START_FRAME
+  #define SERIAL_CMD_CHK    SERIAL_CHK_XOR16
+#endif
+#define SERIAL_FORMATS    4               // frame formats one parser accepts
+#define SERIAL_FMT_V1     0               // format index of the legacy frames, registered first
+#define SERIAL_FMT_V2     1               // format index of the protocol v2 command
+#define SERIAL_FMT_DIRECT 2               // format index of the direct mode frame, the poll frame comes after it
+
+typedef struct {
+  uint8_t  *out;                          // valid frames are copied here: SerialCommand, SerialCommandV2, SerialDirect or SerialSideboard. NULL for a request (poll) frame
+  uint16_t  start;                        // start frame, little endian
+  uint8_t   len;                          // frame length
+  uint8_t   chk;                          // SERIAL_CHK_ type
+} SerialFormat;
+
+typedef struct {
+  uint8_t  *buf;                          // Rx DMA circular buffer
+  uint16_t  size;                         // Rx buffer length
+  uint16_t  rd;                           // first byte not parsed yet
+  SerialFormat fmt[SERIAL_FORMATS];       // accepted frame formats
+  uint8_t   nFmt;                         // formats in use
+  uint8_t   minLen;                       // shortest frame length
+  uint8_t   last;                         // format of the last valid frame
+  uint32_t  frames;                       // valid data frames received
+  uint32_t  polls;                        // valid request frames received, they leave last, frames and the output alone
+  uint32_t  skipped;                      // bytes skipped to resynchronise
+} SerialParser;
+
+// Serial channel: one per USART in use, the roles come from the config.h defines of the port
+#define SERIAL_ROLE_DEBUG       0x01      // printf output and debug commands (DEBUG_SERIAL_USARTx)
+#define SERIAL_ROLE_CONTROL     0x02      // SerialCommand input          (CONTROL_SERIAL_USARTx)
+#define SERIAL_ROLE_SIDEBOARD   0x04      // SerialSideboard input        (SIDEBOARD_SERIAL_USARTx)
+#define SERIAL_ROLE_FEEDBACK    0x08      // SerialFeedback output        (FEEDBACK_SERIAL_USARTx)
+#define SERIAL_ROLE_INPUT       (SERIAL_ROLE_CONTROL | SERIAL_ROLE_SIDEBOARD)
+#define SERIAL_ROLE_RX          (SERIAL_ROLE_DEBUG | SERIAL_ROLE_INPUT | SERIAL_ROLE_FEEDBACK)   // roles that receive (feedback: poll frames), the Rx DMA runs only for these
+#define SERIAL_NO_INPUT         0xFF      // inIdx of a channel without input role
+
+#if defined(CONTROL_SERIAL_USART2) || defined(CONTROL_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART3)
+  #define SERIAL_INPUT                    // at least one channel feeds an input
+#endif
+
+#if defined(FEEDBACK_SERIAL_USART2) || defined(FEEDBACK_SERIAL_USART3)
+  #define SERIAL_FEEDBACK                 // at least one channel sends the feedback
+  #define FEEDBACK_ISR_DIV_MIN  16        // [-] 1 kHz @ 16 kHz PWM, more than any baud rate can carry
+  #if FEEDBACK_ISR_DIV != 0 && FEEDBACK_ISR_DIV < FEEDBACK_ISR_DIV_MIN
+    #error FEEDBACK_ISR_DIV must be 0 or at least FEEDBACK_ISR_DIV_MIN.
   #endif
 #endif
-#if defined(SIDEBOARD_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART3)
-    typedef struct{
-      uint16_t  start;
-      int16_t   pitch;      // Angle
-      int16_t   dPitch;     // Angle derivative
-      int16_t   cmd1;       // RC Channel 1
-      int16_t   cmd2;       // RC Channel 2
-      uint16_t  sensors;    // RC Switches and Optical sideboard sensors
-      uint16_t  checksum;
-    } SerialSideboard;
+
+#if defined(SERIAL_INPUT) || defined(SERIAL_FEEDBACK)
+  #define SERIAL_PARSER                   // frame parser on the input and feedback (poll frame) channels
+#endif
+
+#if defined(SERIAL_USART2) && defined(SERIAL_USART3)
+  #define SERIAL_CHANNELS       2
+  #define SERIAL_CH_USART2      0
+  #define SERIAL_CH_USART3      1
+#elif defined(SERIAL_USART2)
+  #define SERIAL_CHANNELS       1
+  #define SERIAL_CH_USART2      0
+#elif defined(SERIAL_USART3)
+  #define SERIAL_CHANNELS       1
+  #define SERIAL_CH_USART3      0
+#endif
+
+#ifdef SERIAL_CHANNELS
+typedef struct {
+  UART_HandleTypeDef *huart;              // HAL handle, the pins, DMA channels and IRQs are in the uartHw[] table of setup.c
+  IRQn_Type irq;                          // USART interrupt, pended to send a requested feedback frame
+  uint8_t   usart_idx;                    // 2 or 3
+  uint8_t   roles;                        // SERIAL_ROLE_ mask
+  uint8_t   inIdx;                        // input index of the control or sideboard role: 0 = Primary, 1 = Auxiliary
+  uint8_t   timeoutFlg;                   // Timeout Flag for Rx Serial command: 0 = OK, 1 = Problem detected (line disconnected or wrong Rx data)
+  uint16_t  timeoutCnt;                   // Timeout counter for Rx Serial command
+  uint16_t  rxOld;                        // Rx position already handed to the debug commands
+  uint32_t  rxFrames;                     // parser.frames at the last timeout check
+  uint8_t   leds;                         // sideboard LEDs, sent with the feedback
+  SerialParser parser;                    // command or sideboard frame parser on rxBuf
+  union {
+    SerialCommand   command;
+    SerialCommandV2 commandV2;
+    SerialDirect    direct;
+    SerialSideboard sideboard;
+  } in;                                   // last valid input frame, parser.last tells the command format
+  union {
+    SerialFeedback   v1;
+    SerialFeedbackV2 v2;
+  } feedback;                             // feedback frame being sent by the Tx DMA, only built while the Tx DMA is idle
+  volatile uint8_t txReq;                 // feedback requested (period, motor ISR or poll), sent by the USART interrupt when the Tx DMA is idle
+  uint32_t  rxPolls;                      // parser.polls already answered
+  uint32_t  rxParsed;                     // parser.frames already checked for a direct frame
+  uint16_t  txSeq;                        // protocol v2 feedback sequence number
+  uint8_t   rxBuf[SERIAL_BUFFER_SIZE];    // USART Rx DMA circular buffer
+} SerialChannel;
+
+extern SerialChannel serialCh[SERIAL_CHANNELS];
 #endif
 
 // Input Structure
@@ -73,7 +230,24 @@ void Input_Lim_Init(void);
 void Input_Init(void);
 void UART_DisableRxErrors(UART_HandleTypeDef *huart);
 
+// Controller Parameter Functions (bldc.c)
+// rtP_Left/rtP_Right are staged: edit any fields of both, then call ctrlParamCommit() once for the batch
+void ctrlParamInit(void);
+void ctrlParamCommit(void);
+void ctrlParamProcess(void);
+
+// Direct Mode Functions (bldc.c), see SERIAL_DIRECT in config.h
+#ifdef SERIAL_DIRECT
+void    directSet(uint8_t in, int16_t tgtL, int16_t tgtR);
+void    directEnd(void);
+void    directCheck(uint8_t in, uint8_t sel, uint8_t timeoutFlg);
+uint8_t directIsActive(void);
+#endif
+
 // General Functions
+void beepTone(uint8_t freq, uint16_t ms);
+void beepTick(void);
+void beepWait(void);
 void poweronMelody(void);
 void beepCount(uint8_t cnt, uint8_t freq, uint8_t pattern);
 void beepLong(uint8_t freq);
@@ -92,16 +266,33 @@ void calcInputCmd(InputStruct *in, int16_t out_min, int16_t out_max);
 void readInputRaw(void);
 void handleTimeout(void);
 void readCommand(void);
-void usart2_rx_check(void);
-void usart3_rx_check(void);
 #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
 void usart_process_debug(uint8_t *userCommand, uint32_t len);
 #endif
-#if defined(CONTROL_SERIAL_USART2) || defined(CONTROL_SERIAL_USART3)
-void usart_process_command(SerialCommand *command_in, SerialCommand *command_out, uint8_t usart_idx);
+void serialParserInit(SerialParser *p, uint8_t *buf, uint16_t size);
+void serialParserAdd(SerialParser *p, uint8_t *out, uint8_t len, uint16_t start, uint8_t chk);
+void serialParse(SerialParser *p, uint16_t pos);
+
+// Serial Channel Functions
+#ifdef SERIAL_CHANNELS
+void serialInit(void);
+void serialIRQHandler(SerialChannel *ch);
 #endif
-#if defined(SIDEBOARD_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART3)
-void usart_process_sideboard(SerialSideboard *Sideboard_in, SerialSideboard *Sideboard_out, uint8_t usart_idx);
+#ifdef SERIAL_FEEDBACK
+extern uint16_t fdbkPeriod;
+extern uint16_t fdbkDiv;
+extern uint16_t fdbkCnt;
+void serialFeedbackProcess(const SerialFeedback *fb);
+void serialFeedbackRequest(void);
+void serialFeedbackDiv(void);
+
+// Call once per motor ISR: with FDBK_DIV set, request the feedback every fdbkDiv PWM periods
+static inline void fdbkTick(void) {
+  if (fdbkDiv && --fdbkCnt == 0) {
+    fdbkCnt = fdbkDiv;
+    serialFeedbackRequest();
+  }
+}
 #endif
 
 // Sideboard functions
@@ -127,5 +318,15 @@ typedef struct {
 } MultipleTap;
 void multipleTapDet(int16_t u, uint32_t timeNow, MultipleTap *x);
 
+// Debug Serial Functions
+#if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+void    debugTxKick(void);
+void    debugTxWait(uint16_t len);
+uint8_t debugTxFrame(uint8_t *data, uint16_t len);
+#endif
+
+// Checksum Functions
+uint16_t calcCRC16(const uint8_t *data, uint32_t len, uint16_t crc);
+
 #endif
 
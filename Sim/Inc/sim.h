@@ -0,0 +1,72 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Software-in-the-loop (SIL) harness: runs the motor control code of
+  * Src/bldc.c and the generated BLDC controller on a PC.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Define to prevent recursive inclusion
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include "defines.h"
+#include "BLDC_controller.h"
+
+#define SIM_LEFT            0
+#define SIM_RIGHT           1
+#define SIM_PWM_PERIOD_NS   (1000000000ULL / PWM_FREQ)   // 62500 ns @ 16 kHz
+
+// Control types the controller of this build can run (CTRL_TYP_FIXED: CTRL_TYP_SEL only)
+#ifdef CTRL_TYP_FIXED
+  #define SIM_CTRL_TYP_FIRST  CTRL_TYP_SEL
+  #define SIM_CTRL_TYP_LAST   CTRL_TYP_SEL
+#else
+  #define SIM_CTRL_TYP_FIRST  COM_CTRL
+  #define SIM_CTRL_TYP_LAST   FOC_CTRL
+#endif
+
+// Controller data, same objects util.c defines on the target
+extern RT_MODEL *const rtM_Left;
+extern RT_MODEL *const rtM_Right;
+extern P    rtP_Left;
+extern P    rtP_Right;
+extern DW   rtDW_Left,  rtDW_Right;
+extern ExtU rtU_Left,   rtU_Right;
+extern ExtY rtY_Left,   rtY_Right;
+
+extern uint8_t  ctrlModReq;
+extern uint8_t  enable;
+extern uint8_t  adcOffsetState;
+extern volatile int pwml;
+extern volatile int pwmr;
+extern volatile adc_buf_t adc_buffer;
+
+// Motor ISR from Src/bldc.c
+void DMA1_Channel1_IRQHandler(void);
+
+// sim_hal.c
+void     sim_hal_reset(void);
+void     sim_hal_setHall(uint8_t side, uint8_t hallA, uint8_t hallB, uint8_t hallC);
+uint64_t sim_time_ns(void);
+
+// sim_motor.c
+void     sim_motor_init(uint8_t ctrlTyp, uint8_t ctrlMod);
+void     sim_motor_calibrate(void);
+void     filtLowPass32(int32_t u, uint16_t coef, int32_t *y);
+
+#endif // SIM_H
+
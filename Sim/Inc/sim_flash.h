@@ -0,0 +1,60 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Host flash model behind the HAL_FLASH_* stand-ins used by Src/eeprom.c:
+  * a RAM image of the STM32F103xE flash with 2 kB pages, halfword program
+  * semantics (a halfword is programmed only if erased, or to 0x0000), the
+  * datasheet program and erase times, and power-loss injection at any
+  * program or erase operation.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Define to prevent recursive inclusion
+#ifndef SIM_FLASH_H
+#define SIM_FLASH_H
+
+#include <stdint.h>
+#include <setjmp.h>
+
+#define SIM_FLASH_SIZE      (256 * 1024)                  // STM32F103RC, as STM32F103RCTx_FLASH.ld
+#define SIM_FLASH_PAGES     (SIM_FLASH_SIZE / FLASH_PAGE_SIZE)
+#define SIM_FLASH_PROG_US   52.5                          // halfword program time, datasheet typical (40..70 us)
+#define SIM_FLASH_ERASE_US  20000.0                       // page erase time, datasheet typical (max 40 ms)
+
+// What a power cut leaves of the operation it interrupts
+enum {
+  SIM_CUT_BEFORE,           // the operation did not start
+  SIM_CUT_PARTIAL           // program: a random part of the bits cleared, erase: a random part of the words erased
+};
+
+typedef struct {
+  uint32_t programs;        // halfwords programmed
+  uint32_t erases;          // pages erased
+  uint32_t errors;          // operations refused: flash locked, halfword not erased, bad address
+  double   busyUs;          // flash busy time at the datasheet typical timings
+  uint32_t pageErases[SIM_FLASH_PAGES];
+} SimFlashStats;
+
+extern uint32_t      simFlash[SIM_FLASH_SIZE / 4];        // image of the flash from FLASH_BASE
+extern SimFlashStats simFlashStats;
+extern uint16_t      VirtAddVarTab[];                     // EEPROM virtual addresses, util.c on the target
+
+void     sim_flash_erase_all(void);
+void     sim_flash_power_up(void);
+void     sim_flash_cut(uint32_t op, uint8_t mode, jmp_buf *env);
+uint32_t sim_flash_ops(void);
+
+#endif // SIM_FLASH_H
+
@@ -0,0 +1,86 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Closed-loop plant for the SIL build: two PMSM hub motors in the dq frame
+  * (back-EMF, saliency, mechanical load), their hall sensors, a three-phase
+  * inverter with dead time and a battery with internal resistance feeding
+  * the shared DC link.
+  *
+  * Per PWM period: plant_output() writes the controller inputs
+  * (b_hallA..C, i_phaAB, i_phaBC, i_DCLink) and plant_step() applies the
+  * controller outputs (DC_phaA..C) over one period.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Define to prevent recursive inclusion
+#ifndef SIM_PLANT_H
+#define SIM_PLANT_H
+
+#include <stdint.h>
+#include "BLDC_controller.h"
+
+typedef struct {
+  // Motor (per phase, amplitude invariant dq)
+  double   Rs;              // [Ohm]    phase resistance
+  double   Ld;              // [H]      d-axis inductance
+  double   Lq;              // [H]      q-axis inductance
+  double   lambda;          // [Wb]     permanent magnet flux linkage
+  uint8_t  polePairs;       // [-]
+  double   hallOffset;      // [rad]    electrical angle from rotor d-axis to the hall sector boundary
+  // Mechanics (per wheel)
+  double   J;               // [kg*m^2] wheel + share of vehicle inertia
+  double   b;               // [N*m*s]  viscous friction
+  double   Tc;              // [N*m]    Coulomb friction
+  double   Tload;           // [N*m]    external load torque
+  double   dynoRpm;         // [rpm]    != 0: speed held by a dynamometer, mechanics ignored
+  // Inverter
+  uint16_t pwmRes;          // [-]      timer counts per half period, pwm_res in bldc.c
+  uint16_t pwmMargin;       // [-]      pwm_margin in bldc.c
+  double   pwmPeriod;       // [s]
+  double   deadTime;        // [s]
+  // Battery / DC link
+  double   Voc;             // [V]      open circuit voltage
+  double   Rbat;            // [Ohm]    internal resistance + wiring
+  // Measurement
+  double   curGain;         // [bit/A]  A2BIT_CONV
+  // Integration
+  uint8_t  subSteps;        // [-]      Euler sub-steps per PWM period
+} PlantParam;
+
+typedef struct {
+  double   id, iq;          // [A]      dq currents
+  double   wm;              // [rad/s]  mechanical speed
+  double   thetaE;          // [rad]    electrical angle [0, 2*pi)
+  double   ia, ib, ic;      // [A]      phase currents
+  double   idc;             // [A]      DC link current drawn by this inverter
+  double   Te;              // [N*m]    electromagnetic torque
+  double   vd, vq;          // [V]      applied dq voltages (period average)
+} PlantMotor;
+
+typedef struct {
+  PlantParam par;
+  PlantMotor mot[2];        // SIM_LEFT, SIM_RIGHT
+  double     vbat;          // [V]      DC link voltage after battery sag
+  double     t;             // [s]      simulated time
+} Plant;
+
+void    plant_defaults(PlantParam *par);
+void    plant_init(Plant *pl, const PlantParam *par);
+void    plant_output(const Plant *pl, uint8_t side, uint8_t selPhaABC, ExtU *u);
+void    plant_step(Plant *pl, const ExtY *yLeft, const ExtY *yRight);
+double  plant_rpm(const Plant *pl, uint8_t side);
+
+#endif // SIM_PLANT_H
+
@@ -0,0 +1,19 @@
+/*
+ * Forced include for Src/BLDC_controller.c in the host SIL build.
+ *
+ * The generated code checks limits.h against the Cortex-M3 word sizes and
+ * stops on LP64 hosts because `long` is 64-bit there. The controller never
+ * uses `long` (rtwtypes.h maps int32_T to int), so the ulong/long check is
+ * pinned to the 32-bit target values. All other checks are left untouched.
+ */
+#ifndef SIM_WORD_SIZE_H
+#define SIM_WORD_SIZE_H
+
+#include <limits.h>
+
+#undef  ULONG_MAX
+#define ULONG_MAX 0xFFFFFFFFU
+#undef  LONG_MAX
+#define LONG_MAX  0x7FFFFFFF
+
+#endif // SIM_WORD_SIZE_H
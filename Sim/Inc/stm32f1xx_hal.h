@@ -0,0 +1,194 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Host stand-in for the STM32F1xx HAL used by the software-in-the-loop (SIL)
+  * build. It only provides the registers, constants and functions touched by
+  * the motor control path (Src/bldc.c) and by the EEPROM emulation
+  * (Src/eeprom.c), so that code compiles unmodified on a PC. Peripheral
+  * instances are plain RAM structs defined in Sim/Src/sim_hal.c, the flash is
+  * a RAM image in Sim/Src/sim_flash.c.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Define to prevent recursive inclusion
+#ifndef SIM_STM32F1XX_HAL_H
+#define SIM_STM32F1XX_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define __IO volatile
+
+typedef enum {
+  HAL_OK      = 0x00U,
+  HAL_ERROR   = 0x01U,
+  HAL_BUSY    = 0x02U,
+  HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum {
+  GPIO_PIN_RESET = 0U,
+  GPIO_PIN_SET
+} GPIO_PinState;
+
+// ############################### REGISTERS ###############################
+typedef struct {
+  __IO uint32_t CRL;
+  __IO uint32_t CRH;
+  __IO uint32_t IDR;
+  __IO uint32_t ODR;
+  __IO uint32_t BSRR;
+  __IO uint32_t BRR;
+  __IO uint32_t LCKR;
+} GPIO_TypeDef;
+
+typedef struct {
+  __IO uint32_t CR1;
+  __IO uint32_t CR2;
+  __IO uint32_t SMCR;
+  __IO uint32_t DIER;
+  __IO uint32_t SR;
+  __IO uint32_t EGR;
+  __IO uint32_t CCMR1;
+  __IO uint32_t CCMR2;
+  __IO uint32_t CCER;
+  __IO uint32_t CNT;
+  __IO uint32_t PSC;
+  __IO uint32_t ARR;
+  __IO uint32_t RCR;
+  __IO uint32_t CCR1;
+  __IO uint32_t CCR2;
+  __IO uint32_t CCR3;
+  __IO uint32_t CCR4;
+  __IO uint32_t BDTR;
+  __IO uint32_t DCR;
+  __IO uint32_t DMAR;
+} TIM_TypeDef;
+
+typedef struct {
+  __IO uint32_t ISR;
+  __IO uint32_t IFCR;
+} DMA_TypeDef;
+
+typedef struct {
+  __IO uint32_t CCR;
+  __IO uint32_t CNDTR;
+  __IO uint32_t CPAR;
+  __IO uint32_t CMAR;
+} DMA_Channel_TypeDef;
+
+typedef struct {
+  __IO uint32_t DHCSR;
+  __IO uint32_t DCRSR;
+  __IO uint32_t DCRDR;
+  __IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct {
+  __IO uint32_t CTRL;
+  __IO uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+  DMA_Channel_TypeDef *Instance;
+} DMA_HandleTypeDef;
+
+typedef int32_t IRQn_Type;
+
+typedef struct {
+  void              *Instance;
+  DMA_HandleTypeDef *hdmatx;
+  DMA_HandleTypeDef *hdmarx;
+} UART_HandleTypeDef;
+
+extern GPIO_TypeDef sim_GPIOA, sim_GPIOB, sim_GPIOC;
+extern TIM_TypeDef  sim_TIM1, sim_TIM8;
+extern DMA_TypeDef  sim_DMA1;
+
+#define GPIOA               (&sim_GPIOA)
+#define GPIOB               (&sim_GPIOB)
+#define GPIOC               (&sim_GPIOC)
+#define TIM1                (&sim_TIM1)
+#define TIM8                (&sim_TIM8)
+#define DMA1                (&sim_DMA1)
+
+// The cycle counter follows the host monotonic clock scaled to 64 MHz, see sim_dwt()
+extern CoreDebug_Type sim_CoreDebug;
+DWT_Type *sim_dwt(void);
+
+#define CoreDebug           (&sim_CoreDebug)
+#define DWT                 (sim_dwt())
+
+#define GPIO_PIN_0          ((uint16_t)0x0001)
+#define GPIO_PIN_1          ((uint16_t)0x0002)
+#define GPIO_PIN_2          ((uint16_t)0x0004)
+#define GPIO_PIN_3          ((uint16_t)0x0008)
+#define GPIO_PIN_4          ((uint16_t)0x0010)
+#define GPIO_PIN_5          ((uint16_t)0x0020)
+#define GPIO_PIN_6          ((uint16_t)0x0040)
+#define GPIO_PIN_7          ((uint16_t)0x0080)
+#define GPIO_PIN_8          ((uint16_t)0x0100)
+#define GPIO_PIN_9          ((uint16_t)0x0200)
+#define GPIO_PIN_10         ((uint16_t)0x0400)
+#define GPIO_PIN_11         ((uint16_t)0x0800)
+#define GPIO_PIN_12         ((uint16_t)0x1000)
+#define GPIO_PIN_13         ((uint16_t)0x2000)
+#define GPIO_PIN_14         ((uint16_t)0x4000)
+#define GPIO_PIN_15         ((uint16_t)0x8000)
+
+#define TIM_BDTR_MOE        (0x1U << 15)
+#define DMA_ISR_TCIF1       (0x1U << 1)
+#define DMA_IFCR_CTCIF1     (0x1U << 1)
+#define CoreDebug_DEMCR_TRCENA_Msk  (0x1U << 24)
+#define DWT_CTRL_CYCCNTENA_Msk      (0x1U << 0)
+
+// Flash, STM32F103xE: 2 kB pages. Src/eeprom.c reads the flash through EE_FLASH_ADDR()
+#define FLASH_BASE                  0x08000000U
+#define FLASH_PAGE_SIZE             0x800U
+#define FLASH_TYPEERASE_PAGES       0x00U
+#define FLASH_TYPEERASE_MASSERASE   0x02U
+#define FLASH_TYPEPROGRAM_HALFWORD  0x01U
+#define FLASH_TYPEPROGRAM_WORD      0x02U
+#define FLASH_TYPEPROGRAM_DOUBLEWORD 0x03U
+
+typedef struct {
+  uint32_t TypeErase;
+  uint32_t Banks;
+  uint32_t PageAddress;
+  uint32_t NbPages;
+} FLASH_EraseInitTypeDef;
+
+uintptr_t sim_flash_addr(uint32_t address);
+#define EE_FLASH_ADDR(address)      sim_flash_addr(address)
+
+#define __CLZ               __builtin_clz
+#define __DMB()             __sync_synchronize()
+#define __disable_irq()     ((void)0)   // one thread, nothing to mask
+#define __enable_irq()      ((void)0)
+
+// ############################### HAL FUNCTIONS ###############################
+void          HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+void          HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+uint32_t      HAL_GetTick(void);
+void          HAL_Delay(uint32_t Delay);
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError);
+
+#endif // SIM_STM32F1XX_HAL_H
+
@@ -0,0 +1,281 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * SIL benchmark for BLDC_controller_step().
+  * Steps the controller with a synthetic rotating hall/current stimulus for
+  * every control type (COM, SIN, FOC) and every control mode request
+  * (OPEN, VOLTAGE, SPEED, TORQUE), then times the complete motor ISR.
+  * Reported per case: ns/step, steps/s, an instruction count per step and
+  * the share of the 62.5 us PWM period that two steps would take.
+  *
+  * Host numbers are not target numbers: use them to compare modes and to
+  * catch regressions between builds on the same machine.
+  *
+  * Built with PROFILER=1 it also prints the per-stage ISR profile of the
+  * configured control type/mode (DEBUG_ISR_PROFILER, see profiler.h).
+  *
+  * Usage: sil_bench [steps]
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "sim.h"
+#include "profiler.h"
+
+#define STIM_LEN        320     // stimulus period: 320 PWM periods = 50 Hz electrical @ 16 kHz
+#define STIM_CUR_AMP    100     // phase current amplitude in ADC counts (2 A @ A2BIT_CONV = 50)
+#define STIM_INP_TGT    300     // r_inpTgt, same range as pwml/pwmr [-1000, 1000]
+#define WARMUP_STEPS    20000
+
+typedef struct {
+  uint8_t hallA, hallB, hallC;
+  int16_t iA, iB, iC;
+} Stimulus;
+
+static Stimulus stim[STIM_LEN];
+
+static const char *const ctrlTypName[] = { "COM", "SIN", "FOC" };
+static const char *const ctrlModName[] = { "OPEN", "VLT", "SPD", "TRQ" };
+
+// Hall codes in forward order of rotation, see vec_hallToPos in BLDC_controller_data.c
+static const uint8_t hallSeq[6] = { 2, 3, 1, 5, 4, 6 };
+
+static void stimulus_init(void) {
+  for (int k = 0; k < STIM_LEN; k++) {
+    double  th   = 2.0 * M_PI * k / STIM_LEN;
+    uint8_t hall = hallSeq[(k * 6) / STIM_LEN];
+    stim[k].hallA = (hall >> 2) & 1;
+    stim[k].hallB = (hall >> 1) & 1;
+    stim[k].hallC = hall & 1;
+    stim[k].iA    = (int16_t)lround(STIM_CUR_AMP * sin(th));
+    stim[k].iB    = (int16_t)lround(STIM_CUR_AMP * sin(th - 2.0 * M_PI / 3.0));
+    stim[k].iC    = (int16_t)(-stim[k].iA - stim[k].iB);
+  }
+}
+
+// ============================== Instruction counter ==============================
+static int   perfFd = -1;
+static const char *counterName = "n/a";
+
+static void counter_init(void) {
+  struct perf_event_attr pe;
+  memset(&pe, 0, sizeof(pe));
+  pe.type           = PERF_TYPE_HARDWARE;
+  pe.size           = sizeof(pe);
+  pe.config         = PERF_COUNT_HW_INSTRUCTIONS;
+  pe.disabled       = 1;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv     = 1;
+  perfFd = (int)syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+  if (perfFd >= 0) {
+    counterName = "instr";
+  } else {
+  #if defined(__x86_64__) || defined(__i386__)
+    counterName = "tsc";        // no PMU access (container/VM): fall back to time stamp counter ticks
+  #endif
+  }
+}
+
+static void counter_start(void) {
+  if (perfFd >= 0) {
+    ioctl(perfFd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(perfFd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+static uint64_t counter_read(void) {
+  if (perfFd >= 0) {
+    uint64_t cnt = 0;
+    ioctl(perfFd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(perfFd, &cnt, sizeof(cnt)) != sizeof(cnt)) {
+      cnt = 0;
+    }
+    return cnt;
+  }
+  #if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+  #else
+  return 0;
+  #endif
+}
+
+// ============================== Benchmarks ==============================
+static inline void apply_stimulus(ExtU *u, const Stimulus *s, uint8_t selPhaABC) {
+  u->b_hallA  = s->hallA;
+  u->b_hallB  = s->hallB;
+  u->b_hallC  = s->hallC;
+  u->i_phaAB  = selPhaABC ? s->iB : s->iA;
+  u->i_phaBC  = selPhaABC ? s->iC : s->iB;
+  u->i_DCLink = 10;
+}
+
+typedef struct {
+  double   nsPerStep;
+  double   cntPerStep;
+  uint8_t  errCode;
+} BenchResult;
+
+static BenchResult bench_step(uint8_t ctrlTyp, uint8_t ctrlMod, uint32_t steps) {
+  BenchResult res;
+  uint32_t k = 0;
+
+  sim_motor_init(ctrlTyp, ctrlMod);
+  rtU_Left.b_motEna     = 1;
+  rtU_Left.z_ctrlModReq = ctrlMod;
+  rtU_Left.r_inpTgt     = STIM_INP_TGT;
+
+  for (uint32_t i = 0; i < WARMUP_STEPS; i++) {
+    apply_stimulus(&rtU_Left, &stim[k], 0);
+    if (++k == STIM_LEN) k = 0;
+    BLDC_controller_step(rtM_Left);
+  }
+
+  uint64_t t0 = sim_time_ns();
+  counter_start();
+  uint64_t c0 = (perfFd >= 0) ? 0 : counter_read();
+  for (uint32_t i = 0; i < steps; i++) {
+    apply_stimulus(&rtU_Left, &stim[k], 0);
+    if (++k == STIM_LEN) k = 0;
+    BLDC_controller_step(rtM_Left);
+  }
+  uint64_t c1 = counter_read();
+  uint64_t t1 = sim_time_ns();
+
+  res.nsPerStep  = (double)(t1 - t0) / steps;
+  res.cntPerStep = (double)(c1 - c0) / steps;
+  res.errCode    = rtY_Left.z_errCode;
+  return res;
+}
+
+static BenchResult bench_isr(uint8_t ctrlTyp, uint8_t ctrlMod, uint32_t steps) {
+  BenchResult res;
+  uint32_t k = 0;
+
+  sim_motor_init(ctrlTyp, ctrlMod);
+  enable = 1;
+  pwml   = STIM_INP_TGT;
+  pwmr   = STIM_INP_TGT;
+
+  uint64_t t0 = 0, c0 = 0;
+  for (uint32_t i = 0; i < WARMUP_STEPS + steps; i++) {
+    if (i == WARMUP_STEPS) {
+      t0 = sim_time_ns();
+      counter_start();
+      c0 = (perfFd >= 0) ? 0 : counter_read();
+    }
+    const Stimulus *s = &stim[k];
+    if (++k == STIM_LEN) k = 0;
+    sim_hal_setHall(SIM_LEFT,  s->hallA, s->hallB, s->hallC);
+    sim_hal_setHall(SIM_RIGHT, s->hallA, s->hallB, s->hallC);
+    adc_buffer.rlA = (uint16_t)(2000 - s->iA);
+    adc_buffer.rlB = (uint16_t)(2000 - s->iB);
+    adc_buffer.rrB = (uint16_t)(2000 - s->iB);
+    adc_buffer.rrC = (uint16_t)(2000 - s->iC);
+    DMA1_Channel1_IRQHandler();
+  }
+  uint64_t c1 = counter_read();
+  uint64_t t1 = sim_time_ns();
+
+  enable = 0;
+  res.nsPerStep  = (double)(t1 - t0) / steps;
+  res.cntPerStep = (double)(c1 - c0) / steps;
+  res.errCode    = rtY_Left.z_errCode | rtY_Right.z_errCode;
+  return res;
+}
+
+static void print_row(const char *what, uint8_t ctrlTyp, uint8_t ctrlMod, const BenchResult *r, double loadFactor) {
+  printf("%-5s %-4s %-5s %10.1f %12.0f %12.1f %9.2f %6u\n",
+         what, ctrlTypName[ctrlTyp], ctrlModName[ctrlMod],
+         r->nsPerStep, 1e9 / r->nsPerStep, r->cntPerStep,
+         100.0 * loadFactor * r->nsPerStep / SIM_PWM_PERIOD_NS, r->errCode);
+}
+
+#ifdef DEBUG_ISR_PROFILER
+static void print_profile(void) {
+  static const char *const stageName[PRF_STAGES] = { "OFFS", "CHOP", "BUZ", "LEFT", "RIGHT", "ISR" };
+
+  printf("\nISR profile %s %s, cycles @64MHz\n", ctrlTypName[CTRL_TYP_SEL], ctrlModName[CTRL_MOD_REQ]);
+  printf("%-6s %6s %6s %6s", "stage", "min", "max", "mean");
+  printf(" %8s", "<64");
+  for (int b = 1; b < PRF_HIST_BINS; b++) {
+    printf("   >=%4u", 32u << b);     // histogram bin lower bounds
+  }
+  printf("\n");
+  for (int i = 0; i < PRF_STAGES; i++) {
+    const ProfStage *st = &profStages[i];
+    printf("%-6s %6u %6u %6u", stageName[i], st->min, st->max, (unsigned)(st->meanAcc >> PRF_MEAN_SHIFT));
+    for (int b = 0; b < PRF_HIST_BINS; b++) {
+      printf(" %8u", st->hist[b]);
+    }
+    printf("\n");
+  }
+}
+#endif
+
+int main(int argc, char **argv) {
+  uint32_t steps = 200000;
+  if (argc > 1) {
+    steps = (uint32_t)strtoul(argv[1], NULL, 0);
+    if (steps == 0) {
+      fprintf(stderr, "usage: %s [steps]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  stimulus_init();
+  counter_init();
+  sim_hal_reset();
+  sim_motor_init(CTRL_TYP_SEL, CTRL_MOD_REQ);
+  sim_motor_calibrate();
+
+  printf("BLDC_controller_step SIL benchmark: %u steps per case, PWM period %llu ns\n",
+         steps, (unsigned long long)SIM_PWM_PERIOD_NS);
+  printf("%-5s %-4s %-5s %10s %12s %12s %9s %6s\n",
+         "what", "typ", "mode", "ns/step", "steps/s", counterName, "budget%", "err");
+
+  for (uint8_t typ = SIM_CTRL_TYP_FIRST; typ <= SIM_CTRL_TYP_LAST; typ++) {
+    for (uint8_t mod = OPEN_MODE; mod <= TRQ_MODE; mod++) {
+      BenchResult r = bench_step(typ, mod, steps);
+      print_row("step", typ, mod, &r, 2.0);     // the ISR steps two controllers per period
+    }
+  }
+  for (uint8_t typ = SIM_CTRL_TYP_FIRST; typ <= SIM_CTRL_TYP_LAST; typ++) {
+    for (uint8_t mod = OPEN_MODE; mod <= TRQ_MODE; mod++) {
+      BenchResult r = bench_isr(typ, mod, steps);
+      print_row("isr", typ, mod, &r, 1.0);
+    }
+  }
+
+  #ifdef DEBUG_ISR_PROFILER
+  profInit();
+  bench_isr(CTRL_TYP_SEL, CTRL_MOD_REQ, steps);
+  print_profile();
+  #endif
+
+  if (perfFd >= 0) {
+    close(perfFd);
+  }
+  return 0;
+}
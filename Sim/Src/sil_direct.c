@@ -0,0 +1,91 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Direct mode test (SERIAL_DIRECT): checks which targets the motor ISR hands
+  * to the controllers while direct frames arrive, when they expire, when the
+  * port that sent them times out, when another input is selected and when a
+  * normal command frame follows. Needs a build with SERIAL_DIRECT:
+  *   make -C Sim direct
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include "sim.h"
+#include "util.h"
+
+#ifndef SERIAL_DIRECT
+  #error sil_direct needs SERIAL_DIRECT, build it with "make direct".
+#endif
+
+#define CMD_L       123                 // normal command path targets (pwml/pwmr)
+#define CMD_R       -45
+#define DIR_L       300                 // direct frame targets
+#define DIR_R       -200
+
+static unsigned fails;
+
+// One PWM period, then compare the controller targets
+static void expect(const char *what, int16_t tgtL, int16_t tgtR) {
+  DMA1_Channel1_IRQHandler();
+  if (rtU_Left.r_inpTgt != tgtL || rtU_Right.r_inpTgt != tgtR) {
+    printf("FAIL %-40s targets %d/%d, expected %d/%d\n", what, rtU_Left.r_inpTgt, rtU_Right.r_inpTgt, tgtL, tgtR);
+    fails++;
+  } else {
+    printf("ok   %s\n", what);
+  }
+}
+
+int main(void) {
+  sim_hal_reset();
+  sim_motor_init(CTRL_TYP_SEL, CTRL_MOD_REQ);
+  sim_motor_calibrate();
+  pwml = CMD_L;
+  pwmr = CMD_R;
+
+  expect("normal commands", CMD_L, CMD_R);
+
+  directSet(0, DIR_L, DIR_R);
+  expect("direct frame", DIR_L, DIR_R);
+
+  for (uint32_t i = 1; i < SERIAL_DIRECT_TIMEOUT; i++) {
+    DMA1_Channel1_IRQHandler();
+  }
+  expect("direct targets expired", 0, 0);
+
+  directSet(0, DIR_L, DIR_R);
+  directCheck(0, 0, 0);
+  expect("port selected, no timeout", DIR_L, DIR_R);
+  directCheck(0, 0, 1);
+  expect("port timed out", CMD_L, CMD_R);
+
+  directSet(0, DIR_L, DIR_R);
+  directCheck(1, 1, 0);
+  expect("other port checked", DIR_L, DIR_R);
+  directCheck(0, 1, 0);
+  expect("switch to input 1", CMD_L, CMD_R);
+
+  directSet(1, DIR_L, DIR_R);
+  directCheck(1, 0, 0);
+  expect("switch back from input 1", CMD_L, CMD_R);
+
+  directSet(0, DIR_L, DIR_R);
+  directEnd();
+  expect("command frame", CMD_L, CMD_R);
+  directCheck(0, 0, 1);
+  expect("timeout after the end", CMD_L, CMD_R);
+
+  printf("%s: %u failed checks\n", fails ? "FAIL" : "PASS", fails);
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,448 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * SIL test and benchmark of the EEPROM emulation (Src/eeprom.c) on the host
+  * flash model of Sim/Src/sim_flash.c.
+  *
+  * Power-loss test: a page written by the original ST emulation must be read
+  * and converted. Then a random workload of configuration saves
+  * (EE_WriteRecord) and single writes (EE_WriteVariable) is replayed once per
+  * program or erase operation it issues, with the power cut at that operation.
+  * Every other trial also cuts the power during the recovery boot, if that
+  * writes the flash. After the reboot EE_Init must return either the values
+  * before the interrupted write or all the values after it, and the EEPROM
+  * must take further writes.
+  *
+  * Benchmark: host reads/s and updates/s, entries programmed, flash time at
+  * the datasheet timings (average and longest stall of one update) and page
+  * transfers per 1000 updates, for single writes and for records of 1, 4 and
+  * all variables changed. The endurance column is the number of updates until
+  * a page reaches the 10k erase cycles of the STM32F103 datasheet.
+  *
+  * Usage: sil_eeprom [-n updates] [-c cuts] [-s seed] [-m before|partial] [-b|-t]
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim.h"
+#include "eeprom.h"
+#include "sim_flash.h"
+
+#define WORKLOAD_UPDATES    1500        // default power-loss workload, several page transfers
+#define SINGLE_PERCENT      30          // share of single variable writes in the workload
+#define RECORD_CHANGES_MAX  4           // values changed by a workload record
+#define RESUME_UPDATES      200         // updates replayed after the recovery
+#define BENCH_UPDATES       20000
+#define BENCH_READS         10000000
+#define FLASH_ENDURANCE     10000       // erase cycles per page, STM32F103 datasheet minimum
+#define FAIL_PRINT          10
+
+typedef struct {
+  uint8_t single;                       // 1: EE_WriteVariable(var), 0: EE_WriteRecord
+  uint8_t var;
+} Update;
+
+static Update   *workload;
+static uint16_t (*expect)[NB_OF_VAR];   // values after each update, expect[0]: initial record
+static uint32_t updates = WORKLOAD_UPDATES;
+static uint32_t rngState;
+static uint32_t imageBase[SIM_FLASH_SIZE / 4];
+
+static uint32_t rng(void) {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+// Value different from the current one, so that every update programs the flash
+static uint16_t new_value(uint16_t old) {
+  uint16_t v;
+  do { v = (uint16_t)rng(); } while (v == old);
+  return v;
+}
+
+static void workload_init(void) {
+  workload = calloc(updates + 1, sizeof(*workload));
+  expect   = calloc(updates + 1, sizeof(*expect));
+  if (!workload || !expect) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  for (int i = 0; i < NB_OF_VAR; i++) expect[0][i] = (uint16_t)rng();
+  for (uint32_t u = 1; u <= updates; u++) {
+    memcpy(expect[u], expect[u - 1], sizeof(expect[u]));
+    if (rng() % 100 < SINGLE_PERCENT || NB_OF_VAR == 1) {
+      workload[u].single = 1;
+      workload[u].var    = rng() % NB_OF_VAR;
+      expect[u][workload[u].var] = new_value(expect[u][workload[u].var]);
+    } else {
+      for (uint32_t n = 1 + rng() % RECORD_CHANGES_MAX; n > 0; n--) {
+        uint8_t var = rng() % NB_OF_VAR;
+        expect[u][var] = new_value(expect[u][var]);
+      }
+    }
+  }
+}
+
+// Reset: RAM is lost, Input_Init() runs EE_Init() with the flash unlocked
+static uint16_t boot(void) {
+  uint16_t status;
+
+  sim_flash_power_up();
+  memset(&eeStats, 0, sizeof(eeStats));
+  HAL_FLASH_Unlock();
+  status = EE_Init();
+  HAL_FLASH_Lock();
+  return status;
+}
+
+static uint16_t apply(uint32_t u) {
+  uint16_t status;
+
+  HAL_FLASH_Unlock();
+  if (workload[u].single) {
+    status = EE_WriteVariable(VirtAddVarTab[workload[u].var], expect[u][workload[u].var]);
+  } else {
+    status = EE_WriteRecord(expect[u], NULL);
+  }
+  HAL_FLASH_Lock();
+  return status;
+}
+
+// 1 if every variable reads the values of expect[u]
+static int matches(uint32_t u) {
+  uint16_t val;
+
+  for (int i = 0; i < NB_OF_VAR; i++) {
+    if (EE_ReadVariable(VirtAddVarTab[i], &val) != 0 || val != expect[u][i]) return 0;
+  }
+  return 1;
+}
+
+static void print_state(const char *what, uint32_t u) {
+  uint16_t val;
+
+  printf("  %-8s", what);
+  for (int i = 0; i < NB_OF_VAR; i++) {
+    if (EE_ReadVariable(VirtAddVarTab[i], &val) != 0) printf(" ----");
+    else if (val == expect[u][i]) printf(" %04X", val);
+    else printf(" %04X*", val);
+  }
+  printf("\n");
+}
+
+/* =========================== Power-loss test =========================== */
+
+typedef struct {
+  uint32_t trials;
+  uint32_t old;                         // recovered the values before the interrupted update
+  uint32_t new;                         // recovered the values after it
+  uint32_t recoveryCuts;
+  uint32_t torn;                        // writes without commit discarded by EE_Init
+  uint32_t failed;
+} CutResult;
+
+// Replay the workload from imageBase with the power lost at operation op, returns 0 on success
+static int cut_trial(uint32_t op, uint8_t mode, CutResult *res) {
+  static uint32_t imageCut[SIM_FLASH_SIZE / 4];
+  jmp_buf env;
+  volatile uint32_t u = 0;
+  uint32_t recoveryOps, last;
+  const char *err = NULL;
+
+  memcpy(simFlash, imageBase, sizeof(simFlash));
+  boot();
+  sim_flash_cut(op, mode, &env);
+  if (setjmp(env) == 0) {
+    for (u = 1; u <= updates; u++) apply(u);
+    sim_flash_cut(0, mode, NULL);
+    return 0;                           // op is past the end of the workload
+  }
+  res->trials++;
+
+  // Every other trial loses the power again during the recovery boot
+  if (res->trials & 1) {
+    memcpy(imageCut, simFlash, sizeof(simFlash));
+    boot();
+    recoveryOps = sim_flash_ops();
+    memcpy(simFlash, imageCut, sizeof(simFlash));
+    if (recoveryOps) {
+      sim_flash_power_up();
+      sim_flash_cut(1 + rng() % recoveryOps, mode, &env);
+      if (setjmp(env) == 0) {
+        HAL_FLASH_Unlock();
+        EE_Init();
+        sim_flash_cut(0, mode, NULL);
+      } else {
+        res->recoveryCuts++;
+      }
+    }
+  }
+
+  if (boot() != HAL_OK) {
+    err = "EE_Init failed";
+  } else if (matches(u - 1)) {
+    res->old++;
+  } else if (matches(u)) {
+    res->new++;
+  } else {
+    err = "neither the old nor the new values";
+  }
+  res->torn += eeStats.torn;
+
+  // The application saves again after the reboot, then goes on
+  if (!err) {
+    last = u + RESUME_UPDATES < updates ? u + RESUME_UPDATES : updates;
+    for (uint32_t v = u; v <= last && !err; v++) {
+      if (apply(v) != HAL_OK) err = "write failed after the recovery";
+    }
+    if (!err && !matches(last)) err = "wrong values after the recovery";
+    if (!err && (boot() != HAL_OK || !matches(last))) err = "wrong values after a second reboot";
+    if (err) u = last;
+  }
+
+  if (err) {
+    if (res->failed++ < FAIL_PRINT) {
+      printf("cut at op %u, update %u (%s): %s\n", op, u, workload[u].single ? "single" : "record", err);
+      print_state("flash", u);
+    }
+    return 1;
+  }
+  return 0;
+}
+
+// Page of the original ST emulation, entries without wear and commit entries: read, then converted
+static int legacy_test(void) {
+  uint32_t *page = (uint32_t *)sim_flash_addr(PAGE0_BASE_ADDRESS);
+  uint32_t  pos  = 1;
+  int       ok;
+
+  sim_flash_erase_all();
+  page[0] = 0xFFFF0000 | VALID_PAGE;
+  for (int i = 0; i < NB_OF_VAR; i++) page[pos++] = (uint32_t)VirtAddVarTab[i] << 16 | expect[1][i];
+  for (int i = 0; i < NB_OF_VAR; i++) page[pos++] = (uint32_t)VirtAddVarTab[i] << 16 | expect[0][i];
+  ok = boot() == HAL_OK && matches(0) && eeStats.transfers == 1 && boot() == HAL_OK && matches(0);
+  printf("Page of the original ST emulation: %s\n", ok ? "read and converted" : "FAILED");
+  return !ok;
+}
+
+// Records with values left out (Valid 0): a variable never stored stays unwritten, a stored one keeps
+// its value, also across the page transfers of a long run of records
+static int partial_test(void) {
+  uint16_t cur[NB_OF_VAR], val;
+  uint8_t  valid[NB_OF_VAR];
+  uint8_t  last = NB_OF_VAR - 1;
+  int      ok = 1;
+
+  sim_flash_erase_all();
+  boot();
+  memset(valid, 1, sizeof(valid));
+  valid[last] = 0;
+  for (int i = 0; i < NB_OF_VAR; i++) cur[i] = (uint16_t)rng();
+  HAL_FLASH_Unlock();
+  EE_WriteRecord(cur, valid);
+  valid[0] = 0;
+  for (uint32_t u = 0; u < 4 * EE_ENTRIES && ok; u++) {
+    for (int i = 1; i < last; i++) cur[i] = new_value(cur[i]);
+    ok = EE_WriteRecord(cur, valid) == HAL_OK;
+  }
+  HAL_FLASH_Lock();
+  ok = ok && eeStats.transfers > 0;
+  for (int n = 0; n < 2 && ok; n++) {   // from the RAM index, then after a reboot
+    ok = EE_ReadVariable(VirtAddVarTab[last], &val) != 0;
+    for (int i = 0; i < last && ok; i++) {
+      ok = EE_ReadVariable(VirtAddVarTab[i], &val) == 0 && val == cur[i];
+    }
+    ok = ok && boot() == HAL_OK;
+  }
+  printf("Records with values left out: %s\n", ok ? "kept and unwritten" : "FAILED");
+  return !ok;
+}
+
+static int cut_test(uint32_t cuts, uint8_t mode) {
+  CutResult res = {0};
+  uint32_t  total, step, transfers;
+
+  // Base image: formatted EEPROM holding the initial record
+  sim_flash_erase_all();
+  boot();
+  HAL_FLASH_Unlock();
+  EE_WriteRecord(expect[0], NULL);
+  HAL_FLASH_Lock();
+  memcpy(imageBase, simFlash, sizeof(simFlash));
+
+  // Uninterrupted run: number of flash operations of the workload
+  boot();
+  for (uint32_t u = 1; u <= updates; u++) {
+    if (apply(u) != HAL_OK || !matches(u)) {
+      printf("update %u failed without power loss\n", u);
+      return 1;
+    }
+  }
+  total     = sim_flash_ops();
+  transfers = eeStats.transfers;
+  boot();
+  if (!matches(updates)) {
+    printf("wrong values after reboot without power loss\n");
+    return 1;
+  }
+
+  step = (cuts && cuts < total) ? total / cuts : 1;
+  printf("Power-loss test: %u updates, %u flash operations, %u page transfers, cut mode %s, every %u op\n",
+         updates, total, transfers, mode == SIM_CUT_PARTIAL ? "partial" : "before", step);
+  for (uint32_t op = 1; op <= total; op += step) {
+    cut_trial(op, mode, &res);
+  }
+  printf("%u power cuts (%u during the recovery): %u kept the old values, %u the new ones, "
+         "%u interrupted writes discarded, %u FAILED\n",
+         res.trials, res.recoveryCuts, res.old, res.new, res.torn, res.failed);
+  return res.failed != 0;
+}
+
+/* =========================== Benchmark =========================== */
+
+static volatile uint16_t readSink;
+
+static void bench_reads(void) {
+  uint16_t val;
+  uint64_t t0, ns;
+
+  t0 = sim_time_ns();
+  for (uint32_t i = 0; i < BENCH_READS; i++) {
+    EE_ReadVariable(VirtAddVarTab[i % NB_OF_VAR], &val);
+    readSink = val;
+  }
+  ns = sim_time_ns() - t0;
+  printf("EE_ReadVariable: %.1f M reads/s (host, RAM index)\n", BENCH_READS * 1e3 / ns);
+}
+
+// changes: values changed per record, 0: single EE_WriteVariable
+static void bench_updates(const char *what, uint32_t changes) {
+  uint16_t cur[NB_OF_VAR];
+  uint16_t transfers0, status = HAL_OK;
+  uint32_t programs0, entries;
+  uint64_t t0, ns = 0;
+  double   busy0, busy, maxStall = 0, perK;
+
+  sim_flash_erase_all();
+  boot();
+  for (int i = 0; i < NB_OF_VAR; i++) cur[i] = (uint16_t)rng();
+  HAL_FLASH_Unlock();
+  EE_WriteRecord(cur, NULL);
+  transfers0 = eeStats.transfers;
+  programs0  = simFlashStats.programs;
+  busy0      = simFlashStats.busyUs;
+
+  for (uint32_t u = 0; u < BENCH_UPDATES && status == HAL_OK; u++) {
+    uint8_t var = rng() % NB_OF_VAR;
+    busy = simFlashStats.busyUs;
+    if (changes == 0) {
+      cur[var] = new_value(cur[var]);
+      t0 = sim_time_ns();
+      status = EE_WriteVariable(VirtAddVarTab[var], cur[var]);
+    } else {
+      // consecutive variables from a random one, all distinct
+      for (uint32_t n = 0; n < changes; n++) {
+        cur[(var + n) % NB_OF_VAR] = new_value(cur[(var + n) % NB_OF_VAR]);
+      }
+      t0 = sim_time_ns();
+      status = EE_WriteRecord(cur, NULL);
+    }
+    ns += sim_time_ns() - t0;
+    if (simFlashStats.busyUs - busy > maxStall) maxStall = simFlashStats.busyUs - busy;
+  }
+  HAL_FLASH_Lock();
+  if (status != HAL_OK) {
+    printf("%-16s write error %u\n", what, status);
+    return;
+  }
+
+  entries = (simFlashStats.programs - programs0) / 2;
+  perK    = (uint16_t)(eeStats.transfers - transfers0) * 1000.0 / BENCH_UPDATES;
+  printf("%-16s %10.0f %8.2f %10.3f %10.2f %9.2f %12.0f\n", what,
+         BENCH_UPDATES * 1e9 / ns,
+         (double)entries / BENCH_UPDATES,
+         (simFlashStats.busyUs - busy0) / BENCH_UPDATES / 1000.0,
+         maxStall / 1000.0,
+         perK,
+         perK > 0 ? FLASH_ENDURANCE * 2 * 1000.0 / perK : 0);
+}
+
+static void bench(void) {
+  char what[24];
+
+  printf("EEPROM emulation benchmark: %u variables, %u entries per page, %u updates per case\n",
+         NB_OF_VAR, EE_ENTRIES, BENCH_UPDATES);
+  printf("Flash time at %.1f us per halfword and %.0f ms per page erase (datasheet typical)\n",
+         SIM_FLASH_PROG_US, SIM_FLASH_ERASE_US / 1000.0);
+  bench_reads();
+  printf("%-16s %10s %8s %10s %10s %9s %12s\n",
+         "update", "updates/s", "entries", "flash ms", "stall ms", "xfer/1k", "endurance");
+  bench_updates("single write", 0);
+  bench_updates("record 1 change", 1);
+  bench_updates("record 4 changes", NB_OF_VAR < 4 ? NB_OF_VAR : 4);
+  snprintf(what, sizeof(what), "record all %u", NB_OF_VAR);
+  bench_updates(what, NB_OF_VAR);
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-n updates] [-c cuts] [-s seed] [-m before|partial] [-b|-t]\n"
+                  "  -n  power-loss workload length (default %u)\n"
+                  "  -c  number of power cuts spread over the workload (default: at every flash operation)\n"
+                  "  -m  what a cut leaves of the interrupted operation (default partial)\n"
+                  "  -b  benchmark only, -t power-loss test only\n", prog, WORKLOAD_UPDATES);
+}
+
+int main(int argc, char **argv) {
+  uint32_t cuts = 0, seed = 1;
+  uint8_t  mode = SIM_CUT_PARTIAL;
+  uint8_t  doBench = 1, doTest = 1;
+  int      opt;
+
+  while ((opt = getopt(argc, argv, "n:c:s:m:bth")) != -1) {
+    switch (opt) {
+      case 'n': updates = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'c': cuts    = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 's': seed    = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'm':
+        if      (!strcmp(optarg, "before"))  mode = SIM_CUT_BEFORE;
+        else if (!strcmp(optarg, "partial")) mode = SIM_CUT_PARTIAL;
+        else { usage(argv[0]); return 1; }
+        break;
+      case 'b': doTest  = 0; break;
+      case 't': doBench = 0; break;
+      default:  usage(argv[0]); return 1;
+    }
+  }
+  if (updates == 0 || seed == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  rngState = seed;
+
+  if (doBench) {
+    bench();
+  }
+  if (doTest) {
+    if (doBench) printf("\n");
+    workload_init();
+    return legacy_test() | partial_test() | cut_test(cuts, mode);
+  }
+  return 0;
+}
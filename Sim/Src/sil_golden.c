@@ -0,0 +1,363 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Golden vector record/replay for BLDC_controller_step().
+  *
+  * Record (-w) runs both controllers in closed loop with the plant through a
+  * fixed scenario (enable, VLT/SPD/TRQ/OPEN mode changes, reversal, field
+  * weakening, cruise control, a hall sensor fault) and stores, per PWM period
+  * and motor, the controller inputs, the parameters when they changed, the
+  * outputs and a hash of the controller states.
+  *
+  * Replay (-c) feeds the recorded inputs and parameters to the controller of
+  * this build and compares the outputs. Use it to prove that a modified build
+  * of BLDC_controller.c (e.g. CTRL_TYP_FIXED) behaves like the generated code:
+  *   make -C Sim golden
+  *
+  * Usage: sil_golden -w|-c <file> [options]
+  *   -t COM|SIN|FOC        control type to record               (default CTRL_TYP_SEL)
+  *   -e <lsb>              replay: allowed output error, states are not compared when > 0
+  *   -n <count>            replay: timing repetitions           (default 5)
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim.h"
+#include "sim_plant.h"
+
+#define GV_MAGIC        0x31564742U     // "BGV1"
+#define GV_FLAG_PARAM   0x01            // record carries the parameter set
+
+static const char *const ctrlTypName[] = { "COM", "SIN", "FOC" };
+
+typedef struct {
+  uint32_t magic;
+  uint16_t sizeU, sizeY, sizeP, sizeDW;
+  uint8_t  ctrlTyp;
+  uint8_t  reserved[3];
+  uint32_t steps;
+} GvHeader;
+
+typedef struct {
+  uint8_t  flags;
+  ExtU     u;
+  ExtY     y;
+  uint32_t dwHash;
+} GvStep;
+
+// ============================== Scenario ==============================
+typedef struct {
+  double   t;             // [s] segment start
+  uint8_t  ena;           // motor enable request
+  uint8_t  mode;          // z_ctrlModReq
+  int16_t  tgtL, tgtR;    // r_inpTgt
+  uint8_t  fieldWeak;     // b_fieldWeakEna
+  uint8_t  cruise;        // b_cruiseCtrlEna, n_cruiseMotTgt = 0
+  uint8_t  hallFault;     // left hall sensors stuck at 0
+  uint8_t  alt;           // other i_max and field weakening ranges, as a $SET while running
+} Segment;
+
+static const Segment scenario[] = {
+  //  t     ena  mode       tgtL   tgtR  fw  cruise hall alt
+  { 0.00,   0,   SPD_MODE,     0,     0,  0,  0,     0,   0 },
+  { 0.05,   1,   SPD_MODE,   300,  -200,  0,  0,     0,   0 },
+  { 0.45,   1,   VLT_MODE,   500,   400,  0,  0,     0,   0 },
+  { 0.80,   1,   TRQ_MODE,   200,  -300,  0,  0,     0,   0 },
+  { 1.10,   1,   SPD_MODE,  1000,   900,  1,  0,     0,   0 },
+  { 1.30,   1,   SPD_MODE,  1000,   900,  1,  0,     0,   1 },
+  { 1.50,   1,   OPEN_MODE,    0,     0,  0,  0,     0,   0 },
+  { 1.60,   1,   VLT_MODE,  -400,  -600,  0,  0,     0,   0 },
+  { 1.90,   1,   TRQ_MODE,   100,   100,  0,  1,     0,   1 },
+  { 2.20,   0,   TRQ_MODE,     0,     0,  0,  0,     0,   0 },
+  { 2.30,   1,   SPD_MODE,   200,   200,  0,  0,     0,   0 },
+  { 2.50,   1,   SPD_MODE,   200,   200,  0,  0,     1,   0 },
+  { 2.80,   0,   SPD_MODE,     0,     0,  0,  0,     0,   0 },
+};
+#define SCENARIO_END    3.0             // [s]
+
+static uint32_t dw_hash(const DW *dw) {
+  const uint8_t *b = (const uint8_t *)dw;
+  uint32_t h = 2166136261U;             // FNV-1a
+  for (size_t i = 0; i < sizeof(*dw); i++) {
+    h = (h ^ b[i]) * 16777619U;
+  }
+  return h;
+}
+
+static int write_step(FILE *f, uint8_t side, P *pPrev, const P *p, const ExtU *u, const ExtY *y, const DW *dw, uint8_t first) {
+  GvStep st;
+  memset(&st, 0, sizeof(st));
+  st.flags  = (first || memcmp(pPrev, p, sizeof(P)) != 0) ? GV_FLAG_PARAM : 0;
+  st.u      = *u;
+  st.y      = *y;
+  st.dwHash = dw_hash(dw);
+  if (fwrite(&st.flags, 1, 1, f) != 1) return -1;
+  if (st.flags & GV_FLAG_PARAM) {
+    if (fwrite(p, sizeof(P), 1, f) != 1) return -1;
+    *pPrev = *p;
+  }
+  if (fwrite(&st.u, sizeof(ExtU), 1, f) != 1 || fwrite(&st.y, sizeof(ExtY), 1, f) != 1 ||
+      fwrite(&st.dwHash, sizeof(st.dwHash), 1, f) != 1) {
+    return -1;
+  }
+  (void)side;
+  return 0;
+}
+
+static int record(const char *file, uint8_t ctrlTyp) {
+  FILE *f = fopen(file, "wb");
+  if (f == NULL) {
+    perror(file);
+    return 1;
+  }
+
+  PlantParam par;
+  Plant      pl;
+  plant_defaults(&par);
+  par.pwmMargin = (ctrlTyp == FOC_CTRL) ? 110 : 0;
+  plant_init(&pl, &par);
+  sim_motor_init(ctrlTyp, SPD_MODE);
+  const P pDef = rtP_Left;
+
+  GvHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic   = GV_MAGIC;
+  hdr.sizeU   = sizeof(ExtU);
+  hdr.sizeY   = sizeof(ExtY);
+  hdr.sizeP   = sizeof(P);
+  hdr.sizeDW  = sizeof(DW);
+  hdr.ctrlTyp = ctrlTyp;
+  hdr.steps   = (uint32_t)(SCENARIO_END * PWM_FREQ);
+  fwrite(&hdr, sizeof(hdr), 1, f);
+
+  P pPrev[2];
+  size_t seg = 0;
+  uint8_t errSeen = 0;
+  for (uint32_t k = 0; k < hdr.steps; k++) {
+    double t = (double)k / PWM_FREQ;
+    while (seg + 1 < sizeof(scenario) / sizeof(scenario[0]) && t >= scenario[seg + 1].t) {
+      seg++;
+    }
+    const Segment *s = &scenario[seg];
+
+    rtP_Left.b_fieldWeakEna  = rtP_Right.b_fieldWeakEna  = s->fieldWeak;
+    rtP_Left.b_cruiseCtrlEna = rtP_Right.b_cruiseCtrlEna = s->cruise;
+    rtP_Left.n_cruiseMotTgt  = rtP_Right.n_cruiseMotTgt  = 0;
+    rtP_Left.i_max             = rtP_Right.i_max             = s->alt ? pDef.i_max * 3 / 4 : pDef.i_max;
+    rtP_Left.r_fieldWeakLo     = rtP_Right.r_fieldWeakLo     = s->alt ? pDef.r_fieldWeakLo / 4 : pDef.r_fieldWeakLo;
+    rtP_Left.n_fieldWeakAuthLo = rtP_Right.n_fieldWeakAuthLo = s->alt ? pDef.n_fieldWeakAuthLo / 4 : pDef.n_fieldWeakAuthLo;
+
+    // Same enable logic as the motor ISR: an error on either side stops both motors
+    uint8_t enaFin = s->ena && !rtY_Left.z_errCode && !rtY_Right.z_errCode;
+    errSeen |= rtY_Left.z_errCode | rtY_Right.z_errCode;
+
+    plant_output(&pl, SIM_LEFT,  rtP_Left.z_selPhaCurMeasABC,  &rtU_Left);
+    plant_output(&pl, SIM_RIGHT, rtP_Right.z_selPhaCurMeasABC, &rtU_Right);
+    if (s->hallFault) {
+      rtU_Left.b_hallA = rtU_Left.b_hallB = rtU_Left.b_hallC = 0;
+    }
+    rtU_Left.b_motEna      = rtU_Right.b_motEna     = enaFin;
+    rtU_Left.z_ctrlModReq  = rtU_Right.z_ctrlModReq = s->mode;
+    rtU_Left.r_inpTgt      = s->tgtL;
+    rtU_Right.r_inpTgt     = s->tgtR;
+
+    ExtU uL = rtU_Left, uR = rtU_Right;
+    BLDC_controller_step(rtM_Left);
+    BLDC_controller_step(rtM_Right);
+
+    if (write_step(f, SIM_LEFT,  &pPrev[SIM_LEFT],  &rtP_Left,  &uL, &rtY_Left,  &rtDW_Left,  k == 0) ||
+        write_step(f, SIM_RIGHT, &pPrev[SIM_RIGHT], &rtP_Right, &uR, &rtY_Right, &rtDW_Right, k == 0)) {
+      perror(file);
+      fclose(f);
+      return 1;
+    }
+    plant_step(&pl, &rtY_Left, &rtY_Right);
+  }
+  fclose(f);
+  printf("%s: %u steps x 2 motors recorded, control type %s, hall fault %s\n",
+         file, hdr.steps, ctrlTypName[ctrlTyp], errSeen ? "detected" : "NOT detected");
+  return 0;
+}
+
+// ============================== Replay ==============================
+typedef struct {
+  uint8_t  flags;
+  P        p;
+  ExtU     u;
+  ExtY     y;
+  uint32_t dwHash;
+} GvRecord;
+
+static GvRecord *load(const char *file, GvHeader *hdr) {
+  FILE *f = fopen(file, "rb");
+  if (f == NULL) {
+    perror(file);
+    return NULL;
+  }
+  if (fread(hdr, sizeof(*hdr), 1, f) != 1 || hdr->magic != GV_MAGIC ||
+      hdr->sizeU != sizeof(ExtU) || hdr->sizeY != sizeof(ExtY) || hdr->sizeP != sizeof(P) || hdr->sizeDW != sizeof(DW)) {
+    fprintf(stderr, "%s: not a golden vector file of this controller version\n", file);
+    fclose(f);
+    return NULL;
+  }
+  GvRecord *rec = calloc((size_t)hdr->steps * 2, sizeof(GvRecord));
+  if (rec == NULL) {
+    fclose(f);
+    return NULL;
+  }
+  P pLast[2];
+  for (uint32_t i = 0; i < hdr->steps * 2; i++) {
+    GvRecord *r = &rec[i];
+    int ok = fread(&r->flags, 1, 1, f) == 1;
+    if (ok && (r->flags & GV_FLAG_PARAM)) {
+      ok = fread(&pLast[i & 1], sizeof(P), 1, f) == 1;
+    }
+    r->p = pLast[i & 1];
+    ok = ok && fread(&r->u, sizeof(ExtU), 1, f) == 1 && fread(&r->y, sizeof(ExtY), 1, f) == 1 &&
+         fread(&r->dwHash, sizeof(r->dwHash), 1, f) == 1;
+    if (!ok) {
+      fprintf(stderr, "%s: truncated at record %u\n", file, i);
+      free(rec);
+      fclose(f);
+      return NULL;
+    }
+  }
+  fclose(f);
+  return rec;
+}
+
+#define NUM_OUT 8
+static const char *const outName[NUM_OUT] = { "DC_phaA", "DC_phaB", "DC_phaC", "z_errCode", "n_mot", "a_elecAngle", "iq", "id" };
+
+static void outputs(const ExtY *y, int32_t v[NUM_OUT]) {
+  v[0] = y->DC_phaA;  v[1] = y->DC_phaB;     v[2] = y->DC_phaC; v[3] = y->z_errCode;
+  v[4] = y->n_mot;    v[5] = y->a_elecAngle; v[6] = y->iq;      v[7] = y->id;
+}
+
+static int replay(const char *file, int32_t tol, int reps) {
+  GvHeader hdr;
+  GvRecord *rec = load(file, &hdr);
+  if (rec == NULL) {
+    return 1;
+  }
+
+  RT_MODEL *const rtm[2] = { rtM_Left, rtM_Right };
+  P    *const p[2]  = { &rtP_Left,  &rtP_Right };
+  ExtU *const u[2]  = { &rtU_Left,  &rtU_Right };
+  ExtY *const y[2]  = { &rtY_Left,  &rtY_Right };
+  DW   *const dw[2] = { &rtDW_Left, &rtDW_Right };
+
+  uint32_t mismatch = 0, dwMismatch = 0, first = UINT32_MAX;
+  int32_t  maxErr[NUM_OUT] = { 0 };
+  uint64_t best = UINT64_MAX;
+
+  for (int rep = 0; rep < reps; rep++) {
+    sim_motor_init(hdr.ctrlTyp, SPD_MODE);
+    uint64_t t0 = sim_time_ns();
+    for (uint32_t i = 0; i < hdr.steps * 2; i++) {
+      const GvRecord *r = &rec[i];
+      uint8_t side = i & 1;
+      if (r->flags & GV_FLAG_PARAM) {
+        *p[side] = r->p;
+      }
+      *u[side] = r->u;
+      BLDC_controller_step(rtm[side]);
+
+      if (rep == 0) {
+        int32_t a[NUM_OUT], b[NUM_OUT];
+        uint8_t bad = 0;
+        outputs(y[side], a);
+        outputs(&r->y, b);
+        for (int n = 0; n < NUM_OUT; n++) {
+          int32_t e = abs(a[n] - b[n]);
+          if (e > maxErr[n]) maxErr[n] = e;
+          if (e > tol || (n == 3 && e != 0)) bad = 1;
+        }
+        if (tol == 0 && dw_hash(dw[side]) != r->dwHash) {
+          dwMismatch++;
+          bad = 1;
+        }
+        if (bad) {
+          if (first == UINT32_MAX) {
+            first = i;
+            fprintf(stderr, "first mismatch: step %u %s motor\n", i / 2, side ? "right" : "left");
+            for (int n = 0; n < NUM_OUT; n++) {
+              fprintf(stderr, "  %-12s recorded %6d replayed %6d\n", outName[n], b[n], a[n]);
+            }
+          }
+          mismatch++;
+        }
+      }
+    }
+    uint64_t dt = sim_time_ns() - t0;
+    if (dt < best) best = dt;
+  }
+
+  printf("%s: %u steps x 2 motors, control type %s\n", file, hdr.steps, ctrlTypName[hdr.ctrlTyp]);
+  printf("max |error| per output:");
+  for (int n = 0; n < NUM_OUT; n++) {
+    printf(" %s %d", outName[n], maxErr[n]);
+  }
+  printf("\n");
+  if (tol == 0) {
+    printf("state hash mismatches: %u\n", dwMismatch);
+  }
+  printf("replay: %.1f ns/step (best of %d)\n", (double)best / (hdr.steps * 2), reps);
+  printf("%s: %u of %u steps outside tolerance %d\n", mismatch ? "FAIL" : "PASS", mismatch, hdr.steps * 2, tol);
+
+  free(rec);
+  return mismatch ? 1 : 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s -w|-c <file> [-t COM|SIN|FOC] [-e lsb] [-n reps]\n", prog);
+}
+
+int main(int argc, char **argv) {
+  const char *wfile = NULL, *cfile = NULL;
+  uint8_t ctrlTyp = CTRL_TYP_SEL;
+  int32_t tol = 0;
+  int reps = 5;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "w:c:t:e:n:")) != -1) {
+    switch (opt) {
+      case 'w': wfile = optarg; break;
+      case 'c': cfile = optarg; break;
+      case 't':
+        for (ctrlTyp = 0; ctrlTyp < 3 && strcmp(optarg, ctrlTypName[ctrlTyp]) != 0; ctrlTyp++) { }
+        if (ctrlTyp == 3) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'e': tol  = atoi(optarg); break;
+      case 'n': reps = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if ((wfile == NULL) == (cfile == NULL)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  sim_hal_reset();
+  return wfile ? record(wfile, ctrlTyp) : replay(cfile, tol, reps);
+}
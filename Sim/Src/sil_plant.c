@@ -0,0 +1,401 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Closed-loop SIL runs: both BLDC controllers drive the PMSM/inverter plant
+  * (Sim/Src/sim_plant.c) at the PWM rate. A step is applied to r_inpTgt and
+  * the left motor response is evaluated: rise time, overshoot, settling
+  * time, steady-state value and torque ripple.
+  *
+  * Usage: sil_plant [options]
+  *   -t COM|SIN|FOC        control type                        (default FOC)
+  *   -m OPEN|VLT|SPD|TRQ   control mode request                (default SPD)
+  *   -r <target>           r_inpTgt after the step [-1000,1000] (default 500)
+  *   -s <sec>              time of the step                    (default 0.1)
+  *   -d <sec>              simulated duration                  (default 2.0)
+  *   -p <name>=<value>     controller parameter, e.g. -p cf_iqKp=1500
+  *   -P <name>=<value>     plant parameter, e.g. -P J=0.05
+  *   -o <file.csv>         write a trace of the left motor
+  *   -D <n>                trace decimation in PWM periods     (default 16)
+  *   -a                    summary for all control types and modes, TRQ mode
+  *                         on a dynamometer at DYNO_RPM unless -P dynoRpm is given
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <unistd.h>
+#include "sim.h"
+#include "sim_plant.h"
+
+#define SETTLE_BAND     0.05    // settling band relative to the final value
+#define FINAL_WINDOW    0.2     // last fraction of the run used for final value and ripple
+#define DYNO_RPM        50.0    // speed for torque mode runs in the summary
+#define AVG_LEN         16      // step metrics use a 1 ms moving average, the raw signal carries the PWM ripple
+
+static const char *const ctrlTypName[] = { "COM", "SIN", "FOC" };
+static const char *const ctrlModName[] = { "OPEN", "VLT", "SPD", "TRQ" };
+
+// ============================== Parameter overrides ==============================
+typedef struct {
+  const char *name;
+  size_t      offset;
+  uint8_t     size;
+} CtrlParam;
+
+#define CTRL_PARAM(f)   { #f, offsetof(P, f), sizeof(((P *)0)->f) }
+static const CtrlParam ctrlParams[] = {
+  CTRL_PARAM(cf_iqKp),        CTRL_PARAM(cf_iqKi),        CTRL_PARAM(cf_idKp),
+  CTRL_PARAM(cf_idKi),        CTRL_PARAM(cf_nKp),         CTRL_PARAM(cf_nKi),
+  CTRL_PARAM(cf_currFilt),    CTRL_PARAM(cf_KbLimProt),   CTRL_PARAM(cf_iqKiLimProt),
+  CTRL_PARAM(cf_nKiLimProt),  CTRL_PARAM(i_max),          CTRL_PARAM(n_max),
+  CTRL_PARAM(Vd_max),         CTRL_PARAM(b_fieldWeakEna), CTRL_PARAM(id_fieldWeakMax),
+  CTRL_PARAM(a_phaAdvMax),    CTRL_PARAM(r_fieldWeakHi),  CTRL_PARAM(r_fieldWeakLo),
+  CTRL_PARAM(n_fieldWeakAuthHi), CTRL_PARAM(n_fieldWeakAuthLo), CTRL_PARAM(b_diagEna),
+};
+
+typedef struct {
+  const char *name;
+  size_t      offset;
+} PlantParamDesc;
+
+#define PLANT_PARAM(f)  { #f, offsetof(PlantParam, f) }
+static const PlantParamDesc plantParams[] = {
+  PLANT_PARAM(Rs),   PLANT_PARAM(Ld),    PLANT_PARAM(Lq),       PLANT_PARAM(lambda),
+  PLANT_PARAM(J),    PLANT_PARAM(b),     PLANT_PARAM(Tc),       PLANT_PARAM(Tload),
+  PLANT_PARAM(Voc),  PLANT_PARAM(Rbat),  PLANT_PARAM(deadTime), PLANT_PARAM(hallOffset),
+  PLANT_PARAM(dynoRpm),
+};
+
+#define MAX_OVERRIDES   32
+static char    *ctrlOverride[MAX_OVERRIDES];
+static uint8_t  ctrlOverrideCnt;
+static char    *plantOverride[MAX_OVERRIDES];
+static uint8_t  plantOverrideCnt;
+
+static int split_assign(const char *arg, char *name, size_t len, double *value) {
+  const char *eq = strchr(arg, '=');
+  if (!eq || (size_t)(eq - arg) >= len) {
+    return -1;
+  }
+  memcpy(name, arg, eq - arg);
+  name[eq - arg] = '\0';
+  *value = strtod(eq + 1, NULL);
+  return 0;
+}
+
+static int apply_ctrl_override(P *p, const char *arg) {
+  char   name[32];
+  double value;
+  if (split_assign(arg, name, sizeof(name), &value)) {
+    return -1;
+  }
+  for (size_t i = 0; i < ARRAY_LEN(ctrlParams); i++) {
+    if (strcmp(name, ctrlParams[i].name) == 0) {
+      uint8_t *dst = (uint8_t *)p + ctrlParams[i].offset;
+      int32_t  val = (int32_t)value;
+      switch (ctrlParams[i].size) {
+        case 1: *(uint8_t  *)dst = (uint8_t)val;  break;
+        case 2: *(uint16_t *)dst = (uint16_t)val; break;
+        case 4: *(int32_t  *)dst = val;           break;
+      }
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int apply_plant_override(PlantParam *par, const char *arg) {
+  char   name[32];
+  double value;
+  if (split_assign(arg, name, sizeof(name), &value)) {
+    return -1;
+  }
+  for (size_t i = 0; i < ARRAY_LEN(plantParams); i++) {
+    if (strcmp(name, plantParams[i].name) == 0) {
+      *(double *)((uint8_t *)par + plantParams[i].offset) = value;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// ============================== Closed-loop run ==============================
+typedef struct {
+  uint8_t  ctrlTyp;
+  uint8_t  ctrlMod;
+  double   dynoRpm;
+  int16_t  target;
+  double   tStep;
+  double   duration;
+  FILE    *csv;
+  uint32_t csvDecim;
+} RunCfg;
+
+typedef struct {
+  double   final;           // final value of the evaluated signal
+  double   rise;            // [s] 10% to 90% of final
+  double   overshoot;       // [%]
+  double   settle;          // [s] after the step, NAN if never settled
+  double   teMean;          // [N*m] mean torque over the final window
+  double   ripplePkPk;      // [%] torque peak-to-peak / mean
+  double   rippleRms;       // [%] torque standard deviation / mean
+  double   vbatMin;         // [V]
+  double   realtime;        // simulated time / wall time
+  uint8_t  errCode;
+  const char *unit;
+} RunResult;
+
+static RunResult run(const RunCfg *cfg) {
+  RunResult res;
+  PlantParam par;
+  Plant pl;
+
+  memset(&res, 0, sizeof(res));
+  plant_defaults(&par);
+  par.pwmMargin = (cfg->ctrlTyp == FOC_CTRL) ? 110 : 0;
+  par.dynoRpm   = cfg->dynoRpm;
+  for (uint8_t i = 0; i < plantOverrideCnt; i++) {
+    apply_plant_override(&par, plantOverride[i]);
+  }
+  plant_init(&pl, &par);
+
+  sim_motor_init(cfg->ctrlTyp, cfg->ctrlMod);
+  for (uint8_t i = 0; i < ctrlOverrideCnt; i++) {
+    apply_ctrl_override(&rtP_Left, ctrlOverride[i]);
+    apply_ctrl_override(&rtP_Right, ctrlOverride[i]);
+  }
+
+  uint32_t nSteps = (uint32_t)(cfg->duration * PWM_FREQ);
+  uint32_t kStep  = (uint32_t)(cfg->tStep * PWM_FREQ);
+  uint32_t kFinal = nSteps - (uint32_t)(nSteps * FINAL_WINDOW);
+  double  *raw    = malloc(nSteps * sizeof(double));
+  double  *sig    = raw;
+  double  *te     = malloc(nSteps * sizeof(double));
+
+  // Speed is evaluated in SPD/VLT/OPEN mode, torque in TRQ mode
+  uint8_t evalTorque = (cfg->ctrlMod == TRQ_MODE);
+  res.unit    = evalTorque ? "Nm" : "rpm";
+  res.vbatMin = pl.vbat;
+
+  if (cfg->csv) {
+    fprintf(cfg->csv, "t,r_inpTgt,rpm,n_mot,id,iq,id_ctrl,iq_ctrl,Te,ia,ib,ic,DC_phaA,DC_phaB,DC_phaC,vbat,idc,z_errCode\n");
+  }
+
+  uint64_t t0 = sim_time_ns();
+  for (uint32_t k = 0; k < nSteps; k++) {
+    int16_t tgt = (k >= kStep) ? cfg->target : 0;
+
+    rtU_Left.b_motEna      = 1;
+    rtU_Left.z_ctrlModReq  = cfg->ctrlMod;
+    rtU_Left.r_inpTgt      = tgt;
+    rtU_Right.b_motEna     = 1;
+    rtU_Right.z_ctrlModReq = cfg->ctrlMod;
+    rtU_Right.r_inpTgt     = tgt;
+    plant_output(&pl, SIM_LEFT,  rtP_Left.z_selPhaCurMeasABC,  &rtU_Left);
+    plant_output(&pl, SIM_RIGHT, rtP_Right.z_selPhaCurMeasABC, &rtU_Right);
+
+    BLDC_controller_step(rtM_Left);
+    BLDC_controller_step(rtM_Right);
+
+    plant_step(&pl, &rtY_Left, &rtY_Right);
+
+    const PlantMotor *m = &pl.mot[SIM_LEFT];
+    sig[k] = evalTorque ? m->Te : plant_rpm(&pl, SIM_LEFT);
+    te[k]  = m->Te;
+    res.vbatMin  = MIN(res.vbatMin, pl.vbat);
+    res.errCode |= rtY_Left.z_errCode | rtY_Right.z_errCode;
+
+    if (cfg->csv && (k % cfg->csvDecim) == 0) {
+      fprintf(cfg->csv, "%.6f,%d,%.3f,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%d,%d,%d,%.3f,%.4f,%u\n",
+              pl.t, tgt, plant_rpm(&pl, SIM_LEFT), rtY_Left.n_mot,
+              m->id, m->iq, rtY_Left.id / 16.0 / A2BIT_CONV, rtY_Left.iq / 16.0 / A2BIT_CONV,
+              m->Te, m->ia, m->ib, m->ic, rtY_Left.DC_phaA, rtY_Left.DC_phaB, rtY_Left.DC_phaC,
+              pl.vbat, m->idc, rtY_Left.z_errCode);
+    }
+  }
+  uint64_t t1 = sim_time_ns();
+  res.realtime = cfg->duration / ((t1 - t0) * 1e-9);
+
+  // Final value and torque ripple over the final window
+  double sum = 0, teSum = 0, teMin = INFINITY, teMax = -INFINITY;
+  for (uint32_t k = kFinal; k < nSteps; k++) {
+    sum   += sig[k];
+    teSum += te[k];
+    teMin  = MIN(teMin, te[k]);
+    teMax  = MAX(teMax, te[k]);
+  }
+  uint32_t nFinal = nSteps - kFinal;
+  res.final  = sum / nFinal;
+  res.teMean = teSum / nFinal;
+  double var = 0;
+  for (uint32_t k = kFinal; k < nSteps; k++) {
+    var += (te[k] - res.teMean) * (te[k] - res.teMean);
+  }
+  double teRef   = fabs(res.teMean) > 1e-6 ? fabs(res.teMean) : NAN;
+  res.ripplePkPk = 100.0 * (teMax - teMin) / teRef;
+  res.rippleRms  = 100.0 * sqrt(var / nFinal) / teRef;
+
+  // Step response metrics relative to the value before the step
+  double *avg = te;         // torque samples are no longer needed
+  double  acc = 0;
+  for (uint32_t k = 0; k < nSteps; k++) {
+    acc += sig[k];
+    if (k >= AVG_LEN) {
+      acc -= sig[k - AVG_LEN];
+    }
+    avg[k] = acc / MIN(k + 1, AVG_LEN);
+  }
+  sig = avg;
+  double y0 = sig[kStep > 0 ? kStep - 1 : 0];
+  double dy = res.final - y0;
+  int32_t k10 = -1, k90 = -1;
+  double peak = 0;
+  int32_t kSettle = -1;
+  for (uint32_t k = kStep; k < nSteps; k++) {
+    double frac = (dy != 0) ? (sig[k] - y0) / dy : 0;
+    if (k10 < 0 && frac >= 0.1) k10 = k;
+    if (k90 < 0 && frac >= 0.9) k90 = k;
+    peak = MAX(peak, frac);
+    if (fabs(frac - 1.0) > SETTLE_BAND) {
+      kSettle = -1;
+    } else if (kSettle < 0) {
+      kSettle = k;
+    }
+  }
+  res.rise      = (k10 >= 0 && k90 >= 0) ? (double)(k90 - k10) / PWM_FREQ : NAN;
+  res.overshoot = 100.0 * MAX(peak - 1.0, 0.0);
+  res.settle    = (kSettle >= 0) ? (double)(kSettle - (int32_t)kStep) / PWM_FREQ : NAN;
+
+  free(raw);
+  free(te);
+  return res;
+}
+
+static void print_header(void) {
+  printf("%-4s %-4s %6s %10s %4s %8s %8s %9s %8s %9s %9s %7s %8s %4s\n",
+         "typ", "mode", "target", "final", "unit", "rise_ms", "ovs_%", "settle_ms",
+         "Te_Nm", "ripPP_%", "ripRMS_%", "vbat_V", "x_rt", "err");
+}
+
+static void print_result(const RunCfg *cfg, const RunResult *r) {
+  printf("%-4s %-4s %6d %10.3f %4s %8.1f %8.1f %9.1f %8.3f %9.1f %9.1f %7.2f %8.0f %4u\n",
+         ctrlTypName[cfg->ctrlTyp], ctrlModName[cfg->ctrlMod], cfg->target,
+         r->final, r->unit, r->rise * 1e3, r->overshoot, r->settle * 1e3,
+         r->teMean, r->ripplePkPk, r->rippleRms, r->vbatMin, r->realtime, r->errCode);
+}
+
+static int parse_name(const char *arg, const char *const *names, int cnt) {
+  for (int i = 0; i < cnt; i++) {
+    if (strcmp(arg, names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-t COM|SIN|FOC] [-m OPEN|VLT|SPD|TRQ] [-r target] [-s t_step] [-d duration]\n"
+                  "       [-p ctrl_param=value]... [-P plant_param=value]... [-o trace.csv] [-D decimation] [-a]\n", prog);
+  fprintf(stderr, "controller parameters:");
+  for (size_t i = 0; i < ARRAY_LEN(ctrlParams); i++) fprintf(stderr, " %s", ctrlParams[i].name);
+  fprintf(stderr, "\nplant parameters:");
+  for (size_t i = 0; i < ARRAY_LEN(plantParams); i++) fprintf(stderr, " %s", plantParams[i].name);
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+  RunCfg cfg = { FOC_CTRL, SPD_MODE, 0.0, 500, 0.1, 2.0, NULL, 16 };
+  uint8_t all = 0;
+  uint8_t dynoSet = 0;
+  int opt, idx;
+  P pTest;
+  PlantParam parTest;
+
+  while ((opt = getopt(argc, argv, "t:m:r:s:d:p:P:o:D:ah")) != -1) {
+    switch (opt) {
+      case 't':
+        if ((idx = parse_name(optarg, ctrlTypName, 3)) < 0) { usage(argv[0]); return 1; }
+        cfg.ctrlTyp = (uint8_t)idx;
+        break;
+      case 'm':
+        if ((idx = parse_name(optarg, ctrlModName, 4)) < 0) { usage(argv[0]); return 1; }
+        cfg.ctrlMod = (uint8_t)idx;
+        break;
+      case 'r': cfg.target   = (int16_t)CLAMP(atoi(optarg), -1000, 1000); break;
+      case 's': cfg.tStep    = atof(optarg); break;
+      case 'd': cfg.duration = atof(optarg); break;
+      case 'p':
+        if (ctrlOverrideCnt >= MAX_OVERRIDES || apply_ctrl_override(&pTest, optarg)) {
+          fprintf(stderr, "unknown controller parameter: %s\n", optarg);
+          usage(argv[0]);
+          return 1;
+        }
+        ctrlOverride[ctrlOverrideCnt++] = optarg;
+        break;
+      case 'P':
+        if (plantOverrideCnt >= MAX_OVERRIDES || apply_plant_override(&parTest, optarg)) {
+          fprintf(stderr, "unknown plant parameter: %s\n", optarg);
+          usage(argv[0]);
+          return 1;
+        }
+        plantOverride[plantOverrideCnt++] = optarg;
+        dynoSet |= (strncmp(optarg, "dynoRpm=", 8) == 0);
+        break;
+      case 'o':
+        if ((cfg.csv = fopen(optarg, "w")) == NULL) { perror(optarg); return 1; }
+        break;
+      case 'D': cfg.csvDecim = MAX(1, atoi(optarg)); break;
+      case 'a': all = 1; break;
+      default:  usage(argv[0]); return 1;
+    }
+  }
+  if (cfg.duration <= cfg.tStep || cfg.tStep < 0) {
+    fprintf(stderr, "duration must be longer than the step time\n");
+    return 1;
+  }
+
+  sim_hal_reset();
+  printf("Closed-loop SIL: step to r_inpTgt at %.3f s, %.3f s simulated per run\n", cfg.tStep, cfg.duration);
+  print_header();
+
+  if (all) {
+    FILE *csv = cfg.csv;
+    cfg.csv = NULL;
+    for (uint8_t typ = SIM_CTRL_TYP_FIRST; typ <= SIM_CTRL_TYP_LAST; typ++) {
+      for (uint8_t mod = VLT_MODE; mod <= TRQ_MODE; mod++) {
+        RunCfg c = cfg;
+        c.ctrlTyp = typ;
+        c.ctrlMod = mod;
+        if (mod == TRQ_MODE && !dynoSet) {
+          c.dynoRpm = DYNO_RPM;
+        }
+        RunResult r = run(&c);
+        print_result(&c, &r);
+      }
+    }
+    cfg.csv = csv;
+  } else {
+    RunResult r = run(&cfg);
+    print_result(&cfg, &r);
+  }
+
+  if (cfg.csv) {
+    fclose(cfg.csv);
+  }
+  return 0;
+}
@@ -0,0 +1,169 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Host flash model, see Sim/Inc/sim_flash.h.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f1xx_hal.h"
+#include "eeprom.h"
+#include "sim_flash.h"
+
+// Virtual addresses of the EEPROM emulation, same table util.c defines on the target
+#ifdef VARIANT_TRANSPOTTER
+uint16_t VirtAddVarTab[NB_OF_VAR] = {1337};
+#elif defined(PARAM_EEPROM)
+uint16_t VirtAddVarTab[NB_OF_VAR] = {PARAM_EE_VADDR_LIST};
+#else
+uint16_t VirtAddVarTab[NB_OF_VAR] = {1000};
+#endif
+
+uint32_t      simFlash[SIM_FLASH_SIZE / 4];
+SimFlashStats simFlashStats;
+
+static uint8_t  locked = 1;
+static uint32_t ops;                    // program and erase operations since power up
+static uint32_t cutAt;                  // the power is lost at this operation, 0: never
+static uint8_t  cutMode;
+static jmp_buf *cutEnv;
+static uint32_t rngState = 0x12345678;
+
+static uint32_t rng(void) {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+uintptr_t sim_flash_addr(uint32_t address) {
+  if (address < FLASH_BASE || address >= FLASH_BASE + SIM_FLASH_SIZE) {
+    fprintf(stderr, "sim_flash: access outside the flash at 0x%08X\n", address);
+    abort();
+  }
+  return (uintptr_t)simFlash + (address - FLASH_BASE);
+}
+
+void sim_flash_erase_all(void) {
+  memset(simFlash, 0xFF, sizeof(simFlash));
+  memset(&simFlashStats, 0, sizeof(simFlashStats));
+}
+
+// Reset: the flash is locked again and no cut is pending. The image is kept
+void sim_flash_power_up(void) {
+  locked = 1;
+  ops    = 0;
+  cutAt  = 0;
+}
+
+/*
+ * Lose the power at the op-th program or erase operation from now (1: the
+ * next one): the operation is left as given by mode, then the model jumps to
+ * env as the reset would. The caller sees setjmp() return 1.
+ */
+void sim_flash_cut(uint32_t op, uint8_t mode, jmp_buf *env) {
+  cutAt   = op ? ops + op : 0;
+  cutMode = mode;
+  cutEnv  = env;
+}
+
+uint32_t sim_flash_ops(void) {
+  return ops;
+}
+
+static void powerLoss(void) {
+  cutAt = 0;
+  longjmp(*cutEnv, 1);
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) {
+  locked = 0;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void) {
+  locked = 1;
+  return HAL_OK;
+}
+
+/*
+ * Flash cells only go from 1 to 0 when programmed. The STM32F1 programs a
+ * halfword only if it reads 0xFFFF or if the new value is 0x0000, otherwise
+ * it sets PGERR and leaves the cell unchanged.
+ */
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data) {
+  uint32_t n = TypeProgram == FLASH_TYPEPROGRAM_HALFWORD ? 1 : TypeProgram == FLASH_TYPEPROGRAM_WORD ? 2 : 4;
+  uint16_t *cell;
+  uint16_t hw;
+
+  if (locked || (Address & 1) || Address < FLASH_BASE || Address + 2 * n > FLASH_BASE + SIM_FLASH_SIZE) {
+    simFlashStats.errors++;
+    return HAL_ERROR;
+  }
+  for (uint32_t i = 0; i < n; i++, Address += 2, Data >>= 16) {
+    cell = (uint16_t *)sim_flash_addr(Address);
+    hw   = (uint16_t)Data;
+    ops++;
+    if (ops == cutAt) {
+      if (cutMode == SIM_CUT_PARTIAL && *cell == 0xFFFF) {
+        *cell &= hw | (uint16_t)rng();
+      }
+      powerLoss();
+    }
+    if (*cell != 0xFFFF && hw != 0x0000) {
+      simFlashStats.errors++;
+      return HAL_ERROR;
+    }
+    *cell = hw;
+    simFlashStats.programs++;
+    simFlashStats.busyUs += SIM_FLASH_PROG_US;
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError) {
+  uint32_t page, *word;
+
+  *PageError = 0xFFFFFFFF;
+  if (locked || pEraseInit->TypeErase != FLASH_TYPEERASE_PAGES) {
+    simFlashStats.errors++;
+    return HAL_ERROR;
+  }
+  for (uint32_t i = 0; i < pEraseInit->NbPages; i++) {
+    page = (pEraseInit->PageAddress - FLASH_BASE) / FLASH_PAGE_SIZE + i;
+    if (pEraseInit->PageAddress < FLASH_BASE || page >= SIM_FLASH_PAGES) {
+      *PageError = pEraseInit->PageAddress + i * FLASH_PAGE_SIZE;
+      simFlashStats.errors++;
+      return HAL_ERROR;
+    }
+    word = &simFlash[page * FLASH_PAGE_SIZE / 4];
+    ops++;
+    if (ops == cutAt) {
+      if (cutMode == SIM_CUT_PARTIAL) {
+        for (uint32_t w = 0; w < FLASH_PAGE_SIZE / 4; w++) {
+          if (rng() & 1) word[w] = 0xFFFFFFFF;
+        }
+      }
+      powerLoss();
+    }
+    memset(word, 0xFF, FLASH_PAGE_SIZE);
+    simFlashStats.erases++;
+    simFlashStats.pageErases[page]++;
+    simFlashStats.busyUs += SIM_FLASH_ERASE_US;
+  }
+  return HAL_OK;
+}
@@ -0,0 +1,108 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Host implementation of the HAL stand-in declared in Sim/Inc/stm32f1xx_hal.h.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <time.h>
+#include "stm32f1xx_hal.h"
+#include "sim.h"
+
+GPIO_TypeDef sim_GPIOA, sim_GPIOB, sim_GPIOC;
+TIM_TypeDef  sim_TIM1,  sim_TIM8;
+DMA_TypeDef  sim_DMA1;
+CoreDebug_Type sim_CoreDebug;
+static DWT_Type sim_DWT;
+
+volatile adc_buf_t adc_buffer;
+
+static uint32_t sim_tick;
+
+void sim_hal_reset(void) {
+  memset(&sim_GPIOA, 0, sizeof(sim_GPIOA));
+  memset(&sim_GPIOB, 0, sizeof(sim_GPIOB));
+  memset(&sim_GPIOC, 0, sizeof(sim_GPIOC));
+  memset(&sim_TIM1,  0, sizeof(sim_TIM1));
+  memset(&sim_TIM8,  0, sizeof(sim_TIM8));
+  memset(&sim_DMA1,  0, sizeof(sim_DMA1));
+  memset(&sim_CoreDebug, 0, sizeof(sim_CoreDebug));
+  memset(&sim_DWT,   0, sizeof(sim_DWT));
+  memset((void *)&adc_buffer, 0, sizeof(adc_buffer));
+  sim_tick = 0;
+}
+
+/*
+ * Drive the hall sensor input pins. The sensors are open collector, so the
+ * ISR reads them inverted: a hall value of 1 is a low pin.
+ */
+void sim_hal_setHall(uint8_t side, uint8_t hallA, uint8_t hallB, uint8_t hallC) {
+  if (side == SIM_LEFT) {
+    uint32_t idr = LEFT_HALL_U_PORT->IDR & ~(uint32_t)(LEFT_HALL_U_PIN | LEFT_HALL_V_PIN | LEFT_HALL_W_PIN);
+    if (!hallA) idr |= LEFT_HALL_U_PIN;
+    if (!hallB) idr |= LEFT_HALL_V_PIN;
+    if (!hallC) idr |= LEFT_HALL_W_PIN;
+    LEFT_HALL_U_PORT->IDR = idr;
+  } else {
+    uint32_t idr = RIGHT_HALL_U_PORT->IDR & ~(uint32_t)(RIGHT_HALL_U_PIN | RIGHT_HALL_V_PIN | RIGHT_HALL_W_PIN);
+    if (!hallA) idr |= RIGHT_HALL_U_PIN;
+    if (!hallB) idr |= RIGHT_HALL_V_PIN;
+    if (!hallC) idr |= RIGHT_HALL_W_PIN;
+    RIGHT_HALL_U_PORT->IDR = idr;
+  }
+}
+
+uint64_t sim_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * DWT cycle counter: while enabled, CYCCNT is refreshed on every access from
+ * the monotonic clock at the 64 MHz target core clock. Writes to CYCCNT are
+ * not kept, only differences between two reads are meaningful.
+ */
+DWT_Type *sim_dwt(void) {
+  if ((sim_CoreDebug.DEMCR & CoreDebug_DEMCR_TRCENA_Msk) && (sim_DWT.CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+    sim_DWT.CYCCNT = (uint32_t)(sim_time_ns() * 64 / 1000);
+  }
+  return &sim_DWT;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+  if (PinState != GPIO_PIN_RESET) {
+    GPIOx->ODR |= GPIO_Pin;
+  } else {
+    GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+  }
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+  GPIOx->ODR ^= GPIO_Pin;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+  return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+uint32_t HAL_GetTick(void) {
+  return sim_tick;
+}
+
+void HAL_Delay(uint32_t Delay) {
+  sim_tick += Delay;
+}
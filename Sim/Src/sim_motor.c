@@ -0,0 +1,120 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Controller data and initialization for the SIL build. This is the host
+  * counterpart of the BLDC section in Src/util.c, which cannot be compiled
+  * on its own because it pulls in the whole input and serial stack.
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "sim.h"
+#include "rtwtypes.h"
+
+RT_MODEL rtM_Left_;                     /* Real-time model */
+RT_MODEL rtM_Right_;                    /* Real-time model */
+RT_MODEL *const rtM_Left  = &rtM_Left_;
+RT_MODEL *const rtM_Right = &rtM_Right_;
+
+DW       rtDW_Left;                     /* Observable states */
+ExtU     rtU_Left;                      /* External inputs */
+ExtY     rtY_Left;                      /* External outputs */
+
+P        rtP_Right;                     /* Block parameters (auto storage) */
+DW       rtDW_Right;                    /* Observable states */
+ExtU     rtU_Right;                     /* External inputs */
+ExtY     rtY_Right;                     /* External outputs */
+
+uint8_t  ctrlModReq = CTRL_MOD_REQ;     // Final control mode request
+
+#if defined(FEEDBACK_SERIAL_USART2) || defined(FEEDBACK_SERIAL_USART3)
+uint16_t fdbkDiv = 0;                   // the serial feedback is not simulated, the ISR never requests it
+uint16_t fdbkCnt = 0;
+void serialFeedbackRequest(void) { }
+#endif
+
+static P        rtP_Default;            // rtP_Left as generated, restored on every init
+static uint8_t  rtP_DefaultSaved = 0;
+
+/*
+ * Same parameter setup as BLDC_Init() in Src/util.c, with the control type
+ * and mode selectable at run time. All controller states are cleared so
+ * consecutive runs start from identical conditions.
+ */
+void sim_motor_init(uint8_t ctrlTyp, uint8_t ctrlMod) {
+  if (!rtP_DefaultSaved) {
+    rtP_Default      = rtP_Left;
+    rtP_DefaultSaved = 1;
+  }
+  rtP_Left = rtP_Default;
+
+  rtP_Left.b_angleMeasEna       = 0;
+  rtP_Left.z_selPhaCurMeasABC   = 0;
+  rtP_Left.z_ctrlTypSel         = ctrlTyp;
+  rtP_Left.b_diagEna            = DIAG_ENA;
+  rtP_Left.i_max                = (I_MOT_MAX * A2BIT_CONV) << 4;        // fixdt(1,16,4)
+  rtP_Left.n_max                = N_MOT_MAX << 4;                       // fixdt(1,16,4)
+  rtP_Left.b_fieldWeakEna       = FIELD_WEAK_ENA;
+  rtP_Left.id_fieldWeakMax      = (FIELD_WEAK_MAX * A2BIT_CONV) << 4;   // fixdt(1,16,4)
+  rtP_Left.a_phaAdvMax          = PHASE_ADV_MAX << 4;                   // fixdt(1,16,4)
+  rtP_Left.r_fieldWeakHi        = FIELD_WEAK_HI << 4;                   // fixdt(1,16,4)
+  rtP_Left.r_fieldWeakLo        = FIELD_WEAK_LO << 4;                   // fixdt(1,16,4)
+
+  rtP_Right                     = rtP_Left;
+  rtP_Right.z_selPhaCurMeasABC  = 1;
+
+  memset(&rtDW_Left,  0, sizeof(rtDW_Left));
+  memset(&rtU_Left,   0, sizeof(rtU_Left));
+  memset(&rtY_Left,   0, sizeof(rtY_Left));
+  memset(&rtDW_Right, 0, sizeof(rtDW_Right));
+  memset(&rtU_Right,  0, sizeof(rtU_Right));
+  memset(&rtY_Right,  0, sizeof(rtY_Right));
+
+  rtM_Left->defaultParam        = &rtP_Left;
+  rtM_Left->dwork               = &rtDW_Left;
+  rtM_Left->inputs              = &rtU_Left;
+  rtM_Left->outputs             = &rtY_Left;
+
+  rtM_Right->defaultParam       = &rtP_Right;
+  rtM_Right->dwork              = &rtDW_Right;
+  rtM_Right->inputs             = &rtU_Right;
+  rtM_Right->outputs            = &rtY_Right;
+
+  BLDC_controller_initialize(rtM_Left);
+  BLDC_controller_initialize(rtM_Right);
+
+  ctrlModReq = ctrlMod;
+}
+
+/*
+ * Run the ISR through its ADC offset calibration phase with all current
+ * channels at mid scale, so later calls reach the motor control part.
+ */
+void sim_motor_calibrate(void) {
+  adc_buffer.rlA = adc_buffer.rlB = 2000;
+  adc_buffer.rrB = adc_buffer.rrC = 2000;
+  adc_buffer.dcl = adc_buffer.dcr = 2000;
+  while (adcOffsetState == ADC_OFFSET_CAL) {
+    DMA1_Channel1_IRQHandler();
+  }
+}
+
+/* Copy of filtLowPass32() from Src/util.c, used by the ISR battery filter */
+void filtLowPass32(int32_t u, uint16_t coef, int32_t *y) {
+  int64_t tmp;
+  tmp = ((int64_t)((u << 4) - (*y >> 12)) * coef) >> 4;
+  tmp = CLAMP(tmp, -2147483648LL, 2147483647LL);  // Overflow protection: 2147483647LL = 2^31 - 1
+  *y = (int32_t)tmp + (*y);
+}
@@ -0,0 +1,184 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * PMSM + inverter + battery plant for the SIL build, see Sim/Inc/sim_plant.h
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+#include "sim.h"
+#include "sim_plant.h"
+
+#define TWO_PI          (2.0 * M_PI)
+#define SQRT3           1.7320508075688772
+
+// Hall codes (hallA << 2 | hallB << 1 | hallC) per 60 deg sector, see vec_hallToPos in BLDC_controller_data.c
+static const uint8_t hallSeq[6] = { 2, 3, 1, 5, 4, 6 };
+
+/*
+ * Typical 6.5" hoverboard hub motor on a 10S battery
+ */
+void plant_defaults(PlantParam *par) {
+  par->Rs         = 0.15;
+  par->Ld         = 0.35e-3;
+  par->Lq         = 0.35e-3;
+  par->lambda     = 0.0165;
+  par->polePairs  = 15;
+  par->hallOffset = 11.0 * M_PI / 6.0;    // aligns the hall sectors with the angle estimated by the controller
+  par->J          = 0.02;
+  par->b          = 0.002;
+  par->Tc         = 0.05;
+  par->Tload      = 0.0;
+  par->dynoRpm    = 0.0;
+  par->pwmRes     = 64000000 / 2 / PWM_FREQ;
+  par->pwmMargin  = (CTRL_TYP_SEL == FOC_CTRL) ? 110 : 0;
+  par->pwmPeriod  = 1.0 / PWM_FREQ;
+  par->deadTime   = DEAD_TIME / 64.0e6;
+  par->Voc        = BAT_CALIB_REAL_VOLTAGE / 100.0;
+  par->Rbat       = 0.15;
+  par->curGain    = A2BIT_CONV;
+  par->subSteps   = 16;
+}
+
+void plant_init(Plant *pl, const PlantParam *par) {
+  memset(pl, 0, sizeof(*pl));
+  pl->par  = *par;
+  pl->vbat = par->Voc;
+}
+
+static int16_t cur_to_bits(const PlantParam *par, double i) {
+  double bits = round(i * par->curGain);
+  return (int16_t)CLAMP(bits, -2000.0, 2000.0);  // 12 bit ADC around the 2000 offset
+}
+
+void plant_output(const Plant *pl, uint8_t side, uint8_t selPhaABC, ExtU *u) {
+  const PlantMotor *m = &pl->mot[side];
+  double th = fmod(m->thetaE + pl->par.hallOffset, TWO_PI);
+  if (th < 0) {
+    th += TWO_PI;
+  }
+  int sector = (int)(th * 3.0 / M_PI);
+  if (sector > 5) {
+    sector = 5;
+  }
+  uint8_t hall = hallSeq[sector];
+
+  u->b_hallA  = (hall >> 2) & 1;
+  u->b_hallB  = (hall >> 1) & 1;
+  u->b_hallC  = hall & 1;
+  u->i_phaAB  = cur_to_bits(&pl->par, selPhaABC ? m->ib : m->ia);
+  u->i_phaBC  = cur_to_bits(&pl->par, selPhaABC ? m->ic : m->ib);
+  u->i_DCLink = cur_to_bits(&pl->par, m->idc);
+}
+
+/*
+ * Inverter: duty as applied by bldc.c (CLAMP to the PWM margin) and dead
+ * time as a voltage error against the phase current direction.
+ */
+static double phase_duty(const PlantParam *par, int16_t dc, double i) {
+  double ccr  = CLAMP(dc + par->pwmRes / 2, par->pwmMargin, par->pwmRes - par->pwmMargin);
+  double duty = ccr / par->pwmRes;
+  if (i > 0) {
+    duty -= par->deadTime / par->pwmPeriod;
+  } else if (i < 0) {
+    duty += par->deadTime / par->pwmPeriod;
+  }
+  return CLAMP(duty, 0.0, 1.0);
+}
+
+static void motor_step(const PlantParam *par, PlantMotor *m, const ExtY *y, double vdc) {
+  const double dt = par->pwmPeriod / par->subSteps;
+  double vdSum = 0, vqSum = 0, idcSum = 0, teSum = 0;
+
+  for (int n = 0; n < par->subSteps; n++) {
+    double da = phase_duty(par, y->DC_phaA, m->ia);
+    double db = phase_duty(par, y->DC_phaB, m->ib);
+    double dc = phase_duty(par, y->DC_phaC, m->ic);
+
+    // Phase to neutral voltages, Clarke and Park (amplitude invariant)
+    double vn = (da + db + dc) * vdc / 3.0;
+    double va = da * vdc - vn;
+    double vb = db * vdc - vn;
+    double vc = dc * vdc - vn;
+    double valpha = va;
+    double vbeta  = (vb - vc) / SQRT3;
+    double s = sin(m->thetaE), c = cos(m->thetaE);
+    double vd =  valpha * c + vbeta * s;
+    double vq = -valpha * s + vbeta * c;
+
+    // Electrical dynamics
+    double we  = m->wm * par->polePairs;
+    double did = (vd - par->Rs * m->id + we * par->Lq * m->iq) / par->Ld;
+    double diq = (vq - par->Rs * m->iq - we * par->Ld * m->id - we * par->lambda) / par->Lq;
+    m->id += did * dt;
+    m->iq += diq * dt;
+
+    // Mechanics
+    m->Te = 1.5 * par->polePairs * (par->lambda * m->iq + (par->Ld - par->Lq) * m->id * m->iq);
+    double tFric = par->b * m->wm;
+    if (m->wm > 1e-3) {
+      tFric += par->Tc;
+    } else if (m->wm < -1e-3) {
+      tFric -= par->Tc;
+    } else {
+      tFric += CLAMP(m->Te - par->Tload, -par->Tc, par->Tc);   // static friction holds the wheel
+    }
+    if (par->dynoRpm != 0) {
+      m->wm    = par->dynoRpm * TWO_PI / 60.0;
+    } else {
+      m->wm   += (m->Te - par->Tload - tFric) / par->J * dt;
+    }
+    m->thetaE  = fmod(m->thetaE + m->wm * par->polePairs * dt, TWO_PI);
+    if (m->thetaE < 0) {
+      m->thetaE += TWO_PI;
+    }
+
+    // Back to phase currents
+    s = sin(m->thetaE);
+    c = cos(m->thetaE);
+    double ialpha = m->id * c - m->iq * s;
+    double ibeta  = m->id * s + m->iq * c;
+    m->ia = ialpha;
+    m->ib = -0.5 * ialpha + 0.5 * SQRT3 * ibeta;
+    m->ic = -0.5 * ialpha - 0.5 * SQRT3 * ibeta;
+
+    vdSum  += vd;
+    vqSum  += vq;
+    idcSum += da * m->ia + db * m->ib + dc * m->ic;
+    teSum  += m->Te;
+  }
+
+  m->vd  = vdSum  / par->subSteps;
+  m->vq  = vqSum  / par->subSteps;
+  m->idc = idcSum / par->subSteps;
+  m->Te  = teSum  / par->subSteps;
+}
+
+void plant_step(Plant *pl, const ExtY *yLeft, const ExtY *yRight) {
+  const PlantParam *par = &pl->par;
+
+  motor_step(par, &pl->mot[SIM_LEFT],  yLeft,  pl->vbat);
+  motor_step(par, &pl->mot[SIM_RIGHT], yRight, pl->vbat);
+
+  // Battery sag, regenerative current raises the DC link
+  pl->vbat = par->Voc - par->Rbat * (pl->mot[SIM_LEFT].idc + pl->mot[SIM_RIGHT].idc);
+  pl->vbat = CLAMP(pl->vbat, 0.0, 2.0 * par->Voc);
+  pl->t   += par->pwmPeriod;
+}
+
+double plant_rpm(const Plant *pl, uint8_t side) {
+  return pl->mot[side].wm * 60.0 / TWO_PI;
+}
@@ -18,6 +18,35 @@
  */
 
 #include "BLDC_controller.h"
+#include "ramfunc.h"
+#include "config.h"                   /* CTRL_TYP_FIXED, CTRL_TYP_SEL, CTRL_DIV_FREE */
+#undef OPEN_MODE                       /* the control modes are redefined below as uint8_T */
+#undef VLT_MODE
+#undef SPD_MODE
+#undef TRQ_MODE
+
+/* Control type specialisation (CTRL_TYP_FIXED in config.h): the control type is
+ * the compile-time constant CTRL_TYP_SEL instead of Z_CTRLTYPSEL(rtP), so the
+ * compiler drops the branches of the other control types from the step. */
+#ifdef CTRL_TYP_FIXED
+#define Z_CTRLTYPSEL(rtP)              ((uint8_T)CTRL_TYP_SEL)
+#else
+#define Z_CTRLTYPSEL(rtP)              ((rtP)->z_ctrlTypSel)
+#endif
+
+/* Division-free step (CTRL_DIV_FREE in config.h): the divisions whose divisor
+ * is a parameter use a reciprocal from rtM->recip, recomputed in the step
+ * after the parameter changed ($SET). The quotients are exact. The division
+ * by the hall period ('<S14>/Divide3') stays: its divisor changes every edge */
+#ifdef CTRL_DIV_FREE
+#define DIV_S32(n, d, r)               recip_sdiv((n), recip_get((r), (d)))
+#define PLOOK_U8S16(u, bp0, bpSpace, maxIndex, r) plook_u8s16_evenckr((u), (bp0), recip_get((r), (bpSpace)), (maxIndex))
+#define PLOOK_U8U16(u, bp0, bpSpace, maxIndex, r) plook_u8u16_evenckr((u), (bp0), recip_get((r), (bpSpace)), (maxIndex))
+#else
+#define DIV_S32(n, d, r)               ((n) / (d))
+#define PLOOK_U8S16(u, bp0, bpSpace, maxIndex, r) plook_u8s16_evencka((u), (bp0), (bpSpace), (maxIndex))
+#define PLOOK_U8U16(u, bp0, bpSpace, maxIndex, r) plook_u8u16_evencka((u), (bp0), (bpSpace), (maxIndex))
+#endif
 
 /* Named constants for Chart: '<S5>/F03_02_Control_Mode_Manager' */
 #define IN_ACTIVE                      ((uint8_T)1U)
@@ -98,6 +127,18 @@ uint8_T plook_u8s16_evencka(int16_T u, int16_T bp0, uint16_T bpSpace, uint32_T
 uint8_T plook_u8u16_evencka(uint16_T u, uint16_T bp0, uint16_T bpSpace, uint32_T
   maxIndex);
 int32_T div_nde_s32_floor(int32_T numerator, int32_T denominator);
+
+#ifdef CTRL_DIV_FREE
+
+static void recip_init(Recip *r, int32_T d);
+static inline const Recip *recip_get(Recip *r, int32_T d);
+static inline int32_T recip_sdiv(int32_T n, const Recip *r);
+static uint8_T plook_u8s16_evenckr(int16_T u, int16_T bp0, const Recip *bpSpace,
+  uint32_T maxIndex);
+static uint8_T plook_u8u16_evenckr(uint16_T u, uint16_T bp0, const Recip
+  *bpSpace, uint32_T maxIndex);
+
+#endif
 extern void Counter_Init(DW_Counter *localDW, int16_T rtp_z_cntInit);
 extern int16_T Counter(int16_T rtu_inc, int16_T rtu_max, boolean_T rtu_rst,
   DW_Counter *localDW);
@@ -134,7 +175,7 @@ extern void PI_clamp_fixdt_g_Reset(DW_PI_clamp_fixdt_g *localDW);
 extern void PI_clamp_fixdt_k(int16_T rtu_err, uint16_T rtu_P, uint16_T rtu_I,
   int16_T rtu_init, int16_T rtu_satMax, int16_T rtu_satMin, int32_T
   rtu_ext_limProt, int16_T *rty_out, DW_PI_clamp_fixdt_g *localDW);
-uint8_T plook_u8s16_evencka(int16_T u, int16_T bp0, uint16_T bpSpace, uint32_T
+RAM_FUNC uint8_T plook_u8s16_evencka(int16_T u, int16_T bp0, uint16_T bpSpace, uint32_T
   maxIndex)
 {
   uint8_T bpIndex;
@@ -161,7 +202,7 @@ uint8_T plook_u8s16_evencka(int16_T u, int16_T bp0, uint16_T bpSpace, uint32_T
   return bpIndex;
 }
 
-uint8_T plook_u8u16_evencka(uint16_T u, uint16_T bp0, uint16_T bpSpace, uint32_T
+RAM_FUNC uint8_T plook_u8u16_evencka(uint16_T u, uint16_T bp0, uint16_T bpSpace, uint32_T
   maxIndex)
 {
   uint8_T bpIndex;
@@ -188,12 +229,108 @@ uint8_T plook_u8u16_evencka(uint16_T u, uint16_T bp0, uint16_T bpSpace, uint32_T
   return bpIndex;
 }
 
-int32_T div_nde_s32_floor(int32_T numerator, int32_T denominator)
+RAM_FUNC int32_T div_nde_s32_floor(int32_T numerator, int32_T denominator)
 {
   return (((numerator < 0) != (denominator < 0)) && (numerator % denominator !=
            0) ? -1 : 0) + numerator / denominator;
 }
 
+#ifdef CTRL_DIV_FREE
+
+/* Reciprocal for the truncating division by d (Granlund/Montgomery, round-up
+ * multiplier with the add indicator): exact for every 32-bit numerator.
+ * d = 0 gives quotient 0 like the Cortex-M3 divide instruction. */
+RAM_FUNC static void recip_init(Recip *r, int32_T d)
+{
+  uint32_T a;
+  uint32_T r0;
+  uint32_T rem;
+  uint8_T l;
+
+  a = (d < 0) ? 0U - (uint32_T)d : (uint32_T)d;
+  l = 0U;
+  while ((l < 32U) && (((uint64_T)1 << l) < a)) {
+    l++;
+  }
+
+  r->d = d;
+  r->neg = (d < 0);
+  r->sh1 = (uint8_T)((l > 0U) ? 1U : 0U);
+  r->sh2 = (uint8_T)((l > 0U) ? l - 1U : 0U);
+  if (a == 0U) {
+    r->m = 0U;
+  } else if (a <= 0x10000U) {
+    /* m = 2^32 * (2^l - a) / a + 1 in two 32-bit divisions, all divisors of the step are 16-bit */
+    r0 = ((uint32_T)1 << l) - a;
+    rem = (r0 << 16) % a;
+    r->m = (((r0 << 16) / a) << 16) + (rem << 16) / a + 1U;
+  } else {
+    r->m = (uint32_T)(((((uint64_T)1 << l) - a) << 32) / a + 1U);
+  }
+}
+
+static inline const Recip *recip_get(Recip *r, int32_T d)
+{
+  if (r->d != d) {
+    recip_init(r, d);
+  }
+
+  return r;
+}
+
+static inline int32_T recip_sdiv(int32_T n, const Recip *r)
+{
+  uint32_T a;
+  uint32_T t;
+  uint32_T q;
+
+  a = (n < 0) ? 0U - (uint32_T)n : (uint32_T)n;
+  t = (uint32_T)(((uint64_T)a * r->m) >> 32);
+  q = (r->m != 0U) ? (t + ((a - t) >> r->sh1)) >> r->sh2 : 0U;
+  return ((n < 0) != r->neg) ? (int32_T)(0U - q) : (int32_T)q;
+}
+
+/* plook_u8s16_evencka / plook_u8u16_evencka with the reciprocal of bpSpace */
+RAM_FUNC static uint8_T plook_u8s16_evenckr(int16_T u, int16_T bp0, const Recip
+  *bpSpace, uint32_T maxIndex)
+{
+  uint8_T bpIndex;
+  uint16_T fbpIndex;
+  if (u <= bp0) {
+    bpIndex = 0U;
+  } else {
+    fbpIndex = (uint16_T)recip_sdiv((uint16_T)(u - bp0), bpSpace);
+    if (fbpIndex < maxIndex) {
+      bpIndex = (uint8_T)fbpIndex;
+    } else {
+      bpIndex = (uint8_T)maxIndex;
+    }
+  }
+
+  return bpIndex;
+}
+
+RAM_FUNC static uint8_T plook_u8u16_evenckr(uint16_T u, uint16_T bp0, const
+  Recip *bpSpace, uint32_T maxIndex)
+{
+  uint8_T bpIndex;
+  uint16_T fbpIndex;
+  if (u <= bp0) {
+    bpIndex = 0U;
+  } else {
+    fbpIndex = (uint16_T)recip_sdiv((uint16_T)((uint32_T)u - bp0), bpSpace);
+    if (fbpIndex < maxIndex) {
+      bpIndex = (uint8_T)fbpIndex;
+    } else {
+      bpIndex = (uint8_T)maxIndex;
+    }
+  }
+
+  return bpIndex;
+}
+
+#endif                                 /* CTRL_DIV_FREE */
+
 /* System initialize for atomic system: '<S13>/Counter' */
 void Counter_Init(DW_Counter *localDW, int16_T rtp_z_cntInit)
 {
@@ -202,7 +339,7 @@ void Counter_Init(DW_Counter *localDW, int16_T rtp_z_cntInit)
 }
 
 /* Output and update for atomic system: '<S13>/Counter' */
-int16_T Counter(int16_T rtu_inc, int16_T rtu_max, boolean_T rtu_rst, DW_Counter *
+RAM_FUNC int16_T Counter(int16_T rtu_inc, int16_T rtu_max, boolean_T rtu_rst, DW_Counter *
                 localDW)
 {
   int16_T rtu_rst_0;
@@ -245,7 +382,7 @@ void Low_Pass_Filter_Reset(DW_Low_Pass_Filter *localDW)
 }
 
 /* Output and update for atomic system: '<S50>/Low_Pass_Filter' */
-void Low_Pass_Filter(const int16_T rtu_u[2], uint16_T rtu_coef, int16_T rty_y[2],
+RAM_FUNC void Low_Pass_Filter(const int16_T rtu_u[2], uint16_T rtu_coef, int16_T rty_y[2],
                      DW_Low_Pass_Filter *localDW)
 {
   int32_T rtb_Sum3_g;
@@ -317,7 +454,7 @@ void Counter_b_Init(DW_Counter_b *localDW, uint16_T rtp_z_cntInit)
  *    '<S25>/Counter'
  *    '<S24>/Counter'
  */
-void Counter_n(uint16_T rtu_inc, uint16_T rtu_max, boolean_T rtu_rst, uint16_T
+RAM_FUNC void Counter_n(uint16_T rtu_inc, uint16_T rtu_max, boolean_T rtu_rst, uint16_T
                *rty_cnt, DW_Counter_b *localDW)
 {
   uint16_T rtu_rst_0;
@@ -354,7 +491,7 @@ void Counter_n(uint16_T rtu_inc, uint16_T rtu_max, boolean_T rtu_rst, uint16_T
  *    '<S21>/either_edge'
  *    '<S20>/either_edge'
  */
-void either_edge(boolean_T rtu_u, boolean_T *rty_y, DW_either_edge *localDW)
+RAM_FUNC void either_edge(boolean_T rtu_u, boolean_T *rty_y, DW_either_edge *localDW)
 {
   /* RelationalOperator: '<S26>/Relational Operator' incorporates:
    *  UnitDelay: '<S26>/UnitDelay'
@@ -388,7 +525,7 @@ void Debounce_Filter_Init(DW_Debounce_Filter *localDW)
 }
 
 /* Output and update for atomic system: '<S20>/Debounce_Filter' */
-void Debounce_Filter(boolean_T rtu_u, uint16_T rtu_tAcv, uint16_T rtu_tDeacv,
+RAM_FUNC void Debounce_Filter(boolean_T rtu_u, uint16_T rtu_tAcv, uint16_T rtu_tDeacv,
                      boolean_T *rty_y, DW_Debounce_Filter *localDW)
 {
   uint16_T rtb_Sum1_n;
@@ -493,7 +630,7 @@ void I_backCalc_fixdt_Reset(DW_I_backCalc_fixdt *localDW, int32_T rtp_yInit)
  *    '<S83>/I_backCalc_fixdt1'
  *    '<S82>/I_backCalc_fixdt'
  */
-void I_backCalc_fixdt(int16_T rtu_err, uint16_T rtu_I, uint16_T rtu_Kb, int16_T
+RAM_FUNC void I_backCalc_fixdt(int16_T rtu_err, uint16_T rtu_I, uint16_T rtu_Kb, int16_T
                       rtu_satMax, int16_T rtu_satMin, int16_T *rty_out,
                       DW_I_backCalc_fixdt *localDW)
 {
@@ -570,7 +707,7 @@ void PI_clamp_fixdt_Reset(DW_PI_clamp_fixdt *localDW)
 }
 
 /* Output and update for atomic system: '<S63>/PI_clamp_fixdt' */
-void PI_clamp_fixdt(int16_T rtu_err, uint16_T rtu_P, uint16_T rtu_I, int32_T
+RAM_FUNC void PI_clamp_fixdt(int16_T rtu_err, uint16_T rtu_P, uint16_T rtu_I, int32_T
                     rtu_init, int16_T rtu_satMax, int16_T rtu_satMin, int32_T
                     rtu_ext_limProt, int16_T *rty_out, DW_PI_clamp_fixdt
                     *localDW)
@@ -719,7 +856,7 @@ void PI_clamp_fixdt_b_Reset(DW_PI_clamp_fixdt_m *localDW)
 }
 
 /* Output and update for atomic system: '<S61>/PI_clamp_fixdt' */
-void PI_clamp_fixdt_l(int16_T rtu_err, uint16_T rtu_P, uint16_T rtu_I, int16_T
+RAM_FUNC void PI_clamp_fixdt_l(int16_T rtu_err, uint16_T rtu_P, uint16_T rtu_I, int16_T
                       rtu_init, int16_T rtu_satMax, int16_T rtu_satMin, int32_T
                       rtu_ext_limProt, int16_T *rty_out, DW_PI_clamp_fixdt_m
                       *localDW)
@@ -868,7 +1005,7 @@ void PI_clamp_fixdt_g_Reset(DW_PI_clamp_fixdt_g *localDW)
 }
 
 /* Output and update for atomic system: '<S62>/PI_clamp_fixdt' */
-void PI_clamp_fixdt_k(int16_T rtu_err, uint16_T rtu_P, uint16_T rtu_I, int16_T
+RAM_FUNC void PI_clamp_fixdt_k(int16_T rtu_err, uint16_T rtu_P, uint16_T rtu_I, int16_T
                       rtu_init, int16_T rtu_satMax, int16_T rtu_satMin, int32_T
                       rtu_ext_limProt, int16_T *rty_out, DW_PI_clamp_fixdt_g
                       *localDW)
@@ -999,7 +1136,7 @@ void PI_clamp_fixdt_k(int16_T rtu_err, uint16_T rtu_P, uint16_T rtu_I, int16_T
 }
 
 /* Model step function */
-void BLDC_controller_step(RT_MODEL *const rtM)
+RAM_FUNC void BLDC_controller_step(RT_MODEL *const rtM)
 {
   P *rtP = ((P *) rtM->defaultParam);
   DW *rtDW = ((DW *) rtM->dwork);
@@ -1399,7 +1536,7 @@ void BLDC_controller_step(RT_MODEL *const rtM)
    */
   rtb_Sum2_h = rtDW->If1_ActiveSubsystem;
   UnitDelay3 = -1;
-  if (rtP->z_ctrlTypSel == 2) {
+  if (Z_CTRLTYPSEL(rtP) == 2) {
     UnitDelay3 = 0;
   }
 
@@ -1879,7 +2016,7 @@ void BLDC_controller_step(RT_MODEL *const rtM)
      *  Inport: '<S34>/r_inpTgt'
      *  Saturate: '<S33>/Saturation'
      */
-    if (rtP->z_ctrlTypSel == 2) {
+    if (Z_CTRLTYPSEL(rtP) == 2) {
       /* Outputs for IfAction SubSystem: '<S33>/FOC_Control_Type' incorporates:
        *  ActionPort: '<S36>/Action Port'
        */
@@ -2124,9 +2261,9 @@ void BLDC_controller_step(RT_MODEL *const rtM)
        *  Sum: '<S42>/Sum1'
        *  Sum: '<S42>/Sum3'
        */
-      rtb_Divide14_e = (uint16_T)(((int16_T)(DataTypeConversion2 -
-        rtP->r_fieldWeakLo) << 15) / (int16_T)(rtP->r_fieldWeakHi -
-        rtP->r_fieldWeakLo));
+      rtb_Divide14_e = (uint16_T)DIV_S32((int16_T)(DataTypeConversion2 -
+        rtP->r_fieldWeakLo) << 15, (int16_T)(rtP->r_fieldWeakHi -
+        rtP->r_fieldWeakLo), &rtM->recip.fieldWeakRange);
 
       /* Switch: '<S43>/Switch2' incorporates:
        *  Constant: '<S42>/n_fieldWeakAuthHi'
@@ -2154,9 +2291,9 @@ void BLDC_controller_step(RT_MODEL *const rtM)
        *  Sum: '<S42>/Sum2'
        *  Sum: '<S42>/Sum4'
        */
-      rtb_Divide1_f = (uint16_T)(((int16_T)(rtb_Saturation -
-        rtP->n_fieldWeakAuthLo) << 15) / (int16_T)(rtP->n_fieldWeakAuthHi -
-        rtP->n_fieldWeakAuthLo));
+      rtb_Divide1_f = (uint16_T)DIV_S32((int16_T)(rtb_Saturation -
+        rtP->n_fieldWeakAuthLo) << 15, (int16_T)(rtP->n_fieldWeakAuthHi -
+        rtP->n_fieldWeakAuthLo), &rtM->recip.fieldWeakAuth);
 
       /* Switch: '<S42>/Switch1' incorporates:
        *  MinMax: '<S42>/MinMax1'
@@ -2185,7 +2322,7 @@ void BLDC_controller_step(RT_MODEL *const rtM)
        *  Constant: '<S42>/id_fieldWeakMax'
        *  RelationalOperator: '<S42>/Relational Operator1'
        */
-      if (rtP->z_ctrlTypSel == 2) {
+      if (Z_CTRLTYPSEL(rtP) == 2) {
         rtb_Saturation1 = rtP->id_fieldWeakMax;
       } else {
         rtb_Saturation1 = rtP->a_phaAdvMax;
@@ -2210,7 +2347,7 @@ void BLDC_controller_step(RT_MODEL *const rtM)
      */
     rtb_Sum2_h = rtDW->If1_ActiveSubsystem_o;
     UnitDelay3 = -1;
-    if (rtP->z_ctrlTypSel == 2) {
+    if (Z_CTRLTYPSEL(rtP) == 2) {
       UnitDelay3 = 0;
     }
 
@@ -2242,9 +2379,9 @@ void BLDC_controller_step(RT_MODEL *const rtM)
         rtb_Saturation1 = rtDW->Switch1;
       }
 
-      rtDW->Vq_max_M1 = rtP->Vq_max_M1[plook_u8s16_evencka(rtb_Saturation1,
+      rtDW->Vq_max_M1 = rtP->Vq_max_M1[PLOOK_U8S16(rtb_Saturation1,
         rtP->Vq_max_XA[0], (uint16_T)(rtP->Vq_max_XA[1] - rtP->Vq_max_XA[0]),
-        45U)];
+        45U, &rtM->recip.vqMaxSpace)];
 
       /* End of Interpolation_n-D: '<S80>/Vq_max_M1' */
 
@@ -2258,7 +2395,7 @@ void BLDC_controller_step(RT_MODEL *const rtM)
        */
       rtb_Gain3 = rtDW->Divide3 << 16;
       rtb_Gain3 = (rtb_Gain3 == MIN_int32_T) && (rtDW->i_max == -1) ?
-        MAX_int32_T : rtb_Gain3 / rtDW->i_max;
+        MAX_int32_T : DIV_S32(rtb_Gain3, rtDW->i_max, &rtM->recip.iMax);
       if (rtb_Gain3 < 0) {
         rtb_Gain3 = 0;
       } else {
@@ -2273,8 +2410,8 @@ void BLDC_controller_step(RT_MODEL *const rtM)
        *  Product: '<S80>/Divide4'
        */
       rtDW->Divide1_n = (int16_T)
-        ((rtConstP.iq_maxSca_M1_Table[plook_u8u16_evencka((uint16_T)rtb_Gain3,
-           0U, 1311U, 49U)] * rtDW->i_max) >> 16);
+        ((rtConstP.iq_maxSca_M1_Table[PLOOK_U8U16((uint16_T)rtb_Gain3, 0U,
+           1311U, 49U, &rtM->recip.iqMaxScaSpace)] * rtDW->i_max) >> 16);
 
       /* Gain: '<S80>/Gain1' */
       rtDW->Gain1 = (int16_T)-rtDW->Divide1_n;
@@ -2432,7 +2569,7 @@ void BLDC_controller_step(RT_MODEL *const rtM)
        */
       rtb_Sum2_h = rtDW->If1_ActiveSubsystem_j;
       UnitDelay3 = -1;
-      if (rtP->z_ctrlTypSel == 2) {
+      if (Z_CTRLTYPSEL(rtP) == 2) {
         UnitDelay3 = 0;
       }
 
@@ -2809,7 +2946,7 @@ void BLDC_controller_step(RT_MODEL *const rtM)
    */
   rtb_Sum2_h = rtDW->If2_ActiveSubsystem;
   UnitDelay3 = -1;
-  if (rtP->z_ctrlTypSel == 2) {
+  if (Z_CTRLTYPSEL(rtP) == 2) {
     rtb_Saturation = rtDW->Merge;
     UnitDelay3 = 0;
   } else {
@@ -3007,7 +3144,7 @@ void BLDC_controller_step(RT_MODEL *const rtM)
    * About '<S94>/z_commutMap_M1':
    *  2-dimensional Direct Look-Up returning a Column
    */
-  if (rtb_LogicalOperator && (rtP->z_ctrlTypSel == 2)) {
+  if (rtb_LogicalOperator && (Z_CTRLTYPSEL(rtP) == 2)) {
     /* Outputs for IfAction SubSystem: '<S8>/FOC_Method' incorporates:
      *  ActionPort: '<S95>/Action Port'
      */
@@ -3016,7 +3153,7 @@ void BLDC_controller_step(RT_MODEL *const rtM)
     rtb_Merge1 = rtDW->Gain4_e[2];
 
     /* End of Outputs for SubSystem: '<S8>/FOC_Method' */
-  } else if (rtb_LogicalOperator && (rtP->z_ctrlTypSel == 1)) {
+  } else if (rtb_LogicalOperator && (Z_CTRLTYPSEL(rtP) == 1)) {
     /* Outputs for IfAction SubSystem: '<S8>/SIN_Method' incorporates:
      *  ActionPort: '<S96>/Action Port'
      */
@@ -18,9 +18,10 @@
  */
 
 #include "BLDC_controller.h"
+#include "ramfunc.h"
 
 /* Constant parameters (auto storage) */
-const ConstP rtConstP = {
+const ConstP rtConstP RAM_CONST = {
   /* Computed Parameter: r_sin_M1_Table
    * Referenced by: '<S52>/r_sin_M1'
    */
@@ -27,6 +27,10 @@
 #include "setup.h"
 #include "config.h"
 #include "util.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include "scope.h"
+#include "ramfunc.h"
 
 // Matlab includes and defines - from auto-code generation
 // ###############################################################################
@@ -44,6 +48,7 @@ extern P    rtP_Left;
 extern DW   rtDW_Right;                 /* Observable states */
 extern ExtU rtU_Right;                  /* External inputs */
 extern ExtY rtY_Right;                  /* External outputs */
+extern P    rtP_Right;
 // ###############################################################################
 
 static int16_t pwm_margin;              /* This margin allows to have a window in the PWM signal for proper FOC Phase currents measurement */
@@ -56,27 +61,88 @@ int16_t curR_phaB = 0, curR_phaC = 0, curR_DC = 0;
 volatile int pwml = 0;
 volatile int pwmr = 0;
 
+#ifdef SERIAL_DIRECT
+static int16_t  directTgtL   = 0;       // direct mode targets, written by the USART interrupt with the motor ISR masked
+static int16_t  directTgtR   = 0;
+static uint16_t directCnt    = 0;       // [PWM periods] left before the targets expire
+static uint8_t  directActive = 0;       // the targets come from direct frames instead of pwml/pwmr
+static uint8_t  directIn     = 0;       // input index (inIdx) of the port that sent the direct frames
+#endif
+
 extern volatile adc_buf_t adc_buffer;
 
-uint8_t buzzerFreq          = 0;
-uint8_t buzzerPattern       = 0;
-uint8_t buzzerCount         = 0;
+volatile uint8_t  buzzerTone  = 0;      // [PWM periods] half period of the buzzer tone, 0: silent. Set by beepTick()
 volatile uint32_t buzzerTimer = 0;
-static uint8_t  buzzerPrev  = 0;
-static uint8_t  buzzerIdx   = 0;
+static uint8_t  buzzerDiv   = 0;
+static uint8_t  buzzerLevel = 0;
+static uint16_t batFiltCnt  = 1;        // countdown to the next battery filter sample
 
 uint8_t        enable       = 0;        // initially motors are disabled for SAFETY
 static uint8_t enableFin    = 0;
 
+uint32_t        isrOverrunCnt       = 0;  // number of control periods lost to an overrun
+uint16_t        isrOverrunStreakMax = 0;  // longest run of consecutive overrun periods
+static uint16_t isrOverrunStreak    = 0;
+static uint32_t isrLastStart        = 0;  // [cycles] DWT time of the previous period, 0 while the DWT is off
+uint8_t         isrErrCode          = 0;  // latched ISR diagnostics, see ISR_ERR_ flags in defines.h
+
+// Controller parameters: rtP_Left/rtP_Right are the staged set, the controllers run on a copy in one of two banks
+static P                 ctrlParamBank[2][2];     // [bank][0 = left, 1 = right]
+static uint8_t           ctrlParamAct  = 0;       // bank in use by the controllers, changed by the ISR only
+static volatile uint8_t  ctrlParamSwap = 0;       // the other bank holds a new set, switch at the next period
+static volatile uint16_t ctrlParamSeq  = 0;       // staged set version, counted up by every commit
+static uint16_t          ctrlParamPub  = 0;       // staged set version last copied to a bank
+uint32_t                 ctrlParamSwaps = 0;      // [-] parameter sets applied
+
 static const uint16_t pwm_res  = 64000000 / 2 / PWM_FREQ; // = 2000
 
 static uint16_t offsetcount = 0;
-static int16_t offsetrlA    = 2000;
-static int16_t offsetrlB    = 2000;
-static int16_t offsetrrB    = 2000;
-static int16_t offsetrrC    = 2000;
-static int16_t offsetdcl    = 2000;
-static int16_t offsetdcr    = 2000;
+static uint32_t offsetAcc[6];           // sums of rlA, rlB, rrB, rrC, dcl, dcr
+int16_t         offsetrlA   = 0;        // 0: not loaded from the EEPROM
+int16_t         offsetrlB   = 0;
+int16_t         offsetrrB   = 0;
+int16_t         offsetrrC   = 0;
+int16_t         offsetdcl   = 0;
+int16_t         offsetdcr   = 0;
+uint8_t         adcOffsetState = ADC_OFFSET_CAL;
+
+#ifdef ADC_OFFSET_STORE
+// Stored offset agrees with the mean of the first ADC_OFFSET_CHECK samples
+static inline uint8_t offsetCheck(int16_t offset, uint32_t acc) {
+  return offset != 0 && ABS((int16_t)(acc / ADC_OFFSET_CHECK) - offset) <= ADC_OFFSET_TOL;
+}
+#endif
+
+// ADC offsets = mean of the first ADC_OFFSET_SAMPLES samples. With ADC_OFFSET_STORE the offsets
+// loaded from the EEPROM are kept if the first ADC_OFFSET_CHECK samples agree with all of them
+static inline void offsetCalib(void) {
+  offsetAcc[0] += adc_buffer.rlA;
+  offsetAcc[1] += adc_buffer.rlB;
+  offsetAcc[2] += adc_buffer.rrB;
+  offsetAcc[3] += adc_buffer.rrC;
+  offsetAcc[4] += adc_buffer.dcl;
+  offsetAcc[5] += adc_buffer.dcr;
+  offsetcount++;
+
+  #ifdef ADC_OFFSET_STORE
+  if (offsetcount == ADC_OFFSET_CHECK &&
+      offsetCheck(offsetrlA, offsetAcc[0]) && offsetCheck(offsetrlB, offsetAcc[1]) && offsetCheck(offsetrrB, offsetAcc[2]) &&
+      offsetCheck(offsetrrC, offsetAcc[3]) && offsetCheck(offsetdcl, offsetAcc[4]) && offsetCheck(offsetdcr, offsetAcc[5])) {
+    adcOffsetState = ADC_OFFSET_STORED;
+    return;
+  }
+  #endif
+
+  if (offsetcount == ADC_OFFSET_SAMPLES) {
+    offsetrlA = (int16_t)(offsetAcc[0] / ADC_OFFSET_SAMPLES);
+    offsetrlB = (int16_t)(offsetAcc[1] / ADC_OFFSET_SAMPLES);
+    offsetrrB = (int16_t)(offsetAcc[2] / ADC_OFFSET_SAMPLES);
+    offsetrrC = (int16_t)(offsetAcc[3] / ADC_OFFSET_SAMPLES);
+    offsetdcl = (int16_t)(offsetAcc[4] / ADC_OFFSET_SAMPLES);
+    offsetdcr = (int16_t)(offsetAcc[5] / ADC_OFFSET_SAMPLES);
+    adcOffsetState = ADC_OFFSET_MEASURED;
+  }
+}
 
 int16_t        batVoltage       = (400 * BAT_CELLS * BAT_CALIB_ADC) / BAT_CALIB_REAL_VOLTAGE;
 static int32_t batVoltageFixdt  = (400 * BAT_CELLS * BAT_CALIB_ADC) / BAT_CALIB_REAL_VOLTAGE << 16;  // Fixed-point filter output initialized at 400 V*100/cell = 4 V/cell converted to fixed-point
@@ -84,24 +150,33 @@ static int32_t batVoltageFixdt  = (400 * BAT_CELLS * BAT_CALIB_ADC) / BAT_CALIB_
 // =================================
 // DMA interrupt frequency =~ 16 kHz
 // =================================
-void DMA1_Channel1_IRQHandler(void) {
+RAM_FUNC void DMA1_Channel1_IRQHandler(void) {
 
+  PROF_BEGIN();
   DMA1->IFCR = DMA_IFCR_CTCIF1;
+
+  /* Count the periods skipped since the last run: the DMA flag holds only one pending conversion,
+   * so an overrun costs a period only when the next start is more than one period late */
+  uint32_t isrStart = DWT->CYCCNT;
+  if (isrLastStart && isrStart) {
+    uint32_t periods = (isrStart - isrLastStart + ISR_PERIOD_CYCLES / 2) / ISR_PERIOD_CYCLES;
+    if (periods > 1) {
+      isrOverrunCnt += periods - 1;
+    }
+  }
+  isrLastStart = isrStart;
   // HAL_GPIO_WritePin(LED_PORT, LED_PIN, 1);
   // HAL_GPIO_TogglePin(LED_PORT, LED_PIN);
 
-  if(offsetcount < 2000) {  // calibrate ADC offsets
-    offsetcount++;
-    offsetrlA = (adc_buffer.rlA + offsetrlA) / 2;
-    offsetrlB = (adc_buffer.rlB + offsetrlB) / 2;
-    offsetrrB = (adc_buffer.rrB + offsetrrB) / 2;
-    offsetrrC = (adc_buffer.rrC + offsetrrC) / 2;
-    offsetdcl = (adc_buffer.dcl + offsetdcl) / 2;
-    offsetdcr = (adc_buffer.dcr + offsetdcr) / 2;
+  if (adcOffsetState == ADC_OFFSET_CAL) {  // calibrate ADC offsets
+    offsetCalib();
+    PROF_MARK(PRF_OFFSET);
+    PROF_END();
     return;
   }
 
-  if (buzzerTimer % 1000 == 0) {  // Filter battery voltage at a slower sampling rate
+  if (--batFiltCnt == 0) {        // Filter battery voltage at a slower sampling rate
+    batFiltCnt = 1000;
     filtLowPass32(adc_buffer.batt1, BAT_FILT_COEF, &batVoltageFixdt);
     batVoltage = (int16_t)(batVoltageFixdt >> 16);  // convert fixed-point to integer
   }
@@ -115,6 +190,7 @@ void DMA1_Channel1_IRQHandler(void) {
   curR_phaB = (int16_t)(offsetrrB - adc_buffer.rrB);
   curR_phaC = (int16_t)(offsetrrC - adc_buffer.rrC);
   curR_DC   = (int16_t)(offsetdcr - adc_buffer.dcr);
+  PROF_MARK(PRF_OFFSET);
 
   // Disable PWM when current limit is reached (current chopping)
   // This is the Level 2 of current protection. The Level 1 should kick in first given by I_MOT_MAX
@@ -129,26 +205,33 @@ void DMA1_Channel1_IRQHandler(void) {
   } else {
     RIGHT_TIM->BDTR |= TIM_BDTR_MOE;
   }
+  PROF_MARK(PRF_CHOP);
 
-  // Create square wave for buzzer
+  // Create square wave for buzzer, the beep patterns are timed by beepTick()
   buzzerTimer++;
-  if (buzzerFreq != 0 && (buzzerTimer / 5000) % (buzzerPattern + 1) == 0) {
-    if (buzzerPrev == 0) {
-      buzzerPrev = 1;
-      if (++buzzerIdx > (buzzerCount + 2)) {    // pause 2 periods
-        buzzerIdx = 1;
-      }
+  if (buzzerTone != 0) {
+    if (++buzzerDiv >= buzzerTone) {
+      buzzerDiv   = 0;
+      buzzerLevel ^= 1;
+      BUZZER_PORT->BSRR = buzzerLevel ? BUZZER_PIN : (uint32_t)BUZZER_PIN << 16;
     }
-    if (buzzerTimer % buzzerFreq == 0 && (buzzerIdx <= buzzerCount || buzzerCount == 0)) {
-      HAL_GPIO_TogglePin(BUZZER_PORT, BUZZER_PIN);
-    }
-  } else if (buzzerPrev) {
-      HAL_GPIO_WritePin(BUZZER_PORT, BUZZER_PIN, GPIO_PIN_RESET);
-      buzzerPrev = 0;
+  } else if (buzzerLevel) {
+    BUZZER_PORT->BSRR = (uint32_t)BUZZER_PIN << 16;
+    buzzerLevel = 0;
+  }
+  PROF_MARK(PRF_BUZZER);
+
+  // Switch both motors to the new parameter set before either controller steps
+  if (ctrlParamSwap) {
+    ctrlParamAct ^= 1;
+    rtM_Left->defaultParam  = &ctrlParamBank[ctrlParamAct][0];
+    rtM_Right->defaultParam = &ctrlParamBank[ctrlParamAct][1];
+    ctrlParamSwaps++;
+    ctrlParamSwap = 0;
   }
 
   // Adjust pwm_margin depending on the selected Control Type
-  if (rtP_Left.z_ctrlTypSel == FOC_CTRL) {
+  if (rtM_Left->defaultParam->z_ctrlTypSel == FOC_CTRL) {
     pwm_margin = 110;
   } else {
     pwm_margin = 0;
@@ -160,14 +243,35 @@ void DMA1_Channel1_IRQHandler(void) {
   int ur, vr, wr;
   static boolean_T OverrunFlag = false;
 
-  /* Check for overrun */
+  /* Check for overrun: this period is skipped */
   if (OverrunFlag) {
+    isrOverrunCnt++;
+    isrErrCode |= ISR_ERR_OVERRUN;
+    if (++isrOverrunStreak > isrOverrunStreakMax) {
+      isrOverrunStreakMax = isrOverrunStreak;
+    }
+    PROF_END();
     return;
   }
   OverrunFlag = true;
 
   /* Make sure to stop BOTH motors in case of an error */
   enableFin = enable && !rtY_Left.z_errCode && !rtY_Right.z_errCode;
+
+  int16_t tgtL = (int16_t)pwml;
+  int16_t tgtR = (int16_t)pwmr;
+  #ifdef SERIAL_DIRECT
+  if (directActive) {                   // Direct mode: the targets of the last direct frame, 0 once they are older than SERIAL_DIRECT_TIMEOUT
+    if (directCnt) {
+      directCnt--;
+      tgtL = directTgtL;
+      tgtR = directTgtR;
+    } else {
+      tgtL = 0;
+      tgtR = 0;
+    }
+  }
+  #endif
  
   // ========================= LEFT MOTOR ============================ 
     // Get hall sensors values
@@ -178,7 +282,7 @@ void DMA1_Channel1_IRQHandler(void) {
     /* Set motor inputs here */
     rtU_Left.b_motEna     = enableFin;
     rtU_Left.z_ctrlModReq = ctrlModReq;  
-    rtU_Left.r_inpTgt     = pwml;
+    rtU_Left.r_inpTgt     = tgtL;
     rtU_Left.b_hallA      = hall_ul;
     rtU_Left.b_hallB      = hall_vl;
     rtU_Left.b_hallC      = hall_wl;
@@ -204,6 +308,7 @@ void DMA1_Channel1_IRQHandler(void) {
     LEFT_TIM->LEFT_TIM_U    = (uint16_t)CLAMP(ul + pwm_res / 2, pwm_margin, pwm_res-pwm_margin);
     LEFT_TIM->LEFT_TIM_V    = (uint16_t)CLAMP(vl + pwm_res / 2, pwm_margin, pwm_res-pwm_margin);
     LEFT_TIM->LEFT_TIM_W    = (uint16_t)CLAMP(wl + pwm_res / 2, pwm_margin, pwm_res-pwm_margin);
+    PROF_MARK(PRF_LEFT);
   // =================================================================
   
 
@@ -216,7 +321,7 @@ void DMA1_Channel1_IRQHandler(void) {
     /* Set motor inputs here */
     rtU_Right.b_motEna      = enableFin;
     rtU_Right.z_ctrlModReq  = ctrlModReq;
-    rtU_Right.r_inpTgt      = pwmr;
+    rtU_Right.r_inpTgt      = tgtR;
     rtU_Right.b_hallA       = hall_ur;
     rtU_Right.b_hallB       = hall_vr;
     rtU_Right.b_hallC       = hall_wr;
@@ -242,11 +347,108 @@ void DMA1_Channel1_IRQHandler(void) {
     RIGHT_TIM->RIGHT_TIM_U  = (uint16_t)CLAMP(ur + pwm_res / 2, pwm_margin, pwm_res-pwm_margin);
     RIGHT_TIM->RIGHT_TIM_V  = (uint16_t)CLAMP(vr + pwm_res / 2, pwm_margin, pwm_res-pwm_margin);
     RIGHT_TIM->RIGHT_TIM_W  = (uint16_t)CLAMP(wr + pwm_res / 2, pwm_margin, pwm_res-pwm_margin);
+    PROF_MARK(PRF_RIGHT);
   // =================================================================
 
+  #ifdef DEBUG_SERIAL_TELEMETRY
+  telemTick();
+  #endif
+  #ifdef SERIAL_FEEDBACK
+  fdbkTick();
+  #endif
+  #ifdef DEBUG_SCOPE
+  scopeTick();
+  #endif
+
   /* Indicate task complete */
   OverrunFlag = false;
+
+  /* Check for deadline miss: the next ADC conversion already completed, so the next period starts late.
+   * Whether it is also lost is counted at the next start */
+  if (DMA1->ISR & DMA_ISR_TCIF1) {
+    isrErrCode |= ISR_ERR_OVERRUN;
+    if (++isrOverrunStreak > isrOverrunStreakMax) {
+      isrOverrunStreakMax = isrOverrunStreak;
+    }
+  } else {
+    isrOverrunStreak = 0;
+  }
+  PROF_END();
  
  // ###############################################################################
 
 }
+
+
+/* =========================== Controller Parameters =========================== */
+
+// Hand the staged set to the controllers, before the motor ISR starts
+void ctrlParamInit(void) {
+  ctrlParamBank[0][0]     = rtP_Left;
+  ctrlParamBank[0][1]     = rtP_Right;
+  ctrlParamAct            = 0;
+  ctrlParamSwap           = 0;
+  ctrlParamPub            = ctrlParamSeq;
+  rtM_Left->defaultParam  = &ctrlParamBank[0][0];
+  rtM_Right->defaultParam = &ctrlParamBank[0][1];
+}
+
+// Call after a batch of edits to rtP_Left/rtP_Right, from the main loop or an interrupt.
+// The whole batch reaches both motors in the same PWM period, within one main loop.
+void ctrlParamCommit(void) {
+  ctrlParamSeq++;
+}
+
+// Call from the main loop: copies the committed staged set to the idle bank and requests the switch
+void ctrlParamProcess(void) {
+  uint16_t seq = ctrlParamSeq;
+
+  if (ctrlParamSwap || seq == ctrlParamPub) {
+    return;                               // the ISR has not taken the previous set yet, or nothing new
+  }
+  ctrlParamBank[ctrlParamAct ^ 1][0] = rtP_Left;
+  ctrlParamBank[ctrlParamAct ^ 1][1] = rtP_Right;
+  if (ctrlParamSeq != seq) {
+    return;                               // a serial command committed during the copy, copy again next loop
+  }
+  ctrlParamPub  = seq;
+  __DMB();
+  ctrlParamSwap = 1;
+}
+
+
+/* =========================== Direct Mode =========================== */
+#ifdef SERIAL_DIRECT
+
+// Direct frame on input in: the motor ISR uses the targets from the next PWM period on. USART interrupt,
+// which the motor ISR preempts: the targets are written as a whole
+void directSet(uint8_t in, int16_t tgtL, int16_t tgtR) {
+  __disable_irq();
+  directTgtL   = tgtL;
+  directTgtR   = tgtR;
+  directCnt    = SERIAL_DIRECT_TIMEOUT;
+  directIn     = in;
+  directActive = 1;
+  __enable_irq();
+}
+
+// Back to the normal command path (pwml/pwmr)
+void directEnd(void) {
+  __disable_irq();
+  directActive = 0;
+  directCnt    = 0;
+  __enable_irq();
+}
+
+// Main loop, for every control port after the timeout check: direct mode ends when the port that started it
+// times out or is no longer the selected input sel
+void directCheck(uint8_t in, uint8_t sel, uint8_t timeoutFlg) {
+  if (directActive && directIn == in && (timeoutFlg || in != sel)) {
+    directEnd();
+  }
+}
+
+uint8_t directIsActive(void) {
+  return directActive;
+}
+#endif
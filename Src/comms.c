@@ -28,46 +28,16 @@
 #include "BLDC_controller.h"
 #include "util.h"
 #include "comms.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include "scope.h"
+#include "sched.h"
 
 #if defined(DEBUG_SERIAL_PROTOCOL)
 #if defined(DEBUG_SERIAL_PROTOCOL) && (defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3))
 
-#ifdef CONTROL_ADC
-  #define RAW_MIN 0
-  #define RAW_MAX 4095
-#else
-  #define RAW_MIN -1000
-  #define RAW_MAX 1000
-#endif
-
-
 #define MAX_PARAM_WATCH 15
-
-extern ExtY rtY_Left;                   /* External outputs */
-extern ExtU rtU_Left;                   /* External inputs */
-extern P    rtP_Left;
-
-extern ExtY rtY_Right;                  /* External outputs */
-extern ExtU rtU_Right;                      /* External inputs */
-extern P    rtP_Right;
-
-
-extern InputStruct input1[];            // input structure
-extern InputStruct input2[];            // input structure
-
-extern uint16_t VirtAddVarTab[NB_OF_VAR];
-extern int16_t speedAvg;                      // average measured speed
-extern int16_t speedAvgAbs;                   // average measured speed in absolute
-extern uint8_t ctrlModReqRaw;
-extern int16_t batVoltageCalib;
-extern int16_t board_temp_deg_c;
-extern int16_t left_dc_curr;
-extern int16_t right_dc_curr;
-extern int16_t dc_curr;
-extern int16_t cmdL; 
-extern int16_t cmdR; 
-
-
+#define PRINT_LINE_MAX  128             // [bytes] longest line of the $HELP and $GET dumps
 
 enum commandTypes {READ,WRITE};
 // Function0 - Function with 0 parameter
@@ -83,69 +53,6 @@ const command_entry commands[] = {
     {WRITE  ,"SAVE"    ,saveAllParamVal   ,NULL            ,NULL           ,"Save Parameters to EEPROM"},
 };
 
-enum paramTypes {PARAMETER,VARIABLE};
-const parameter_entry params[] = {
-  // CONTROL PARAMETERS
-  // Type       ,Name                 ,Datatype ,ValueL ptr                  ,ValueR                    ,EEPRM Addr ,Init              Int/Ext ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback Function  ,Help text
-    {PARAMETER  ,"CTRL_MOD"           ,ADD_PARAM(ctrlModReqRaw)              ,NULL                      ,0          ,CTRL_MOD_REQ      ,0      ,1      ,3      ,0               ,0    ,0     ,NULL               ,"Ctrl mode 1:VLT 2:SPD 3:TRQ"},
-    {PARAMETER  ,"CTRL_TYP"           ,ADD_PARAM(rtP_Left.z_ctrlTypSel)      ,&rtP_Right.z_ctrlTypSel   ,0          ,CTRL_TYP_SEL      ,0      ,0      ,2      ,0               ,0    ,0     ,NULL               ,"Ctrl type 0:COM 1:SIN 2:FOC"},
-    {PARAMETER  ,"I_MOT_MAX"          ,ADD_PARAM(rtP_Left.i_max)             ,&rtP_Right.i_max          ,1          ,I_MOT_MAX         ,1      ,1      ,40     ,A2BIT_CONV      ,0    ,4     ,NULL               ,"Max phase current A"},
-    {PARAMETER  ,"N_MOT_MAX"          ,ADD_PARAM(rtP_Left.n_max)             ,&rtP_Right.n_max          ,2          ,N_MOT_MAX         ,1      ,10     ,2000   ,0               ,0    ,4     ,NULL               ,"Max motor RPM"},
-    {PARAMETER  ,"FI_WEAK_ENA"        ,ADD_PARAM(rtP_Left.b_fieldWeakEna)    ,&rtP_Right.b_fieldWeakEna ,0          ,FIELD_WEAK_ENA    ,0      ,0      ,1      ,0               ,0    ,0     ,NULL               ,"Enable field weak"},
-  	{PARAMETER  ,"FI_WEAK_HI"         ,ADD_PARAM(rtP_Left.r_fieldWeakHi)     ,&rtP_Right.r_fieldWeakHi  ,0          ,FIELD_WEAK_HI     ,1      ,0      ,1500   ,0               ,0    ,4     ,Input_Lim_Init     ,"Field weak high RPM"},
-	  {PARAMETER  ,"FI_WEAK_LO"         ,ADD_PARAM(rtP_Left.r_fieldWeakLo)     ,&rtP_Right.r_fieldWeakLo  ,0          ,FIELD_WEAK_LO     ,1      ,0      ,1000   ,0               ,0    ,4     ,Input_Lim_Init     ,"Field weak low RPM"},
-    {PARAMETER  ,"FI_WEAK_MAX"        ,ADD_PARAM(rtP_Left.id_fieldWeakMax)   ,&rtP_Right.id_fieldWeakMax,0          ,FIELD_WEAK_MAX    ,1      ,0      ,20     ,A2BIT_CONV      ,0    ,4     ,NULL               ,"Field weak max current A(FOC)"},
-    {PARAMETER  ,"PHA_ADV_MAX"        ,ADD_PARAM(rtP_Left.a_phaAdvMax)       ,&rtP_Right.a_phaAdvMax    ,0          ,PHASE_ADV_MAX     ,1      ,0      ,55     ,0               ,0    ,4     ,NULL               ,"Max Phase Adv angle Deg(SIN)"},     
-  // INPUT PARAMETERS
-  // Type       ,Name                 ,ValueL ptr                            ,ValueR                    ,EEPRM Addr ,Init              Int/Ext ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback Function  ,Help text
-    {VARIABLE   ,"IN1_RAW"            ,ADD_PARAM(input1[0].raw)              ,NULL                      ,0          ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input1 raw"},        
-    {PARAMETER  ,"IN1_TYP"            ,ADD_PARAM(input1[0].typ)              ,NULL                      ,3          ,0                 ,0      ,0      ,3      ,0               ,0    ,0     ,0                  ,"Input1 type"},        
-    {PARAMETER  ,"IN1_MIN"            ,ADD_PARAM(input1[0].min)              ,NULL                      ,4          ,RAW_MIN           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input1 min"},        
-    {PARAMETER  ,"IN1_MID"            ,ADD_PARAM(input1[0].mid)              ,NULL                      ,5          ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input1 mid"},
-    {PARAMETER  ,"IN1_MAX"            ,ADD_PARAM(input1[0].max)              ,NULL                      ,6          ,RAW_MAX           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input1 max"},        
-    {VARIABLE   ,"IN1_CMD"            ,ADD_PARAM(input1[0].cmd)              ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,0                  ,"Input1 cmd"},        
-    
-    {VARIABLE   ,"IN2_RAW"            ,ADD_PARAM(input2[0].raw)              ,NULL                      ,0          ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input2 raw"},   
-    {PARAMETER  ,"IN2_TYP"            ,ADD_PARAM(input2[0].typ)              ,NULL                      ,7          ,0                 ,0      ,0      ,3      ,0               ,0    ,0     ,0                  ,"Input2 type"},        
-    {PARAMETER  ,"IN2_MIN"            ,ADD_PARAM(input2[0].min)              ,NULL                      ,8          ,RAW_MIN           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input2 min"},        
-    {PARAMETER  ,"IN2_MID"            ,ADD_PARAM(input2[0].mid)              ,NULL                      ,9          ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input2 mid"},
-    {PARAMETER  ,"IN2_MAX"            ,ADD_PARAM(input2[0].max)              ,NULL                      ,10         ,RAW_MAX           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Input2 max"},
-    {VARIABLE   ,"IN2_CMD"            ,ADD_PARAM(input2[0].cmd)              ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,0                  ,"Input2 cmd"},
-#if defined(PRI_INPUT1) && defined(PRI_INPUT2) && defined(AUX_INPUT1) && defined(AUX_INPUT2)  
-  // Type       ,Name                 ,ValueL ptr                            ,ValueR                    ,EEPRM Addr ,Init              Int/Ext ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback Function  ,Help text
-    {VARIABLE   ,"AUX_IN1_RAW"        ,ADD_PARAM(input1[1].raw)              ,NULL                      ,0          ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input1 raw"},        
-    {PARAMETER  ,"AUX_IN1_TYP"        ,ADD_PARAM(input1[1].typ)              ,NULL                      ,11         ,0                 ,0      ,0      ,3      ,0               ,0    ,0     ,0                  ,"Aux. input1 type"},        
-    {PARAMETER  ,"AUX_IN1_MIN"        ,ADD_PARAM(input1[1].min)              ,NULL                      ,12         ,RAW_MIN           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input1 min"},        
-    {PARAMETER  ,"AUX_IN1_MID"        ,ADD_PARAM(input1[1].mid)              ,NULL                      ,13         ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input1 mid"},
-    {PARAMETER  ,"AUX_IN1_MAX"        ,ADD_PARAM(input1[1].max)              ,NULL                      ,14         ,RAW_MAX           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input1 max"},        
-    {VARIABLE   ,"AUX_IN1_CMD"        ,ADD_PARAM(input1[1].cmd)              ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,0                  ,"Aux. input1 cmd"},        
-    
-    {VARIABLE   ,"AUX_IN2_RAW"        ,ADD_PARAM(input2[1].raw)              ,NULL                      ,0          ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input2 raw"},        
-    {PARAMETER  ,"AUX_IN2_TYP"        ,ADD_PARAM(input2[1].typ)              ,NULL                      ,15         ,0                 ,0      ,0      ,3      ,0               ,0    ,0     ,0                  ,"Aux. input2 type"},        
-    {PARAMETER  ,"AUX_IN2_MIN"        ,ADD_PARAM(input2[1].min)              ,NULL                      ,16         ,RAW_MIN           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input2 min"},        
-    {PARAMETER  ,"AUX_IN2_MID"        ,ADD_PARAM(input2[1].mid)              ,NULL                      ,17         ,0                 ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input2 mid"},
-    {PARAMETER  ,"AUX_IN2_MAX"        ,ADD_PARAM(input2[1].max)              ,NULL                      ,18         ,RAW_MAX           ,0      ,RAW_MIN,RAW_MAX,0               ,0    ,0     ,0                  ,"Aux. input2 max"},
-    {VARIABLE   ,"AUX_IN2_CMD"        ,ADD_PARAM(input2[1].cmd)              ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,0                  ,"Aux. input2 cmd"},
-#endif  
-  // FEEDBACK
-  // Type       ,Name                 ,Datatype, ValueL ptr                  ,ValueR                    ,EEPRM Addr ,Init              Int/Ext ,Min    ,Max    ,Div             ,Mul  ,Fix   ,Callback Function  ,Help text
-    {VARIABLE   ,"DC_CURR"            ,ADD_PARAM(dc_curr)                    ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Total DC Link current A *100"},
-    {VARIABLE   ,"RDC_CURR"           ,ADD_PARAM(right_dc_curr)              ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Right DC Link current A *100"},
-    {VARIABLE   ,"LDC_CURR"           ,ADD_PARAM(left_dc_curr)               ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Left DC Link current A *100"},
-    {VARIABLE   ,"CMDL"               ,ADD_PARAM(cmdL)                       ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Left Motor Command"},
-    {VARIABLE   ,"CMDR"               ,ADD_PARAM(cmdR)                       ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Right Motor Command"},
-    {VARIABLE   ,"SPD_AVG"            ,ADD_PARAM(speedAvg)                   ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Motor Measured Avg RPM"},
-    {VARIABLE   ,"SPDL"               ,ADD_PARAM(rtY_Left.n_mot)             ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Left Motor Measured RPM"},
-    {VARIABLE   ,"SPDR"               ,ADD_PARAM(rtY_Right.n_mot)            ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Right Motor Measured RPM"},
-    {VARIABLE   ,"RATE"               ,0       , NULL                        ,NULL                      ,0          ,RATE              ,0      ,0      ,0      ,0               ,0    ,4     ,NULL               ,"Rate *10"},
-    {VARIABLE   ,"SPD_COEF"           ,0       , NULL                        ,NULL                      ,0          ,SPEED_COEFFICIENT ,0      ,0      ,0      ,0               ,10   ,14    ,NULL               ,"Speed Coefficient *10"},
-    {VARIABLE   ,"STR_COEF"           ,0       , NULL                        ,NULL                      ,0          ,STEER_COEFFICIENT ,0      ,0      ,0      ,0               ,10   ,14    ,NULL               ,"Steer Coefficient *10"},
-    {VARIABLE   ,"BATV"               ,ADD_PARAM(batVoltageCalib)            ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Calibrated Battery voltage *100"},       
-    {VARIABLE   ,"TEMP"               ,ADD_PARAM(board_temp_deg_c)           ,NULL                      ,0          ,0                 ,0      ,0      ,0      ,0               ,0    ,0     ,NULL               ,"Calibrated Temperature °C *10"},       
-
-};
-
-
 const char *errors[9] = {
   "Command not found", // Err1
   "Parameter not found", // Err2
@@ -175,103 +82,12 @@ int8_t setParamValExt(uint8_t index, int32_t value) {
   return ret;
 }
 
-// Set Param with value from internal format
+// Set Param with value from internal format, beep if the value changes
 int8_t setParamValInt(uint8_t index, int32_t newValue) {
-  int32_t oldValue = getParamValInt(index);
-  if (oldValue != newValue){ 
-    // if value is different, beep, cast and assign new value
-    switch (params[index].datatype){
-      case UINT8_T:
-        if (params[index].valueL != NULL) *(uint8_t*)params[index].valueL = newValue;
-        if (params[index].valueR != NULL) *(uint8_t*)params[index].valueR = newValue;
-        break;
-      case UINT16_T:
-        if (params[index].valueL != NULL) *(uint16_t*)params[index].valueL = newValue; 
-        if (params[index].valueR != NULL) *(uint16_t*)params[index].valueR = newValue;
-        break;
-      case UINT32_T:
-        if (params[index].valueL != NULL) *(uint32_t*)params[index].valueL = newValue; 
-        if (params[index].valueR != NULL) *(uint32_t*)params[index].valueR = newValue;
-        break;
-      case INT8_T:
-        if (params[index].valueL != NULL) *(int8_t*)params[index].valueL = newValue; 
-        if (params[index].valueR != NULL) *(int8_t*)params[index].valueR = newValue;
-        break;
-      case INT16_T:
-        if (params[index].valueL != NULL) *(int16_t*)params[index].valueL = newValue; 
-        if (params[index].valueR != NULL) *(int16_t*)params[index].valueR = newValue;
-        break;
-      case INT32_T:
-        if (params[index].valueL != NULL) *(int32_t*)params[index].valueL = newValue; 
-        if (params[index].valueR != NULL) *(int32_t*)params[index].valueR = newValue;
-        break;
-    }
-
-    // Beep if value was modified
-    beepShort(5);
-  }
-
-  // Run callback function if assigned
-  if (params[index].callback_function) (*params[index].callback_function)();
+  if (paramWrite(index, newValue)) beepShort(5);
   return 1;
 }
 
-// Get Parameter Internal value and translate to external 
-int32_t getParamValExt(uint8_t index) {
-  return intToExt(index,getParamValInt(index));
-}
-
-// Get Parameter Internal Value
-int32_t getParamValInt(uint8_t index) {
-  int32_t value = 0;
-
-  int8_t countVar = 0;
-  if (params[index].valueL != NULL) countVar++;
-  if (params[index].valueR != NULL) countVar++;
-
-  if (countVar > 0){
-    // Read Left and Right values and calculate average 
-    // If left and right have to be summed up, DIV field could be adapted to multiply by 2
-    // Cast to parameter datatype
-    switch (params[index].datatype){
-      case UINT8_T:
-        if (params[index].valueL != NULL) value += *(uint8_t*)params[index].valueL;
-        if (params[index].valueR != NULL) value += *(uint8_t*)params[index].valueR;
-        break;
-      case UINT16_T:
-        if (params[index].valueL != NULL) value += *(uint16_t*)params[index].valueL;
-        if (params[index].valueR != NULL) value += *(uint16_t*)params[index].valueR;
-        break;
-      case UINT32_T:
-        if (params[index].valueL != NULL) value += *(uint32_t*)params[index].valueL;
-        if (params[index].valueR != NULL) value += *(uint32_t*)params[index].valueR;
-        break;
-      case INT8_T:
-        if (params[index].valueL != NULL) value += *(int8_t*)params[index].valueL;
-        if (params[index].valueR != NULL) value += *(int8_t*)params[index].valueR;
-        break;
-      case INT16_T:
-        if (params[index].valueL != NULL) value += *(int16_t*)params[index].valueL;
-        if (params[index].valueR != NULL) value += *(int16_t*)params[index].valueR;
-        break;
-      case INT32_T:
-        if (params[index].valueL != NULL) value += *(int32_t*)params[index].valueL;
-        if (params[index].valueR != NULL) value += *(int32_t*)params[index].valueR;
-        break;
-      default:
-        value = 0;
-    }
-
-    // Divide by number of values provided for the parameter
-    value /= countVar;
-  }else{
-    // No variable was provided, return init value that might contain a macro
-    value = params[index].init;
-  }
-
-  return value;
-}
-
 // Add or remove parameter from watch list
 int8_t watchParamVal(uint8_t index){
   int8_t i,found = 0;
@@ -308,28 +124,40 @@ int8_t printCommandHelp(uint8_t index){
 
 // Print help for parameter
 int8_t printParamHelp(uint8_t index){
+  #ifdef PARAM_HELP
   printf("? %s:\"%s\" ",params[index].name,params[index].help);
+  #else
+  printf("? %s ",params[index].name);
+  #endif
   if (params[index].type == PARAMETER) printf("[min:%li max:%li]",params[index].min,params[index].max);
   printf("\r\n");
   return 1;
 }
 
-// Print help for all parameters
+// Print help for all parameters. Longer than the printf ring: wait for room before each line
 int8_t printAllParamHelp(){
   printf("? Commands\r\n");
-  for(int i=0;i<COMMAND_SIZE(commands);i++)
+  for(int i=0;i<COMMAND_SIZE(commands);i++){
+    debugTxWait(PRINT_LINE_MAX);
     printCommandHelp(i);
+  }
   printf("?\r\n");
 
   printf("? Parameters\r\n");
   for(int i=0;i<PARAM_SIZE(params);i++){
-    if (params[i].type == PARAMETER) printParamHelp(i);
+    if (params[i].type == PARAMETER){
+      debugTxWait(PRINT_LINE_MAX);
+      printParamHelp(i);
+    }
   }
   printf("?\r\n");
 
   printf("? Variables\r\n");
   for(int i=0;i<PARAM_SIZE(params);i++){
-    if (params[i].type == VARIABLE) printParamHelp(i);
+    if (params[i].type == VARIABLE){
+      debugTxWait(PRINT_LINE_MAX);
+      printParamHelp(i);
+    }
   }
   printf("?\r\n");
 
@@ -349,7 +177,10 @@ int8_t printParamDef(uint8_t index){
 
 // Print definition(name,value,initial value, min, max) for all parameters
 int8_t printAllParamDef(){
-  for(int i=0;i<PARAM_SIZE(params);i++) printParamDef(i);
+  for(int i=0;i<PARAM_SIZE(params);i++){
+    debugTxWait(PRINT_LINE_MAX);
+    printParamDef(i);
+  }
   return 1;
 }
 
@@ -374,78 +205,10 @@ int8_t incrParamVal(uint8_t index) {
 
 // Get internal Parameter value and save it to EEprom for all paraemeter with an address assigned 
 int8_t saveAllParamVal() {
-  HAL_FLASH_Unlock();
-  EE_WriteVariable(VirtAddVarTab[0] , (uint16_t)FLASH_WRITE_KEY);
-  for(int i=0;i<PARAM_SIZE(params);i++){ 
-    // Only Parameters with eeprom address can be saved
-    if (params[i].addr){
-      EE_WriteVariable(VirtAddVarTab[params[i].addr] , (uint16_t)getParamValInt(i));    
-    }
-  }
-  HAL_FLASH_Lock();
+  schedTrigger(TASK_SAVE);              // written by the main loop when no other task is due
   return 1;
 }
 
-// Translate from Internal to External format
-int32_t intToExt(uint8_t index,int32_t value){
-  // Multiply for small number
-  if(params[index].mul) value *= params[index].mul;
-  // Divide to translate to external format
-  if(params[index].div) value /= params[index].div;
-  // Shift to translate to external format
-  if(params[index].fix) value >>= params[index].fix;
-  return value;
-}
-
-// Translate from External to Internal Format
-int32_t extToInt(uint8_t index,int32_t value){
-  // Multiply to translate to internal format
-  if(params[index].div) value *= params[index].div;
-  // Shift to translate to internal format
-  if (params[index].fix) value <<= params[index].fix;
-  // Divide for small number
-  if(params[index].mul) value /= params[index].mul;
-  return value;
-}
-
-// Get Parameter Init value(EEPROM or init/config.h) and translate to external format
-int32_t getParamInitExt(uint8_t index) {
-  return intToExt(index,getParamInitInt(index));
-}
-
-// Get Parameter value with EEprom data if address is avalaible, init/config.h value otherwise
-int16_t getParamInitInt(uint8_t index){
-  if (params[index].addr){
-    // if EEPROM address is specified, init from EEPROM address
-    uint16_t writeCheck, readVal;
-    
-    HAL_FLASH_Unlock();
-    EE_ReadVariable(VirtAddVarTab[0], &writeCheck);
-    EE_ReadVariable(VirtAddVarTab[params[index].addr] , &readVal);
-    HAL_FLASH_Lock();
-    
-    // EEPROM was written, use stored value
-    if (writeCheck == FLASH_WRITE_KEY){
-      return readVal;
-    }else{
-      // Use init value from array
-      if (params[index].initFormat){
-        // Init Value is in External format (e.g. PHA_ADV_MAX is 25 deg)
-        return extToInt(index,params[index].init);
-      }else{
-        return params[index].init;
-      }
-    }
-  }else{
-    if (params[index].initFormat){
-      // Init Value is in External format (e.g. PHA_ADV_MAX is 25 deg)
-      return extToInt(index,params[index].init);
-    }else{
-      return params[index].init;
-    }
-  }
-}
-
 
 // initialize Parameter value with EEprom data if address is avalaible, init/config.h value otherwise
 int8_t initParamVal(uint8_t index) {
@@ -468,19 +231,6 @@ int8_t findCommand(uint8_t *userCommand, uint32_t len){
   return -1; // Not found
 }
 
-// Find parameter in params array and return index
-int8_t findParam(uint8_t *userCommand, uint32_t len){
-  for(int index=0;index<PARAM_SIZE(params);index++){
-    uint8_t param_len = strlen(params[index].name);
-    if (param_len < len){
-      if (memcmp(userCommand,params[index].name,param_len)==0){
-        return index;
-      }
-    }
-  }
-  return -1; // Not found
-}
-
 // Parse and save the command to be executed
 void handle_input(uint8_t *userCommand, uint32_t len)
 {
@@ -647,6 +397,186 @@ void process_debug()
   }
 }
 
+
+#ifdef DEBUG_SERIAL_BINARY
+/* =========================== Binary Parameter Requests =========================== */
+
+extern UART_HandleTypeDef huart2;
+extern UART_HandleTypeDef huart3;
+
+#if defined(DEBUG_SERIAL_USART2)
+  #define PRM_UART  huart2
+#else
+  #define PRM_UART  huart3
+#endif
+
+uint32_t paramRxErrors = 0;             // binary requests dropped: too long, bad CRC or queue full
+
+static uint8_t  prmRx[PRM_REQ_MAX + 6];                 // request being received
+static uint8_t  prmRxLen;
+static uint8_t  prmQueue[PRM_QUEUE][PRM_REQ_MAX + 6];   // checked requests waiting for the main loop
+static volatile uint8_t prmHead;        // written by the USART interrupt
+static volatile uint8_t prmTail;        // written by the main loop
+static uint8_t  prmTx[PRM_RESP_MAX + 6];                // response waiting for the UART
+static uint16_t prmTxLen;
+
+// Size of a value in the binary protocol
+static uint8_t paramSize(uint8_t index) {
+  if (params[index].valueL == NULL || params[index].mul) {
+    return 4;                           // config.h constant, or scaled up: may not fit the datatype
+  }
+  switch (params[index].datatype) {
+    case UINT8_T:
+    case INT8_T:
+      return 1;
+    case UINT16_T:
+    case INT16_T:
+      return 2;
+    default:
+      return 4;
+  }
+}
+
+static uint8_t *putVal(uint8_t *p, int32_t value, uint8_t size) {
+  for (uint8_t k = 0; k < size; k++) {
+    *p++ = (uint8_t)(value >> (8 * k));
+  }
+  return p;
+}
+
+// Collect binary requests from the bytes received on the debug port (USART interrupt).
+// Returns 0 if the bytes are not binary, they are then for handle_input.
+uint8_t paramRx(const uint8_t *data, uint32_t len) {
+  if (prmRxLen == 0 && data[0] != (uint8_t)PRM_START_FRAME) {
+    return 0;
+  }
+
+  for (uint32_t i = 0; i < len; i++) {
+    uint8_t b = data[i];
+    if (prmRxLen == 1 && b != (uint8_t)(PRM_START_FRAME >> 8)) {
+      prmRxLen = (b == (uint8_t)PRM_START_FRAME);     // not a start frame, but maybe the start of the next one
+      continue;
+    }
+    if (prmRxLen == 0 && b != (uint8_t)PRM_START_FRAME) {
+      continue;
+    }
+    prmRx[prmRxLen++] = b;
+    if (prmRxLen == 4 && prmRx[3] > PRM_REQ_MAX) {
+      paramRxErrors++;
+      prmRxLen = 0;
+    } else if (prmRxLen > 4 && prmRxLen == prmRx[3] + 6) {
+      uint8_t  next = (prmHead + 1) & (PRM_QUEUE - 1);
+      uint16_t crc  = (uint16_t)(prmRx[prmRxLen - 2] | (prmRx[prmRxLen - 1] << 8));
+      if (crc != calcCRC16(&prmRx[2], prmRxLen - 4, 0xFFFF) || next == prmTail) {
+        paramRxErrors++;
+      } else {
+        memcpy(prmQueue[prmHead], prmRx, prmRxLen);
+        prmHead = next;
+      }
+      prmRxLen = 0;
+    }
+  }
+  return 1;
+}
+
+// Execute one request and build its response in prmTx, returns the frame length
+static uint16_t paramAnswer(const uint8_t *req) {
+  uint8_t       cmd = req[2];
+  uint8_t       n   = req[3];
+  const uint8_t *in = &req[4];
+  uint8_t       *p  = &prmTx[4];
+  uint8_t       err = 0;
+  uint8_t       i, k;
+  int32_t       value;
+
+  switch (cmd) {
+    case PRM_CMD_INFO:
+      *p++ = PRM_VERSION;
+      *p++ = PARAM_SIZE(params);
+      break;
+
+    case PRM_CMD_DESC:
+      if (n != 1 || in[0] >= PARAM_SIZE(params)) {
+        err = 2;                        // Err2: Parameter not found
+        break;
+      }
+      i    = in[0];
+      *p++ = i;
+      *p++ = params[i].type;
+      *p++ = params[i].datatype;
+      *p++ = paramSize(i);
+      p    = putVal(p, params[i].min, 4);
+      p    = putVal(p, params[i].max, 4);
+      *p++ = params[i].div;
+      *p++ = params[i].mul;
+      *p++ = params[i].fix;
+      for (k = 0; params[i].name[k] && k < PRM_RESP_MAX - 15; k++) {
+        *p++ = params[i].name[k];
+      }
+      break;
+
+    case PRM_CMD_GET:
+      for (k = 0; k < n; k++) {
+        if (in[k] >= PARAM_SIZE(params)) {
+          err = 2;
+          break;
+        }
+        p = putVal(p, getParamValExt(in[k]), paramSize(in[k]));
+      }
+      break;
+
+    case PRM_CMD_SET:
+      if (n != 5 || in[0] >= PARAM_SIZE(params)) {
+        err = 2;
+        break;
+      }
+      i     = in[0];
+      value = (int32_t)(in[1] | (in[2] << 8) | (in[3] << 16) | ((uint32_t)in[4] << 24));
+      if (params[i].type == VARIABLE) {
+        err = 3;                        // Err3: This command cannot be used with a Variable
+      } else if (!IN_RANGE(value, params[i].min, params[i].max)) {
+        err = 4;                        // Err4: Value not in range
+      } else {
+        paramWrite(i, extToInt(i, value));
+        *p++ = i;
+        p    = putVal(p, getParamValExt(i), paramSize(i));
+      }
+      break;
+
+    default:
+      err = 1;                          // Err1: Command not found
+  }
+
+  if (err) {
+    cmd |= PRM_ERR;
+    p    = &prmTx[4];
+    *p++ = err;
+  }
+  prmTx[0] = (uint8_t)PRM_START_FRAME;
+  prmTx[1] = (uint8_t)(PRM_START_FRAME >> 8);
+  prmTx[2] = cmd;
+  prmTx[3] = (uint8_t)(p - &prmTx[4]);
+  p = putVal(p, calcCRC16(&prmTx[2], (uint32_t)(p - &prmTx[2]), 0xFFFF), 2);
+  return (uint16_t)(p - prmTx);
+}
+
+// Call from the main loop. Answers one request when the UART DMA is idle, never waits.
+void paramProcess(void) {
+  if (PRM_UART.gState != HAL_UART_STATE_READY) {
+    return;                             // previous response, printf output or telemetry still being sent
+  }
+  if (prmTxLen == 0) {
+    if (prmTail == prmHead) {
+      return;
+    }
+    prmTxLen = paramAnswer(prmQueue[prmTail]);
+    prmTail  = (prmTail + 1) & (PRM_QUEUE - 1);
+  }
+  if (debugTxFrame(prmTx, prmTxLen)) {
+    prmTxLen = 0;                       // sent, else try again next loop
+  }
+}
+#endif
 #endif
 #endif  // DEBUG_SERIAL_PROTOCOL
 
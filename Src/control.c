@@ -5,6 +5,7 @@
 #include "defines.h"
 #include "setup.h"
 #include "config.h"
+#include "i2cbus.h"
 
 #define NUNCHUK_I2C_ADDRESS 0xA4
 
@@ -16,8 +17,10 @@ uint32_t timeoutCntGen = TIMEOUT;
 uint8_t  timeoutFlgGen = 0;
 uint8_t  nunchuk_data[6] = {0};
 
-uint8_t i2cBuffer[2];
 nunchuk_state nunchukState = NUNCHUK_CONNECTING;
+static uint8_t nunchukRx[6];
+static volatile uint8_t nunchukPend;    // transfers of the transaction on the I2C bus, see i2cbus.h
+static uint8_t nunchukReq = false;      // transaction queued, result not yet taken
 
 extern I2C_HandleTypeDef hi2c2;
 extern DMA_HandleTypeDef hdma_i2c2_rx;
@@ -217,101 +220,91 @@ void PWM_Init(void) {
 }
 #endif
 
-uint8_t Nunchuk_tx(uint8_t i2cBuffer[], uint8_t i2cBufferLength) {
-  if(HAL_I2C_Master_Transmit(&hi2c2,NUNCHUK_I2C_ADDRESS,(uint8_t*)i2cBuffer, i2cBufferLength, 100) == HAL_OK) {
-    return true;
-  }
-  return false;
-}
+/* Queue the init: unencrypted mode, 10 ms after each step */
+void Nunchuk_Connect(void) {
+  static const uint8_t init1[2] = {0xF0, 0x55};
+  static const uint8_t init2[2] = {0xFB, 0x00};
 
-uint8_t Nunchuk_rx(uint8_t i2cBuffer[], uint8_t i2cBufferLength) {
-  if(HAL_I2C_Master_Receive(&hi2c2,NUNCHUK_I2C_ADDRESS,(uint8_t*)i2cBuffer, i2cBufferLength, 100) == HAL_OK) {
-    return true;
+  /* Initialise the I2C peripheral on first use, the bus resets itself after a hung transfer */
+  if(hi2c2.State == HAL_I2C_STATE_RESET) {
+    I2C_Init();
   }
-  return false;
-}
 
-uint8_t Nunchuk_Init(void) {
-  //-- START -- init WiiNunchuk
-  i2cBuffer[0] = 0xF0;
-  i2cBuffer[1] = 0x55;
-
-  if(Nunchuk_tx(i2cBuffer, 2) == false) {
-    return false;
+  nunchukReq  = true;
+  nunchukPend = 2;
+  if(!i2cWrite(NUNCHUK_I2C_ADDRESS, init1, 2, 0, &nunchukPend) ||
+     !i2cWrite(NUNCHUK_I2C_ADDRESS, init2, 2, 10, &nunchukPend)) {
+    nunchukPend = I2C_FAIL;
   }
-  HAL_Delay(10);
-
-  i2cBuffer[0] = 0xFB;
-  i2cBuffer[1] = 0x00;
+}
 
-  if(Nunchuk_tx(i2cBuffer, 2) == false) {
-    return false;
-  }
-  HAL_Delay(10);
+/* Queue a read: address 0x00, then 6 bytes after the conversion time */
+static void Nunchuk_Request(uint8_t hold) {
+  static const uint8_t addr = 0x00;
 
-  return true;
-}
+  /* Clear the receive data buffer */
+  memset(nunchukRx, 0, sizeof(nunchukRx));
 
-uint8_t Nunchuk_Connect() {
-  /* Initialise / re-initialise I2C peripheral */
-  I2C_Init();
-  
-  /* Initialise / re-initialise nunchuk */
-  if(Nunchuk_Init() == true) {
-    nunchukState = NUNCHUK_CONNECTED;
-    return true;
-  } else {
-    return false;
+  nunchukReq  = true;
+  nunchukPend = 2;
+  if(!i2cWrite(NUNCHUK_I2C_ADDRESS, &addr, 1, hold, &nunchukPend) ||
+     !i2cRead(NUNCHUK_I2C_ADDRESS, nunchukRx, 6, 3, &nunchukPend)) {
+    nunchukPend = I2C_FAIL;
   }
 }
 
+/* Non-blocking: the transfers run on the I2C interrupt, each call takes the result
+ * of the last transaction when it is over and queues the next one */
 nunchuk_state Nunchuk_Read(void) {
   static uint8_t delay_counter = 0;
   uint16_t checksum = 0;
   uint8_t success = true;
+  uint8_t done = false;
   uint8_t i = 0;
 
+  /* Transaction still on the bus, it ends within the bus timeout */
+  if(nunchukReq) {
+    if(nunchukPend != 0 && nunchukPend != I2C_FAIL) {
+      return nunchukState;
+    }
+    nunchukReq = false;
+    done = true;
+  }
+
   switch(nunchukState) {
     case NUNCHUK_DISCONNECTED:
       success = false;
       /* Delay a bit before reconnecting */
       if(delay_counter++ > 100) {
-        success = Nunchuk_Connect();
+        Nunchuk_Connect();
+        nunchukState = NUNCHUK_RECONNECTING;
         delay_counter = 0;
       }
       break;
       
     case NUNCHUK_CONNECTING:
     case NUNCHUK_RECONNECTING:
-        /* Try to reconnect once, if fails again fall back to disconnected state */
-        success = Nunchuk_Connect();
-        if(!success) {
-          nunchukState = NUNCHUK_DISCONNECTED;
-        }
-      break;
-
-    case NUNCHUK_CONNECTED:
-      /* Send read address of 0x00 to the Nunchuk */
-      i2cBuffer[0] = 0x00;
-      if(!Nunchuk_tx(i2cBuffer, 1)) {
+      /* Try to reconnect once, if fails again fall back to disconnected state */
+      if(!done) {
         success = false;
+        Nunchuk_Connect();
+      } else if(nunchukPend == 0) {
+        nunchukState = NUNCHUK_CONNECTED;
+        Nunchuk_Request(10);
+      } else {
+        success = false;
+        nunchukState = NUNCHUK_DISCONNECTED;
       }
-      HAL_Delay(3);
-
-      /* Clear the receive data buffer */
-      for(i = 0; i<6; i++) {
-        nunchuk_data[i] = 0;
-      }
+      break;
 
-      /* Read back 6 bytes from the Nunchuk */
-      if(!Nunchuk_rx(nunchuk_data, 6)) {
+    case NUNCHUK_CONNECTED:
+      if(nunchukPend != 0) {
         success = false;
       }
-      HAL_Delay(3);
 
       /* Checksum the receive buffer to ensure it is not in an error condition, i.e. all 0x00 or 0xFF */
       for(i = 0; i<6; i++) {
-        checksum += nunchuk_data[i];
+        checksum += nunchukRx[i];
       }
       if(checksum == 0 || checksum == 0x5FA) {
         success = false;
@@ -329,6 +322,9 @@ nunchuk_state Nunchuk_Read(void) {
         nunchuk_data[1] = 128;
         timeoutFlgGen = 1;
         nunchukState = NUNCHUK_RECONNECTING;
+      } else {
+        memcpy(nunchuk_data, nunchukRx, sizeof(nunchukRx));
+        Nunchuk_Request(3);
       }
       break;
   }
@@ -5,6 +5,11 @@
   * @version V1.3.0
   * @date    18-December-2015
   * @brief   This file provides all the EEPROM emulation firmware functions.
+  *          Log-structured: EE_Init scans the active page once into a RAM index,
+  *          reads come from the index and writes append to the log. Every write
+  *          ends with a commit entry, so that a write interrupted by a power loss
+  *          is discarded as a whole: a record of several variables
+  *          (EE_WriteRecord) is applied all or nothing.
   ******************************************************************************
   * @attention
   *
@@ -44,683 +49,591 @@
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
+#define EE_ENTRY_FREE         ((uint32_t)0xFFFFFFFF)
+
 /* Private macro -------------------------------------------------------------*/
+/* Flash reads. The SIL build (Sim/Src/sim_flash.c) maps the flash addresses to a RAM image */
+#ifndef EE_FLASH_ADDR
+  #define EE_FLASH_ADDR(address)  (address)
+#endif
+#define EE_READ16(address)    (*(__IO uint16_t*)EE_FLASH_ADDR(address))
+#define EE_READ32(address)    (*(__IO uint32_t*)EE_FLASH_ADDR(address))
+
+#define EE_OTHER_PAGE(page)   ((page) == PAGE0_BASE_ADDRESS ? PAGE1_BASE_ADDRESS : PAGE0_BASE_ADDRESS)
+#define EE_ENTRY_ADDR(page, n) ((page) + 4 * (uint32_t)((n) + 1))    /* Entry n, after the header word */
+
 /* Private variables ---------------------------------------------------------*/
+EE_StatsTypeDef eeStats;
 
-/* Global variable used to store variable value in read sequence */
-uint16_t DataVar = 0;
+static uint16_t eeData[NB_OF_VAR];      /* Last stored value of each variable of VirtAddVarTab */
+static uint8_t  eeFound[NB_OF_VAR];     /* 1 if the variable is stored */
+static uint32_t eePage;                 /* Base address of the active page, 0 before EE_Init */
+static uint16_t eeNext;                 /* Next free entry in the active page */
 
 /* Virtual address defined by the user: 0xFFFF value is prohibited */
 extern uint16_t VirtAddVarTab[NB_OF_VAR];
 
+/* Private macro -------------------------------------------------------------*/
+/* Variable idx is part of the record Data (Valid NULL: all variables) */
+#define EE_IN_RECORD(Data, Valid, idx)  ((Data) != NULL && ((Valid) == NULL || (Valid)[idx]))
+
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
-static HAL_StatusTypeDef EE_Format(void);
-static uint16_t EE_FindValidPage(uint8_t Operation);
-static uint16_t EE_VerifyPageFullWriteVariable(uint16_t VirtAddress, uint16_t Data);
-static uint16_t EE_PageTransfer(uint16_t VirtAddress, uint16_t Data);
+static int16_t  EE_Index(uint16_t VirtAddress);
+static int32_t  EE_PageWear(uint32_t Page);
+static uint16_t EE_Format(void);
+static uint16_t EE_ErasePage(uint32_t Page);
+static uint16_t EE_ProgramEntry(uint16_t VirtAddress, uint16_t Data);
+static uint16_t EE_Commit(const uint16_t* Data, const uint8_t* Valid, int16_t Index, uint16_t Value, uint16_t Count);
+static uint16_t EE_PageTransfer(const uint16_t* Data, const uint8_t* Valid, int16_t Index, uint16_t Value);
+static uint8_t  EE_Scan(uint32_t Page);
 static uint16_t EE_VerifyPageFullyErased(uint32_t Address);
 
 /**
   * @brief  Restore the pages to a known good state in case of page's status
-  *   corruption after a power loss.
+  *   corruption after a power loss, then build the RAM index of the active page.
   * @param  None.
   * @retval - Flash error code: on write Flash error
-  *         - FLASH_COMPLETE: on success
+  *         - HAL_OK: on success
   */
 uint16_t EE_Init(void)
 {
-  uint16_t pagestatus0 = 6, pagestatus1 = 6;
-  uint16_t varidx = 0;
-  uint16_t eepromstatus = 0, readstatus = 0;
-  int16_t x = -1;
-  HAL_StatusTypeDef  flashstatus;
-  uint32_t page_error = 0;
-  FLASH_EraseInitTypeDef s_eraseinit;
-
+  uint16_t pagestatus0, pagestatus1;
+  int32_t  wear0, wear1;
+  uint32_t page = 0;
+  uint16_t status;
 
-  /* Get Page0 status */
-  pagestatus0 = (*(__IO uint16_t*)PAGE0_BASE_ADDRESS);
-  /* Get Page1 status */
-  pagestatus1 = (*(__IO uint16_t*)PAGE1_BASE_ADDRESS);
+  eePage = 0;
 
-  /* Fill EraseInit structure*/
-  s_eraseinit.TypeErase   = FLASH_TYPEERASE_PAGES;
-  s_eraseinit.PageAddress = PAGE0_ID;
-  s_eraseinit.NbPages     = 1;
+  /* Get Page0 and Page1 status */
+  pagestatus0 = EE_READ16(PAGE0_BASE_ADDRESS);
+  pagestatus1 = EE_READ16(PAGE1_BASE_ADDRESS);
 
-  /* Check for invalid header states and repair if necessary */
-  switch (pagestatus0)
+  if (pagestatus0 == VALID_PAGE && pagestatus1 == VALID_PAGE)
   {
-    case ERASED:
-      if (pagestatus1 == VALID_PAGE) /* Page0 erased, Page1 valid */
-      {
-          /* Erase Page0 */
-        if(!EE_VerifyPageFullyErased(PAGE0_BASE_ADDRESS))
-        {
-          flashstatus = HAL_FLASHEx_Erase(&s_eraseinit, &page_error);
-          /* If erase operation was failed, a Flash error code is returned */
-          if (flashstatus != HAL_OK)
-          {
-            return flashstatus;
-          }
-        }
-      }
-      else if (pagestatus1 == RECEIVE_DATA) /* Page0 erased, Page1 receive */
-      {
-        /* Erase Page0 */
-        if(!EE_VerifyPageFullyErased(PAGE0_BASE_ADDRESS))
-        {
-          flashstatus = HAL_FLASHEx_Erase(&s_eraseinit, &page_error);
-          /* If erase operation was failed, a Flash error code is returned */
-          if (flashstatus != HAL_OK)
-          {
-            return flashstatus;
-          }
-        }
-        /* Mark Page1 as valid */
-        flashstatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, PAGE1_BASE_ADDRESS, VALID_PAGE);
-        /* If program operation was failed, a Flash error code is returned */
-        if (flashstatus != HAL_OK)
-        {
-          return flashstatus;
-        }
-      }
-      else /* First EEPROM access (Page0&1 are erased) or invalid state -> format EEPROM */
-      {
-        /* Erase both Page0 and Page1 and set Page0 as valid page */
-        flashstatus = EE_Format();
-        /* If erase/program operation was failed, a Flash error code is returned */
-        if (flashstatus != HAL_OK)
-        {
-          return flashstatus;
-        }
-      }
-      break;
-
-    case RECEIVE_DATA:
-      if (pagestatus1 == VALID_PAGE) /* Page0 receive, Page1 valid */
-      {
-        /* Transfer data from Page1 to Page0 */
-        for (varidx = 0; varidx < NB_OF_VAR; varidx++)
-        {
-          if (( *(__IO uint16_t*)(PAGE0_BASE_ADDRESS + 6)) == VirtAddVarTab[varidx])
-          {
-            x = varidx;
-          }
-          if (varidx != x)
-          {
-            /* Read the last variables' updates */
-            readstatus = EE_ReadVariable(VirtAddVarTab[varidx], &DataVar);
-            /* In case variable corresponding to the virtual address was found */
-            if (readstatus != 0x1)
-            {
-              /* Transfer the variable to the Page0 */
-              eepromstatus = EE_VerifyPageFullWriteVariable(VirtAddVarTab[varidx], DataVar);
-              /* If program operation was failed, a Flash error code is returned */
-              if (eepromstatus != HAL_OK)
-              {
-                return eepromstatus;
-              }
-            }
-          }
-        }
-        /* Mark Page0 as valid */
-        flashstatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, PAGE0_BASE_ADDRESS, VALID_PAGE);
-        /* If program operation was failed, a Flash error code is returned */
-        if (flashstatus != HAL_OK)
-        {
-          return flashstatus;
-        }
-        s_eraseinit.TypeErase   = FLASH_TYPEERASE_PAGES;
-        s_eraseinit.PageAddress = PAGE1_ID;
-        s_eraseinit.NbPages     = 1;
-        /* Erase Page1 */
-        if(!EE_VerifyPageFullyErased(PAGE1_BASE_ADDRESS))
-        {
-          flashstatus = HAL_FLASHEx_Erase(&s_eraseinit, &page_error);
-          /* If erase operation was failed, a Flash error code is returned */
-          if (flashstatus != HAL_OK)
-          {
-            return flashstatus;
-          }
-        }
-      }
-      else if (pagestatus1 == ERASED) /* Page0 receive, Page1 erased */
-      {
-        s_eraseinit.TypeErase   = FLASH_TYPEERASE_PAGES;
-        s_eraseinit.PageAddress = PAGE1_ID;
-        s_eraseinit.NbPages     = 1;
-        /* Erase Page1 */
-        if(!EE_VerifyPageFullyErased(PAGE1_BASE_ADDRESS))
-        {
-          flashstatus = HAL_FLASHEx_Erase(&s_eraseinit, &page_error);
-          /* If erase operation was failed, a Flash error code is returned */
-          if (flashstatus != HAL_OK)
-          {
-            return flashstatus;
-          }
-        }
-        /* Mark Page0 as valid */
-        flashstatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, PAGE0_BASE_ADDRESS, VALID_PAGE);
-        /* If program operation was failed, a Flash error code is returned */
-        if (flashstatus != HAL_OK)
-        {
-          return flashstatus;
-        }
-      }
-      else /* Invalid state -> format eeprom */
-      {
-        /* Erase both Page0 and Page1 and set Page0 as valid page */
-        flashstatus = EE_Format();
-        /* If erase/program operation was failed, a Flash error code is returned */
-        if (flashstatus != HAL_OK)
-        {
-          return flashstatus;
-        }
-      }
-      break;
-
-    case VALID_PAGE:
-      if (pagestatus1 == VALID_PAGE) /* Invalid state -> format eeprom */
-      {
-        /* Erase both Page0 and Page1 and set Page0 as valid page */
-        flashstatus = EE_Format();
-        /* If erase/program operation was failed, a Flash error code is returned */
-        if (flashstatus != HAL_OK)
-        {
-          return flashstatus;
-        }
-      }
-      else if (pagestatus1 == ERASED) /* Page0 valid, Page1 erased */
-      {
-        s_eraseinit.TypeErase   = FLASH_TYPEERASE_PAGES;
-        s_eraseinit.PageAddress = PAGE1_ID;
-        s_eraseinit.NbPages     = 1;
-        /* Erase Page1 */
-        if(!EE_VerifyPageFullyErased(PAGE1_BASE_ADDRESS))
-        {
-          flashstatus = HAL_FLASHEx_Erase(&s_eraseinit, &page_error);
-          /* If erase operation was failed, a Flash error code is returned */
-          if (flashstatus != HAL_OK)
-          {
-            return flashstatus;
-          }
-        }
-      }
-      else /* Page0 valid, Page1 receive */
-      {
-        /* Transfer data from Page0 to Page1 */
-        for (varidx = 0; varidx < NB_OF_VAR; varidx++)
-        {
-          if ((*(__IO uint16_t*)(PAGE1_BASE_ADDRESS + 6)) == VirtAddVarTab[varidx])
-          {
-            x = varidx;
-          }
-          if (varidx != x)
-          {
-            /* Read the last variables' updates */
-            readstatus = EE_ReadVariable(VirtAddVarTab[varidx], &DataVar);
-            /* In case variable corresponding to the virtual address was found */
-            if (readstatus != 0x1)
-            {
-              /* Transfer the variable to the Page1 */
-              eepromstatus = EE_VerifyPageFullWriteVariable(VirtAddVarTab[varidx], DataVar);
-              /* If program operation was failed, a Flash error code is returned */
-              if (eepromstatus != HAL_OK)
-              {
-                return eepromstatus;
-              }
-            }
-          }
-        }
-        /* Mark Page1 as valid */
-        flashstatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, PAGE1_BASE_ADDRESS, VALID_PAGE);
-        /* If program operation was failed, a Flash error code is returned */
-        if (flashstatus != HAL_OK)
-        {
-          return flashstatus;
-        }
-        s_eraseinit.TypeErase   = FLASH_TYPEERASE_PAGES;
-        s_eraseinit.PageAddress = PAGE0_ID;
-        s_eraseinit.NbPages     = 1;
-        /* Erase Page0 */
-        if(!EE_VerifyPageFullyErased(PAGE0_BASE_ADDRESS))
-        {
-          flashstatus = HAL_FLASHEx_Erase(&s_eraseinit, &page_error);
-          /* If erase operation was failed, a Flash error code is returned */
-          if (flashstatus != HAL_OK)
-          {
-            return flashstatus;
-          }
-        }
-      }
-      break;
-
-    default:  /* Any other state -> format eeprom */
-      /* Erase both Page0 and Page1 and set Page0 as valid page */
-      flashstatus = EE_Format();
-      /* If erase/program operation was failed, a Flash error code is returned */
-      if (flashstatus != HAL_OK)
-      {
-        return flashstatus;
-      }
-      break;
+    /* Power lost after a transfer, before the old page was erased: keep the page written last */
+    wear0 = EE_PageWear(PAGE0_BASE_ADDRESS);
+    wear1 = EE_PageWear(PAGE1_BASE_ADDRESS);
+    if (wear1 >= 0 && (wear0 < 0 || (int16_t)(wear1 - wear0) > 0))
+    {
+      page = PAGE1_BASE_ADDRESS;
+    }
+    else if (wear0 >= 0)
+    {
+      page = PAGE0_BASE_ADDRESS;
+    }
   }
-
-  return HAL_OK;
-}
-
-/**
-  * @brief  Verify if specified page is fully erased.
-  * @param  Address: page address
-  *   This parameter can be one of the following values:
-  *     @arg PAGE0_BASE_ADDRESS: Page0 base address
-  *     @arg PAGE1_BASE_ADDRESS: Page1 base address
-  * @retval page fully erased status:
-  *           - 0: if Page not erased
-  *           - 1: if Page erased
-  */
-uint16_t EE_VerifyPageFullyErased(uint32_t Address)
-{
-  uint32_t readstatus = 1;
-  uint16_t addressvalue = 0x5555;
-
-  /* Check each active page address starting from end */
-  while (Address <= PAGE0_END_ADDRESS)
+  else if (pagestatus0 == VALID_PAGE)
   {
-    /* Get the current location content to be compared with virtual address */
-    addressvalue = (*(__IO uint16_t*)Address);
-
-    /* Compare the read address with the virtual address */
-    if (addressvalue != ERASED)
+    page = PAGE0_BASE_ADDRESS;
+  }
+  else if (pagestatus1 == VALID_PAGE)
+  {
+    page = PAGE1_BASE_ADDRESS;
+  }
+  else if ((pagestatus0 == RECEIVE_DATA && pagestatus1 == ERASED) ||
+           (pagestatus1 == RECEIVE_DATA && pagestatus0 == ERASED))
+  {
+    /* Transfer of the original ST emulation complete, the old page was erased: mark the new page as valid */
+    page = (pagestatus0 == RECEIVE_DATA) ? PAGE0_BASE_ADDRESS : PAGE1_BASE_ADDRESS;
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, page, VALID_PAGE);
+    if (status != HAL_OK)
     {
+      return status;
+    }
+  }
 
-      /* In case variable value is read, reset readstatus flag */
-      readstatus = 0;
-
-      break;
+  if (page == 0)
+  {
+    /* First EEPROM access (Page0&1 are erased) or invalid state -> format EEPROM */
+    status = EE_Format();
+    if (status != HAL_OK)
+    {
+      return status;
     }
-    /* Next address location */
-    Address = Address + 4;
+    page = PAGE0_BASE_ADDRESS;
   }
 
-  /* Return readstatus value: (0: Page not erased, 1: Page erased) */
-  return readstatus;
+  /* The other page is erased, or holds an interrupted transfer or the previous copy: discard it */
+  status = EE_ErasePage(EE_OTHER_PAGE(page));
+  if (status != HAL_OK)
+  {
+    return status;
+  }
+
+  if (!EE_Scan(page))
+  {
+    /* Page written by the original ST emulation, without commit entries: convert it */
+    return EE_PageTransfer(NULL, NULL, -1, 0);
+  }
+  return HAL_OK;
 }
 
 /**
   * @brief  Returns the last stored variable data, if found, which correspond to
-  *   the passed virtual address
+  *   the passed virtual address. Reads the RAM index, no flash access.
   * @param  VirtAddress: Variable virtual address
   * @param  Data: Global variable contains the read variable value
   * @retval Success or error status:
   *           - 0: if variable was found
   *           - 1: if the variable was not found
-  *           - NO_VALID_PAGE: if no valid page was found.
+  *           - NO_VALID_PAGE: if no valid page was found (EE_Init not called or failed)
   */
 uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t* Data)
 {
-  uint16_t validpage = PAGE0;
-  uint16_t addressvalue = 0x5555, readstatus = 1;
-  uint32_t address = EEPROM_START_ADDRESS, PageStartAddress = EEPROM_START_ADDRESS;
-
-  /* Get active Page for read operation */
-  validpage = EE_FindValidPage(READ_FROM_VALID_PAGE);
+  int16_t idx;
 
-  /* Check if there is no valid page */
-  if (validpage == NO_VALID_PAGE)
+  if (eePage == 0)
   {
-    return  NO_VALID_PAGE;
+    return NO_VALID_PAGE;
   }
-
-  /* Get the valid Page start Address */
-  PageStartAddress = (uint32_t)(EEPROM_START_ADDRESS + (uint32_t)(validpage * PAGE_SIZE));
-
-  /* Get the valid Page end Address */
-  address = (uint32_t)((EEPROM_START_ADDRESS - 2) + (uint32_t)((1 + validpage) * PAGE_SIZE));
-
-  /* Check each active page address starting from end */
-  while (address > (PageStartAddress + 2))
+  idx = EE_Index(VirtAddress);
+  if (idx < 0 || !eeFound[idx])
   {
-    /* Get the current location content to be compared with virtual address */
-    addressvalue = (*(__IO uint16_t*)address);
-
-    /* Compare the read address with the virtual address */
-    if (addressvalue == VirtAddress)
-    {
-      /* Get content of Address-2 which is variable value */
-      *Data = (*(__IO uint16_t*)(address - 2));
-
-      /* In case variable value is read, reset readstatus flag */
-      readstatus = 0;
-
-      break;
-    }
-    else
-    {
-      /* Next address location */
-      address = address - 4;
-    }
+    return 1;
   }
-
-  /* Return readstatus value: (0: variable exist, 1: variable doesn't exist) */
-  return readstatus;
+  *Data = eeData[idx];
+  return 0;
 }
 
 /**
-  * @brief  Writes/upadtes variable data in EEPROM.
-  * @param  VirtAddress: Variable virtual address
+  * @brief  Writes/upadtes variable data in EEPROM. Nothing is written if the
+  *   variable already holds this value.
+  * @param  VirtAddress: Variable virtual address, one of VirtAddVarTab
   * @param  Data: 16 bit data to be written
   * @retval Success or error status:
-  *           - FLASH_COMPLETE: on success
-  *           - PAGE_FULL: if valid page is full
+  *           - HAL_OK: on success
+  *           - 1: if the virtual address is not in VirtAddVarTab
   *           - NO_VALID_PAGE: if no valid page was found
   *           - Flash error code: on write Flash error
   */
 uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data)
 {
-  uint16_t Status = 0;
+  int16_t idx;
 
-  /* Write the variable virtual address and value in the EEPROM */
-  Status = EE_VerifyPageFullWriteVariable(VirtAddress, Data);
-
-  /* In case the EEPROM active page is full */
-  if (Status == PAGE_FULL)
+  if (eePage == 0)
   {
-    /* Perform Page transfer */
-    Status = EE_PageTransfer(VirtAddress, Data);
+    return NO_VALID_PAGE;
   }
-
-  /* Return last operation status */
-  return Status;
+  idx = EE_Index(VirtAddress);
+  if (idx < 0)
+  {
+    return 1;
+  }
+  if (eeFound[idx] && eeData[idx] == Data)
+  {
+    eeStats.skipped++;
+    return HAL_OK;
+  }
+  return EE_Commit(NULL, NULL, idx, Data, 1);
 }
 
 /**
-  * @brief  Erases PAGE and PAGE1 and writes VALID_PAGE header to PAGE
-  * @param  None
-  * @retval Status of the last operation (Flash write or erase) done during
-  *         EEPROM formating
+  * @brief  Writes a whole configuration record: Data[i] is the value of
+  *   VirtAddVarTab[i], for all NB_OF_VAR variables. Only the changed values are
+  *   written, under one commit entry, so that after a power loss EE_Init
+  *   restores either all of them or none.
+  * @param  Data: NB_OF_VAR values
+  * @param  Valid: NB_OF_VAR flags, 0: Data[i] is not part of the record and the
+  *   variable keeps its stored value, or stays unwritten. NULL: all values valid
+  * @retval Success or error status, as EE_WriteVariable
   */
-static HAL_StatusTypeDef EE_Format(void)
+uint16_t EE_WriteRecord(const uint16_t* Data, const uint8_t* Valid)
 {
-  HAL_StatusTypeDef flashstatus = HAL_OK;
-  uint32_t page_error = 0;
-  FLASH_EraseInitTypeDef s_eraseinit;
+  uint16_t n = 0;
+  int16_t  idx;
 
-  s_eraseinit.TypeErase   = FLASH_TYPEERASE_PAGES;
-  s_eraseinit.PageAddress = PAGE0_ID;
-  s_eraseinit.NbPages     = 1;
-  /* Erase Page0 */
-  if(!EE_VerifyPageFullyErased(PAGE0_BASE_ADDRESS))
+  if (eePage == 0)
   {
-    flashstatus = HAL_FLASHEx_Erase(&s_eraseinit, &page_error);
-    /* If erase operation was failed, a Flash error code is returned */
-    if (flashstatus != HAL_OK)
+    return NO_VALID_PAGE;
+  }
+  for (idx = 0; idx < NB_OF_VAR; idx++)
+  {
+    if (EE_IN_RECORD(Data, Valid, idx) && (!eeFound[idx] || eeData[idx] != Data[idx]))
     {
-      return flashstatus;
+      n++;
     }
   }
-  /* Set Page0 as valid page: Write VALID_PAGE at Page0 base address */
-  flashstatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, PAGE0_BASE_ADDRESS, VALID_PAGE);
-  /* If program operation was failed, a Flash error code is returned */
-  if (flashstatus != HAL_OK)
+  eeStats.skipped += NB_OF_VAR - n;
+  if (n == 0)
   {
-    return flashstatus;
+    return HAL_OK;
   }
+  return EE_Commit(Data, Valid, -1, 0, n);
+}
 
-  s_eraseinit.PageAddress = PAGE1_ID;
-  /* Erase Page1 */
-  if(!EE_VerifyPageFullyErased(PAGE1_BASE_ADDRESS))
+/**
+  * @brief  Index of a virtual address in VirtAddVarTab. O(1) for a table of
+  *   consecutive addresses (params.h), a linear search otherwise.
+  * @param  VirtAddress: Variable virtual address
+  * @retval Index, or -1 if the address is not in the table
+  */
+static int16_t EE_Index(uint16_t VirtAddress)
+{
+  uint16_t idx = (uint16_t)(VirtAddress - VirtAddVarTab[0]);
+
+  if (idx < NB_OF_VAR && VirtAddVarTab[idx] == VirtAddress)
+  {
+    return idx;
+  }
+  for (idx = 0; idx < NB_OF_VAR; idx++)
   {
-    flashstatus = HAL_FLASHEx_Erase(&s_eraseinit, &page_error);
-    /* If erase operation was failed, a Flash error code is returned */
-    if (flashstatus != HAL_OK)
+    if (VirtAddVarTab[idx] == VirtAddress)
     {
-      return flashstatus;
+      return idx;
     }
   }
-
-  return HAL_OK;
+  return -1;
 }
 
 /**
-  * @brief  Find valid Page for write or read operation
-  * @param  Operation: operation to achieve on the valid page.
-  *   This parameter can be one of the following values:
-  *     @arg READ_FROM_VALID_PAGE: read operation from valid page
-  *     @arg WRITE_IN_VALID_PAGE: write operation from valid page
-  * @retval Valid page number (PAGE or PAGE1) or NO_VALID_PAGE in case
-  *   of no valid page was found
+  * @brief  Page transfers count of the wear entry of a page.
+  * @param  Page: base address of the page
+  * @retval Count, or -1 if the page does not start with a wear entry
   */
-static uint16_t EE_FindValidPage(uint8_t Operation)
+static int32_t EE_PageWear(uint32_t Page)
 {
-  uint16_t pagestatus0 = 6, pagestatus1 = 6;
+  uint32_t entry = EE_READ32(EE_ENTRY_ADDR(Page, 0));
 
-  /* Get Page0 actual status */
-  pagestatus0 = (*(__IO uint16_t*)PAGE0_BASE_ADDRESS);
+  if ((uint16_t)(entry >> 16) != EE_WEAR_VADDR)
+  {
+    return -1;
+  }
+  return (uint16_t)entry;
+}
 
-  /* Get Page1 actual status */
-  pagestatus1 = (*(__IO uint16_t*)PAGE1_BASE_ADDRESS);
+/**
+  * @brief  Build the RAM index from the log of the active page, in one pass.
+  *   The entries before a commit entry are applied, entries without a commit
+  *   (write interrupted by a power loss) are discarded.
+  * @param  Page: base address of the active page
+  * @retval 1 for a log page, 0 for a page of the original ST emulation (entries
+  *   applied on their own, no commit entries)
+  */
+static uint8_t EE_Scan(uint32_t Page)
+{
+  uint32_t entry;
+  uint16_t pos, k, n;
+  uint16_t end, first;                  /* first: first entry not committed yet */
+  uint16_t vaddr;
+  int16_t  idx;
+  int32_t  wear;
+  uint8_t  log;
+
+  for (idx = 0; idx < NB_OF_VAR; idx++)
+  {
+    eeFound[idx] = 0;
+  }
+  wear = EE_PageWear(Page);
+  log  = (wear >= 0);
+  eeStats.transfers = log ? (uint16_t)wear : 0;
+  end   = log;                          /* entry 0 of a log page is the wear entry */
+  first = log;
 
-  /* Write or read operation */
-  switch (Operation)
+  for (pos = log; pos < EE_ENTRIES; pos++)
   {
-    case WRITE_IN_VALID_PAGE:   /* ---- Write operation ---- */
-      if (pagestatus1 == VALID_PAGE)
+    entry = EE_READ32(EE_ENTRY_ADDR(Page, pos));
+    if (entry == EE_ENTRY_FREE)
+    {
+      continue;
+    }
+    end   = pos + 1;
+    vaddr = (uint16_t)(entry >> 16);
+
+    if (!log)
+    {
+      /* Entries without virtual address (power lost between the two halfwords) do not match */
+      if ((idx = EE_Index(vaddr)) >= 0)
       {
-        /* Page0 receiving data */
-        if (pagestatus0 == RECEIVE_DATA)
-        {
-          return PAGE0;         /* Page0 valid */
-        }
-        else
-        {
-          return PAGE1;         /* Page1 valid */
-        }
+        eeData[idx]  = (uint16_t)entry;
+        eeFound[idx] = 1;
       }
-      else if (pagestatus0 == VALID_PAGE)
+    }
+    else if (vaddr == EE_COMMIT_VADDR)
+    {
+      /* Apply the n entries before the commit, discard older entries left without commit */
+      n = (uint16_t)entry;
+      if (n <= pos - first)
       {
-        /* Page1 receiving data */
-        if (pagestatus1 == RECEIVE_DATA)
+        for (k = pos - n; k < pos; k++)
         {
-          return PAGE1;         /* Page1 valid */
-        }
-        else
-        {
-          return PAGE0;         /* Page0 valid */
+          entry = EE_READ32(EE_ENTRY_ADDR(Page, k));
+          if ((idx = EE_Index((uint16_t)(entry >> 16))) >= 0)
+          {
+            eeData[idx]  = (uint16_t)entry;
+            eeFound[idx] = 1;
+          }
         }
       }
-      else
+      if (n != pos - first)
       {
-        return NO_VALID_PAGE;   /* No valid Page */
+        eeStats.torn++;
       }
+      first = pos + 1;
+    }
+  }
+  if (log && first < end)
+  {
+    eeStats.torn++;                     /* last write interrupted */
+  }
 
-    case READ_FROM_VALID_PAGE:  /* ---- Read operation ---- */
-      if (pagestatus0 == VALID_PAGE)
-      {
-        return PAGE0;           /* Page0 valid */
-      }
-      else if (pagestatus1 == VALID_PAGE)
-      {
-        return PAGE1;           /* Page1 valid */
-      }
-      else
-      {
-        return NO_VALID_PAGE ;  /* No valid Page */
-      }
+  eePage       = Page;
+  eeNext       = end;
+  eeStats.used = end;
+  return log;
+}
 
-    default:
-      return PAGE0;             /* Page0 valid */
+/**
+  * @brief  Erases Page0 and writes its wear entry, then marks it VALID_PAGE.
+  * @param  None
+  * @retval HAL_OK or the Flash error code
+  */
+static uint16_t EE_Format(void)
+{
+  uint16_t status;
+
+  status = EE_ErasePage(PAGE0_BASE_ADDRESS);
+  if (status == HAL_OK)
+  {
+    eePage = PAGE0_BASE_ADDRESS;
+    eeNext = 0;
+    eeStats.transfers = 0;
+    status = EE_ProgramEntry(EE_WEAR_VADDR, 0);
+  }
+  if (status == HAL_OK)
+  {
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, PAGE0_BASE_ADDRESS, VALID_PAGE);
   }
+  eePage = 0;
+  return status;
 }
 
 /**
-  * @brief  Verify if active page is full and Writes variable in EEPROM.
-  * @param  VirtAddress: 16 bit virtual address of the variable
-  * @param  Data: 16 bit data to be written as variable value
-  * @retval Success or error status:
-  *           - FLASH_COMPLETE: on success
-  *           - PAGE_FULL: if valid page is full
-  *           - NO_VALID_PAGE: if no valid page was found
-  *           - Flash error code: on write Flash error
+  * @brief  Erase a page, if it is not erased already.
+  * @param  Page: base address of the page
+  * @retval HAL_OK or the Flash error code
   */
-static uint16_t EE_VerifyPageFullWriteVariable(uint16_t VirtAddress, uint16_t Data)
+static uint16_t EE_ErasePage(uint32_t Page)
 {
-  HAL_StatusTypeDef flashstatus = HAL_OK;
-  uint16_t validpage = PAGE0;
-  uint32_t address = EEPROM_START_ADDRESS, pageendaddress = EEPROM_START_ADDRESS+PAGE_SIZE;
-
-  /* Get valid Page for write operation */
-  validpage = EE_FindValidPage(WRITE_IN_VALID_PAGE);
+  uint32_t page_error = 0;
+  FLASH_EraseInitTypeDef s_eraseinit;
 
-  /* Check if there is no valid page */
-  if (validpage == NO_VALID_PAGE)
+  if (EE_VerifyPageFullyErased(Page))
   {
-    return  NO_VALID_PAGE;
+    return HAL_OK;
   }
+  s_eraseinit.TypeErase   = FLASH_TYPEERASE_PAGES;
+  s_eraseinit.PageAddress = Page;
+  s_eraseinit.NbPages     = 1;
+  return HAL_FLASHEx_Erase(&s_eraseinit, &page_error);
+}
 
-  /* Get the valid Page start address */
-  address = (uint32_t)(EEPROM_START_ADDRESS + (uint32_t)(validpage * PAGE_SIZE));
-
-  /* Get the valid Page end address */
-  pageendaddress = (uint32_t)((EEPROM_START_ADDRESS - 1) + (uint32_t)((validpage + 1) * PAGE_SIZE));
+/**
+  * @brief  Verify if specified page is fully erased.
+  * @param  Address: page address
+  *   This parameter can be one of the following values:
+  *     @arg PAGE0_BASE_ADDRESS: Page0 base address
+  *     @arg PAGE1_BASE_ADDRESS: Page1 base address
+  * @retval page fully erased status:
+  *           - 0: if Page not erased
+  *           - 1: if Page erased
+  */
+static uint16_t EE_VerifyPageFullyErased(uint32_t Address)
+{
+  uint32_t end = Address + PAGE_SIZE;
 
-  /* Check each active page address starting from begining */
-  while (address < pageendaddress)
+  while (Address < end)
   {
-    /* Verify if address and address+2 contents are 0xFFFFFFFF */
-    if ((*(__IO uint32_t*)address) == 0xFFFFFFFF)
-    {
-      /* Set variable data */
-      flashstatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address, Data);
-      /* If program operation was failed, a Flash error code is returned */
-      if (flashstatus != HAL_OK)
-      {
-        return flashstatus;
-      }
-      /* Set variable virtual address */
-      flashstatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address + 2, VirtAddress);       
-      /* Return program operation status */
-      return flashstatus;
-    }
-    else
+    if (EE_READ32(Address) != EE_ENTRY_FREE)
     {
-      /* Next address location */
-      address = address + 4;
+      return 0;
     }
+    Address = Address + 4;
   }
-
-  /* Return PAGE_FULL in case the valid page is full */
-  return PAGE_FULL;
+  return 1;
 }
 
 /**
-  * @brief  Transfers last updated variables data from the full Page to
-  *   an empty one.
+  * @brief  Append one entry to the active page: the data first, then the
+  *   virtual address.
   * @param  VirtAddress: 16 bit virtual address of the variable
   * @param  Data: 16 bit data to be written as variable value
-  * @retval Success or error status:
-  *           - FLASH_COMPLETE: on success
-  *           - PAGE_FULL: if valid page is full
-  *           - NO_VALID_PAGE: if no valid page was found
-  *           - Flash error code: on write Flash error
+  * @retval HAL_OK, PAGE_FULL or the Flash error code
   */
-static uint16_t EE_PageTransfer(uint16_t VirtAddress, uint16_t Data)
+static uint16_t EE_ProgramEntry(uint16_t VirtAddress, uint16_t Data)
 {
-  HAL_StatusTypeDef flashstatus = HAL_OK;
-  uint32_t newpageaddress = EEPROM_START_ADDRESS;
-  uint32_t oldpageid = 0;
-  uint16_t validpage = PAGE0, varidx = 0;
-  uint16_t eepromstatus = 0, readstatus = 0;
-  uint32_t page_error = 0;
-  FLASH_EraseInitTypeDef s_eraseinit;
+  uint16_t status;
+  uint32_t address;
+
+  if (eeNext >= EE_ENTRIES)
+  {
+    return PAGE_FULL;
+  }
+  address = EE_ENTRY_ADDR(eePage, eeNext);
+  eeNext++;                             /* a failed entry is skipped, not written twice */
+  eeStats.used = eeNext;
 
-  /* Get active Page for read operation */
-  validpage = EE_FindValidPage(READ_FROM_VALID_PAGE);
+  status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address, Data);
+  if (status == HAL_OK)
+  {
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address + 2, VirtAddress);
+  }
+  eeStats.writes++;
+  return status;
+}
+
+/**
+  * @brief  Appends the changed values and their commit entry to the active
+  *   page, or transfers the page if they do not fit.
+  * @param  Data: NB_OF_VAR values of a record, or NULL
+  * @param  Valid: values of Data that are part of the record, NULL: all
+  * @param  Index: index of a single variable being written, if Data is NULL
+  * @param  Value: value of that variable
+  * @param  Count: number of values that differ from the RAM index
+  * @retval HAL_OK or the Flash error code
+  */
+static uint16_t EE_Commit(const uint16_t* Data, const uint8_t* Valid, int16_t Index, uint16_t Value, uint16_t Count)
+{
+  uint16_t status = HAL_OK;
+  int16_t  idx;
 
-  if (validpage == PAGE1)       /* Page1 valid */
+  if (eeNext + Count + 1 > EE_ENTRIES)
   {
-    /* New page address where variable will be moved to */
-    newpageaddress = PAGE0_BASE_ADDRESS;
+    /* Active page full: transfer the variables with the new values to the other page */
+    return EE_PageTransfer(Data, Valid, Index, Value);
+  }
 
-    /* Old page ID where variable will be taken from */
-    oldpageid = PAGE1_ID;
+  if (Data == NULL)
+  {
+    status = EE_ProgramEntry(VirtAddVarTab[Index], Value);
   }
-  else if (validpage == PAGE0)  /* Page0 valid */
+  for (idx = 0; Data != NULL && idx < NB_OF_VAR && status == HAL_OK; idx++)
   {
-    /* New page address  where variable will be moved to */
-    newpageaddress = PAGE1_BASE_ADDRESS;
+    if (EE_IN_RECORD(Data, Valid, idx) && (!eeFound[idx] || eeData[idx] != Data[idx]))
+    {
+      status = EE_ProgramEntry(VirtAddVarTab[idx], Data[idx]);
+    }
+  }
+  if (status == HAL_OK)
+  {
+    status = EE_ProgramEntry(EE_COMMIT_VADDR, Count);
+  }
+  if (status != HAL_OK)
+  {
+    return status;
+  }
 
-    /* Old page ID where variable will be taken from */
-    oldpageid = PAGE0_ID;
+  /* Committed: update the index */
+  if (Data == NULL)
+  {
+    eeData[Index]  = Value;
+    eeFound[Index] = 1;
   }
-  else
+  for (idx = 0; Data != NULL && idx < NB_OF_VAR; idx++)
   {
-    return NO_VALID_PAGE;       /* No valid Page */
+    if (EE_IN_RECORD(Data, Valid, idx))
+    {
+      eeData[idx]  = Data[idx];
+      eeFound[idx] = 1;
+    }
   }
+  return HAL_OK;
+}
+
+/**
+  * @brief  Transfers the last values of all variables from the full page to
+  *   the other one, merged with the values being written.
+  *   The new page is marked RECEIVE_DATA, filled, committed and marked
+  *   VALID_PAGE, then the old page is erased. Until then EE_Init keeps the old
+  *   page, or the new one if both are valid (higher transfer count).
+  * @param  Data: NB_OF_VAR values of a record, or NULL
+  * @param  Valid: values of Data that are part of the record, NULL: all
+  * @param  Index: index of a single variable being written, or -1
+  * @param  Value: value of that variable
+  * @retval Success or error status:
+  *           - HAL_OK: on success
+  *           - Flash error code: on write Flash error
+  */
+static uint16_t EE_PageTransfer(const uint16_t* Data, const uint8_t* Valid, int16_t Index, uint16_t Value)
+{
+  uint16_t status;
+  uint32_t oldpage = eePage;
+  uint32_t newpage = EE_OTHER_PAGE(eePage);
+  uint16_t oldnext = eeNext;
+  uint16_t value, n = 0;
+  int16_t  idx;
 
   /* Set the new Page status to RECEIVE_DATA status */
-  flashstatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, newpageaddress, RECEIVE_DATA);
-  /* If program operation was failed, a Flash error code is returned */
-  if (flashstatus != HAL_OK)
+  status = EE_ErasePage(newpage);
+  if (status == HAL_OK)
   {
-    return flashstatus;
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, newpage, RECEIVE_DATA);
   }
-
-  /* Write the variable passed as parameter in the new active page */
-  eepromstatus = EE_VerifyPageFullWriteVariable(VirtAddress, Data);
-  /* If program operation was failed, a Flash error code is returned */
-  if (eepromstatus != HAL_OK)
+  if (status == HAL_OK)
   {
-    return eepromstatus;
+    eePage = newpage;
+    eeNext = 0;
+    status = EE_ProgramEntry(EE_WEAR_VADDR, eeStats.transfers + 1);
   }
 
-  /* Transfer process: transfer variables from old to the new active page */
-  for (varidx = 0; varidx < NB_OF_VAR; varidx++)
+  /* Write the merged values to the new page */
+  for (idx = 0; idx < NB_OF_VAR && status == HAL_OK; idx++)
   {
-    if (VirtAddVarTab[varidx] != VirtAddress)  /* Check each variable except the one passed as parameter */
+    if (EE_IN_RECORD(Data, Valid, idx))
     {
-      /* Read the other last variable updates */
-      readstatus = EE_ReadVariable(VirtAddVarTab[varidx], &DataVar);
-      /* In case variable corresponding to the virtual address was found */
-      if (readstatus != 0x1)
-      {
-        /* Transfer the variable to the new active page */
-        eepromstatus = EE_VerifyPageFullWriteVariable(VirtAddVarTab[varidx], DataVar);
-        /* If program operation was failed, a Flash error code is returned */
-        if (eepromstatus != HAL_OK)
-        {
-          return eepromstatus;
-        }
-      }
+      value = Data[idx];
+    }
+    else if (idx == Index)
+    {
+      value = Value;
     }
+    else if (eeFound[idx])
+    {
+      value = eeData[idx];
+    }
+    else
+    {
+      continue;
+    }
+    status = EE_ProgramEntry(VirtAddVarTab[idx], value);
+    n++;
   }
-
-  s_eraseinit.TypeErase   = FLASH_TYPEERASE_PAGES;
-  s_eraseinit.PageAddress = oldpageid;
-  s_eraseinit.NbPages     = 1;
-
-  /* Erase the old Page: Set old Page status to ERASED status */
-  flashstatus = HAL_FLASHEx_Erase(&s_eraseinit, &page_error);
-  /* If erase operation was failed, a Flash error code is returned */
-  if (flashstatus != HAL_OK)
+  if (status == HAL_OK)
   {
-    return flashstatus;
+    status = EE_ProgramEntry(EE_COMMIT_VADDR, n);
   }
 
   /* Set new Page status to VALID_PAGE status */
-  flashstatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, newpageaddress, VALID_PAGE);
-  /* If program operation was failed, a Flash error code is returned */
-  if (flashstatus != HAL_OK)
+  if (status == HAL_OK)
   {
-    return flashstatus;
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, newpage, VALID_PAGE);
+  }
+  if (status != HAL_OK)
+  {
+    /* The old page is still the valid one */
+    eePage = oldpage;
+    eeNext = oldnext;
+    eeStats.used = oldnext;
+    return status;
   }
 
+  eeStats.transfers++;
+  for (idx = 0; idx < NB_OF_VAR; idx++)
+  {
+    if (EE_IN_RECORD(Data, Valid, idx))
+    {
+      eeData[idx]  = Data[idx];
+      eeFound[idx] = 1;
+    }
+    else if (idx == Index)
+    {
+      eeData[idx]  = Value;
+      eeFound[idx] = 1;
+    }
+  }
 
-
-  /* Return last operation flash status */
-  return flashstatus;
+  /* Erase the old Page */
+  return EE_ErasePage(oldpage);
 }
 
 /**
@@ -11,12 +11,9 @@ uint32_t PCF8574_Type0Pins[8] = { 4, 5, 6, 7, 0, 1, 2, 3 };
 uint8_t LCDerrorFlag = 0;
 
 void LCD_WaitForBusyFlag(LCD_PCF8574_HandleTypeDef* handle) {
-	uint8_t flag;
-	LCD_GetBusyFlag(handle, &flag);
-	//uint32_t startTick=HAL_GetTick();
-	//while (flag == 1 && HAL_GetTick()-startTick<handle->pcf8574.PCF_I2C_TIMEOUT) {
-	//	LCD_GetBusyFlag(handle, &flag);
-	//}
+	// No busy flag read: the next command needs at least two port writes before
+	// its E pulse, over 180 us at 100 kHz, longer than the 37/43 us execution time.
+	// The slow commands (clear, init) add a bus hold with PCF8574_Delay()
 	return;
 }
 
@@ -70,30 +67,30 @@ LCD_RESULT LCD_Init(LCD_PCF8574_HandleTypeDef* handle) {
 	LCD_WriteToDataBus(handle, 3);
 
 	LCD_StateWriteBit(handle, 1, LCD_PIN_E);
-	HAL_Delay(1);
+	PCF8574_Delay(&handle->pcf8574, 1);
 	LCD_StateWriteBit(handle, 0, LCD_PIN_E);
-	HAL_Delay(5);
+	PCF8574_Delay(&handle->pcf8574, 5);
 
 	LCD_WriteToDataBus(handle, 3);
 
 	LCD_StateWriteBit(handle, 1, LCD_PIN_E);
-	HAL_Delay(1);
+	PCF8574_Delay(&handle->pcf8574, 1);
 	LCD_StateWriteBit(handle, 0, LCD_PIN_E);
-	HAL_Delay(1);
+	PCF8574_Delay(&handle->pcf8574, 1);
 
 	LCD_WriteToDataBus(handle, 3);
 
 	LCD_StateWriteBit(handle, 1, LCD_PIN_E);
-	HAL_Delay(1);
+	PCF8574_Delay(&handle->pcf8574, 1);
 	LCD_StateWriteBit(handle, 0, LCD_PIN_E);
-	HAL_Delay(1);
+	PCF8574_Delay(&handle->pcf8574, 1);
 
 	LCD_WriteToDataBus(handle, 2);
 
 	LCD_StateWriteBit(handle, 1, LCD_PIN_E);
-	HAL_Delay(1);
+	PCF8574_Delay(&handle->pcf8574, 1);
 	LCD_StateWriteBit(handle, 0, LCD_PIN_E);
-	HAL_Delay(1);
+	PCF8574_Delay(&handle->pcf8574, 1);
 
 	uint8_t cmd = 0;
 	cmd = cmd | (handle->NUMBER_OF_LINES << 3);
@@ -239,7 +236,9 @@ LCD_RESULT LCD_WriteString(LCD_PCF8574_HandleTypeDef* handle, char *s) {
 }
 
 LCD_RESULT LCD_ClearDisplay(LCD_PCF8574_HandleTypeDef* handle) {
-	return LCD_WriteCMD(handle, 1);
+	LCD_RESULT res = LCD_WriteCMD(handle, 1);
+	PCF8574_Delay(&handle->pcf8574, 2);	// clear takes 1.52 ms
+	return res;
 }
 
 LCD_RESULT LCD_DisplayON(LCD_PCF8574_HandleTypeDef* handle) {
@@ -0,0 +1,238 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Interrupt driven transfer queue on I2C2, see i2cbus.h
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Includes
+#include <stddef.h>
+#include <string.h>
+#include "stm32f1xx_hal.h"
+#include "config.h"
+#include "defines.h"
+#include "i2cbus.h"
+
+extern I2C_HandleTypeDef hi2c2;
+
+typedef struct {
+  uint8_t  addr;                        // 8-bit device address
+  uint8_t  len;                         // [bytes]
+  uint8_t  hold;                        // [ms] bus idle time before the start
+  uint8_t  *rx;                         // read destination, NULL: write of data[]
+  volatile uint8_t *pend;               // transaction counter, NULL: none
+  uint8_t  data[I2C_JOB_DATA];
+} I2CJob;
+
+// The main loop fills the queue at jobTail, the I2C2 interrupts (priority 1, below the motor ISR) run it from jobHead.
+// SysTick only pends I2C2_ER_IRQn, so the queue is never touched by two interrupts at once
+static I2CJob           jobs[I2C_QUEUE];
+static volatile uint8_t jobHead;
+static volatile uint8_t jobTail;
+static uint8_t          jobRunning;     // head job is on the bus
+static uint32_t         jobIdle;        // [ms] HAL tick at the end of the last transfer
+static uint32_t         jobStart;       // [ms] HAL tick at the start of the head job
+static volatile uint8_t i2cRecover;     // timeout: interrupts off until i2cPoll() has recovered the bus
+
+
+/* =========================== Interrupt Context =========================== */
+
+static void i2cEnd(uint8_t ok) {
+  volatile uint8_t *pend = jobs[jobHead].pend;
+
+  if (pend && *pend != I2C_FAIL) {
+    *pend = ok ? *pend - 1 : I2C_FAIL;
+  }
+  jobHead    = (jobHead + 1) & (I2C_QUEUE - 1);
+  jobRunning = 0;
+  jobIdle    = HAL_GetTick();
+}
+
+// Lost interrupt or a device holding the bus: drop the job and leave the reset to the main loop
+static void i2cFail(void) {
+  i2cEnd(0);
+  i2cRecover = 1;
+  HAL_NVIC_DisableIRQ(I2C2_EV_IRQn);
+  HAL_NVIC_DisableIRQ(I2C2_ER_IRQn);
+}
+
+// Start the head job if it is due and the bus is free, else check the timeout.
+// A start right after a transfer finds its stop condition still on the bus, the next tick retries
+static void i2cStart(void) {
+  HAL_StatusTypeDef res;
+  uint32_t now = HAL_GetTick();
+
+  while (!i2cRecover && jobHead != jobTail) {
+    I2CJob *j = &jobs[jobHead];
+    if (jobRunning) {
+      if (now - jobStart > I2C_TIMEOUT_MS) {
+        i2cFail();
+      }
+      return;
+    }
+    if (now - jobIdle <= j->hold) {
+      return;
+    }
+    if (__HAL_I2C_GET_FLAG(&hi2c2, I2C_FLAG_BUSY)) {
+      if (now - jobIdle > j->hold + I2C_TIMEOUT_MS) {
+        i2cFail();
+      }
+      return;
+    }
+    jobRunning = 1;
+    jobStart   = now;
+    if (j->rx) {
+      res = HAL_I2C_Master_Receive_IT(&hi2c2, j->addr, j->rx, j->len);
+    } else {
+      res = HAL_I2C_Master_Transmit_IT(&hi2c2, j->addr, j->data, j->len);
+    }
+    if (res != HAL_OK) {
+      i2cEnd(0);
+    }
+  }
+}
+
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c) {
+  if (jobRunning) {
+    i2cEnd(1);
+  }
+  i2cStart();
+}
+
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+  if (jobRunning) {
+    i2cEnd(1);
+  }
+  i2cStart();
+}
+
+// NACK, bus or arbitration error: the HAL has released the bus, drop the job
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+  if (jobRunning) {                     // not an error left over from a bus recovery
+    i2cEnd(0);
+  }
+  i2cStart();
+}
+
+// I2C2 error interrupt: bus errors, and the ms tick pended by i2cTick()
+void i2cErrorIrq(void) {
+  if (__HAL_I2C_GET_FLAG(&hi2c2, I2C_FLAG_BERR) || __HAL_I2C_GET_FLAG(&hi2c2, I2C_FLAG_ARLO) ||
+      __HAL_I2C_GET_FLAG(&hi2c2, I2C_FLAG_AF)   || __HAL_I2C_GET_FLAG(&hi2c2, I2C_FLAG_OVR)) {
+    HAL_I2C_ER_IRQHandler(&hi2c2);
+  }
+  i2cStart();
+}
+
+// Call every ms from SysTick: the holds and the timeout are checked at the I2C priority
+void i2cTick(void) {
+  if (jobHead != jobTail && !i2cRecover) {
+    HAL_NVIC_SetPendingIRQ(I2C2_ER_IRQn);
+  }
+}
+
+
+/* =========================== Main Loop Context =========================== */
+
+static void i2cDelayUs(uint32_t us) {
+  uint32_t start = DWT->CYCCNT;
+  while (DWT->CYCCNT - start < us * (SystemCoreClock / 1000000U));
+}
+
+// Bus recovery after a timeout: up to 9 SCL clocks until a device holding SDA low lets go of it,
+// then a stop condition and a reset of the peripheral. Call from the main loop
+void i2cPoll(void) {
+  GPIO_InitTypeDef GPIO_InitStruct;
+
+  if (!i2cRecover) {
+    return;
+  }
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;   // enable the trace block, needed for the DWT
+  DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;       // start the cycle counter
+
+  HAL_GPIO_WritePin(GPIOB, I2C_SCL_PIN | I2C_SDA_PIN, GPIO_PIN_SET);
+  GPIO_InitStruct.Pin   = I2C_SCL_PIN | I2C_SDA_PIN;
+  GPIO_InitStruct.Mode  = GPIO_MODE_OUTPUT_OD;
+  GPIO_InitStruct.Pull  = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+  for (uint8_t i = 0; i < 9 && !HAL_GPIO_ReadPin(GPIOB, I2C_SDA_PIN); i++) {
+    HAL_GPIO_WritePin(GPIOB, I2C_SCL_PIN, GPIO_PIN_RESET);
+    i2cDelayUs(I2C_RECOVER_US);
+    HAL_GPIO_WritePin(GPIOB, I2C_SCL_PIN, GPIO_PIN_SET);
+    i2cDelayUs(I2C_RECOVER_US);
+  }
+  HAL_GPIO_WritePin(GPIOB, I2C_SDA_PIN, GPIO_PIN_RESET);   // stop: SDA rises while SCL is high
+  i2cDelayUs(I2C_RECOVER_US);
+  HAL_GPIO_WritePin(GPIOB, I2C_SDA_PIN, GPIO_PIN_SET);
+  i2cDelayUs(I2C_RECOVER_US);
+
+  I2C_Init();                           // back to the peripheral, enables the interrupts again
+  __disable_irq();
+  jobIdle    = HAL_GetTick();
+  i2cRecover = 0;
+  __enable_irq();
+}
+
+// Append a job, a write right after a write to the same device goes into the same transfer.
+// Waits while the queue is full: the interrupts drain it, a dead bus is recovered here after I2C_TIMEOUT_MS
+static uint8_t i2cQueue(uint8_t addr, const uint8_t *data, uint8_t *rx, uint8_t len, uint8_t hold, volatile uint8_t *pend) {
+  I2CJob  *j;
+  uint8_t  last, next;
+
+  if (len == 0 || len > I2C_JOB_DATA || hi2c2.State == HAL_I2C_STATE_RESET) {
+    return 0;
+  }
+  while (1) {
+    __disable_irq();
+    last = (jobTail - 1) & (I2C_QUEUE - 1);
+    next = (jobTail + 1) & (I2C_QUEUE - 1);
+    j    = &jobs[last];
+    if (!rx && !pend && !hold && jobTail != jobHead && !(last == jobHead && jobRunning) &&
+        !j->rx && !j->pend && j->addr == addr && j->len + len <= I2C_JOB_DATA) {
+      memcpy(&j->data[j->len], data, len);
+      j->len += len;
+      break;
+    }
+    if (next != jobHead) {
+      j       = &jobs[jobTail];
+      j->addr = addr;
+      j->len  = len;
+      j->hold = hold;
+      j->rx   = rx;
+      j->pend = pend;
+      if (!rx) {
+        memcpy(j->data, data, len);
+      }
+      jobTail = next;
+      break;
+    }
+    __enable_irq();
+    i2cPoll();
+  }
+  __enable_irq();
+  return 1;
+}
+
+// Queue a write of len bytes. Returns 0 if the bus is not initialised or len is out of range
+uint8_t i2cWrite(uint8_t addr, const uint8_t *data, uint8_t len, uint8_t hold, volatile uint8_t *pend) {
+  return i2cQueue(addr, data, NULL, len, hold, pend);
+}
+
+// Queue a read of len bytes into rx, rx must stay valid until the transaction is over
+uint8_t i2cRead(uint8_t addr, uint8_t *rx, uint8_t len, uint8_t hold, volatile uint8_t *pend) {
+  return i2cQueue(addr, NULL, rx, len, hold, pend);
+}
+
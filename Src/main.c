@@ -30,6 +30,12 @@
 #include "BLDC_controller.h"      /* BLDC's header file */
 #include "rtwtypes.h"
 #include "comms.h"
+#include "params.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include "scope.h"
+#include "sched.h"
+#include "i2cbus.h"
 
 #if defined(DEBUG_I2C_LCD) || defined(SUPPORT_LCD)
 #include "hd44780.h"
@@ -81,15 +87,12 @@ extern volatile int pwml;               // global variable for pwm left. -1000 t
 extern volatile int pwmr;               // global variable for pwm right. -1000 to 1000
 
 extern uint8_t enable;                  // global variable for motor enable
+extern uint8_t  isrErrCode;             // latched motor ISR diagnostics
+extern uint32_t isrOverrunCnt;          // number of control periods lost to an overrun
+extern uint8_t  adcOffsetState;         // ADC offset calibration, ADC_OFFSET_ states in defines.h
 
 extern int16_t batVoltage;              // global variable for battery voltage
 
-#if defined(SIDEBOARD_SERIAL_USART2)
-extern SerialSideboard Sideboard_L;
-#endif
-#if defined(SIDEBOARD_SERIAL_USART3)
-extern SerialSideboard Sideboard_R;
-#endif
 #if (defined(CONTROL_PPM_LEFT) && defined(DEBUG_SERIAL_USART3)) || (defined(CONTROL_PPM_RIGHT) && defined(DEBUG_SERIAL_USART2))
 extern volatile uint16_t ppm_captured_value[PPM_NUM_CHANNELS+1];
 #endif
@@ -112,29 +115,13 @@ int16_t right_dc_curr;           // global variable for Right DC Link current
 int16_t dc_curr;                 // global variable for Total DC Link current 
 int16_t cmdL;                    // global variable for Left Command 
 int16_t cmdR;                    // global variable for Right Command 
+uint16_t bootTime;               // [ms] from reset to the motors enabled, 0 until then
 
 //------------------------------------------------------------------------
 // Local variables
 //------------------------------------------------------------------------
 #if defined(FEEDBACK_SERIAL_USART2) || defined(FEEDBACK_SERIAL_USART3)
-typedef struct{
-  uint16_t  start;
-  int16_t   cmd1;
-  int16_t   cmd2;
-  int16_t   speedR_meas;
-  int16_t   speedL_meas;
-  int16_t   batVoltage;
-  int16_t   boardTemp;
-  uint16_t  cmdLed;
-  uint16_t  checksum;
-} SerialFeedback;
-static SerialFeedback Feedback;
-#endif
-#if defined(FEEDBACK_SERIAL_USART2)
-static uint8_t sideboard_leds_L;
-#endif
-#if defined(FEEDBACK_SERIAL_USART3)
-static uint8_t sideboard_leds_R;
+static SerialFeedback Feedback;         // common part of the feedback, each port adds its sideboard LEDs and checksum
 #endif
 
 #ifdef VARIANT_TRANSPOTTER
@@ -158,8 +145,12 @@ static int16_t    speed;                // local variable for speed. -1000 to 10
   static int32_t  speedFixdt;           // local fixed-point variable for speed low-pass filter
 #endif
 
-static uint32_t    buzzerTimer_prev = 0;
+#if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+static uint8_t     isrOverrunReported;  // print the overrun message once per latch
+#endif
 static uint32_t    inactivity_timeout_counter;
+static int32_t     board_temp_adcFixdt; // Fixed-point filter output of the board temperature
+static int16_t     board_temp_adcFilt;
 static MultipleTap MultipleTapBrake;    // define multiple tap functionality for the Brake pedal
 
 static uint16_t rate = RATE; // Adjustable rate to support multiple drive modes on startup
@@ -169,6 +160,44 @@ static uint16_t rate = RATE; // Adjustable rate to support multiple drive modes
   static uint16_t max_speed;
 #endif
 
+//------------------------------------------------------------------------
+// Main loop tasks, see sched.h
+//------------------------------------------------------------------------
+#define TEMP_TASK_PERIOD  100                                                             // [ms]
+#define TEMP_TASK_COEF    MIN(TEMP_FILT_COEF * TEMP_TASK_PERIOD / DELAY_IN_MAIN_LOOP, 65535)  // same time constant as TEMP_FILT_COEF every loop
+
+static void taskControl(void);
+static void taskTemp(void);
+#if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+#if defined(DEBUG_SCOPE) || defined(DEBUG_SERIAL_TELEMETRY) || defined(DEBUG_SERIAL_BINARY)
+static void taskComms(void);
+#endif
+static void taskDebug(void);
+#endif
+#if defined(VARIANT_TRANSPOTTER) && defined(SUPPORT_LCD)
+static void taskLcd(void);
+#endif
+#ifdef PARAM_EEPROM
+static void taskSave(void);
+#endif
+
+static SchedTask tasks[TASK_COUNT] = {
+  [TASK_CONTROL] = SCHED_TASK(taskControl, DELAY_IN_MAIN_LOOP),
+  #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+  #if defined(DEBUG_SCOPE) || defined(DEBUG_SERIAL_TELEMETRY) || defined(DEBUG_SERIAL_BINARY)
+  [TASK_COMMS]   = SCHED_TASK(taskComms, 1),
+  #endif
+  [TASK_DEBUG]   = SCHED_TASK(taskDebug, 125),
+  #endif
+  [TASK_TEMP]    = SCHED_TASK(taskTemp, TEMP_TASK_PERIOD),
+  #if defined(VARIANT_TRANSPOTTER) && defined(SUPPORT_LCD)
+  [TASK_LCD]     = SCHED_TASK(taskLcd, 100 * DELAY_IN_MAIN_LOOP),
+  #endif
+  #ifdef PARAM_EEPROM
+  [TASK_SAVE]    = SCHED_TASK(taskSave, 0),
+  #endif
+};
+
 
 int main(void) {
 
@@ -188,8 +217,8 @@ int main(void) {
   HAL_NVIC_SetPriority(DebugMonitor_IRQn, 0, 0);
   /* PendSV_IRQn interrupt configuration */
   HAL_NVIC_SetPriority(PendSV_IRQn, 0, 0);
-  /* SysTick_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(SysTick_IRQn, 0, 0);
+  /* SysTick_IRQn interrupt configuration, below the motor ISR (DMA1_Channel1) */
+  HAL_NVIC_SetPriority(SysTick_IRQn, 1, 0);
 
   SystemClock_Config();
 
@@ -198,7 +227,17 @@ int main(void) {
   MX_TIM_Init();
   MX_ADC1_Init();
   MX_ADC2_Init();
+  paramInit();        // Parameter defaults from params.h
   BLDC_Init();        // BLDC Controller Init
+  #ifdef DEBUG_ISR_PROFILER
+  profInit();         // ISR cycle profiler Init
+  #endif
+  #ifdef DEBUG_SERIAL_TELEMETRY
+  telemInit();        // Telemetry stream Init
+  #endif
+  #ifdef DEBUG_SCOPE
+  scopeInit();        // Triggered scope Init
+  #endif
 
   HAL_GPIO_WritePin(OFF_PORT, OFF_PIN, GPIO_PIN_SET);   // Activate Latch
   Input_Lim_Init();   // Input Limitations Init
@@ -207,11 +246,21 @@ int main(void) {
   HAL_ADC_Start(&hadc1);
   HAL_ADC_Start(&hadc2);
 
+  #ifndef SILENT_START
   poweronMelody();
+  #endif
+
+  // Wait for the ADC offsets: 4 ms with stored offsets that pass the check, 64 ms when measured
+  while (adcOffsetState == ADC_OFFSET_CAL) { HAL_Delay(1); }
+  #if defined(ADC_OFFSET_STORE) && defined(PARAM_EEPROM)
+  if (adcOffsetState == ADC_OFFSET_MEASURED) {
+    paramSaveRange(IDX_OFS_RLA, IDX_OFS_DCR);   // for the next power on
+  }
+  #endif
   HAL_GPIO_WritePin(LED_PORT, LED_PIN, GPIO_PIN_SET);
   
-  int32_t board_temp_adcFixdt = adc_buffer.temp << 16;  // Fixed-point filter output initialized with current ADC converted to fixed-point
-  int16_t board_temp_adcFilt  = adc_buffer.temp;
+  board_temp_adcFixdt = adc_buffer.temp << 16;          // Fixed-point filter output initialized with current ADC converted to fixed-point
+  board_temp_adcFilt  = adc_buffer.temp;
 
   #ifdef MULTI_MODE_DRIVE
     if (adc_buffer.l_tx2 > input1[0].min + 50 && adc_buffer.l_rx2 > input2[0].min + 50) {
@@ -233,6 +282,7 @@ int main(void) {
       rtP_Left.n_max = rtP_Right.n_max = MULTI_MODE_M1_N_MOT_MAX << 4;
       rtP_Left.i_max = rtP_Right.i_max = (MULTI_MODE_M1_I_MOT_MAX * A2BIT_CONV) << 4;
     }
+    ctrlParamCommit();
 
     printf("Drive mode %i selected: max_speed:%i acc_rate:%i \r\n", drive_mode, max_speed, rate);
   #endif
@@ -245,366 +295,393 @@ int main(void) {
     while((adc_buffer.l_rx2 + adc_buffer.l_tx2) >= (input1[0].min + input2[0].min)) { HAL_Delay(10); }
   #endif
 
+  schedInit(tasks);
   while(1) {
-    if (buzzerTimer - buzzerTimer_prev > 16*DELAY_IN_MAIN_LOOP) {   // 1 ms = 16 ticks buzzerTimer
-
-    readCommand();                        // Read Command: input1[inIdx].cmd, input2[inIdx].cmd
-    calcAvgSpeed();                       // Calculate average measured speed: speedAvg, speedAvgAbs
-
-    #ifndef VARIANT_TRANSPOTTER
-      // ####### MOTOR ENABLING: Only if the initial input is very small (for SAFETY) #######
-      if (enable == 0 && !rtY_Left.z_errCode && !rtY_Right.z_errCode && 
-          ABS(input1[inIdx].cmd) < 50 && ABS(input2[inIdx].cmd) < 50){
-        beepShort(6);                     // make 2 beeps indicating the motor enable
-        beepShort(4); HAL_Delay(100);
-        steerFixdt = speedFixdt = 0;      // reset filters
-        enable = 1;                       // enable motors
-        #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-        printf("-- Motors enabled --\r\n");
-        #endif
-      }
+    if (!schedDispatch()) {
+      __WFI();                            // nothing due: sleep until the next interrupt, at the latest the motor ISR
+    }
+  }
+}
 
-      // ####### VARIANT_HOVERCAR #######
-      #if defined(VARIANT_HOVERCAR) || defined(VARIANT_SKATEBOARD) || defined(ELECTRIC_BRAKE_ENABLE)
-        uint16_t speedBlend;                                        // Calculate speed Blend, a number between [0, 1] in fixdt(0,16,15)
-        speedBlend = (uint16_t)(((CLAMP(speedAvgAbs,10,60) - 10) << 15) / 50); // speedBlend [0,1] is within [10 rpm, 60rpm]
-      #endif
+/* =========================== Main Loop Tasks =========================== */
 
-      #ifdef STANDSTILL_HOLD_ENABLE
-        standstillHold();                                           // Apply Standstill Hold functionality. Only available and makes sense for VOLTAGE or TORQUE Mode
+// Inputs, filters, mixer, outputs, feedback, beeps and power-off checks. RATE, FILTER, the beep patterns
+// and the input timeouts count runs of this task, so it keeps the DELAY_IN_MAIN_LOOP period
+static void taskControl(void) {
+  #ifdef I2C_BUS
+    i2cPoll();                          // Recover the I2C bus after a hung transfer
+  #endif
+  readCommand();                        // Read Command: input1[inIdx].cmd, input2[inIdx].cmd
+  calcAvgSpeed();                       // Calculate average measured speed: speedAvg, speedAvgAbs
+
+  #ifndef VARIANT_TRANSPOTTER
+    // ####### MOTOR ENABLING: Only if the initial input is very small (for SAFETY) #######
+    if (enable == 0 && !rtY_Left.z_errCode && !rtY_Right.z_errCode && 
+        ABS(input1[inIdx].cmd) < 50 && ABS(input2[inIdx].cmd) < 50){
+      #ifndef SILENT_START
+      beepShort(6);                     // make 2 beeps indicating the motor enable
+      beepShort(4);
       #endif
-
-      #ifdef VARIANT_HOVERCAR
-      if (inIdx == CONTROL_ADC) {                                   // Only use use implementation below if pedals are in use (ADC input)
-        if (speedAvgAbs < 60) {                                     // Check if Hovercar is physically close to standstill to enable Double tap detection on Brake pedal for Reverse functionality
-          multipleTapDet(input1[inIdx].cmd, HAL_GetTick(), &MultipleTapBrake); // Brake pedal in this case is "input1" variable
-        }
-
-        if (input1[inIdx].cmd > 30) {                               // If Brake pedal (input1) is pressed, bring to 0 also the Throttle pedal (input2) to avoid "Double pedal" driving
-          input2[inIdx].cmd = (int16_t)((input2[inIdx].cmd * speedBlend) >> 15);
-          cruiseControl((uint8_t)rtP_Left.b_cruiseCtrlEna);         // Cruise control deactivated by Brake pedal if it was active
-        }
+      steerFixdt = speedFixdt = 0;      // reset filters
+      enable = 1;                       // enable motors
+      if (!bootTime) {
+        bootTime = (uint16_t)HAL_GetTick();
       }
+      #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+      printf("-- Motors enabled --\r\n");
       #endif
+    }
 
-      #ifdef ELECTRIC_BRAKE_ENABLE
-        electricBrake(speedBlend, MultipleTapBrake.b_multipleTap);  // Apply Electric Brake. Only available and makes sense for TORQUE Mode
-      #endif
+    // ####### VARIANT_HOVERCAR #######
+    #if defined(VARIANT_HOVERCAR) || defined(VARIANT_SKATEBOARD) || defined(ELECTRIC_BRAKE_ENABLE)
+      uint16_t speedBlend;                                        // Calculate speed Blend, a number between [0, 1] in fixdt(0,16,15)
+      speedBlend = (uint16_t)(((CLAMP(speedAvgAbs,10,60) - 10) << 15) / 50); // speedBlend [0,1] is within [10 rpm, 60rpm]
+    #endif
 
-      #ifdef VARIANT_HOVERCAR
-      if (inIdx == CONTROL_ADC) {                                   // Only use use implementation below if pedals are in use (ADC input)
-        if (speedAvg > 0) {                                         // Make sure the Brake pedal is opposite to the direction of motion AND it goes to 0 as we reach standstill (to avoid Reverse driving by Brake pedal) 
-          input1[inIdx].cmd = (int16_t)((-input1[inIdx].cmd * speedBlend) >> 15);
-        } else {
-          input1[inIdx].cmd = (int16_t)(( input1[inIdx].cmd * speedBlend) >> 15);
-        }
+    #ifdef STANDSTILL_HOLD_ENABLE
+      standstillHold();                                           // Apply Standstill Hold functionality. Only available and makes sense for VOLTAGE or TORQUE Mode
+    #endif
+
+    #ifdef VARIANT_HOVERCAR
+    if (inIdx == CONTROL_ADC) {                                   // Only use use implementation below if pedals are in use (ADC input)
+      if (speedAvgAbs < 60) {                                     // Check if Hovercar is physically close to standstill to enable Double tap detection on Brake pedal for Reverse functionality
+        multipleTapDet(input1[inIdx].cmd, HAL_GetTick(), &MultipleTapBrake); // Brake pedal in this case is "input1" variable
       }
-      #endif
 
-      #ifdef VARIANT_SKATEBOARD
-        if (input2[inIdx].cmd < 0) {                                // When Throttle is negative, it acts as brake. This condition is to make sure it goes to 0 as we reach standstill (to avoid Reverse driving) 
-          if (speedAvg > 0) {                                       // Make sure the braking is opposite to the direction of motion
-            input2[inIdx].cmd  = (int16_t)(( input2[inIdx].cmd * speedBlend) >> 15);
-          } else {
-            input2[inIdx].cmd  = (int16_t)((-input2[inIdx].cmd * speedBlend) >> 15);
-          }
-        }
-      #endif
+      if (input1[inIdx].cmd > 30) {                               // If Brake pedal (input1) is pressed, bring to 0 also the Throttle pedal (input2) to avoid "Double pedal" driving
+        input2[inIdx].cmd = (int16_t)((input2[inIdx].cmd * speedBlend) >> 15);
+        cruiseControl((uint8_t)rtP_Left.b_cruiseCtrlEna);         // Cruise control deactivated by Brake pedal if it was active
+      }
+    }
+    #endif
 
-      // ####### LOW-PASS FILTER #######
-      rateLimiter16(input1[inIdx].cmd, rate, &steerRateFixdt);
-      rateLimiter16(input2[inIdx].cmd, rate, &speedRateFixdt);
-      filtLowPass32(steerRateFixdt >> 4, FILTER, &steerFixdt);
-      filtLowPass32(speedRateFixdt >> 4, FILTER, &speedFixdt);
-      steer = (int16_t)(steerFixdt >> 16);  // convert fixed-point to integer
-      speed = (int16_t)(speedFixdt >> 16);  // convert fixed-point to integer
-
-      // ####### VARIANT_HOVERCAR #######
-      #ifdef VARIANT_HOVERCAR
-      if (inIdx == CONTROL_ADC) {               // Only use use implementation below if pedals are in use (ADC input)
-
-        #ifdef MULTI_MODE_DRIVE
-        if (speed >= max_speed) {
-          speed = max_speed;
-        }
-        #endif
+    #ifdef ELECTRIC_BRAKE_ENABLE
+      electricBrake(speedBlend, MultipleTapBrake.b_multipleTap);  // Apply Electric Brake. Only available and makes sense for TORQUE Mode
+    #endif
+
+    #ifdef VARIANT_HOVERCAR
+    if (inIdx == CONTROL_ADC) {                                   // Only use use implementation below if pedals are in use (ADC input)
+      if (speedAvg > 0) {                                         // Make sure the Brake pedal is opposite to the direction of motion AND it goes to 0 as we reach standstill (to avoid Reverse driving by Brake pedal) 
+        input1[inIdx].cmd = (int16_t)((-input1[inIdx].cmd * speedBlend) >> 15);
+      } else {
+        input1[inIdx].cmd = (int16_t)(( input1[inIdx].cmd * speedBlend) >> 15);
+      }
+    }
+    #endif
 
-        if (!MultipleTapBrake.b_multipleTap) {  // Check driving direction
-          speed = steer + speed;                // Forward driving: in this case steer = Brake, speed = Throttle
+    #ifdef VARIANT_SKATEBOARD
+      if (input2[inIdx].cmd < 0) {                                // When Throttle is negative, it acts as brake. This condition is to make sure it goes to 0 as we reach standstill (to avoid Reverse driving) 
+        if (speedAvg > 0) {                                       // Make sure the braking is opposite to the direction of motion
+          input2[inIdx].cmd  = (int16_t)(( input2[inIdx].cmd * speedBlend) >> 15);
         } else {
-          speed = steer - speed;                // Reverse driving: in this case steer = Brake, speed = Throttle
+          input2[inIdx].cmd  = (int16_t)((-input2[inIdx].cmd * speedBlend) >> 15);
         }
-        steer = 0;                              // Do not apply steering to avoid side effects if STEER_COEFFICIENT is NOT 0
       }
-      #endif
+    #endif
 
-      #if defined(TANK_STEERING) && !defined(VARIANT_HOVERCAR) && !defined(VARIANT_SKATEBOARD) 
-        // Tank steering (no mixing)
-        cmdL = steer; 
-        cmdR = speed;
-      #else 
-        // ####### MIXER #######
-        mixerFcn(speed << 4, steer << 4, &cmdR, &cmdL);   // This function implements the equations above
+    // ####### LOW-PASS FILTER #######
+    rateLimiter16(input1[inIdx].cmd, rate, &steerRateFixdt);
+    rateLimiter16(input2[inIdx].cmd, rate, &speedRateFixdt);
+    filtLowPass32(steerRateFixdt >> 4, FILTER, &steerFixdt);
+    filtLowPass32(speedRateFixdt >> 4, FILTER, &speedFixdt);
+    steer = (int16_t)(steerFixdt >> 16);  // convert fixed-point to integer
+    speed = (int16_t)(speedFixdt >> 16);  // convert fixed-point to integer
+
+    // ####### VARIANT_HOVERCAR #######
+    #ifdef VARIANT_HOVERCAR
+    if (inIdx == CONTROL_ADC) {               // Only use use implementation below if pedals are in use (ADC input)
+
+      #ifdef MULTI_MODE_DRIVE
+      if (speed >= max_speed) {
+        speed = max_speed;
+      }
       #endif
 
+      if (!MultipleTapBrake.b_multipleTap) {  // Check driving direction
+        speed = steer + speed;                // Forward driving: in this case steer = Brake, speed = Throttle
+      } else {
+        speed = steer - speed;                // Reverse driving: in this case steer = Brake, speed = Throttle
+      }
+      steer = 0;                              // Do not apply steering to avoid side effects if STEER_COEFFICIENT is NOT 0
+    }
+    #endif
 
-      // ####### SET OUTPUTS (if the target change is less than +/- 100) #######
-      #ifdef INVERT_R_DIRECTION
-        pwmr = cmdR;
-      #else
-        pwmr = -cmdR;
-      #endif
-      #ifdef INVERT_L_DIRECTION
-        pwml = -cmdL;
-      #else
-        pwml = cmdL;
-      #endif
+    #if defined(TANK_STEERING) && !defined(VARIANT_HOVERCAR) && !defined(VARIANT_SKATEBOARD) 
+      // Tank steering (no mixing)
+      cmdL = steer; 
+      cmdR = speed;
+    #else 
+      // ####### MIXER #######
+      mixerFcn(speed << 4, steer << 4, &cmdR, &cmdL);   // This function implements the equations above
     #endif
 
-    #ifdef VARIANT_TRANSPOTTER
-      distance    = CLAMP(input1[inIdx].cmd - 180, 0, 4095);
-      steering    = (input2[inIdx].cmd - 2048) / 2048.0;
-      distanceErr = distance - (int)(setDistance * 1345);
+    // ####### SET OUTPUTS (if the target change is less than +/- 100) #######
+    #ifdef INVERT_R_DIRECTION
+      pwmr = cmdR;
+    #else
+      pwmr = -cmdR;
+    #endif
+    #ifdef INVERT_L_DIRECTION
+      pwml = -cmdL;
+    #else
+      pwml = cmdL;
+    #endif
+  #endif
 
-      if (nunchuk_connected == 0) {
-        cmdL = cmdL * 0.8f + (CLAMP(distanceErr + (steering*((float)MAX(ABS(distanceErr), 50)) * ROT_P), -850, 850) * -0.2f);
-        cmdR = cmdR * 0.8f + (CLAMP(distanceErr - (steering*((float)MAX(ABS(distanceErr), 50)) * ROT_P), -850, 850) * -0.2f);
-        if (distanceErr > 0) {
-          enable = 1;
-        }
-        if (distanceErr > -300) {
-          #ifdef INVERT_R_DIRECTION
-            pwmr = cmdR;
-          #else
-            pwmr = -cmdR;
-          #endif
-          #ifdef INVERT_L_DIRECTION
-            pwml = -cmdL;
-          #else
-            pwml = cmdL;
-          #endif
-
-          if (checkRemote) {
-            if (!HAL_GPIO_ReadPin(LED_PORT, LED_PIN)) {
-              //enable = 1;
-            } else {
-              enable = 0;
-            }
-          }
-        } else {
-          enable = 0;
-        }
-        timeoutCntGen = 0;
-        timeoutFlgGen = 0;
-      }
+  #ifdef VARIANT_TRANSPOTTER
+    distance    = CLAMP(input1[inIdx].cmd - 180, 0, 4095);
+    steering    = (input2[inIdx].cmd - 2048) / 2048.0;
+    distanceErr = distance - (int)(setDistance * 1345);
 
-      if (timeoutFlgGen) {
-        pwml = 0;
-        pwmr = 0;
-        enable = 0;
-        #ifdef SUPPORT_LCD
-          LCD_SetLocation(&lcd,  0, 0); LCD_WriteString(&lcd, "Len:");
-          LCD_SetLocation(&lcd,  8, 0); LCD_WriteString(&lcd, "m(");
-          LCD_SetLocation(&lcd, 14, 0); LCD_WriteString(&lcd, "m)");
-        #endif
-        HAL_Delay(1000);
-        nunchuk_connected = 0;
+    if (nunchuk_connected == 0) {
+      cmdL = cmdL * 0.8f + (CLAMP(distanceErr + (steering*((float)MAX(ABS(distanceErr), 50)) * ROT_P), -850, 850) * -0.2f);
+      cmdR = cmdR * 0.8f + (CLAMP(distanceErr - (steering*((float)MAX(ABS(distanceErr), 50)) * ROT_P), -850, 850) * -0.2f);
+      if (distanceErr > 0) {
+        enable = 1;
       }
+      if (distanceErr > -300) {
+        #ifdef INVERT_R_DIRECTION
+          pwmr = cmdR;
+        #else
+          pwmr = -cmdR;
+        #endif
+        #ifdef INVERT_L_DIRECTION
+          pwml = -cmdL;
+        #else
+          pwml = cmdL;
+        #endif
 
-      if ((distance / 1345.0) - setDistance > 0.5 && (lastDistance / 1345.0) - setDistance > 0.5) { // Error, robot too far away!
+        if (checkRemote) {
+          if (!HAL_GPIO_ReadPin(LED_PORT, LED_PIN)) {
+            //enable = 1;
+          } else {
+            enable = 0;
+          }
+        }
+      } else {
         enable = 0;
-        beepLong(5);
-        #ifdef SUPPORT_LCD
-          LCD_ClearDisplay(&lcd);
-          HAL_Delay(5);
-          LCD_SetLocation(&lcd, 0, 0); LCD_WriteString(&lcd, "Emergency Off!");
-          LCD_SetLocation(&lcd, 0, 1); LCD_WriteString(&lcd, "Keeper too fast.");
-        #endif
-        poweroff();
       }
+      timeoutCntGen = 0;
+      timeoutFlgGen = 0;
+    }
 
-      #ifdef SUPPORT_NUNCHUK
-        if (transpotter_counter % 500 == 0) {
-          if (nunchuk_connected == 0 && enable == 0) {
-              if(Nunchuk_Read() == NUNCHUK_CONNECTED) {
-                #ifdef SUPPORT_LCD
-                  LCD_SetLocation(&lcd, 0, 0); LCD_WriteString(&lcd, "Nunchuk Control");
-                #endif
-                nunchuk_connected = 1;
-	      }
-	    } else {
-              nunchuk_connected = 0;
-	    }
-          }
-        }   
+    if (timeoutFlgGen) {
+      pwml = 0;
+      pwmr = 0;
+      enable = 0;
+      #ifdef SUPPORT_LCD
+        LCD_SetLocation(&lcd,  0, 0); LCD_WriteString(&lcd, "Len:");
+        LCD_SetLocation(&lcd,  8, 0); LCD_WriteString(&lcd, "m(");
+        LCD_SetLocation(&lcd, 14, 0); LCD_WriteString(&lcd, "m)");
       #endif
+      HAL_Delay(1000);
+      nunchuk_connected = 0;
+    }
 
+    if ((distance / 1345.0) - setDistance > 0.5 && (lastDistance / 1345.0) - setDistance > 0.5) { // Error, robot too far away!
+      enable = 0;
+      beepLong(5);
       #ifdef SUPPORT_LCD
-        if (transpotter_counter % 100 == 0) {
-          if (LCDerrorFlag == 1 && enable == 0) {
+        LCD_ClearDisplay(&lcd);
+        LCD_SetLocation(&lcd, 0, 0); LCD_WriteString(&lcd, "Emergency Off!");
+        LCD_SetLocation(&lcd, 0, 1); LCD_WriteString(&lcd, "Keeper too fast.");
+      #endif
+      poweroff();
+    }
 
-          } else {
-            if (nunchuk_connected == 0) {
-              LCD_SetLocation(&lcd,  4, 0); LCD_WriteFloat(&lcd,distance/1345.0,2);
-              LCD_SetLocation(&lcd, 10, 0); LCD_WriteFloat(&lcd,setDistance,2);
-            }
-            LCD_SetLocation(&lcd,  4, 1); LCD_WriteFloat(&lcd,batVoltage, 1);
-            // LCD_SetLocation(&lcd, 11, 1); LCD_WriteFloat(&lcd,MAX(ABS(currentR), ABS(currentL)),2);
-          }
+    #ifdef SUPPORT_NUNCHUK
+      if (transpotter_counter % 500 == 0) {
+        if (nunchuk_connected == 0 && enable == 0) {
+            if(Nunchuk_Read() == NUNCHUK_CONNECTED) {
+              #ifdef SUPPORT_LCD
+                LCD_SetLocation(&lcd, 0, 0); LCD_WriteString(&lcd, "Nunchuk Control");
+              #endif
+              nunchuk_connected = 1;
+	      }
+	    } else {
+            nunchuk_connected = 0;
+	    }
         }
-      #endif
-      transpotter_counter++;
+      }   
     #endif
 
-    // ####### SIDEBOARDS HANDLING #######
-    #if defined(SIDEBOARD_SERIAL_USART2)
-      sideboardSensors((uint8_t)Sideboard_L.sensors);
-    #endif
-    #if defined(FEEDBACK_SERIAL_USART2)
-      sideboardLeds(&sideboard_leds_L);
-    #endif
-    #if defined(SIDEBOARD_SERIAL_USART3)
-      sideboardSensors((uint8_t)Sideboard_R.sensors);
-    #endif
-    #if defined(FEEDBACK_SERIAL_USART3)
-      sideboardLeds(&sideboard_leds_R);
-    #endif
-    
+    transpotter_counter++;
+  #endif
 
-    // ####### CALC BOARD TEMPERATURE #######
-    filtLowPass32(adc_buffer.temp, TEMP_FILT_COEF, &board_temp_adcFixdt);
-    board_temp_adcFilt  = (int16_t)(board_temp_adcFixdt >> 16);  // convert fixed-point to integer
-    board_temp_deg_c    = (TEMP_CAL_HIGH_DEG_C - TEMP_CAL_LOW_DEG_C) * (board_temp_adcFilt - TEMP_CAL_LOW_ADC) / (TEMP_CAL_HIGH_ADC - TEMP_CAL_LOW_ADC) + TEMP_CAL_LOW_DEG_C;
+  // ####### SIDEBOARDS HANDLING #######
+  #ifdef SERIAL_CHANNELS
+    for (uint8_t i = 0; i < SERIAL_CHANNELS; i++) {
+      if (serialCh[i].roles & SERIAL_ROLE_SIDEBOARD) {
+        sideboardSensors((uint8_t)serialCh[i].in.sideboard.sensors);
+      }
+      if (serialCh[i].roles & SERIAL_ROLE_FEEDBACK) {
+        sideboardLeds(&serialCh[i].leds);
+      }
+    }
+  #endif
 
-    // ####### CALC CALIBRATED BATTERY VOLTAGE #######
-    batVoltageCalib = batVoltage * BAT_CALIB_REAL_VOLTAGE / BAT_CALIB_ADC;
+  // ####### CONTROLLER PARAMETERS #######
+  ctrlParamProcess();                   // Hand the committed rtP_Left/rtP_Right changes to the motor ISR, both motors switch in the same period
+
+  // ####### CALC CALIBRATED BATTERY VOLTAGE #######
+  batVoltageCalib = batVoltage * BAT_CALIB_REAL_VOLTAGE / BAT_CALIB_ADC;
+
+  // ####### CALC DC LINK CURRENT #######
+  left_dc_curr  = -(rtU_Left.i_DCLink * 100) / A2BIT_CONV;   // Left DC Link Current * 100 
+  right_dc_curr = -(rtU_Right.i_DCLink * 100) / A2BIT_CONV;  // Right DC Link Current * 100
+  dc_curr       = left_dc_curr + right_dc_curr;            // Total DC Link Current * 100
+
+  // ####### FEEDBACK SERIAL OUT #######
+  #if defined(FEEDBACK_SERIAL_USART2) || defined(FEEDBACK_SERIAL_USART3)
+    Feedback.start	        = (uint16_t)SERIAL_START_FRAME;   // snapshot every loop, the speeds are read when a frame is built
+    Feedback.cmd1           = (int16_t)input1[inIdx].cmd;
+    Feedback.cmd2           = (int16_t)input2[inIdx].cmd;
+    Feedback.batVoltage	    = (int16_t)batVoltageCalib;
+    Feedback.boardTemp	    = (int16_t)board_temp_deg_c;
+    Feedback.cmdLed         = (uint16_t)((isrErrCode & ISR_ERR_OVERRUN ? FDBK_ISR_OVERRUN : 0) |   // FDBK_ diagnostic flags in the upper byte
+                                         (rtY_Left.z_errCode  ? FDBK_MOT_ERR_L : 0) |
+                                         (rtY_Right.z_errCode ? FDBK_MOT_ERR_R : 0));
+    serialFeedbackProcess(&Feedback);     // sends every FDBK_PER loops, on FDBK_DIV from the motor ISR or on a poll frame
+  #endif
 
-    // ####### CALC DC LINK CURRENT #######
-    left_dc_curr  = -(rtU_Left.i_DCLink * 100) / A2BIT_CONV;   // Left DC Link Current * 100 
-    right_dc_curr = -(rtU_Right.i_DCLink * 100) / A2BIT_CONV;  // Right DC Link Current * 100
-    dc_curr       = left_dc_curr + right_dc_curr;            // Total DC Link Current * 100
+  // ####### POWEROFF BY POWER-BUTTON #######
+  poweroffPressCheck();
 
-    // ####### DEBUG SERIAL OUT #######
+  // ####### BEEP AND EMERGENCY POWEROFF #######
+  if (TEMP_POWEROFF_ENABLE && board_temp_deg_c >= TEMP_POWEROFF && speedAvgAbs < 20){  // poweroff before mainboard burns OR low bat 3
     #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-      if (main_loop_counter % 25 == 0) {    // Send data periodically every 125 ms      
-        #if defined(DEBUG_SERIAL_PROTOCOL)
-          process_debug();
-        #else
-          printf("in1:%i in2:%i cmdL:%i cmdR:%i BatADC:%i BatV:%i TempADC:%i Temp:%i \r\n",
-            input1[inIdx].raw,        // 1: INPUT1
-            input2[inIdx].raw,        // 2: INPUT2
-            cmdL,                     // 3: output command: [-1000, 1000]
-            cmdR,                     // 4: output command: [-1000, 1000]
-            adc_buffer.batt1,         // 5: for battery voltage calibration
-            batVoltageCalib,          // 6: for verifying battery voltage calibration
-            board_temp_adcFilt,       // 7: for board temperature calibration
-            board_temp_deg_c);        // 8: for verifying board temperature calibration
-        #endif
-      }
+      printf("Powering off, temperature is too high\r\n");
     #endif
-
-    // ####### FEEDBACK SERIAL OUT #######
-    #if defined(FEEDBACK_SERIAL_USART2) || defined(FEEDBACK_SERIAL_USART3)
-      if (main_loop_counter % 60 == 0) {    // Send data periodically every 300 ms
-        Feedback.start	        = (uint16_t)SERIAL_START_FRAME;
-        Feedback.cmd1           = (int16_t)input1[inIdx].cmd;
-        Feedback.cmd2           = (int16_t)input2[inIdx].cmd;
-        Feedback.speedR_meas	  = (int16_t)rtY_Right.n_mot;
-        Feedback.speedL_meas	  = (int16_t)rtY_Left.n_mot;
-        Feedback.batVoltage	    = (int16_t)batVoltageCalib;
-        Feedback.boardTemp	    = (int16_t)board_temp_deg_c;
-
-        #if defined(FEEDBACK_SERIAL_USART2)
-          if(__HAL_DMA_GET_COUNTER(huart2.hdmatx) == 0) {
-            Feedback.cmdLed     = (uint16_t)sideboard_leds_L;
-            Feedback.checksum   = (uint16_t)(Feedback.start ^ Feedback.cmd1 ^ Feedback.cmd2 ^ Feedback.speedR_meas ^ Feedback.speedL_meas 
-                                           ^ Feedback.batVoltage ^ Feedback.boardTemp ^ Feedback.cmdLed);
-
-            HAL_UART_Transmit_DMA(&huart2, (uint8_t *)&Feedback, sizeof(Feedback));
-          }
-        #endif
-        #if defined(FEEDBACK_SERIAL_USART3)
-          if(__HAL_DMA_GET_COUNTER(huart3.hdmatx) == 0) {
-            Feedback.cmdLed     = (uint16_t)sideboard_leds_R;
-            Feedback.checksum   = (uint16_t)(Feedback.start ^ Feedback.cmd1 ^ Feedback.cmd2 ^ Feedback.speedR_meas ^ Feedback.speedL_meas 
-                                           ^ Feedback.batVoltage ^ Feedback.boardTemp ^ Feedback.cmdLed);
-
-            HAL_UART_Transmit_DMA(&huart3, (uint8_t *)&Feedback, sizeof(Feedback));
-          }
-        #endif
-      }
+    poweroff();
+  } else if ( BAT_DEAD_ENABLE && batVoltage < BAT_DEAD && speedAvgAbs < 20){
+    #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+      printf("Powering off, battery voltage is too low\r\n");
     #endif
+    poweroff();
+  } else if (rtY_Left.z_errCode || rtY_Right.z_errCode) {                                           // 1 beep (low pitch): Motor error, disable motors
+    enable = 0;
+    beepCount(1, 24, 1);
+  } else if (timeoutFlgADC) {                                                                       // 2 beeps (low pitch): ADC timeout
+    beepCount(2, 24, 1);
+  } else if (timeoutFlgSerial) {                                                                    // 3 beeps (low pitch): Serial timeout
+    //beepCount(3, 24, 1);
+    //printf("Serial disconnected but audio 3 beep warning disabled!\r\n");
+  } else if (timeoutFlgGen) {                                                                       // 4 beeps (low pitch): General timeout (PPM, PWM, Nunchuk)
+    beepCount(4, 24, 1);
+  } else if (TEMP_WARNING_ENABLE && board_temp_deg_c >= TEMP_WARNING) {                             // 5 beeps (low pitch): Mainboard temperature warning
+    beepCount(5, 24, 1);
+  } else if (BAT_LVL1_ENABLE && batVoltage < BAT_LVL1) {                                            // 1 beep fast (medium pitch): Low bat 1
+    beepCount(0, 10, 6);
+  } else if (BAT_LVL2_ENABLE && batVoltage < BAT_LVL2) {                                            // 1 beep slow (medium pitch): Low bat 2
+    beepCount(0, 10, 30);
+  } else if (BEEPS_BACKWARD && (((cmdR < -50 || cmdL < -50) && speedAvg < 0) || MultipleTapBrake.b_multipleTap)) { // 1 beep fast (high pitch): Backward spinning motors
+    beepCount(0, 5, 1);
+    backwardDrive = 1;
+  } else {  // do not beep
+    beepCount(0, 0, 0);
+    backwardDrive = 0;
+  }
 
-    // ####### POWEROFF BY POWER-BUTTON #######
-    poweroffPressCheck();
+  inactivity_timeout_counter++;
 
-    // ####### BEEP AND EMERGENCY POWEROFF #######
-    if (TEMP_POWEROFF_ENABLE && board_temp_deg_c >= TEMP_POWEROFF && speedAvgAbs < 20){  // poweroff before mainboard burns OR low bat 3
-      #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-        printf("Powering off, temperature is too high\r\n");
-      #endif
-      poweroff();
-    } else if ( BAT_DEAD_ENABLE && batVoltage < BAT_DEAD && speedAvgAbs < 20){
-      #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-        printf("Powering off, battery voltage is too low\r\n");
-      #endif
-      poweroff();
-    } else if (rtY_Left.z_errCode || rtY_Right.z_errCode) {                                           // 1 beep (low pitch): Motor error, disable motors
-      enable = 0;
-      beepCount(1, 24, 1);
-    } else if (timeoutFlgADC) {                                                                       // 2 beeps (low pitch): ADC timeout
-      beepCount(2, 24, 1);
-    } else if (timeoutFlgSerial) {                                                                    // 3 beeps (low pitch): Serial timeout
-      //beepCount(3, 24, 1);
-      //printf("Serial disconnected but audio 3 beep warning disabled!\r\n");
-    } else if (timeoutFlgGen) {                                                                       // 4 beeps (low pitch): General timeout (PPM, PWM, Nunchuk)
-      beepCount(4, 24, 1);
-    } else if (TEMP_WARNING_ENABLE && board_temp_deg_c >= TEMP_WARNING) {                             // 5 beeps (low pitch): Mainboard temperature warning
-      beepCount(5, 24, 1);
-    } else if (BAT_LVL1_ENABLE && batVoltage < BAT_LVL1) {                                            // 1 beep fast (medium pitch): Low bat 1
-      beepCount(0, 10, 6);
-    } else if (BAT_LVL2_ENABLE && batVoltage < BAT_LVL2) {                                            // 1 beep slow (medium pitch): Low bat 2
-      beepCount(0, 10, 30);
-    } else if (BEEPS_BACKWARD && (((cmdR < -50 || cmdL < -50) && speedAvg < 0) || MultipleTapBrake.b_multipleTap)) { // 1 beep fast (high pitch): Backward spinning motors
-      beepCount(0, 5, 1);
-      backwardDrive = 1;
-    } else {  // do not beep
-      beepCount(0, 0, 0);
-      backwardDrive = 0;
+  // ####### INACTIVITY TIMEOUT #######
+  if (abs(cmdL) > 50 || abs(cmdR) > 50) {
+    inactivity_timeout_counter = 0;
+  }
+
+  #if defined(CRUISE_CONTROL_SUPPORT) || defined(STANDSTILL_HOLD_ENABLE)
+    if ((abs(rtP_Left.n_cruiseMotTgt)  > 50 && rtP_Left.b_cruiseCtrlEna) || 
+        (abs(rtP_Right.n_cruiseMotTgt) > 50 && rtP_Right.b_cruiseCtrlEna)) {
+      inactivity_timeout_counter = 0;
     }
+  #endif
 
+  if (inactivity_timeout_counter > (INACTIVITY_TIMEOUT * 60 * 1000) / DELAY_IN_MAIN_LOOP) {  // the control task runs every DELAY_IN_MAIN_LOOP ms
+    #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+      printf("Powering off, wheels were inactive for too long\r\n");
+    #endif
+    poweroff();
+  }
 
-    inactivity_timeout_counter++;
+  // HAL_GPIO_TogglePin(LED_PORT, LED_PIN);                 // This is to measure the control task period with an oscilloscope connected to LED_PIN
+  // Update states
+  inIdx_prev = inIdx;
+  main_loop_counter++;
+}
 
-    // ####### INACTIVITY TIMEOUT #######
-    if (abs(cmdL) > 50 || abs(cmdR) > 50) {
-      inactivity_timeout_counter = 0;
-    }
+#if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+#if defined(DEBUG_SCOPE) || defined(DEBUG_SERIAL_TELEMETRY) || defined(DEBUG_SERIAL_BINARY)
+// Debug port frames. Each function returns at once if the UART is busy
+static void taskComms(void) {
+  #if defined(DEBUG_SCOPE)
+    scopeProcess();                     // Send the next frame of a finished scope capture
+  #endif
+  #if defined(DEBUG_SERIAL_TELEMETRY)
+    telemProcess();                     // Send the samples buffered by the motor ISR
+  #endif
+  #if defined(DEBUG_SERIAL_BINARY)
+    paramProcess();                     // Answer a binary parameter request
+  #endif
+}
+#endif
 
-    #if defined(CRUISE_CONTROL_SUPPORT) || defined(STANDSTILL_HOLD_ENABLE)
-      if ((abs(rtP_Left.n_cruiseMotTgt)  > 50 && rtP_Left.b_cruiseCtrlEna) || 
-          (abs(rtP_Right.n_cruiseMotTgt) > 50 && rtP_Right.b_cruiseCtrlEna)) {
-        inactivity_timeout_counter = 0;
-      }
+// ASCII debug protocol and the ISR overrun message, or the calibration printout
+static void taskDebug(void) {
+  #if defined(DEBUG_SERIAL_PROTOCOL)
+    #ifdef DEBUG_ISR_PROFILER
+      profExport();
     #endif
+    schedExport();
+    process_debug();
+  #elif !defined(DEBUG_SERIAL_TELEMETRY)
+    printf("in1:%i in2:%i cmdL:%i cmdR:%i BatADC:%i BatV:%i TempADC:%i Temp:%i \r\n",
+      input1[inIdx].raw,        // 1: INPUT1
+      input2[inIdx].raw,        // 2: INPUT2
+      cmdL,                     // 3: output command: [-1000, 1000]
+      cmdR,                     // 4: output command: [-1000, 1000]
+      adc_buffer.batt1,         // 5: for battery voltage calibration
+      batVoltageCalib,          // 6: for verifying battery voltage calibration
+      board_temp_adcFilt,       // 7: for board temperature calibration
+      board_temp_deg_c);        // 8: for verifying board temperature calibration
+  #endif
 
-    if (inactivity_timeout_counter > (INACTIVITY_TIMEOUT * 60 * 1000) / (DELAY_IN_MAIN_LOOP + 1)) {  // rest of main loop needs maybe 1ms
-      #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-        printf("Powering off, wheels were inactive for too long\r\n");
-      #endif
-      poweroff();
-    }
+  // ####### ISR OVERRUN REPORT #######
+  if ((isrErrCode & ISR_ERR_OVERRUN) && !isrOverrunReported) {
+    printf("Motor ISR overrun detected, %lu control periods lost\r\n", (unsigned long)isrOverrunCnt);
+  }
+  isrOverrunReported = isrErrCode & ISR_ERR_OVERRUN;
+}
+#endif
 
+// Board temperature. TEMP_FILT_COEF is given for the DELAY_IN_MAIN_LOOP rate
+static void taskTemp(void) {
+  filtLowPass32(adc_buffer.temp, TEMP_TASK_COEF, &board_temp_adcFixdt);
+  board_temp_adcFilt  = (int16_t)(board_temp_adcFixdt >> 16);  // convert fixed-point to integer
+  board_temp_deg_c    = (TEMP_CAL_HIGH_DEG_C - TEMP_CAL_LOW_DEG_C) * (board_temp_adcFilt - TEMP_CAL_LOW_ADC) / (TEMP_CAL_HIGH_ADC - TEMP_CAL_LOW_ADC) + TEMP_CAL_LOW_DEG_C;
+}
+
+#if defined(VARIANT_TRANSPOTTER) && defined(SUPPORT_LCD)
+// Distance and battery on the LCD
+static void taskLcd(void) {
+  if (LCDerrorFlag == 1 && enable == 0) {
 
-    // HAL_GPIO_TogglePin(LED_PORT, LED_PIN);                 // This is to measure the main() loop duration with an oscilloscope connected to LED_PIN
-    // Update states
-    inIdx_prev = inIdx;
-    buzzerTimer_prev = buzzerTimer;
-    main_loop_counter++;
+  } else {
+    if (nunchuk_connected == 0) {
+      LCD_SetLocation(&lcd,  4, 0); LCD_WriteFloat(&lcd,distance/1345.0,2);
+      LCD_SetLocation(&lcd, 10, 0); LCD_WriteFloat(&lcd,setDistance,2);
     }
+    LCD_SetLocation(&lcd,  4, 1); LCD_WriteFloat(&lcd,batVoltage, 1);
+    // LCD_SetLocation(&lcd, 11, 1); LCD_WriteFloat(&lcd,MAX(ABS(currentR), ABS(currentL)),2);
   }
 }
+#endif
 
+#ifdef PARAM_EEPROM
+// $SAVE: write the parameters when no other task is due
+static void taskSave(void) {
+  paramSave();
+}
+#endif
 
 // ===========================================================
 /** System Clock Configuration
@@ -647,6 +724,6 @@ void SystemClock_Config(void) {
     */
   HAL_SYSTICK_CLKSourceConfig(SYSTICK_CLKSOURCE_HCLK);
 
-  /* SysTick_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(SysTick_IRQn, 0, 0);
+  /* SysTick_IRQn interrupt configuration, below the motor ISR (DMA1_Channel1) */
+  HAL_NVIC_SetPriority(SysTick_IRQn, 1, 0);
 }
@@ -0,0 +1,388 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Parameter table, defaults and EEPROM storage, generated from the schema in params.h
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Includes
+#include <string.h>
+#include "stm32f1xx_hal.h"
+#include "config.h"
+#include "defines.h"
+#include "eeprom.h"
+#include "BLDC_controller.h"
+#include "util.h"
+#include "comms.h"
+#include "params.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include "scope.h"
+#include "sched.h"
+
+extern ExtY rtY_Left;                   /* External outputs */
+extern P    rtP_Left;
+extern ExtY rtY_Right;                  /* External outputs */
+extern P    rtP_Right;
+
+extern InputStruct input1[];            // input structure
+extern InputStruct input2[];            // input structure
+
+extern uint16_t VirtAddVarTab[NB_OF_VAR];
+extern int16_t speedAvg;                // average measured speed
+extern uint8_t ctrlModReqRaw;
+extern int16_t batVoltageCalib;
+extern int16_t board_temp_deg_c;
+extern int16_t left_dc_curr;
+extern int16_t right_dc_curr;
+extern int16_t dc_curr;
+extern int16_t cmdL;
+extern int16_t cmdR;
+extern uint8_t  isrErrCode;
+extern uint32_t isrOverrunCnt;
+extern uint16_t isrOverrunStreakMax;
+extern uint32_t ctrlParamSwaps;
+extern uint32_t dbgTxDrops;
+extern uint16_t bootTime;
+extern uint8_t  adcOffsetState;
+extern int16_t  offsetrlA, offsetrlB, offsetrrB, offsetrrC, offsetdcl, offsetdcr;
+extern uint8_t  schedSel;
+extern uint32_t schedRuns;
+extern uint32_t schedMisses;
+extern uint16_t schedExec;
+extern uint16_t schedExecMax;
+extern uint16_t schedLate;
+extern int32_t  schedSlack;
+extern uint8_t  schedLoad;
+#ifdef DEBUG_ISR_PROFILER
+extern uint8_t  profSel;
+extern uint16_t profMin;
+extern uint16_t profMax;
+extern uint16_t profMean;
+extern uint32_t profHist[];
+#endif
+
+_Static_assert(PARAM_COUNT < 128, "params[] is indexed with int8_t");
+
+#ifdef PARAM_HELP
+  #define PARAM_HELP_COL(help)  ,help
+#else
+  #define PARAM_HELP_COL(help)
+#endif
+#define PARAM_ADDR_EE(slot)     slot
+#define PARAM_ADDR_RAM(slot)    0
+#define PARAM_X_ENTRY(type, name, var, varR, store, init, fmt, min, max, div, mul, fix, callback, help) \
+  {type, #name, var, varR, PARAM_ADDR_##store(EE_##name), init, fmt, min, max, div, mul, fix, callback PARAM_HELP_COL(help)},
+
+const parameter_entry params[PARAM_COUNT] = {
+  PARAM_LIST(PARAM_X_ENTRY)
+};
+
+static uint8_t paramIdx[PARAM_COUNT];   // params[] indexes sorted by name, for findParam()
+
+
+/* =========================== Parameter Functions =========================== */
+
+// Default value in internal format
+static int32_t paramDefault(uint8_t index) {
+  if (params[index].initFormat) {
+    // Init Value is in External format (e.g. PHA_ADV_MAX is 25 deg)
+    return extToInt(index, params[index].init);
+  }
+  return params[index].init;
+}
+
+// EEPROM word to internal value, sign extended for the signed datatypes
+static int32_t paramFromEE(uint8_t index, uint16_t value) {
+  if (params[index].datatype == INT8_T || params[index].datatype == INT16_T || params[index].datatype == INT32_T) {
+    return (int16_t)value;
+  }
+  return value;
+}
+
+// Cast and assign the value to the variables of the parameter
+static void storeParamVal(uint8_t index, int32_t value) {
+  switch (params[index].datatype) {
+    case UINT8_T:
+      if (params[index].valueL != NULL) *(uint8_t*)params[index].valueL = value;
+      if (params[index].valueR != NULL) *(uint8_t*)params[index].valueR = value;
+      break;
+    case UINT16_T:
+      if (params[index].valueL != NULL) *(uint16_t*)params[index].valueL = value;
+      if (params[index].valueR != NULL) *(uint16_t*)params[index].valueR = value;
+      break;
+    case UINT32_T:
+      if (params[index].valueL != NULL) *(uint32_t*)params[index].valueL = value;
+      if (params[index].valueR != NULL) *(uint32_t*)params[index].valueR = value;
+      break;
+    case INT8_T:
+      if (params[index].valueL != NULL) *(int8_t*)params[index].valueL = value;
+      if (params[index].valueR != NULL) *(int8_t*)params[index].valueR = value;
+      break;
+    case INT16_T:
+      if (params[index].valueL != NULL) *(int16_t*)params[index].valueL = value;
+      if (params[index].valueR != NULL) *(int16_t*)params[index].valueR = value;
+      break;
+    case INT32_T:
+      if (params[index].valueL != NULL) *(int32_t*)params[index].valueL = value;
+      if (params[index].valueR != NULL) *(int32_t*)params[index].valueR = value;
+      break;
+  }
+}
+
+// Compare a name token with a parameter name, as strcmp
+static int paramCmp(const uint8_t *token, uint32_t len, const char *name) {
+  int c = strncmp((const char *)token, name, len);
+  return (c == 0 && name[len] != '\0') ? -1 : c;
+}
+
+// Apply the defaults of the schema and build the name index. Call once at boot, before BLDC_Init()
+void paramInit(void) {
+  uint8_t i, k, tmp;
+
+  for (i = 0; i < PARAM_COUNT; i++) {
+    if (params[i].type == PARAMETER && params[i].valueL != NULL) {
+      storeParamVal(i, paramDefault(i));  // no callbacks, the modules are not initialized yet
+    }
+  }
+
+  // Insertion sort, the table is small and this runs once
+  for (i = 0; i < PARAM_COUNT; i++) {
+    tmp = i;
+    for (k = i; k > 0 && strcmp(params[paramIdx[k - 1]].name, params[tmp].name) > 0; k--) {
+      paramIdx[k] = paramIdx[k - 1];
+    }
+    paramIdx[k] = tmp;
+  }
+}
+
+// Write a value in internal format, run the callback and hand the change to the controllers. Returns 1 if the value changed
+uint8_t paramWrite(uint8_t index, int32_t newValue) {
+  uint8_t changed = (getParamValInt(index) != newValue);
+  if (changed) {
+    storeParamVal(index, newValue);
+  }
+
+  // Run callback function if assigned
+  if (params[index].callback_function) (*params[index].callback_function)();
+  ctrlParamCommit();
+  return changed;
+}
+
+#ifdef PARAM_EEPROM
+// Stored value of an EE row. Parameters count only with the FLASH_WRITE_KEY of this configuration,
+// measured variables (ADC offsets) do not depend on it
+static uint8_t paramStored(uint8_t index, uint16_t *value) {
+  uint16_t writeCheck;
+
+  if (!params[index].addr) {
+    return 0;
+  }
+  if (params[index].type == PARAMETER &&
+      (EE_ReadVariable(VirtAddVarTab[EE_KEY], &writeCheck) != 0 || writeCheck != FLASH_WRITE_KEY)) {
+    return 0;
+  }
+  return EE_ReadVariable(VirtAddVarTab[params[index].addr], value) == 0;
+}
+
+// Write params[first..last] and the values the other EE rows load with as one record: only the
+// changed values are written, and after a power loss the EEPROM holds either the whole new record or the previous one
+static void paramSaveRecord(uint8_t first, uint8_t last, uint16_t key) {
+  uint16_t record[NB_OF_VAR] = {0};
+  uint8_t  valid[NB_OF_VAR]  = {0};
+
+  // The slots of the groups not in this build stay out of the record: they keep what a build with them
+  // stored, or stay unwritten
+  record[EE_KEY] = key;
+  valid[EE_KEY]  = 1;
+  for (uint8_t i = 0; i < PARAM_COUNT; i++) {
+    // Only Parameters with eeprom address can be saved
+    if (params[i].addr) {
+      record[params[i].addr] = (uint16_t)((i >= first && i <= last) ? getParamValInt(i) : getParamInitInt(i));
+      valid[params[i].addr]  = 1;
+    }
+  }
+  HAL_FLASH_Unlock();
+  EE_WriteRecord(record, valid);
+  HAL_FLASH_Lock();
+}
+#endif
+
+// Load the EE rows found in the EEPROM. Call with the flash unlocked after EE_Init().
+// Returns 0 if the EEPROM holds no configuration of this firmware (FLASH_WRITE_KEY), the parameter defaults stay then
+uint8_t paramLoad(void) {
+  #ifdef PARAM_EEPROM
+  uint16_t writeCheck, readVal;
+
+  for (uint8_t i = 0; i < PARAM_COUNT; i++) {
+    // Slots missing in the EEPROM (parameters added since the last save) keep their default,
+    // and so do parameters outside the $SET range (saved by another build, or a corrupted slot).
+    // Variables (ADC offsets) have no range
+    if (paramStored(i, &readVal)) {
+      int32_t value = paramFromEE(i, readVal);
+      if (params[i].type == VARIABLE || IN_RANGE(intToExt(i, value), params[i].min, params[i].max)) {
+        paramWrite(i, value);
+      }
+    }
+  }
+  return EE_ReadVariable(VirtAddVarTab[EE_KEY], &writeCheck) == 0 && writeCheck == FLASH_WRITE_KEY;
+  #else
+  return 0;
+  #endif
+}
+
+// Save all EE rows to the EEPROM with the FLASH_WRITE_KEY
+void paramSave(void) {
+  #ifdef PARAM_EEPROM
+  paramSaveRecord(0, PARAM_COUNT - 1, (uint16_t)FLASH_WRITE_KEY);
+  #endif
+}
+
+// Save the EE rows params[first..last] only. The stored key is kept: saving a few values does not
+// validate the rest of the configuration
+void paramSaveRange(uint8_t first, uint8_t last) {
+  #ifdef PARAM_EEPROM
+  uint16_t key;
+
+  if (EE_ReadVariable(VirtAddVarTab[EE_KEY], &key) != 0) {
+    key = (uint16_t)~FLASH_WRITE_KEY;
+  }
+  paramSaveRecord(first, last, key);
+  #endif
+}
+
+// Translate from Internal to External format
+int32_t intToExt(uint8_t index,int32_t value){
+  // Multiply for small number
+  if(params[index].mul) value *= params[index].mul;
+  // Divide to translate to external format
+  if(params[index].div) value /= params[index].div;
+  // Shift to translate to external format
+  if(params[index].fix) value >>= params[index].fix;
+  return value;
+}
+
+// Translate from External to Internal Format
+int32_t extToInt(uint8_t index,int32_t value){
+  // Multiply to translate to internal format
+  if(params[index].div) value *= params[index].div;
+  // Shift to translate to internal format
+  if (params[index].fix) value <<= params[index].fix;
+  // Divide for small number
+  if(params[index].mul) value /= params[index].mul;
+  return value;
+}
+
+// Get Parameter Internal value and translate to external
+int32_t getParamValExt(uint8_t index) {
+  return intToExt(index,getParamValInt(index));
+}
+
+// Get Parameter Internal Value
+int32_t getParamValInt(uint8_t index) {
+  int32_t value = 0;
+
+  int8_t countVar = 0;
+  if (params[index].valueL != NULL) countVar++;
+  if (params[index].valueR != NULL) countVar++;
+
+  if (countVar > 0){
+    // Read Left and Right values and calculate average
+    // If left and right have to be summed up, DIV field could be adapted to multiply by 2
+    // Cast to parameter datatype
+    switch (params[index].datatype){
+      case UINT8_T:
+        if (params[index].valueL != NULL) value += *(uint8_t*)params[index].valueL;
+        if (params[index].valueR != NULL) value += *(uint8_t*)params[index].valueR;
+        break;
+      case UINT16_T:
+        if (params[index].valueL != NULL) value += *(uint16_t*)params[index].valueL;
+        if (params[index].valueR != NULL) value += *(uint16_t*)params[index].valueR;
+        break;
+      case UINT32_T:
+        if (params[index].valueL != NULL) value += *(uint32_t*)params[index].valueL;
+        if (params[index].valueR != NULL) value += *(uint32_t*)params[index].valueR;
+        break;
+      case INT8_T:
+        if (params[index].valueL != NULL) value += *(int8_t*)params[index].valueL;
+        if (params[index].valueR != NULL) value += *(int8_t*)params[index].valueR;
+        break;
+      case INT16_T:
+        if (params[index].valueL != NULL) value += *(int16_t*)params[index].valueL;
+        if (params[index].valueR != NULL) value += *(int16_t*)params[index].valueR;
+        break;
+      case INT32_T:
+        if (params[index].valueL != NULL) value += *(int32_t*)params[index].valueL;
+        if (params[index].valueR != NULL) value += *(int32_t*)params[index].valueR;
+        break;
+      default:
+        value = 0;
+    }
+
+    // Divide by number of values provided for the parameter
+    value /= countVar;
+  }else{
+    // No variable was provided, return init value that might contain a macro
+    value = params[index].init;
+  }
+
+  return value;
+}
+
+// Get Parameter Init value(EEPROM or init/config.h) and translate to external format
+int32_t getParamInitExt(uint8_t index) {
+  return intToExt(index,getParamInitInt(index));
+}
+
+// Get Parameter value with EEprom data if the slot was saved, init/config.h value otherwise
+int32_t getParamInitInt(uint8_t index){
+  #ifdef PARAM_EEPROM
+  // EEPROM was written, use stored value. EE_ReadVariable reads the RAM index of the EEPROM, no flash access
+  uint16_t readVal;
+
+  if (paramStored(index, &readVal)) {
+    return paramFromEE(index, readVal);
+  }
+  #endif
+  return paramDefault(index);
+}
+
+// Find the parameter name at the start of userCommand, returns its index or -1. Binary search on the name index
+int8_t findParam(uint8_t *userCommand, uint32_t len){
+  uint32_t n = 0;
+  int      lo = 0, hi = PARAM_COUNT - 1, mid, c;
+
+  while (n < len && (userCommand[n] == '_' || (userCommand[n] >= '0' && userCommand[n] <= '9') ||
+         (userCommand[n] >= 'A' && userCommand[n] <= 'Z') || (userCommand[n] >= 'a' && userCommand[n] <= 'z'))) {
+    n++;
+  }
+  if (n == 0 || n == len) {
+    return -1; // Not found, or no end of line after the name
+  }
+
+  while (lo <= hi) {
+    mid = (lo + hi) >> 1;
+    c   = paramCmp(userCommand, n, params[paramIdx[mid]].name);
+    if (c == 0) {
+      return paramIdx[mid];
+    }
+    if (c < 0) {
+      hi = mid - 1;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return -1; // Not found
+}
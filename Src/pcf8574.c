@@ -6,53 +6,44 @@
  */
 
 #include "pcf8574.h"
+#include "i2cbus.h"
 
 PCF8574_RESULT PCF8574_Init(PCF8574_HandleTypeDef* handle) {
 
 	handle->PCF_I2C_ADDRESS &= 0x07;
 
-	/*if (handle->i2c.State == HAL_I2C_STATE_RESET) {
-		handle->i2c.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
-		handle->i2c.Init.DualAddressMode = I2C_DUALADDRESS_DISABLED;
-		handle->i2c.Init.DutyCycle = I2C_DUTYCYCLE_2;
-		handle->i2c.Init.NoStretchMode = I2C_NOSTRETCH_DISABLED;
-		handle->i2c.Init.OwnAddress1 = 0xFE;
-		if (HAL_I2C_Init(&handle->i2c) != HAL_OK) {
-			handle->errorCallback(PCF8574_ERROR);
-			return PCF8574_ERROR;
-		}
-	}*/
+	handle->hold = 0;	// the I2C bus itself is set up by I2C_Init()
 	return PCF8574_OK;
 }
 
 PCF8574_RESULT PCF8574_DeInit(PCF8574_HandleTypeDef* handle) {
-	HAL_I2C_DeInit(&handle->i2c);
+	handle->hold = 0;
 	return PCF8574_OK;
 }
 
 PCF8574_RESULT PCF8574_Write(PCF8574_HandleTypeDef* handle, uint8_t val) {
-	if (HAL_I2C_Master_Transmit(&handle->i2c,
-			(handle->PCF_I2C_ADDRESS << 1) | PCF8574_I2C_ADDRESS_MASK, &val, 1,
-			handle->PCF_I2C_TIMEOUT) != HAL_OK) {
+	if (!i2cWrite((handle->PCF_I2C_ADDRESS << 1) | PCF8574_I2C_ADDRESS_MASK,
+			&val, 1, handle->hold, NULL)) {
 		//handle->errorCallback(PCF8574_ERROR);
 		return PCF8574_ERROR;
 	}
-
-	/*if (HAL_I2C_Master_Transmit_DMA(&handle->i2c,
-			(handle->PCF_I2C_ADDRESS << 1) | PCF8574_I2C_ADDRESS_MASK, &val, 1) != HAL_OK) {
-		handle->errorCallback(PCF8574_ERROR);
-		//<return PCF8574_ERROR;
-	}*/
-
-	//HAL_I2C_Master_Transmit_DMA(&hi2c2, 0xA4, (uint8_t*)ai2cBuffer, 2);
+	handle->hold = 0;
 	return PCF8574_OK;
 }
 
-PCF8574_RESULT PCF8574_Read(PCF8574_HandleTypeDef* handle, uint8_t* val) {
-	if (HAL_I2C_Master_Receive(&handle->i2c,
-			(handle->PCF_I2C_ADDRESS << 1) | PCF8574_I2C_ADDRESS_MASK, val, 1,
-			handle->PCF_I2C_TIMEOUT) != HAL_OK) {
+PCF8574_RESULT PCF8574_Read(PCF8574_HandleTypeDef* handle, uint8_t* val, volatile uint8_t* pend) {
+	*pend = 1;
+	if (!i2cRead((handle->PCF_I2C_ADDRESS << 1) | PCF8574_I2C_ADDRESS_MASK,
+			val, 1, handle->hold, pend)) {
+		*pend = I2C_FAIL;
 		return PCF8574_ERROR;
 	}
+	handle->hold = 0;
 	return PCF8574_OK;
 }
+
+void PCF8574_Delay(PCF8574_HandleTypeDef* handle, uint8_t ms) {
+	if (ms > handle->hold) {
+		handle->hold = ms;
+	}
+}
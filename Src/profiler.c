@@ -0,0 +1,72 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Per-stage cycle profiler for the motor ISR, see profiler.h
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Includes
+#include <string.h>
+#include "stm32f1xx_hal.h"
+#include "config.h"
+#include "profiler.h"
+
+#ifdef DEBUG_ISR_PROFILER
+
+ProfStage         profStages[PRF_STAGES];
+volatile uint8_t  profResetReq;
+
+// Snapshot of the selected stage, read by the $GET / $WATCH commands (see comms.c)
+uint8_t  profSel = PRF_TOTAL;
+uint16_t profMin;
+uint16_t profMax;
+uint16_t profMean;
+uint32_t profHist[PRF_HIST_BINS];
+
+
+/* =========================== Profiler Functions =========================== */
+
+void profInit(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;   // enable the trace block, needed for the DWT
+  DWT->CYCCNT       = 0;
+  DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;       // start the cycle counter
+  profReset();
+}
+
+// Called from the ISR only (via profResetReq), so the statistics are never cleared half way through an update
+void profReset(void) {
+  memset(profStages, 0, sizeof(profStages));
+  for (uint8_t i = 0; i < PRF_STAGES; i++) {
+    profStages[i].min = 0xFFFF;
+  }
+  profResetReq = 0;
+}
+
+// Parameter callback: a new stage was selected, restart the statistics
+void profSelect(void) {
+  profResetReq = 1;
+}
+
+// Copy the selected stage for the debug protocol. Call periodically from the main loop.
+void profExport(void) {
+  const ProfStage *s = &profStages[profSel < PRF_STAGES ? profSel : PRF_TOTAL];
+
+  profMin   = (s->min == 0xFFFF) ? 0 : s->min;
+  profMax   = s->max;
+  profMean  = (uint16_t)(s->meanAcc >> PRF_MEAN_SHIFT);
+  memcpy(profHist, s->hist, sizeof(profHist));
+}
+
+#endif // DEBUG_ISR_PROFILER
@@ -0,0 +1,137 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Cooperative multi-rate scheduler for the main loop, see sched.h
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Includes
+#include "stm32f1xx_hal.h"
+#include "config.h"
+#include "defines.h"
+#include "sched.h"
+
+extern volatile uint32_t buzzerTimer;
+
+static SchedTask *taskTab;
+static uint32_t   busyCycles;           // [cycles] spent in tasks since loadStart
+static uint32_t   loadStart;            // [ticks]
+
+// Snapshot of the selected task, read by the $GET / $WATCH commands (see comms.c)
+uint8_t  schedSel = TASK_CONTROL;
+uint32_t schedRuns;
+uint32_t schedMisses;
+uint16_t schedExec;                     // [us] filtered mean
+uint16_t schedExecMax;                  // [us]
+uint16_t schedLate;                     // [us] max
+int32_t  schedSlack;                    // [us] min
+uint8_t  schedLoad;                     // [%] CPU time in tasks over the last second
+
+
+/* =========================== Scheduler Functions =========================== */
+
+// Start the tasks, all periodic tasks are due at once. Call once before the first schedDispatch()
+void schedInit(SchedTask *tasks) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;   // enable the trace block, needed for the DWT
+  DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;       // start the cycle counter
+  taskTab   = tasks;
+  loadStart = buzzerTimer;
+  for (uint8_t i = 0; i < TASK_COUNT; i++) {
+    taskTab[i].release = loadStart;
+  }
+}
+
+// Run a background task when no periodic task is due
+void schedTrigger(uint8_t id) {
+  if (!taskTab[id].trig) {
+    taskTab[id].release = buzzerTimer;
+    taskTab[id].trig    = 1;
+  }
+}
+
+static void schedRun(SchedTask *t, uint32_t now) {
+  uint32_t late  = now - t->release;
+  uint32_t start = DWT->CYCCNT;
+  uint32_t cycles;
+  int32_t  slack;
+
+  t->trig = 0;
+  t->run();
+  cycles = DWT->CYCCNT - start;
+  busyCycles += cycles;
+
+  t->runs++;
+  if (cycles > t->execMax) t->execMax = cycles;
+  t->execAcc += cycles - (t->execAcc >> SCHED_MEAN_SHIFT);
+  if (late > t->lateMax) t->lateMax = (uint16_t)MIN(late, UINT16_MAX);
+
+  if (t->period) {
+    t->release += t->period;
+    slack = (int32_t)(t->release - buzzerTimer);
+    if (slack < t->slackMin) t->slackMin = (int16_t)MAX(slack, INT16_MIN);
+    if (slack < 0) {
+      t->misses++;
+      if (-slack >= t->period) {
+        t->release = buzzerTimer;       // a whole period lost: run once now instead of a burst of late runs
+      }
+    }
+  }
+}
+
+// Run the highest priority task that is due. Returns 0 if there was none, the caller can then sleep until the next interrupt
+uint8_t schedDispatch(void) {
+  uint32_t now = buzzerTimer;
+  uint32_t elapsed;
+
+  for (uint8_t i = 0; i < TASK_COUNT; i++) {
+    SchedTask *t = &taskTab[i];
+    if (t->run && (t->period ? (int32_t)(now - t->release) >= 0 : t->trig)) {
+      schedRun(t, now);
+      return 1;
+    }
+  }
+
+  elapsed = now - loadStart;
+  if (elapsed >= SCHED_LOAD_WINDOW) {
+    schedLoad  = (uint8_t)MIN(busyCycles / (elapsed * (SCHED_CYCLES_TICK / 100)), 100);
+    busyCycles = 0;
+    loadStart  = now;
+  }
+  return 0;
+}
+
+// Parameter callback: a new task was selected, restart its statistics
+void schedSelect(void) {
+  SchedTask *t = &taskTab[schedSel < TASK_COUNT ? schedSel : TASK_CONTROL];
+
+  t->runs     = 0;
+  t->misses   = 0;
+  t->execMax  = 0;
+  t->execAcc  = 0;
+  t->lateMax  = 0;
+  t->slackMin = INT16_MAX;
+}
+
+// Copy the selected task for the debug protocol. Call periodically from a task
+void schedExport(void) {
+  const SchedTask *t = &taskTab[schedSel < TASK_COUNT ? schedSel : TASK_CONTROL];
+
+  schedRuns    = t->runs;
+  schedMisses  = t->misses;
+  schedExec    = (uint16_t)MIN((t->execAcc >> SCHED_MEAN_SHIFT) / 64, UINT16_MAX);
+  schedExecMax = (uint16_t)MIN(t->execMax / 64, UINT16_MAX);
+  schedLate    = (uint16_t)MIN((uint32_t)t->lateMax * 1000 / SCHED_TICKS_MS, UINT16_MAX);
+  schedSlack   = (t->slackMin == INT16_MAX) ? 0 : (int32_t)t->slackMin * 1000 / SCHED_TICKS_MS;
+}
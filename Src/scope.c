@@ -0,0 +1,213 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Triggered scope capture at the full PWM rate, see scope.h
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Includes
+#include "stm32f1xx_hal.h"
+#include "config.h"
+#include "defines.h"
+#include "util.h"
+#include "ramfunc.h"
+#include "scope.h"
+#include "BLDC_controller.h"
+
+#ifdef DEBUG_SCOPE
+
+extern UART_HandleTypeDef huart2;
+extern UART_HandleTypeDef huart3;
+
+extern ExtU rtU_Left;
+extern ExtY rtY_Left;
+extern ExtU rtU_Right;
+extern ExtY rtY_Right;
+
+#if defined(DEBUG_SERIAL_USART2)
+  #define SCOPE_UART  huart2
+#else
+  #define SCOPE_UART  huart3
+#endif
+
+uint8_t  scopeState = SCOPE_IDLE;       // [-] SCOPE_ state, written by the ISR while ARMED or TRIGGERED, by the main loop otherwise
+uint8_t  scopeCmd   = SCOPE_CMD_STOP;   // [-] last command, SCOPE_CMD_
+uint8_t  scopeTrig  = SCOPE_TRIG;       // [-] trigger mask, SCOPE_TRIG_ERR | SCOPE_TRIG_CUR
+uint16_t scopeThr   = SCOPE_THR;        // [-] current trigger threshold in ADC counts (A2BIT_CONV per A)
+uint16_t scopePre   = SCOPE_PRE;        // [samples] pre-trigger window
+uint8_t  scopeMotor = 0;                // [-] 0 = left, 1 = right
+
+static int16_t   scopeBuf[SCOPE_DEPTH][SCP_SIGNALS];
+static uint16_t  scopeWr;               // next slot to write
+static uint16_t  scopeFilled;           // samples written since arming, saturates at SCOPE_DEPTH
+static uint16_t  scopePreCur;           // pre-trigger samples of this capture
+static uint16_t  scopePostLeft;         // post-trigger samples still to record
+static uint16_t  scopeStart;            // slot of the first sample of the capture
+static uint16_t  scopeLen;              // samples in the capture
+static uint16_t  scopeSent;             // samples already drained
+static uint16_t  scopeCapture;          // capture number
+static uint8_t   scopeSource;           // trigger source that fired
+static uint8_t   scopeForce;            // force request from the main loop
+static uint8_t   scopeErrRef;           // z_errCode when armed
+static uint8_t   scopeMot;              // motor of this capture, latched when armed
+static uint8_t   scopeFrame[SCOPE_HEADER_SIZE + SCOPE_FRAME_SAMPLES * SCP_SIGNALS * 2 + 2];
+
+
+/* =========================== Scope Functions =========================== */
+
+// Prepare an empty capture and hand it over to the ISR
+static void scopeArm(void) {
+  scopeState  = SCOPE_IDLE;             // the ISR stops touching the capture
+  __DMB();
+  if (scopePre > SCOPE_DEPTH - 1) {
+    scopePre  = SCOPE_DEPTH - 1;
+  }
+  scopeWr     = 0;
+  scopeFilled = 0;
+  scopeSent   = 0;
+  scopeForce  = 0;
+  scopeMot    = scopeMotor;
+  scopeErrRef = scopeMot ? rtY_Right.z_errCode : rtY_Left.z_errCode;
+  __DMB();
+  scopeState  = SCOPE_ARMED;            // last: the ISR starts sampling
+}
+
+void scopeInit(void) {
+  scopeState   = SCOPE_IDLE;
+  scopeCapture = 0;
+  #ifdef SCOPE_ARM_AT_BOOT
+  scopeCmd     = SCOPE_CMD_NORMAL;
+  scopeArm();
+  #endif
+}
+
+// Callback for SCP_CMD
+void scopeCommand(void) {
+  switch (scopeCmd) {
+    case SCOPE_CMD_STOP:
+      scopeState = SCOPE_IDLE;
+      break;
+    case SCOPE_CMD_SINGLE:
+    case SCOPE_CMD_NORMAL:
+      scopeArm();
+      break;
+    case SCOPE_CMD_FORCE:               // trigger now, arms first if idle, ignored while a capture is in progress
+      if (scopeState == SCOPE_IDLE) {
+        scopeArm();
+      }
+      scopeForce = 1;
+      break;
+  }
+}
+
+// Called from the motor ISR every period while ARMED or TRIGGERED (see scopeTick)
+RAM_FUNC void scopeSample(void) {
+  const ExtU *u = scopeMot ? &rtU_Right : &rtU_Left;
+  const ExtY *y = scopeMot ? &rtY_Right : &rtY_Left;
+  uint16_t wr   = scopeWr;
+  int16_t  *s   = scopeBuf[wr];
+  uint8_t  trig = 0;
+
+  s[SCP_I_AB] = u->i_phaAB;
+  s[SCP_I_BC] = u->i_phaBC;
+  s[SCP_I_DC] = u->i_DCLink;
+  s[SCP_HALL] = (int16_t)(u->b_hallA | (u->b_hallB << 1) | (u->b_hallC << 2) | (y->z_errCode << 8));
+  s[SCP_DC_A] = y->DC_phaA;
+  s[SCP_DC_B] = y->DC_phaB;
+  s[SCP_DC_C] = y->DC_phaC;
+  s[SCP_IQ]   = y->iq;
+  s[SCP_ID]   = y->id;
+  scopeWr     = (wr + 1) & (SCOPE_DEPTH - 1);
+
+  if (scopeState == SCOPE_TRIGGERED) {
+    if (--scopePostLeft == 0) {
+      scopeState = SCOPE_DONE;
+    }
+    return;
+  }
+
+  // ARMED: look for the trigger
+  if (scopeForce) {
+    trig |= SCOPE_TRIG_CMD;
+  }
+  if ((scopeTrig & SCOPE_TRIG_ERR) && y->z_errCode != scopeErrRef) {
+    trig |= SCOPE_TRIG_ERR;
+  }
+  if ((scopeTrig & SCOPE_TRIG_CUR) && (ABS(u->i_phaAB) > scopeThr || ABS(u->i_phaBC) > scopeThr || ABS(u->i_DCLink) > scopeThr)) {
+    trig |= SCOPE_TRIG_CUR;
+  }
+  if (!trig) {
+    if (scopeFilled < SCOPE_DEPTH) {
+      scopeFilled++;                      // samples before this one
+    }
+    return;
+  }
+
+  scopePreCur   = (scopeFilled < scopePre) ? scopeFilled : scopePre;
+  scopePostLeft = SCOPE_DEPTH - 1 - scopePre;
+  scopeStart    = (wr - scopePreCur) & (SCOPE_DEPTH - 1);
+  scopeLen      = scopePreCur + 1 + scopePostLeft;
+  scopeSource   = trig;
+  scopeCapture++;
+  scopeState    = (scopePostLeft == 0) ? SCOPE_DONE : SCOPE_TRIGGERED;
+}
+
+static uint8_t *putU16(uint8_t *p, uint16_t v) {
+  *p++ = (uint8_t)v;
+  *p++ = (uint8_t)(v >> 8);
+  return p;
+}
+
+// Call from the main loop. Sends one frame of a finished capture when the UART DMA is idle, never waits.
+void scopeProcess(void) {
+  uint8_t  n, i, k;
+  uint8_t  *p;
+
+  if (scopeState != SCOPE_DONE || SCOPE_UART.gState != HAL_UART_STATE_READY) {
+    return;
+  }
+
+  n = (scopeLen - scopeSent > SCOPE_FRAME_SAMPLES) ? SCOPE_FRAME_SAMPLES : (uint8_t)(scopeLen - scopeSent);
+
+  p = putU16(scopeFrame, SCOPE_START_FRAME);
+  *p++ = SCOPE_VERSION;
+  *p++ = n;
+  p = putU16(p, scopeCapture);
+  p = putU16(p, (uint16_t)((int16_t)scopeSent - (int16_t)scopePreCur));
+  p = putU16(p, scopeLen);
+  *p++ = scopeSource;
+  *p++ = scopeMot;
+  for (i = 0; i < n; i++) {
+    const int16_t *s = scopeBuf[(scopeStart + scopeSent + i) & (SCOPE_DEPTH - 1)];
+    for (k = 0; k < SCP_SIGNALS; k++) {
+      p = putU16(p, (uint16_t)s[k]);
+    }
+  }
+  p = putU16(p, calcCRC16(&scopeFrame[2], (uint32_t)(p - &scopeFrame[2]), 0xFFFF));
+  if (!debugTxFrame(scopeFrame, (uint16_t)(p - scopeFrame))) {
+    return;                               // printf output took the UART first, send this frame again next loop
+  }
+
+  scopeSent += n;
+  if (scopeSent >= scopeLen) {            // capture drained: the frame is copied, the buffer can be reused
+    if (scopeCmd == SCOPE_CMD_NORMAL) {
+      scopeArm();
+    } else {
+      scopeState = SCOPE_IDLE;
+    }
+  }
+}
+
+#endif // DEBUG_SCOPE
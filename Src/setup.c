@@ -38,6 +38,7 @@ pb10 usart3 dma1 channel2/3
 #include "defines.h"
 #include "config.h"
 #include "setup.h"
+#include "i2cbus.h"
 
 TIM_HandleTypeDef htim_right;
 TIM_HandleTypeDef htim_left;
@@ -54,227 +55,143 @@ DMA_HandleTypeDef hdma_usart3_tx;
 volatile adc_buf_t adc_buffer;
 
 
-#if defined(DEBUG_SERIAL_USART2) || defined(CONTROL_SERIAL_USART2) || defined(FEEDBACK_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2)
- /* USART2 init function */
- void UART2_Init(void)
+#if defined(SERIAL_USART2) || defined(SERIAL_USART3)
+/* USART hardware, one row per port in use. UART_Init and the MSP functions are the same for every port */
+typedef struct {
+  UART_HandleTypeDef  *huart;
+  USART_TypeDef       *instance;
+  uint32_t             baudRate;
+  uint32_t             wordLength;
+  uint32_t             clkUsart;      // RCC_APB1ENR bit of the USART
+  uint32_t             clkGpio;       // RCC_APB2ENR bit of the GPIO port
+  GPIO_TypeDef        *port;
+  uint16_t             pinTx;
+  uint16_t             pinRx;
+  IRQn_Type            irq;
+  DMA_HandleTypeDef   *hdmarx;
+  DMA_Channel_TypeDef *dmaRx;
+  IRQn_Type            dmaRxIrq;
+  DMA_HandleTypeDef   *hdmatx;
+  DMA_Channel_TypeDef *dmaTx;
+  IRQn_Type            dmaTxIrq;
+} UartHw;
+
+static const UartHw uartHw[] = {
+  #ifdef SERIAL_USART2
+  /* PA2 ------> USART2_TX, PA3 ------> USART2_RX, Rx DMA1_Channel6, Tx DMA1_Channel7 */
+  { &huart2, USART2, USART2_BAUD, USART2_WORDLENGTH, RCC_APB1ENR_USART2EN, RCC_APB2ENR_IOPAEN, GPIOA, GPIO_PIN_2, GPIO_PIN_3, USART2_IRQn,
+    &hdma_usart2_rx, DMA1_Channel6, DMA1_Channel6_IRQn, &hdma_usart2_tx, DMA1_Channel7, DMA1_Channel7_IRQn },
+  #endif
+  #ifdef SERIAL_USART3
+  /* PB10 ------> USART3_TX, PB11 ------> USART3_RX, Rx DMA1_Channel3, Tx DMA1_Channel2 */
+  { &huart3, USART3, USART3_BAUD, USART3_WORDLENGTH, RCC_APB1ENR_USART3EN, RCC_APB2ENR_IOPBEN, GPIOB, GPIO_PIN_10, GPIO_PIN_11, USART3_IRQn,
+    &hdma_usart3_rx, DMA1_Channel3, DMA1_Channel3_IRQn, &hdma_usart3_tx, DMA1_Channel2, DMA1_Channel2_IRQn },
+  #endif
+};
+
+static const UartHw *UART_Hw(UART_HandleTypeDef *huart)
 {
-  /* DMA controller clock enable */
-  __HAL_RCC_DMA1_CLK_ENABLE();
-  
-  /* DMA1_Channel6_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(DMA1_Channel6_IRQn, 0, 0);
-  HAL_NVIC_EnableIRQ(DMA1_Channel6_IRQn);
-  /* DMA1_Channel7_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 0, 0);
-  HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
-  
-  huart2.Instance = USART2;
-  huart2.Init.BaudRate = USART2_BAUD;
-  huart2.Init.WordLength = USART2_WORDLENGTH;
-  huart2.Init.StopBits = UART_STOPBITS_1;
-  huart2.Init.Parity = UART_PARITY_NONE;
-  huart2.Init.Mode = UART_MODE_TX_RX;
-  huart2.Init.HwFlowCtl = UART_HWCONTROL_NONE;
-  huart2.Init.OverSampling = UART_OVERSAMPLING_16;
-  HAL_UART_Init(&huart2);
+  for (uint8_t i = 0; i < sizeof(uartHw) / sizeof(uartHw[0]); i++) {
+    if (uartHw[i].huart == huart) {
+      return &uartHw[i];
+    }
+  }
+  return NULL;
 }
-#endif
 
-#if defined(DEBUG_SERIAL_USART3) || defined(CONTROL_SERIAL_USART3) || defined(FEEDBACK_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
-/* USART3 init function */
-void UART3_Init(void)
+/* USART init function */
+void UART_Init(UART_HandleTypeDef *huart)
 {
+  const UartHw *hw = UART_Hw(huart);
+
   /* DMA controller clock enable */
   __HAL_RCC_DMA1_CLK_ENABLE();
 
-  /* DMA interrupt init */
-  /* DMA1_Channel2_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(DMA1_Channel2_IRQn, 0, 0);
-  HAL_NVIC_EnableIRQ(DMA1_Channel2_IRQn);
-  /* DMA1_Channel3_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(DMA1_Channel3_IRQn, 0, 0);
-  HAL_NVIC_EnableIRQ(DMA1_Channel3_IRQn);
-  
-  huart3.Instance = USART3;
-  huart3.Init.BaudRate = USART3_BAUD;
-  huart3.Init.WordLength = USART3_WORDLENGTH;
-  huart3.Init.StopBits = UART_STOPBITS_1;
-  huart3.Init.Parity = UART_PARITY_NONE;
-  huart3.Init.Mode = UART_MODE_TX_RX;
-  huart3.Init.HwFlowCtl = UART_HWCONTROL_NONE;
-  huart3.Init.OverSampling = UART_OVERSAMPLING_16;
-  HAL_UART_Init(&huart3);
+  /* DMA interrupt init, below the motor ISR: the callbacks decode and build whole frames */
+  HAL_NVIC_SetPriority(hw->dmaRxIrq, 1, 0);
+  HAL_NVIC_EnableIRQ(hw->dmaRxIrq);
+  HAL_NVIC_SetPriority(hw->dmaTxIrq, 1, 0);
+  HAL_NVIC_EnableIRQ(hw->dmaTxIrq);
+
+  huart->Instance = hw->instance;
+  huart->Init.BaudRate = hw->baudRate;
+  huart->Init.WordLength = hw->wordLength;
+  huart->Init.StopBits = UART_STOPBITS_1;
+  huart->Init.Parity = UART_PARITY_NONE;
+  huart->Init.Mode = UART_MODE_TX_RX;
+  huart->Init.HwFlowCtl = UART_HWCONTROL_NONE;
+  huart->Init.OverSampling = UART_OVERSAMPLING_16;
+  HAL_UART_Init(huart);
+}
+
+static void UART_DMA_Init(DMA_HandleTypeDef *hdma, DMA_Channel_TypeDef *channel, uint32_t direction, uint32_t mode)
+{
+  hdma->Instance = channel;
+  hdma->Init.Direction = direction;
+  hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma->Init.MemInc = DMA_MINC_ENABLE;
+  hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma->Init.Mode = mode;
+  hdma->Init.Priority = DMA_PRIORITY_LOW;
+  HAL_DMA_Init(hdma);
 }
-#endif
 
-#if defined(DEBUG_SERIAL_USART2) || defined(CONTROL_SERIAL_USART2) || defined(FEEDBACK_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2) || \
-    defined(DEBUG_SERIAL_USART3) || defined(CONTROL_SERIAL_USART3) || defined(FEEDBACK_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
 void HAL_UART_MspInit(UART_HandleTypeDef* uartHandle)
 {
   GPIO_InitTypeDef GPIO_InitStruct = {0};
-  if(uartHandle->Instance==USART2)
-  {
-  /* USER CODE BEGIN USART2_MspInit 0 */
+  const UartHw *hw = UART_Hw(uartHandle);
 
-  /* USER CODE END USART2_MspInit 0 */
-    /* USART2 clock enable */
-    __HAL_RCC_USART2_CLK_ENABLE();
-  
-    __HAL_RCC_GPIOA_CLK_ENABLE();
-    /**USART2 GPIO Configuration    
-    PA2     ------> USART2_TX
-    PA3     ------> USART2_RX 
-    */
-    GPIO_InitStruct.Pin = GPIO_PIN_2;
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
-    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-
-    GPIO_InitStruct.Pin = GPIO_PIN_3;
-    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
-    GPIO_InitStruct.Pull = GPIO_PULLUP;
-    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-
-    /* USART2 DMA Init */
-    /* USART2_RX Init */
-    hdma_usart2_rx.Instance = DMA1_Channel6;
-    hdma_usart2_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
-    hdma_usart2_rx.Init.PeriphInc = DMA_PINC_DISABLE;
-    hdma_usart2_rx.Init.MemInc = DMA_MINC_ENABLE;
-    hdma_usart2_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-    hdma_usart2_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
-    hdma_usart2_rx.Init.Mode = DMA_CIRCULAR;
-    hdma_usart2_rx.Init.Priority = DMA_PRIORITY_LOW;
-    HAL_DMA_Init(&hdma_usart2_rx);
-    __HAL_LINKDMA(uartHandle,hdmarx,hdma_usart2_rx);
-
-    /* USART2_TX Init */
-    hdma_usart2_tx.Instance = DMA1_Channel7;
-    hdma_usart2_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
-    hdma_usart2_tx.Init.PeriphInc = DMA_PINC_DISABLE;
-    hdma_usart2_tx.Init.MemInc = DMA_MINC_ENABLE;
-    hdma_usart2_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-    hdma_usart2_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
-    hdma_usart2_tx.Init.Mode = DMA_NORMAL;
-    hdma_usart2_tx.Init.Priority = DMA_PRIORITY_LOW;
-    HAL_DMA_Init(&hdma_usart2_tx);
-    __HAL_LINKDMA(uartHandle,hdmatx,hdma_usart2_tx);
-
-    /* USART2 interrupt Init */
-    HAL_NVIC_SetPriority(USART2_IRQn, 0, 0);
-    HAL_NVIC_EnableIRQ(USART2_IRQn);
-  /* USER CODE BEGIN USART2_MspInit 1 */
-	__HAL_UART_ENABLE_IT (uartHandle, UART_IT_IDLE);  // Enable the USART IDLE line detection interrupt
-  /* USER CODE END USART2_MspInit 1 */
+  if (hw == NULL) {
+    return;
   }
-  else if(uartHandle->Instance==USART3)
-  {
-  /* USER CODE BEGIN USART3_MspInit 0 */
 
-  /* USER CODE END USART3_MspInit 0 */
-    /* USART3 clock enable */
-    __HAL_RCC_USART3_CLK_ENABLE();
-  
-    __HAL_RCC_GPIOB_CLK_ENABLE();
-    /**USART3 GPIO Configuration    
-    PB10     ------> USART3_TX
-    PB11     ------> USART3_RX 
-    */
-    GPIO_InitStruct.Pin = GPIO_PIN_10;
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
-    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-    GPIO_InitStruct.Pin = GPIO_PIN_11;
-    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
-    GPIO_InitStruct.Pull = GPIO_PULLUP;
-    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-    /* USART3 DMA Init */
-    /* USART3_RX Init */
-    hdma_usart3_rx.Instance = DMA1_Channel3;
-    hdma_usart3_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
-    hdma_usart3_rx.Init.PeriphInc = DMA_PINC_DISABLE;
-    hdma_usart3_rx.Init.MemInc = DMA_MINC_ENABLE;
-    hdma_usart3_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-    hdma_usart3_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
-    hdma_usart3_rx.Init.Mode = DMA_CIRCULAR;
-    hdma_usart3_rx.Init.Priority = DMA_PRIORITY_LOW;
-    HAL_DMA_Init(&hdma_usart3_rx);
-    __HAL_LINKDMA(uartHandle,hdmarx,hdma_usart3_rx);
-
-    /* USART3_TX Init */
-    hdma_usart3_tx.Instance = DMA1_Channel2;
-    hdma_usart3_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
-    hdma_usart3_tx.Init.PeriphInc = DMA_PINC_DISABLE;
-    hdma_usart3_tx.Init.MemInc = DMA_MINC_ENABLE;
-    hdma_usart3_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-    hdma_usart3_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
-    hdma_usart3_tx.Init.Mode = DMA_NORMAL;
-    hdma_usart3_tx.Init.Priority = DMA_PRIORITY_LOW;
-    HAL_DMA_Init(&hdma_usart3_tx);
-    __HAL_LINKDMA(uartHandle,hdmatx,hdma_usart3_tx);
-
-    /* USART3 interrupt Init */
-    HAL_NVIC_SetPriority(USART3_IRQn, 0, 0);
-    HAL_NVIC_EnableIRQ(USART3_IRQn);
-  /* USER CODE BEGIN USART3_MspInit 1 */
-	__HAL_UART_ENABLE_IT (uartHandle, UART_IT_IDLE);  // Enable the USART IDLE line detection interrupt
-  /* USER CODE END USART3_MspInit 1 */
-  }
+  /* USART and GPIO clock enable */
+  SET_BIT(RCC->APB1ENR, hw->clkUsart);
+  SET_BIT(RCC->APB2ENR, hw->clkGpio);
+  (void)READ_BIT(RCC->APB2ENR, hw->clkGpio);      /* Delay after an RCC peripheral clock enabling */
+
+  GPIO_InitStruct.Pin = hw->pinTx;
+  GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+  HAL_GPIO_Init(hw->port, &GPIO_InitStruct);
+
+  GPIO_InitStruct.Pin = hw->pinRx;
+  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
+  HAL_GPIO_Init(hw->port, &GPIO_InitStruct);
+
+  /* USART DMA Init: circular Rx, normal Tx */
+  UART_DMA_Init(hw->hdmarx, hw->dmaRx, DMA_PERIPH_TO_MEMORY, DMA_CIRCULAR);
+  __HAL_LINKDMA(uartHandle,hdmarx,*hw->hdmarx);
+  UART_DMA_Init(hw->hdmatx, hw->dmaTx, DMA_MEMORY_TO_PERIPH, DMA_NORMAL);
+  __HAL_LINKDMA(uartHandle,hdmatx,*hw->hdmatx);
+
+  /* USART interrupt Init, below the motor ISR */
+  HAL_NVIC_SetPriority(hw->irq, 1, 0);
+  HAL_NVIC_EnableIRQ(hw->irq);
+  __HAL_UART_ENABLE_IT (uartHandle, UART_IT_IDLE);  // Enable the USART IDLE line detection interrupt
 }
 
 void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
 {
+  const UartHw *hw = UART_Hw(uartHandle);
 
-  if(uartHandle->Instance==USART2)
-  {
-  /* USER CODE BEGIN USART2_MspDeInit 0 */
-
-  /* USER CODE END USART2_MspDeInit 0 */
-    /* Peripheral clock disable */
-    __HAL_RCC_USART2_CLK_DISABLE();
-  
-    /**USART2 GPIO Configuration    
-    PA2     ------> USART2_TX
-    PA3     ------> USART2_RX 
-    */
-    HAL_GPIO_DeInit(GPIOA, GPIO_PIN_2|GPIO_PIN_3);
-
-    /* USART2 DMA DeInit */
-    HAL_DMA_DeInit(uartHandle->hdmarx);
-    HAL_DMA_DeInit(uartHandle->hdmatx);
-
-    /* USART2 interrupt Deinit */
-    HAL_NVIC_DisableIRQ(USART2_IRQn);
-  /* USER CODE BEGIN USART2_MspDeInit 1 */
-
-  /* USER CODE END USART2_MspDeInit 1 */
+  if (hw == NULL) {
+    return;
   }
-  else if(uartHandle->Instance==USART3)
-  {
-  /* USER CODE BEGIN USART3_MspDeInit 0 */
 
-  /* USER CODE END USART3_MspDeInit 0 */
-    /* Peripheral clock disable */
-    __HAL_RCC_USART3_CLK_DISABLE();
-  
-    /**USART3 GPIO Configuration    
-    PB10     ------> USART3_TX
-    PB11     ------> USART3_RX 
-    */
-    HAL_GPIO_DeInit(GPIOB, GPIO_PIN_10|GPIO_PIN_11);
+  /* Peripheral clock disable */
+  CLEAR_BIT(RCC->APB1ENR, hw->clkUsart);
 
-    /* USART3 DMA DeInit */
-    HAL_DMA_DeInit(uartHandle->hdmarx);
-    HAL_DMA_DeInit(uartHandle->hdmatx);
+  HAL_GPIO_DeInit(hw->port, hw->pinTx | hw->pinRx);
 
-    /* USART3 interrupt Deinit */
-    HAL_NVIC_DisableIRQ(USART3_IRQn);
-  /* USER CODE BEGIN USART3_MspDeInit 1 */
+  /* USART DMA DeInit */
+  HAL_DMA_DeInit(uartHandle->hdmarx);
+  HAL_DMA_DeInit(uartHandle->hdmatx);
 
-  /* USER CODE END USART3_MspDeInit 1 */
-  }
+  /* USART interrupt Deinit */
+  HAL_NVIC_DisableIRQ(hw->irq);
 } 
 #endif
 
@@ -299,7 +216,7 @@ void I2C_Init(void)
   /* Initialise I2C peripheral */
   __HAL_RCC_I2C2_CLK_ENABLE();
   hi2c2.Instance = I2C2;
-  hi2c2.Init.ClockSpeed = 200000;
+  hi2c2.Init.ClockSpeed = I2C_CLOCK;
   hi2c2.Init.DutyCycle = I2C_DUTYCYCLE_2;
   hi2c2.Init.OwnAddress1 = 0;
   hi2c2.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
@@ -348,12 +265,11 @@ void I2C_Init(void)
 
   __HAL_LINKDMA(&hi2c2,hdmatx,hdma_i2c2_tx);
 */
-  /* Peripheral interrupt init */
-/*  HAL_NVIC_SetPriority(I2C2_EV_IRQn, 0, 0);
+  /* Peripheral interrupt init, the transfers run from the interrupts (i2cbus.c), below the motor ISR */
+  HAL_NVIC_SetPriority(I2C2_EV_IRQn, 1, 0);
   HAL_NVIC_EnableIRQ(I2C2_EV_IRQn);
-  HAL_NVIC_SetPriority(I2C2_ER_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(I2C2_ER_IRQn, 1, 0);
   HAL_NVIC_EnableIRQ(I2C2_ER_IRQn);
-*/
 }
 
 void MX_GPIO_Init(void) {
@@ -37,6 +37,7 @@
 #include "defines.h"
 #include "config.h"
 #include "util.h"
+#include "i2cbus.h"
 
 extern DMA_HandleTypeDef hdma_i2c2_rx;
 extern DMA_HandleTypeDef hdma_i2c2_tx;
@@ -181,6 +182,8 @@ void SysTick_Handler(void) {
   HAL_IncTick();
   HAL_SYSTICK_IRQHandler();
   /* USER CODE BEGIN SysTick_IRQn 1 */
+  beepTick();
+
 #if defined(CONTROL_PPM_LEFT) || defined(CONTROL_PPM_RIGHT)
   PPM_SysTick_Callback();
 #endif
@@ -188,20 +191,32 @@ void SysTick_Handler(void) {
 #if defined(CONTROL_PWM_LEFT) || defined(CONTROL_PWM_RIGHT)
   PWM_SysTick_Callback();
 #endif
+
+#ifdef I2C_BUS
+  i2cTick();
+#endif
   /* USER CODE END SysTick_IRQn 1 */
 }
 
-#ifdef CONTROL_NUNCHUK
-extern I2C_HandleTypeDef hi2c2;
-void I2C1_EV_IRQHandler(void)
+#ifdef I2C_BUS
+/**
+* @brief This function handles I2C2 event interrupt.
+*/
+void I2C2_EV_IRQHandler(void)
 {
   HAL_I2C_EV_IRQHandler(&hi2c2);
 }
 
-void I2C1_ER_IRQHandler(void)
+/**
+* @brief This function handles I2C2 error interrupt.
+*/
+void I2C2_ER_IRQHandler(void)
 {
-  HAL_I2C_ER_IRQHandler(&hi2c2);
+  i2cErrorIrq();
 }
+#endif
+
+#ifdef CONTROL_NUNCHUK
 
 /**
 * @brief This function handles DMA1 channel4 global interrupt.
@@ -333,7 +348,7 @@ void DMA1_Channel3_IRQHandler(void)
 }
 #endif
 
-#if defined(DEBUG_SERIAL_USART2) || defined(CONTROL_SERIAL_USART2) || defined(FEEDBACK_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2)
+#ifdef SERIAL_USART2
 /**
   * @brief This function handles USART2 global interrupt.
   */
@@ -342,17 +357,14 @@ void USART2_IRQHandler(void)
   /* USER CODE BEGIN USART2_IRQn 0 */
 
   /* USER CODE END USART2_IRQn 0 */
-  HAL_UART_IRQHandler(&huart2);
+  serialIRQHandler(&serialCh[SERIAL_CH_USART2]);
   /* USER CODE BEGIN USART2_IRQn 1 */
-  if(RESET != __HAL_UART_GET_IT_SOURCE(&huart2, UART_IT_IDLE)) {  // Check for IDLE line interrupt
-      __HAL_UART_CLEAR_IDLEFLAG(&huart2);                         // Clear IDLE line flag (otherwise it will continue to enter interrupt)
-      usart2_rx_check();                                          // Check for data to process
-  }
+
   /* USER CODE END USART2_IRQn 1 */
 }
 #endif
 
-#if defined(DEBUG_SERIAL_USART3) || defined(CONTROL_SERIAL_USART3) || defined(FEEDBACK_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
+#ifdef SERIAL_USART3
 /**
   * @brief This function handles USART3 global interrupt.
   */
@@ -361,12 +373,9 @@ void USART3_IRQHandler(void)
   /* USER CODE BEGIN USART2_IRQn 0 */
 
   /* USER CODE END USART2_IRQn 0 */
-  HAL_UART_IRQHandler(&huart3);
+  serialIRQHandler(&serialCh[SERIAL_CH_USART3]);
   /* USER CODE BEGIN USART2_IRQn 1 */
-  if(RESET != __HAL_UART_GET_IT_SOURCE(&huart3, UART_IT_IDLE)) {  // Check for IDLE line interrupt  
-      __HAL_UART_CLEAR_IDLEFLAG(&huart3);                         // Clear IDLE line flag (otherwise it will continue to enter interrupt)
-      usart3_rx_check();                                          // Check for data to process
-  }
+
   /* USER CODE END USART2_IRQn 1 */
 }
 #endif
@@ -0,0 +1,156 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Binary telemetry stream on the debug serial port, see telemetry.h
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Includes
+#include "stm32f1xx_hal.h"
+#include "config.h"
+#include "defines.h"
+#include "util.h"
+#include "ramfunc.h"
+#include "telemetry.h"
+#include "BLDC_controller.h"
+
+#ifdef DEBUG_SERIAL_TELEMETRY
+
+extern UART_HandleTypeDef huart2;
+extern UART_HandleTypeDef huart3;
+
+extern ExtY rtY_Left;
+extern ExtY rtY_Right;
+extern int16_t batVoltage;
+extern int16_t curL_phaA, curL_phaB, curL_DC;
+extern int16_t curR_phaB, curR_phaC, curR_DC;
+
+#if defined(DEBUG_SERIAL_USART2)
+  #define TELEM_UART  huart2
+#else
+  #define TELEM_UART  huart3
+#endif
+
+uint8_t  telemEna   = 1;                // [-] streaming on/off
+uint16_t telemDiv   = TELEM_DIV;        // [-] PWM periods per sample
+uint16_t telemMask  = TELEM_MASK;       // [-] signals to send, bit n = signal n of the TLM_ enum
+uint32_t telemDrops = 0;                // [-] samples lost because the ring was full
+uint16_t telemCnt   = TELEM_DIV;        // [-] ISR countdown to the next sample
+
+static TelemSample       telemRing[TELEM_RING_SIZE];
+static volatile uint8_t  telemHead;     // written by the ISR
+static volatile uint8_t  telemTail;     // written by the main loop
+static uint16_t          telemIndex;    // sample index, counts the dropped samples too
+static uint8_t           telemFrame[TELEM_HEADER_SIZE + TELEM_FRAME_SAMPLES * TLM_SIGNALS * 2 + 2];
+
+
+/* =========================== Telemetry Functions =========================== */
+
+void telemInit(void) {
+  telemHead  = telemTail = 0;
+  telemIndex = 0;
+  telemCnt   = telemDiv;
+}
+
+// Called from the motor ISR every telemDiv periods (see telemTick). Copies all signals, the mask is applied when sending.
+RAM_FUNC void telemSample(void) {
+  uint8_t head = telemHead;
+  uint8_t next = (head + 1) & (TELEM_RING_SIZE - 1);
+
+  telemCnt = (telemDiv < TELEM_DIV_MIN) ? TELEM_DIV_MIN : telemDiv;
+  if (!telemEna) {
+    return;
+  }
+  if (next == telemTail) {                // ring full, the UART cannot keep up: drop the sample, the index gap shows it
+    telemDrops++;
+    telemIndex++;
+    return;
+  }
+
+  telemRing[head].index = telemIndex++;
+  int16_t *s = telemRing[head].sig;
+  s[TLM_IQ_L]     = rtY_Left.iq;
+  s[TLM_ID_L]     = rtY_Left.id;
+  s[TLM_N_L]      = rtY_Left.n_mot;
+  s[TLM_ANG_L]    = rtY_Left.a_elecAngle;
+  s[TLM_IQ_R]     = rtY_Right.iq;
+  s[TLM_ID_R]     = rtY_Right.id;
+  s[TLM_N_R]      = rtY_Right.n_mot;
+  s[TLM_ANG_R]    = rtY_Right.a_elecAngle;
+  s[TLM_BAT]      = batVoltage;
+  s[TLM_CUR_L_A]  = curL_phaA;
+  s[TLM_CUR_L_B]  = curL_phaB;
+  s[TLM_CUR_L_DC] = curL_DC;
+  s[TLM_CUR_R_B]  = curR_phaB;
+  s[TLM_CUR_R_C]  = curR_phaC;
+  s[TLM_CUR_R_DC] = curR_DC;
+  s[TLM_ERR]      = (int16_t)(rtY_Left.z_errCode | (rtY_Right.z_errCode << 8));
+  telemHead = next;
+}
+
+static uint8_t *putU16(uint8_t *p, uint16_t v) {
+  *p++ = (uint8_t)v;
+  *p++ = (uint8_t)(v >> 8);
+  return p;
+}
+
+// Call from the main loop. Sends the buffered samples as one frame when the UART DMA is idle, never waits.
+void telemProcess(void) {
+  uint8_t  tail, n, i;
+  uint16_t mask, index;
+  uint8_t  *p, *pN;
+
+  if (TELEM_UART.gState != HAL_UART_STATE_READY) {
+    return;                               // previous frame or printf output still being sent
+  }
+
+  tail = telemTail;
+  n    = (telemHead - tail) & (TELEM_RING_SIZE - 1);
+  if (n == 0) {
+    return;
+  }
+  if (n > TELEM_FRAME_SAMPLES) {
+    n = TELEM_FRAME_SAMPLES;
+  }
+
+  index = telemRing[tail].index;
+  mask  = telemMask;
+
+  p = putU16(telemFrame, TELEM_START_FRAME);
+  *p++ = TELEM_VERSION;
+  pN   = p++;
+  p = putU16(p, mask);
+  p = putU16(p, telemDiv);
+  p = putU16(p, index);
+  for (i = 0; i < n; i++) {
+    const TelemSample *s = &telemRing[(tail + i) & (TELEM_RING_SIZE - 1)];
+    if (s->index != (uint16_t)(index + i)) {
+      break;                              // samples were dropped here, the next frame starts after the gap
+    }
+    for (uint8_t k = 0; k < TLM_SIGNALS; k++) {
+      if (mask & (1U << k)) {
+        p = putU16(p, (uint16_t)s->sig[k]);
+      }
+    }
+  }
+  *pN = i;
+  p = putU16(p, calcCRC16(&telemFrame[2], (uint32_t)(p - &telemFrame[2]), 0xFFFF));
+
+  if (debugTxFrame(telemFrame, (uint16_t)(p - telemFrame))) {
+    telemTail = (tail + i) & (TELEM_RING_SIZE - 1);   // the samples are copied, free their slots
+  }
+}
+
+#endif // DEBUG_SERIAL_TELEMETRY
@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <stdlib.h> // for abs()
 #include <string.h>
+#include <stdarg.h>
 #include "stm32f1xx_hal.h"
 #include "defines.h"
 #include "setup.h"
@@ -30,6 +31,7 @@
 #include "BLDC_controller.h"
 #include "rtwtypes.h"
 #include "comms.h"
+#include "ramfunc.h"
 
 #if defined(DEBUG_I2C_LCD) || defined(SUPPORT_LCD)
 #include "hd44780.h"
@@ -47,9 +49,7 @@ extern UART_HandleTypeDef huart3;
 
 extern int16_t batVoltage;
 extern uint8_t backwardDrive;
-extern uint8_t buzzerCount;             // global variable for the buzzer counts. can be 1, 2, 3, 4, 5, 6, 7...
-extern uint8_t buzzerFreq;              // global variable for the buzzer pitch. can be 1, 2, 3, 4, 5, 6, 7...
-extern uint8_t buzzerPattern;           // global variable for the buzzer pattern. can be 1, 2, 3, 4, 5, 6, 7...
+extern volatile uint8_t buzzerTone;     // buzzer half period in PWM periods for the motor ISR, 0: silent
 
 extern uint8_t enable;                  // global variable for motor enable
 
@@ -116,9 +116,8 @@ float    setDistance;
 uint16_t VirtAddVarTab[NB_OF_VAR] = {1337};       // Virtual address defined by the user: 0xFFFF value is prohibited
 static   uint16_t saveValue       = 0;
 static   uint8_t  saveValue_valid = 0;
-#elif !defined(VARIANT_HOVERBOARD) && !defined(VARIANT_TRANSPOTTER)
-uint16_t VirtAddVarTab[NB_OF_VAR] = {1000, 1001, 1002, 1003, 1004, 1005, 1006, 1007, 1008, 1009,
-                                     1010, 1011, 1012, 1013, 1014, 1015, 1016, 1017, 1018};
+#elif defined(PARAM_EEPROM)
+uint16_t VirtAddVarTab[NB_OF_VAR] = {PARAM_EE_VADDR_LIST};   // Virtual addresses of the EEPROM slots, see params.h
 #else
 uint16_t VirtAddVarTab[NB_OF_VAR] = {1000};       // Dummy virtual address to avoid warnings
 #endif
@@ -130,6 +129,20 @@ uint16_t VirtAddVarTab[NB_OF_VAR] = {1000};       // Dummy virtual address to av
 static int16_t INPUT_MAX;             // [-] Input target maximum limitation
 static int16_t INPUT_MIN;             // [-] Input target minimum limitation
 
+static BeepStep          beepQueue[BEEP_QUEUE];  // tones to play, see beepTick()
+static volatile uint8_t  beepHead;      // written by the main loop
+static volatile uint8_t  beepTail;      // written by the SysTick
+static volatile uint16_t beepLeft;      // [ms] of the tone playing
+static uint8_t alarmCount;              // warning pattern of beepCount()
+static uint8_t alarmFreq;
+static uint8_t alarmPattern;
+static uint8_t buzzerCount;             // buzzer counts. can be 1, 2, 3, 4, 5, 6, 7...
+static uint8_t buzzerFreq;              // buzzer pitch. can be 1, 2, 3, 4, 5, 6, 7...
+static uint8_t buzzerPattern;           // buzzer pattern. can be 1, 2, 3, 4, 5, 6, 7...
+static uint8_t buzzerPrev;              // tone window active
+static uint8_t buzzerIdx;               // tone windows since the pause
+static uint8_t buzzerWin;               // window index in the pattern
+static uint16_t buzzerWinLeft;          // [ms] left in the window
 
 #if !defined(VARIANT_HOVERBOARD) && !defined(VARIANT_TRANSPOTTER)
   static uint8_t  cur_spd_valid  = 0;
@@ -140,50 +153,82 @@ static int16_t INPUT_MIN;             // [-] Input target minimum limitation
 static uint16_t timeoutCntADC = ADC_PROTECT_TIMEOUT;  // Timeout counter for ADC Protection
 #endif
 
-#if defined(DEBUG_SERIAL_USART2) || defined(CONTROL_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2)
-static uint8_t  rx_buffer_L[SERIAL_BUFFER_SIZE];      // USART Rx DMA circular buffer
-static uint32_t rx_buffer_L_len = ARRAY_LEN(rx_buffer_L);
-#endif
-#if defined(CONTROL_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2)
-static uint16_t timeoutCntSerial_L = SERIAL_TIMEOUT;  // Timeout counter for Rx Serial command
-static uint8_t  timeoutFlgSerial_L = 0;               // Timeout Flag for Rx Serial command: 0 = OK, 1 = Problem detected (line disconnected or wrong Rx data)
+// Serial channel table: the roles and input index of each port come from its config.h defines
+#ifdef SERIAL_USART2
+  #ifdef DEBUG_SERIAL_USART2
+    #define USART2_DEBUG      SERIAL_ROLE_DEBUG
+  #else
+    #define USART2_DEBUG      0
+  #endif
+  #ifdef FEEDBACK_SERIAL_USART2
+    #define USART2_FEEDBACK   SERIAL_ROLE_FEEDBACK
+  #else
+    #define USART2_FEEDBACK   0
+  #endif
+  #if defined(CONTROL_SERIAL_USART2)
+    #define USART2_INPUT      SERIAL_ROLE_CONTROL
+    #define USART2_INIDX      CONTROL_SERIAL_USART2
+  #elif defined(SIDEBOARD_SERIAL_USART2)
+    #define USART2_INPUT      SERIAL_ROLE_SIDEBOARD
+    #define USART2_INIDX      SIDEBOARD_SERIAL_USART2
+  #else
+    #define USART2_INPUT      0
+    #define USART2_INIDX      SERIAL_NO_INPUT
+  #endif
 #endif
-#if defined(SIDEBOARD_SERIAL_USART2)
-SerialSideboard Sideboard_L;
-SerialSideboard Sideboard_L_raw;
-static uint32_t Sideboard_L_len = sizeof(Sideboard_L);
+#ifdef SERIAL_USART3
+  #ifdef DEBUG_SERIAL_USART3
+    #define USART3_DEBUG      SERIAL_ROLE_DEBUG
+  #else
+    #define USART3_DEBUG      0
+  #endif
+  #ifdef FEEDBACK_SERIAL_USART3
+    #define USART3_FEEDBACK   SERIAL_ROLE_FEEDBACK
+  #else
+    #define USART3_FEEDBACK   0
+  #endif
+  #if defined(CONTROL_SERIAL_USART3)
+    #define USART3_INPUT      SERIAL_ROLE_CONTROL
+    #define USART3_INIDX      CONTROL_SERIAL_USART3
+  #elif defined(SIDEBOARD_SERIAL_USART3)
+    #define USART3_INPUT      SERIAL_ROLE_SIDEBOARD
+    #define USART3_INIDX      SIDEBOARD_SERIAL_USART3
+  #else
+    #define USART3_INPUT      0
+    #define USART3_INIDX      SERIAL_NO_INPUT
+  #endif
 #endif
 
-#if defined(DEBUG_SERIAL_USART3) || defined(CONTROL_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
-static uint8_t  rx_buffer_R[SERIAL_BUFFER_SIZE];      // USART Rx DMA circular buffer
-static uint32_t rx_buffer_R_len = ARRAY_LEN(rx_buffer_R);
-#endif
-#if defined(CONTROL_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
-static uint16_t timeoutCntSerial_R = SERIAL_TIMEOUT;  // Timeout counter for Rx Serial command
-static uint8_t  timeoutFlgSerial_R = 0;               // Timeout Flag for Rx Serial command: 0 = OK, 1 = Problem detected (line disconnected or wrong Rx data)
+#ifdef SERIAL_CHANNELS
+SerialChannel serialCh[SERIAL_CHANNELS] = {
+  #ifdef SERIAL_USART2
+  { .huart = &huart2, .irq = USART2_IRQn, .usart_idx = 2, .roles = USART2_DEBUG | USART2_FEEDBACK | USART2_INPUT, .inIdx = USART2_INIDX, .timeoutCnt = SERIAL_TIMEOUT },
+  #endif
+  #ifdef SERIAL_USART3
+  { .huart = &huart3, .irq = USART3_IRQn, .usart_idx = 3, .roles = USART3_DEBUG | USART3_FEEDBACK | USART3_INPUT, .inIdx = USART3_INIDX, .timeoutCnt = SERIAL_TIMEOUT },
+  #endif
+};
 #endif
-#if defined(SIDEBOARD_SERIAL_USART3)
-SerialSideboard Sideboard_R;
-SerialSideboard Sideboard_R_raw;
-static uint32_t Sideboard_R_len = sizeof(Sideboard_R);
+
+#ifdef SERIAL_FEEDBACK
+uint16_t fdbkPeriod = FEEDBACK_PERIOD;  // [main loops] feedback period, 0 = only on poll frames
+uint16_t fdbkDiv    = FEEDBACK_ISR_DIV; // [PWM periods] if not 0, the motor ISR requests the feedback instead
+uint16_t fdbkCnt    = FEEDBACK_ISR_DIV; // [-] ISR countdown to the next request
+static uint16_t       fdbkLoops;        // main loops since the last periodic request
+static SerialFeedback fdbkSnap[2];      // main loop snapshot, double buffered: the USART interrupt reads fdbkSnap[fdbkSnapIdx]
+static volatile uint8_t fdbkSnapIdx;
 #endif
 
-#if defined(CONTROL_SERIAL_USART2)
-static SerialCommand commandL;
-static SerialCommand commandL_raw;
-static uint32_t commandL_len = sizeof(commandL);
-  #ifdef CONTROL_IBUS
-  static uint16_t ibusL_captured_value[IBUS_NUM_CHANNELS];
-  #endif
+#ifdef VARIANT_HOVERBOARD
+  #define SERIAL_ROLE_PRIMARY SERIAL_ROLE_CONTROL       // input roles that report their timeout as Primary Input, the hoverboard sideboards are reported together
+#else
+  #define SERIAL_ROLE_PRIMARY SERIAL_ROLE_INPUT
 #endif
 
-#if defined(CONTROL_SERIAL_USART3)
-static SerialCommand commandR;
-static SerialCommand commandR_raw;
-static uint32_t commandR_len = sizeof(commandR);
-  #ifdef CONTROL_IBUS
-  static uint16_t ibusR_captured_value[IBUS_NUM_CHANNELS];
-  #endif
+#if defined(SIDEBOARD_SERIAL_USART2)
+  #define SERIAL_CH_SIDEBOARD SERIAL_CH_USART2      // sideboard used for the buttons, the left one if both are connected
+#elif defined(SIDEBOARD_SERIAL_USART3)
+  #define SERIAL_CH_SIDEBOARD SERIAL_CH_USART3
 #endif
 
 #if defined(SUPPORT_BUTTONS) || defined(SUPPORT_BUTTONS_LEFT) || defined(SUPPORT_BUTTONS_RIGHT)
@@ -199,30 +244,218 @@ static uint8_t brakePressed;
 static uint8_t cruiseCtrlAcv = 0;
 static uint8_t standstillAcv = 0;
 #endif
+#ifdef CRUISE_CONTROL_SUPPORT
+static uint32_t cruiseTick;             // [ms] last cruise control change
+#endif
 
 /* =========================== Retargeting printf =========================== */
-/* retarget the C library printf function to the USART */
+/* printf writes into a RAM ring that the debug USART TX DMA drains in the background, so printing never waits for the UART.
+ * When the ring is full the characters are dropped and counted in dbgTxDrops. Bulk dumps ($HELP, $GET) call debugTxWait() per line.
+ * printf, puts and putchar are replaced by a small integer-only formatter (%d %i %u %x %X %c %s %%, l, width, precision, 0 and - flags)
+ * so newlib printf is not linked. %f and the other float conversions need PRINTF_FLOAT_SUPPORT, which keeps the newlib printf on the same ring. */
 #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
-  #ifdef __GNUC__
-    #define PUTCHAR_PROTOTYPE int __io_putchar(int ch)
+  #if defined(DEBUG_SERIAL_USART2)
+    #define DEBUG_UART      huart2
+    #define DEBUG_UART_IRQn USART2_IRQn
   #else
-    #define PUTCHAR_PROTOTYPE int fputc(int ch, FILE *f)
+    #define DEBUG_UART      huart3
+    #define DEBUG_UART_IRQn USART3_IRQn
   #endif
-  PUTCHAR_PROTOTYPE {
-    #if defined(DEBUG_SERIAL_USART2)
-      HAL_UART_Transmit(&huart2, (uint8_t *)&ch, 1, 1000);
-    #elif defined(DEBUG_SERIAL_USART3)
-      HAL_UART_Transmit(&huart3, (uint8_t *)&ch, 1, 1000);
-    #endif
-    return ch;
+  #define DEBUG_TX_MASK     (DEBUG_TX_BUF_SIZE - 1)
+  #define DEBUG_TX_WAIT_MS  50            // [ms] max wait of debugTxWait(), a line at 115200 baud takes about 10 ms
+
+  static uint8_t           dbgTxBuf[DEBUG_TX_BUF_SIZE];
+  static volatile uint16_t dbgTxHead;   // next byte to write, only written by printf (main loop)
+  static volatile uint16_t dbgTxTail;   // next byte to send, only written by the TX complete callback
+  static volatile uint16_t dbgTxLen;    // bytes in the DMA transfer in progress, 0 = ring not being sent
+  uint32_t                 dbgTxDrops;  // characters dropped on a full ring
+
+  // Start the DMA on the next contiguous block of the ring. Runs in the USART IRQ, or with the USART IRQ masked (debugTxKick).
+  static void dbgTxStart(void) {
+    uint16_t head = dbgTxHead;
+    uint16_t tail = dbgTxTail;
+    uint16_t len;
+
+    if (dbgTxLen || head == tail || DEBUG_UART.gState != HAL_UART_STATE_READY) {
+      return;
+    }
+    len = ((head > tail) ? head : DEBUG_TX_BUF_SIZE) - tail;
+    dbgTxLen = len;
+    if (HAL_UART_Transmit_DMA(&DEBUG_UART, &dbgTxBuf[tail], len) != HAL_OK) {
+      dbgTxLen = 0;
+    }
   }
-  
-  #ifdef __GNUC__
+
+  void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+    if (huart == &DEBUG_UART) {
+      if (dbgTxLen) {
+        dbgTxTail = (dbgTxTail + dbgTxLen) & DEBUG_TX_MASK;
+        dbgTxLen  = 0;
+      }
+      dbgTxStart();                     // chain the next block, or give the UART to a waiting frame
+    }
+  }
+
+  // Send what printf buffered. Called by printf, call from the main loop when the UART may have been busy.
+  void debugTxKick(void) {
+    HAL_NVIC_DisableIRQ(DEBUG_UART_IRQn);
+    dbgTxStart();
+    HAL_NVIC_EnableIRQ(DEBUG_UART_IRQn);
+  }
+
+  // Send a binary frame with DMA (telemetry, scope). Returns 0 if the UART is busy with printf or another frame.
+  uint8_t debugTxFrame(uint8_t *data, uint16_t len) {
+    uint8_t ret = 0;
+    HAL_NVIC_DisableIRQ(DEBUG_UART_IRQn);
+    if (dbgTxLen == 0 && DEBUG_UART.gState == HAL_UART_STATE_READY) {
+      ret = (HAL_UART_Transmit_DMA(&DEBUG_UART, data, len) == HAL_OK);
+    }
+    HAL_NVIC_EnableIRQ(DEBUG_UART_IRQn);
+    return ret;
+  }
+
+  // Wait until len bytes fit in the ring, at most DEBUG_TX_WAIT_MS. For the bulk dumps of the main loop that exceed the ring
+  void debugTxWait(uint16_t len) {
+    uint32_t start = HAL_GetTick();
+
+    debugTxKick();
+    while (((dbgTxTail - dbgTxHead - 1) & DEBUG_TX_MASK) < len && HAL_GetTick() - start < DEBUG_TX_WAIT_MS);
+  }
+
+  static void dbgPutc(uint8_t ch) {
+    uint16_t head = dbgTxHead;
+    uint16_t next = (head + 1) & DEBUG_TX_MASK;
+
+    if (next == dbgTxTail) {            // ring full: drop, printf never waits for the UART
+      dbgTxDrops++;
+      return;
+    }
+    dbgTxBuf[head] = ch;
+    dbgTxHead      = next;
+  }
+
+  #if defined(__GNUC__) && !defined(PRINTF_FLOAT_SUPPORT)
+    // prec: minimum number of digits, -1 if not given. A precision turns off the 0 flag, as in C
+    static int dbgPutNum(uint32_t val, uint8_t base, uint8_t upper, uint8_t neg, uint8_t width, int8_t prec, uint8_t zero, uint8_t left) {
+      char    buf[11];
+      uint8_t n = 0, len, pad, lead;
+
+      while (val || (n == 0 && prec < 0)) {
+        uint8_t d = val % base;
+        buf[n++]  = (d < 10) ? '0' + d : (upper ? 'A' : 'a') + d - 10;
+        val      /= base;
+      }
+      lead = (prec > n) ? prec - n : 0;
+      len  = n + lead + neg;
+      pad  = (width > len) ? width - len : 0;
+      zero = zero && prec < 0;
+
+      if (neg && zero)  { dbgPutc('-'); }
+      if (!left)        { for (uint8_t i = 0; i < pad; i++) dbgPutc(zero ? '0' : ' '); }
+      if (neg && !zero) { dbgPutc('-'); }
+      while (lead--)    { dbgPutc('0'); }
+      while (n)         { dbgPutc(buf[--n]); }
+      if (left)         { for (uint8_t i = 0; i < pad; i++) dbgPutc(' '); }
+      return len + pad;
+    }
+
+    int printf(const char *fmt, ...) {
+      va_list  args;
+      int      cnt = 0;
+
+      va_start(args, fmt);
+      for (; *fmt; fmt++) {
+        uint8_t width = 0, zero = 0, left = 0, lng = 0;
+        int8_t  prec  = -1;
+        if (*fmt != '%') {
+          dbgPutc(*fmt);
+          cnt++;
+          continue;
+        }
+        fmt++;
+        if (*fmt == '-') { left = 1; fmt++; }
+        if (*fmt == '0') { zero = !left; fmt++; }
+        while (*fmt >= '0' && *fmt <= '9') { width = width * 10 + (*fmt++ - '0'); }
+        if (*fmt == '.') {
+          for (prec = 0, fmt++; *fmt >= '0' && *fmt <= '9'; fmt++) { prec = prec * 10 + (*fmt - '0'); }
+        }
+        while (*fmt == 'l' || *fmt == 'h') { lng |= (*fmt++ == 'l'); }
+        switch (*fmt) {
+          case 'd':
+          case 'i': {
+            int32_t v = lng ? va_arg(args, long) : va_arg(args, int);
+            cnt += dbgPutNum((v < 0) ? -(uint32_t)v : (uint32_t)v, 10, 0, v < 0, width, prec, zero, left);
+            break;
+          }
+          case 'u':
+            cnt += dbgPutNum(lng ? va_arg(args, unsigned long) : va_arg(args, unsigned int), 10, 0, 0, width, prec, zero, left);
+            break;
+          case 'x':
+          case 'X':
+            cnt += dbgPutNum(lng ? va_arg(args, unsigned long) : va_arg(args, unsigned int), 16, *fmt == 'X', 0, width, prec, zero, left);
+            break;
+          case 'c':
+            dbgPutc((uint8_t)va_arg(args, int));
+            cnt++;
+            break;
+          case 's': {
+            const char *str = va_arg(args, const char *);
+            size_t      len = 0;
+            while (str[len] && (prec < 0 || len < (size_t)prec)) { len++; }
+            if (!left) { for (; width > len; width--, cnt++) dbgPutc(' '); }
+            for (size_t i = 0; i < len; i++, cnt++) dbgPutc(str[i]);
+            if (left)  { for (; width > len; width--, cnt++) dbgPutc(' '); }
+            break;
+          }
+          case '%':
+            dbgPutc('%');
+            cnt++;
+            break;
+          case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            (void)va_arg(args, double);   // no float support: skip the argument so the next ones stay in place
+            dbgPutc('%');
+            dbgPutc(*fmt);
+            cnt += 2;
+            break;
+          default:                      // unsupported conversion: print it as is
+            if (!*fmt) { fmt--; break; }
+            dbgPutc('%');
+            dbgPutc(*fmt);
+            cnt += 2;
+            break;
+        }
+      }
+      va_end(args);
+      debugTxKick();
+      return cnt;
+    }
+
+    // gcc turns printf("text\n") into puts("text") and printf("c") into putchar('c')
+    int puts(const char *str) {
+      int cnt = 0;
+      for (; *str; str++, cnt++) { dbgPutc(*str); }
+      dbgPutc('\n');
+      debugTxKick();
+      return cnt + 1;
+    }
+
+    int (putchar)(int ch) {
+      dbgPutc((uint8_t)ch);
+      debugTxKick();
+      return ch;
+    }
+  #elif defined(__GNUC__)
     int _write(int file, char *data, int len) {
-      int i;
-      for (i = 0; i < len; i++) { __io_putchar( *data++ );}
+      for (int i = 0; i < len; i++) { dbgPutc(*data++); }
+      debugTxKick();
       return len;
     }
+  #else
+    int fputc(int ch, FILE *f) {
+      dbgPutc((uint8_t)ch);
+      debugTxKick();
+      return ch;
+    }
   #endif
 #endif
 
@@ -233,30 +466,22 @@ void BLDC_Init(void) {
   /* Set BLDC controller parameters */ 
   rtP_Left.b_angleMeasEna       = 0;            // Motor angle input: 0 = estimated angle, 1 = measured angle (e.g. if encoder is available)
   rtP_Left.z_selPhaCurMeasABC   = 0;            // Left motor measured current phases {Green, Blue} = {iA, iB} -> do NOT change
-  rtP_Left.z_ctrlTypSel         = CTRL_TYP_SEL;
   rtP_Left.b_diagEna            = DIAG_ENA;
-  rtP_Left.i_max                = (I_MOT_MAX * A2BIT_CONV) << 4;        // fixdt(1,16,4)
-  rtP_Left.n_max                = N_MOT_MAX << 4;                       // fixdt(1,16,4)
-  rtP_Left.b_fieldWeakEna       = FIELD_WEAK_ENA; 
-  rtP_Left.id_fieldWeakMax      = (FIELD_WEAK_MAX * A2BIT_CONV) << 4;   // fixdt(1,16,4)
-  rtP_Left.a_phaAdvMax          = PHASE_ADV_MAX << 4;                   // fixdt(1,16,4)
-  rtP_Left.r_fieldWeakHi        = FIELD_WEAK_HI << 4;                   // fixdt(1,16,4)
-  rtP_Left.r_fieldWeakLo        = FIELD_WEAK_LO << 4;                   // fixdt(1,16,4)
+  // z_ctrlTypSel, i_max, n_max, field weakening and the gains: set by paramInit() from params.h
 
   rtP_Right                     = rtP_Left;     // Copy the Left motor parameters to the Right motor parameters
   rtP_Right.z_selPhaCurMeasABC  = 1;            // Right motor measured current phases {Blue, Yellow} = {iB, iC} -> do NOT change
 
   /* Pack LEFT motor data into RTM */
-  rtM_Left->defaultParam        = &rtP_Left;
   rtM_Left->dwork               = &rtDW_Left;
   rtM_Left->inputs              = &rtU_Left;
   rtM_Left->outputs             = &rtY_Left;
 
   /* Pack RIGHT motor data into RTM */
-  rtM_Right->defaultParam       = &rtP_Right;
   rtM_Right->dwork              = &rtDW_Right;
   rtM_Right->inputs             = &rtU_Right;
   rtM_Right->outputs            = &rtY_Right;
+  ctrlParamInit();                              // the controllers run on a copy of rtP_Left/rtP_Right, see ctrlParamCommit()
 
   /* Initialize BLDC controllers */
   BLDC_controller_initialize(rtM_Left);
@@ -282,43 +507,19 @@ void Input_Init(void) {
     PWM_Init();
   #endif
 
-  #if defined(DEBUG_SERIAL_USART2) || defined(CONTROL_SERIAL_USART2) || defined(FEEDBACK_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2)
-    UART2_Init();
-  #endif
-  #if defined(DEBUG_SERIAL_USART3) || defined(CONTROL_SERIAL_USART3) || defined(FEEDBACK_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
-    UART3_Init();
-  #endif
-  #if defined(DEBUG_SERIAL_USART2) || defined(CONTROL_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2)
-    HAL_UART_Receive_DMA(&huart2, (uint8_t *)rx_buffer_L, sizeof(rx_buffer_L));
-    UART_DisableRxErrors(&huart2);
-  #endif
-  #if defined(DEBUG_SERIAL_USART3) || defined(CONTROL_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
-    HAL_UART_Receive_DMA(&huart3, (uint8_t *)rx_buffer_R, sizeof(rx_buffer_R));
-    UART_DisableRxErrors(&huart3);
+  #ifdef SERIAL_CHANNELS
+    serialInit();
   #endif
 
   #if !defined(VARIANT_HOVERBOARD) && !defined(VARIANT_TRANSPOTTER)
-    uint16_t writeCheck, readVal;
     HAL_FLASH_Unlock();
     EE_Init();            /* EEPROM Init */
-    EE_ReadVariable(VirtAddVarTab[0], &writeCheck);
-    if (writeCheck == FLASH_WRITE_KEY) {
+    if (paramLoad()) {    /* EE parameters of params.h, incl. the input calibration */
       #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
         printf("Using the configuration from EEprom\r\n");
       #endif
 
-      EE_ReadVariable(VirtAddVarTab[1] , &readVal); rtP_Left.i_max = rtP_Right.i_max = (int16_t)readVal;
-      EE_ReadVariable(VirtAddVarTab[2] , &readVal); rtP_Left.n_max = rtP_Right.n_max = (int16_t)readVal;
       for (uint8_t i=0; i<INPUTS_NR; i++) {
-        EE_ReadVariable(VirtAddVarTab[ 3+8*i] , &readVal); input1[i].typ = (uint8_t)readVal;
-        EE_ReadVariable(VirtAddVarTab[ 4+8*i] , &readVal); input1[i].min = (int16_t)readVal;
-        EE_ReadVariable(VirtAddVarTab[ 5+8*i] , &readVal); input1[i].mid = (int16_t)readVal;
-        EE_ReadVariable(VirtAddVarTab[ 6+8*i] , &readVal); input1[i].max = (int16_t)readVal;
-        EE_ReadVariable(VirtAddVarTab[ 7+8*i] , &readVal); input2[i].typ = (uint8_t)readVal;
-        EE_ReadVariable(VirtAddVarTab[ 8+8*i] , &readVal); input2[i].min = (int16_t)readVal;
-        EE_ReadVariable(VirtAddVarTab[ 9+8*i] , &readVal); input2[i].mid = (int16_t)readVal;
-        EE_ReadVariable(VirtAddVarTab[10+8*i] , &readVal); input2[i].max = (int16_t)readVal;
-      
         printf("Limits Input1: TYP:%i MIN:%i MID:%i MAX:%i\r\nLimits Input2: TYP:%i MIN:%i MID:%i MAX:%i\r\n",
           input1[i].typ, input1[i].min, input1[i].mid, input1[i].max,
           input2[i].typ, input2[i].min, input2[i].mid, input2[i].max);
@@ -365,8 +566,6 @@ void Input_Init(void) {
     I2C_Init();
     HAL_Delay(50);
     lcd.pcf8574.PCF_I2C_ADDRESS = 0x27;
-    lcd.pcf8574.PCF_I2C_TIMEOUT = 5;
-    lcd.pcf8574.i2c             = hi2c2;
     lcd.NUMBER_OF_LINES         = NUMBER_OF_LINES_2;
     lcd.type                    = TYPE0;
 
@@ -376,7 +575,6 @@ void Input_Init(void) {
     }
 
     LCD_ClearDisplay(&lcd);
-    HAL_Delay(5);
     LCD_SetLocation(&lcd, 0, 0);
     #ifdef VARIANT_TRANSPOTTER
       LCD_WriteString(&lcd, "TranspOtter V2.1");
@@ -388,7 +586,6 @@ void Input_Init(void) {
 
   #if defined(VARIANT_TRANSPOTTER) && defined(SUPPORT_LCD)
     LCD_ClearDisplay(&lcd);
-    HAL_Delay(5);
     LCD_SetLocation(&lcd,  0, 1); LCD_WriteString(&lcd, "Bat:");
     LCD_SetLocation(&lcd,  8, 1); LCD_WriteString(&lcd, "V");
     LCD_SetLocation(&lcd, 15, 1); LCD_WriteString(&lcd, "A");
@@ -404,45 +601,129 @@ void Input_Init(void) {
   * @param  huart: UART handle.
   * @retval None
   */
-#if defined(DEBUG_SERIAL_USART2) || defined(CONTROL_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2) || \
-    defined(DEBUG_SERIAL_USART3) || defined(CONTROL_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
+#ifdef SERIAL_CHANNELS
 void UART_DisableRxErrors(UART_HandleTypeDef *huart)
 {  
   CLEAR_BIT(huart->Instance->CR1, USART_CR1_PEIE);    /* Disable PE (Parity Error) interrupts */  
   CLEAR_BIT(huart->Instance->CR3, USART_CR3_EIE);     /* Disable EIE (Frame error, noise error, overrun error) interrupts */
 }
+
+ /*
+ * Initialize the serial channels: same sequence for every port, the roles select the parser and the Rx DMA
+ */
+void serialInit(void)
+{
+  for (uint8_t i = 0; i < SERIAL_CHANNELS; i++) {
+    SerialChannel *ch = &serialCh[i];
+    UART_Init(ch->huart);
+    #ifdef SERIAL_PARSER
+    serialParserInit(&ch->parser, ch->rxBuf, SERIAL_BUFFER_SIZE);
+    if (ch->roles & SERIAL_ROLE_CONTROL) {
+      serialParserAdd(&ch->parser, (uint8_t *)&ch->in.command, sizeof(ch->in.command), SERIAL_CMD_START, SERIAL_CMD_CHK);
+      #ifdef SERIAL_PROTOCOL_V2
+      serialParserAdd(&ch->parser, (uint8_t *)&ch->in.commandV2, sizeof(ch->in.commandV2), SERIAL_START_FRAME_V2, SERIAL_CHK_CRC16);
+      #ifdef SERIAL_DIRECT
+      serialParserAdd(&ch->parser, (uint8_t *)&ch->in.direct, sizeof(ch->in.direct), SERIAL_START_FRAME_DIRECT, SERIAL_CHK_CRC16);
+      #endif
+      #endif
+    } else if (ch->roles & SERIAL_ROLE_SIDEBOARD) {
+      serialParserAdd(&ch->parser, (uint8_t *)&ch->in.sideboard, sizeof(ch->in.sideboard), SERIAL_START_FRAME, SERIAL_CHK_XOR16);
+    }
+    if (ch->roles & SERIAL_ROLE_FEEDBACK) {                             // every feedback port answers a poll frame
+      serialParserAdd(&ch->parser, NULL, sizeof(SerialPoll), SERIAL_START_FRAME_POLL, SERIAL_CHK_CRC16);
+    }
+    #endif
+    if (ch->roles & SERIAL_ROLE_RX) {
+      HAL_UART_Receive_DMA(ch->huart, ch->rxBuf, SERIAL_BUFFER_SIZE);
+      UART_DisableRxErrors(ch->huart);
+    }
+  }
+}
 #endif
 
 
 /* =========================== General Functions =========================== */
 
+/*
+ * Buzzer sequencer
+ * - beepShort, beepLong and the melodies queue tones (frequency, duration) and return at once
+ * - beepTick() plays the queue from the 1 ms SysTick, so the tones keep their length while the main loop runs.
+ *   Without queued tones it applies the warning pattern set with beepCount()
+ * - the pattern is timed here, the motor ISR only generates the square wave of buzzerTone
+ */
+void beepTone(uint8_t freq, uint16_t ms) {
+    uint8_t next = (beepHead + 1) & (BEEP_QUEUE - 1);
+
+    if (next == beepTail) {
+      return;                           // queue full, drop the tone
+    }
+    beepQueue[beepHead].freq = freq;
+    beepQueue[beepHead].ms   = ms;
+    beepHead = next;
+}
+
+// SysTick, 1 ms
+void beepTick(void) {
+    if (beepLeft) {
+      beepLeft--;
+    }
+    if (beepLeft == 0) {
+      if (beepTail != beepHead) {       // next tone
+        buzzerCount   = 0;              // prevent interraction with beep counter
+        buzzerPattern = 0;
+        buzzerFreq    = beepQueue[beepTail].freq;
+        beepLeft      = beepQueue[beepTail].ms;
+        beepTail      = (beepTail + 1) & (BEEP_QUEUE - 1);
+      } else {                          // queue played: back to the warning pattern
+        buzzerCount   = alarmCount;
+        buzzerFreq    = alarmFreq;
+        buzzerPattern = alarmPattern;
+      }
+    }
+
+    // Tone windows of BEEP_WINDOW_MS, one every buzzerPattern + 1 windows. With buzzerCount, that many tones then a pause of 2 windows
+    if (buzzerWinLeft == 0 || --buzzerWinLeft == 0) {
+      buzzerWinLeft = BEEP_WINDOW_MS;
+      buzzerWin     = (buzzerWin >= buzzerPattern) ? 0 : buzzerWin + 1;
+    }
+    if (buzzerFreq != 0 && buzzerWin == 0) {
+      if (buzzerPrev == 0) {
+        buzzerPrev = 1;
+        if (++buzzerIdx > (buzzerCount + 2)) {  // pause 2 periods
+          buzzerIdx = 1;
+        }
+      }
+      buzzerTone = (buzzerIdx <= buzzerCount || buzzerCount == 0) ? buzzerFreq : 0;
+    } else {
+      buzzerPrev = 0;
+      buzzerTone = 0;
+    }
+}
+
+// Wait until the queued tones are played
+void beepWait(void) {
+    while (beepTail != beepHead || beepLeft) { }
+}
+
 void poweronMelody(void) {
-    buzzerCount = 0;  // prevent interraction with beep counter
     for (int i = 8; i >= 0; i--) {
-      buzzerFreq = (uint8_t)i;
-      HAL_Delay(100);
+      beepTone((uint8_t)i, 100);
     }
-    buzzerFreq = 0;
 }
 
+// Warning pattern, played when no tone is queued
 void beepCount(uint8_t cnt, uint8_t freq, uint8_t pattern) {
-    buzzerCount   = cnt;
-    buzzerFreq    = freq;
-    buzzerPattern = pattern;
+    alarmCount   = cnt;
+    alarmFreq    = freq;
+    alarmPattern = pattern;
 }
 
 void beepLong(uint8_t freq) {
-    buzzerCount = 0;  // prevent interraction with beep counter
-    buzzerFreq = freq;
-    HAL_Delay(500);
-    buzzerFreq = 0;
+    beepTone(freq, 500);
 }
 
 void beepShort(uint8_t freq) {
-    buzzerCount = 0;  // prevent interraction with beep counter
-    buzzerFreq = freq;
-    HAL_Delay(100);
-    buzzerFreq = 0;
+    beepTone(freq, 100);
 }
 
 void beepShortMany(uint8_t cnt, int8_t dir) {
@@ -650,6 +931,7 @@ void updateCurSpdLim(void) {
     rtP_Left.n_max = rtP_Right.n_max  = (int16_t)((N_MOT_MAX * spd_factor) >> 12);                 // fixdt(0,16,16) to fixdt(1,16,4)
     cur_spd_valid  += 2;  // Mark update to be saved in Flash at shutdown
   }
+  ctrlParamCommit();      // both limits of both motors in one switch
 
   #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
   // cur_spd_valid: 0 = No limit changed, 1 = Current limit changed, 2 = Speed limit changed, 3 = Both limits changed
@@ -677,6 +959,7 @@ void standstillHold(void) {
         rtP_Right.n_cruiseMotTgt  = 0;
         rtP_Left.b_cruiseCtrlEna  = 1;
         rtP_Right.b_cruiseCtrlEna = 1;
+        ctrlParamCommit();
         standstillAcv = 1;
       } 
     }
@@ -684,6 +967,7 @@ void standstillHold(void) {
       if (input1[inIdx].cmd < 20 && input2[inIdx].cmd > 50 && !cruiseCtrlAcv) { // Check if Brake is released AND Throttle is pressed AND no Cruise Control
         rtP_Left.b_cruiseCtrlEna  = 0;
         rtP_Right.b_cruiseCtrlEna = 0;
+        ctrlParamCommit();
         standstillAcv = 0;
       }
     }
@@ -736,17 +1020,24 @@ void electricBrake(uint16_t speedBlend, uint8_t reverseDir) {
  */
 void cruiseControl(uint8_t button) {
   #ifdef CRUISE_CONTROL_SUPPORT
+    if (button && HAL_GetTick() - cruiseTick < 200) {                   // 200 ms debounce after a change
+      return;
+    }
     if (button && !rtP_Left.b_cruiseCtrlEna) {                          // Cruise control activated
       rtP_Left.n_cruiseMotTgt   = rtY_Left.n_mot;
       rtP_Right.n_cruiseMotTgt  = rtY_Right.n_mot;
       rtP_Left.b_cruiseCtrlEna  = 1;
       rtP_Right.b_cruiseCtrlEna = 1;
+      ctrlParamCommit();
       cruiseCtrlAcv = 1;
-      beepShortMany(2, 1);                                              // 200 ms beep delay. Acts as a debounce also.
+      cruiseTick = HAL_GetTick();
+      beepShortMany(2, 1);
     } else if (button && rtP_Left.b_cruiseCtrlEna && !standstillAcv) {  // Cruise control deactivated if no Standstill Hold is active
       rtP_Left.b_cruiseCtrlEna  = 0;
       rtP_Right.b_cruiseCtrlEna = 0;
+      ctrlParamCommit();
       cruiseCtrlAcv = 0;
+      cruiseTick = HAL_GetTick();
       beepShortMany(2, -1);
     }
   #endif
@@ -853,45 +1144,42 @@ void readInputRaw(void) {
     }
     #endif
 
-    #if defined(CONTROL_SERIAL_USART2)
-    if (inIdx == CONTROL_SERIAL_USART2) {
-      #ifdef CONTROL_IBUS
-        for (uint8_t i = 0; i < (IBUS_NUM_CHANNELS * 2); i+=2) {
-          ibusL_captured_value[(i/2)] = CLAMP(commandL.channels[i] + (commandL.channels[i+1] << 8) - 1000, 0, INPUT_MAX); // 1000-2000 -> 0-1000
-        }
-        input1[inIdx].raw = (ibusL_captured_value[0] - 500) * 2;
-        input2[inIdx].raw = (ibusL_captured_value[1] - 500) * 2; 
-      #else
-        input1[inIdx].raw = commandL.steer;
-        input2[inIdx].raw = commandL.speed;
-      #endif
-    }
-    #endif
-    #if defined(CONTROL_SERIAL_USART3)
-    if (inIdx == CONTROL_SERIAL_USART3) {
-      #ifdef CONTROL_IBUS
-        for (uint8_t i = 0; i < (IBUS_NUM_CHANNELS * 2); i+=2) {
-          ibusR_captured_value[(i/2)] = CLAMP(commandR.channels[i] + (commandR.channels[i+1] << 8) - 1000, 0, INPUT_MAX); // 1000-2000 -> 0-1000
-        }
-        input1[inIdx].raw = (ibusR_captured_value[0] - 500) * 2;
-        input2[inIdx].raw = (ibusR_captured_value[1] - 500) * 2; 
-      #else
-        input1[inIdx].raw = commandR.steer;
-        input2[inIdx].raw = commandR.speed;
-      #endif
-    }
-    #endif
-
-    #if defined(SIDEBOARD_SERIAL_USART2)
-    if (inIdx == SIDEBOARD_SERIAL_USART2) {
-      input1[inIdx].raw = Sideboard_L.cmd1;
-      input2[inIdx].raw = Sideboard_L.cmd2;
-    }
-    #endif
-    #if defined(SIDEBOARD_SERIAL_USART3)
-    if (inIdx == SIDEBOARD_SERIAL_USART3) {
-      input1[inIdx].raw = Sideboard_R.cmd1;
-      input2[inIdx].raw = Sideboard_R.cmd2;
+    #ifdef SERIAL_INPUT
+    for (uint8_t i = 0; i < SERIAL_CHANNELS; i++) {
+      const SerialChannel *ch = &serialCh[i];
+      if (!(ch->roles & SERIAL_ROLE_INPUT) || inIdx != ch->inIdx) {
+        continue;
+      }
+      if (ch->roles & SERIAL_ROLE_SIDEBOARD) {
+        input1[inIdx].raw = ch->in.sideboard.cmd1;
+        input2[inIdx].raw = ch->in.sideboard.cmd2;
+      } else {
+        #ifdef CONTROL_IBUS
+          int16_t ibus_captured_value[2];
+          for (uint8_t k = 0; k < 2; k++) {
+            ibus_captured_value[k] = CLAMP(ch->in.command.channels[2*k] + (ch->in.command.channels[2*k+1] << 8) - 1000, 0, INPUT_MAX); // 1000-2000 -> 0-1000
+          }
+          input1[inIdx].raw = (ibus_captured_value[0] - 500) * 2;
+          input2[inIdx].raw = (ibus_captured_value[1] - 500) * 2;
+        #else
+          #ifdef SERIAL_DIRECT
+          if (ch->parser.last == SERIAL_FMT_DIRECT) {
+            input1[inIdx].raw = 0;                // Direct mode: the motor ISR takes the targets, the normal path idles at 0
+            input2[inIdx].raw = 0;
+            continue;
+          }
+          #endif
+          #ifdef SERIAL_PROTOCOL_V2
+          if (ch->parser.last == SERIAL_FMT_V2) {
+            input1[inIdx].raw = ch->in.commandV2.steer;
+            input2[inIdx].raw = ch->in.commandV2.speed;
+            continue;
+          }
+          #endif
+          input1[inIdx].raw = ch->in.command.steer;
+          input2[inIdx].raw = ch->in.command.speed;
+        #endif
+      }
     }
     #endif
 
@@ -957,54 +1245,53 @@ void handleTimeout(void) {
     }
     #endif
 
-    #if defined(CONTROL_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2)
-      if (timeoutCntSerial_L++ >= SERIAL_TIMEOUT) {     // Timeout qualification
-        timeoutFlgSerial_L = 1;                         // Timeout detected
-        timeoutCntSerial_L = SERIAL_TIMEOUT;            // Limit timout counter value
-        #if defined(DUAL_INPUTS) && ((defined(CONTROL_SERIAL_USART2) && CONTROL_SERIAL_USART2 == 1) || (defined(SIDEBOARD_SERIAL_USART2) && SIDEBOARD_SERIAL_USART2 == 1))
-          inIdx = 0;                                    // Switch to Primary input in case of Timeout on Auxiliary input
-        #endif
-      } else {                                          // No Timeout
-        #if defined(DUAL_INPUTS) && defined(SIDEBOARD_SERIAL_USART2)
-          if (Sideboard_L.sensors & SWA_SET) {          // If SWA is set, switch to Sideboard control
-            inIdx = SIDEBOARD_SERIAL_USART2;
-          } else {
-            inIdx = !SIDEBOARD_SERIAL_USART2;
-          }
-        #elif defined(DUAL_INPUTS) && (defined(CONTROL_SERIAL_USART2) && CONTROL_SERIAL_USART2 == 1)
-          inIdx = 1;                                    // Switch to Auxiliary input in case of NO Timeout on Auxiliary input
-        #endif
+    #ifdef SERIAL_INPUT
+    for (uint8_t i = 0; i < SERIAL_CHANNELS; i++) {
+      SerialChannel *ch = &serialCh[i];
+      if (!(ch->roles & SERIAL_ROLE_INPUT)) {
+        continue;
       }
-      #if (defined(CONTROL_SERIAL_USART2) && CONTROL_SERIAL_USART2 == 0) || (defined(SIDEBOARD_SERIAL_USART2) && SIDEBOARD_SERIAL_USART2 == 0 && !defined(VARIANT_HOVERBOARD))
-        timeoutFlgSerial = timeoutFlgSerial_L;          // Report Timeout only on the Primary Input
-      #endif
-    #endif
-
-    #if defined(CONTROL_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
-      if (timeoutCntSerial_R++ >= SERIAL_TIMEOUT) {     // Timeout qualification
-        timeoutFlgSerial_R = 1;                         // Timeout detected
-        timeoutCntSerial_R = SERIAL_TIMEOUT;            // Limit timout counter value
-        #if defined(DUAL_INPUTS) && ((defined(CONTROL_SERIAL_USART3) && CONTROL_SERIAL_USART3 == 1) || (defined(SIDEBOARD_SERIAL_USART3) && SIDEBOARD_SERIAL_USART3 == 1))
-          inIdx = 0;                                    // Switch to Primary input in case of Timeout on Auxiliary input
+      if (ch->rxFrames != ch->parser.frames) {          // Valid frame received since the last check
+        ch->rxFrames   = ch->parser.frames;
+        ch->timeoutFlg = 0;                             // Clear timeout flag
+        ch->timeoutCnt = 0;                             // Reset timeout counter
+      }
+      if (ch->timeoutCnt++ >= SERIAL_TIMEOUT) {         // Timeout qualification
+        ch->timeoutFlg = 1;                             // Timeout detected
+        ch->timeoutCnt = SERIAL_TIMEOUT;                // Limit timout counter value
+        #ifdef DUAL_INPUTS
+          if (ch->inIdx == 1) {
+            inIdx = 0;                                  // Switch to Primary input in case of Timeout on Auxiliary input
+          }
         #endif
       } else {                                          // No Timeout
-        #if defined(DUAL_INPUTS) && defined(SIDEBOARD_SERIAL_USART3)
-          if (Sideboard_R.sensors & SWA_SET) {          // If SWA is set, switch to Sideboard control
-            inIdx = SIDEBOARD_SERIAL_USART3;
-          } else {
-            inIdx = !SIDEBOARD_SERIAL_USART3;
+        #ifdef DUAL_INPUTS
+          if (ch->roles & SERIAL_ROLE_SIDEBOARD) {
+            if (ch->in.sideboard.sensors & SWA_SET) {   // If SWA is set, switch to Sideboard control
+              inIdx = ch->inIdx;
+            } else {
+              inIdx = !ch->inIdx;
+            }
+          } else if (ch->inIdx == 1) {
+            inIdx = 1;                                  // Switch to Auxiliary input in case of NO Timeout on Auxiliary input
           }
-        #elif defined(DUAL_INPUTS) && (defined(CONTROL_SERIAL_USART3) && CONTROL_SERIAL_USART3 == 1)
-          inIdx = 1;                                    // Switch to Auxiliary input in case of NO Timeout on Auxiliary input
         #endif
       }
-      #if (defined(CONTROL_SERIAL_USART3) && CONTROL_SERIAL_USART3 == 0) || (defined(SIDEBOARD_SERIAL_USART3) && SIDEBOARD_SERIAL_USART3 == 0 && !defined(VARIANT_HOVERBOARD))
-        timeoutFlgSerial = timeoutFlgSerial_R;          // Report Timeout only on the Primary Input
-      #endif
+      if (ch->inIdx == 0 && (ch->roles & SERIAL_ROLE_PRIMARY)) {
+        timeoutFlgSerial = ch->timeoutFlg;              // Report Timeout only on the Primary Input
+      }
+    }
+    #ifdef SERIAL_DIRECT
+    for (uint8_t i = 0; i < SERIAL_CHANNELS; i++) {     // Direct mode ends with a timeout of its port or a switch to another input
+      if (serialCh[i].roles & SERIAL_ROLE_CONTROL) {
+        directCheck(serialCh[i].inIdx, inIdx, serialCh[i].timeoutFlg);
+      }
+    }
+    #endif
     #endif
 
     #if defined(SIDEBOARD_SERIAL_USART2) && defined(SIDEBOARD_SERIAL_USART3)
-      timeoutFlgSerial = timeoutFlgSerial_L || timeoutFlgSerial_R;
+      timeoutFlgSerial = serialCh[SERIAL_CH_USART2].timeoutFlg || serialCh[SERIAL_CH_USART3].timeoutFlg;
     #endif
 
     #if defined(CONTROL_NUNCHUK) || defined(SUPPORT_NUNCHUK) || defined(VARIANT_TRANSPOTTER) || \
@@ -1085,148 +1372,181 @@ void readCommand(void) {
 
 
 /*
- * Check for new data received on USART2 with DMA: refactored function from https://github.com/MaJerle/stm32-usart-uart-dma-rx-tx
- * - this function is called for every USART IDLE line detection, in the USART interrupt handler
+ * Feedback
+ * - the main loop stores a snapshot of the feedback every loop (serialFeedbackProcess), double buffered so the
+ *   USART interrupt never reads a half written one
+ * - a request (every fdbkPeriod loops, every fdbkDiv motor ISR periods, or a poll frame on the port) sets txReq
+ *   of the feedback ports and pends their USART interrupt
+ * - the USART interrupt builds the frame of its port from the latest snapshot and the current speeds as soon as
+ *   its Tx DMA is idle, so a frame is never overwritten while it is being sent and the data is never older than
+ *   one main loop. A request made while a frame is still being sent is served by the transfer complete interrupt
  */
-void usart2_rx_check(void)
+#ifdef SERIAL_FEEDBACK
+void serialFeedbackProcess(const SerialFeedback *fb)
 {
-  #if defined(DEBUG_SERIAL_USART2) || defined(CONTROL_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2)  
-  static uint32_t old_pos;
-  uint32_t pos;
-  pos = rx_buffer_L_len - __HAL_DMA_GET_COUNTER(huart2.hdmarx);         // Calculate current position in buffer
-  #endif
+  uint8_t back = fdbkSnapIdx ^ 1;
 
-  #if defined(DEBUG_SERIAL_USART2)
-  uint8_t ptr_debug[SERIAL_BUFFER_SIZE];
-  if (pos != old_pos) {                                                 // Check change in received data
-    if (pos > old_pos) {                                                // "Linear" buffer mode: check if current position is over previous one
-      usart_process_debug(&rx_buffer_L[old_pos], pos - old_pos);        // Process data
-    } else {                                                            // "Overflow" buffer mode
-      memcpy(&ptr_debug[0], &rx_buffer_L[old_pos], rx_buffer_L_len - old_pos);    // First copy data from the end of buffer
-      if (pos > 0) {                                                    // Check and continue with beginning of buffer
-        memcpy(&ptr_debug[rx_buffer_L_len - old_pos], &rx_buffer_L[0], pos);                              // Copy remaining data
-      }
-      usart_process_debug(ptr_debug, rx_buffer_L_len - old_pos + pos);        // Process data
-    }
+  fdbkSnap[back] = *fb;
+  fdbkSnapIdx    = back;                                                // the USART interrupt uses the new snapshot from now on
+
+  if (fdbkDiv == 0 && fdbkPeriod != 0 && ++fdbkLoops >= fdbkPeriod) {
+    fdbkLoops = 0;
+    serialFeedbackRequest();
   }
-  #endif // DEBUG_SERIAL_USART2
-
-  #ifdef CONTROL_SERIAL_USART2
-  uint8_t *ptr;	
-  if (pos != old_pos) {                                                 // Check change in received data
-    ptr = (uint8_t *)&commandL_raw;                                     // Initialize the pointer with command_raw address
-    if (pos > old_pos && (pos - old_pos) == commandL_len) {             // "Linear" buffer mode: check if current position is over previous one AND data length equals expected length
-      memcpy(ptr, &rx_buffer_L[old_pos], commandL_len);                 // Copy data. This is possible only if command_raw is contiguous! (meaning all the structure members have the same size)
-      usart_process_command(&commandL_raw, &commandL, 2);               // Process data
-    } else if ((rx_buffer_L_len - old_pos + pos) == commandL_len) {     // "Overflow" buffer mode: check if data length equals expected length
-      memcpy(ptr, &rx_buffer_L[old_pos], rx_buffer_L_len - old_pos);    // First copy data from the end of buffer
-      if (pos > 0) {                                                    // Check and continue with beginning of buffer
-        ptr += rx_buffer_L_len - old_pos;                               // Move to correct position in command_raw
-        memcpy(ptr, &rx_buffer_L[0], pos);                              // Copy remaining data
-      }
-      usart_process_command(&commandL_raw, &commandL, 2);               // Process data
+}
+
+// Request a feedback frame on every feedback port. Called from the main loop and from the motor ISR
+RAM_FUNC void serialFeedbackRequest(void)
+{
+  for (uint8_t i = 0; i < SERIAL_CHANNELS; i++) {
+    if (serialCh[i].roles & SERIAL_ROLE_FEEDBACK) {
+      serialCh[i].txReq = 1;
+      NVIC_SetPendingIRQ(serialCh[i].irq);
     }
   }
-  #endif // CONTROL_SERIAL_USART2
-
-  #ifdef SIDEBOARD_SERIAL_USART2
-  uint8_t *ptr;	
-  if (pos != old_pos) {                                                 // Check change in received data
-    ptr = (uint8_t *)&Sideboard_L_raw;                                  // Initialize the pointer with Sideboard_raw address
-    if (pos > old_pos && (pos - old_pos) == Sideboard_L_len) {          // "Linear" buffer mode: check if current position is over previous one AND data length equals expected length
-      memcpy(ptr, &rx_buffer_L[old_pos], Sideboard_L_len);              // Copy data. This is possible only if Sideboard_raw is contiguous! (meaning all the structure members have the same size)
-      usart_process_sideboard(&Sideboard_L_raw, &Sideboard_L, 2);       // Process data
-    } else if ((rx_buffer_L_len - old_pos + pos) == Sideboard_L_len) {  // "Overflow" buffer mode: check if data length equals expected length
-      memcpy(ptr, &rx_buffer_L[old_pos], rx_buffer_L_len - old_pos);    // First copy data from the end of buffer
-      if (pos > 0) {                                                    // Check and continue with beginning of buffer
-        ptr += rx_buffer_L_len - old_pos;                               // Move to correct position in Sideboard_raw
-        memcpy(ptr, &rx_buffer_L[0], pos);                              // Copy remaining data
-      }
-      usart_process_sideboard(&Sideboard_L_raw, &Sideboard_L, 2);       // Process data
-    }
+}
+
+// Callback for FDBK_DIV
+void serialFeedbackDiv(void)
+{
+  if (fdbkDiv != 0 && fdbkDiv < FEEDBACK_ISR_DIV_MIN) {
+    fdbkDiv = FEEDBACK_ISR_DIV_MIN;
   }
-  #endif // SIDEBOARD_SERIAL_USART2
+  fdbkCnt = fdbkDiv;
+}
+
+// Called in the USART interrupt: build and send the requested frame once the Tx DMA is idle
+static void serialTxCheck(SerialChannel *ch)
+{
+  const SerialFeedback *fb;
 
-  #if defined(DEBUG_SERIAL_USART2) || defined(CONTROL_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART2)
-  old_pos = pos;                                                        // Update old position
-  if (old_pos == rx_buffer_L_len) {                                     // Check and manually update if we reached end of buffer
-    old_pos = 0;
+  if (!ch->txReq || ch->huart->gState != HAL_UART_STATE_READY) {
+    return;                                                             // nothing to send, or the transfer complete interrupt comes back here
+  }
+  ch->txReq = 0;
+  fb = &fdbkSnap[fdbkSnapIdx];
+
+  #ifdef SERIAL_PROTOCOL_V2
+  if ((ch->roles & SERIAL_ROLE_CONTROL) && ch->parser.last != SERIAL_FMT_V1) {    // the host spoke v2 (or direct) last: answer in v2
+    SerialFeedbackV2 *v2 = &ch->feedback.v2;
+    v2->start       = SERIAL_START_FRAME_V2;
+    v2->seq         = ch->txSeq++;
+    v2->time        = HAL_GetTick();
+    v2->cmdSeq      = ch->in.commandV2.seq;                              // same place in SerialDirect
+    v2->cmdCnt      = (uint16_t)ch->parser.frames;
+    v2->cmd1        = fb->cmd1;
+    v2->cmd2        = fb->cmd2;
+    v2->speedR_meas = (int16_t)rtY_Right.n_mot;
+    v2->speedL_meas = (int16_t)rtY_Left.n_mot;
+    v2->batVoltage  = fb->batVoltage;
+    v2->boardTemp   = fb->boardTemp;
+    v2->cmdLed      = fb->cmdLed | ch->leds;
+    v2->crc         = calcCRC16((const uint8_t *)&v2->seq, sizeof(*v2) - 4, 0xFFFF);
+    HAL_UART_Transmit_DMA(ch->huart, (uint8_t *)v2, sizeof(*v2));
+    return;
   }
-	#endif
+  #endif
+  SerialFeedback *v1 = &ch->feedback.v1;
+  *v1               = *fb;
+  v1->speedR_meas   = (int16_t)rtY_Right.n_mot;
+  v1->speedL_meas   = (int16_t)rtY_Left.n_mot;
+  v1->cmdLed        = fb->cmdLed | ch->leds;
+  v1->checksum      = (uint16_t)(v1->start ^ v1->cmd1 ^ v1->cmd2 ^ v1->speedR_meas ^ v1->speedL_meas
+                                 ^ v1->batVoltage ^ v1->boardTemp ^ v1->cmdLed);
+  HAL_UART_Transmit_DMA(ch->huart, (uint8_t *)v1, sizeof(*v1));
 }
+#endif
+
+/*
+ * Frames decoded on an input or feedback channel: answer a poll frame, hand a direct frame to the motor ISR
+ */
+#ifdef SERIAL_PARSER
+static void serialRxFrames(SerialChannel *ch)
+{
+  #ifdef SERIAL_FEEDBACK
+  if (ch->parser.polls != ch->rxPolls) {                                // A poll frame requests a feedback frame on this port
+    ch->rxPolls = ch->parser.polls;
+    ch->txReq   = 1;
+    NVIC_SetPendingIRQ(ch->irq);
+  }
+  #endif
 
+  #ifdef SERIAL_DIRECT
+  if (ch->parser.frames != ch->rxParsed && (ch->roles & SERIAL_ROLE_CONTROL) && ch->inIdx == inIdx) {
+    ch->rxParsed = ch->parser.frames;
+    if (ch->parser.last == SERIAL_FMT_DIRECT) {                         // Only the last frame counts, the motor ISR takes it at the next PWM period
+      int16_t tgtL = (int16_t)CLAMP(ch->in.direct.tgtL, -1000, 1000);
+      int16_t tgtR = (int16_t)CLAMP(ch->in.direct.tgtR, -1000, 1000);
+      #ifdef INVERT_L_DIRECTION
+        tgtL = -tgtL;
+      #endif
+      #ifndef INVERT_R_DIRECTION
+        tgtR = -tgtR;
+      #endif
+      directSet(ch->inIdx, tgtL, tgtR);
+    } else {
+      directEnd();                                                      // Back to the normal command path
+    }
+  }
+  #endif
+}
+#endif
 
 /*
- * Check for new data received on USART3 with DMA: refactored function from https://github.com/MaJerle/stm32-usart-uart-dma-rx-tx
+ * Check for new data received on a serial channel with DMA: refactored function from https://github.com/MaJerle/stm32-usart-uart-dma-rx-tx
  * - this function is called for every USART IDLE line detection, in the USART interrupt handler
  */
-void usart3_rx_check(void)
+#ifdef SERIAL_CHANNELS
+static void serialRxCheck(SerialChannel *ch)
 {
-  #if defined(DEBUG_SERIAL_USART3) || defined(CONTROL_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
-  static uint32_t old_pos;
-  uint32_t pos;  
-  pos = rx_buffer_R_len - __HAL_DMA_GET_COUNTER(huart3.hdmarx);         // Calculate current position in buffer
-  #endif
+  uint16_t pos;
 
-  #if defined(DEBUG_SERIAL_USART3)
-  uint8_t ptr_debug[SERIAL_BUFFER_SIZE];
+  if (!(ch->roles & SERIAL_ROLE_RX)) {
+    return;
+  }
+  pos = SERIAL_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(ch->huart->hdmarx);    // Calculate current position in buffer
 
-  if (pos != old_pos) {                                                 // Check change in received data
+  #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
+  if ((ch->roles & SERIAL_ROLE_DEBUG) && pos != ch->rxOld) {            // Check change in received data
+    uint8_t  ptr_debug[SERIAL_BUFFER_SIZE];
+    uint16_t old_pos = ch->rxOld;
     if (pos > old_pos) {                                                // "Linear" buffer mode: check if current position is over previous one
-      usart_process_debug(&rx_buffer_R[old_pos], pos - old_pos);        // Process data
+      usart_process_debug(&ch->rxBuf[old_pos], pos - old_pos);          // Process data
     } else {                                                            // "Overflow" buffer mode
-      memcpy(&ptr_debug[0], &rx_buffer_R[old_pos], rx_buffer_R_len - old_pos);    // First copy data from the end of buffer
+      memcpy(&ptr_debug[0], &ch->rxBuf[old_pos], SERIAL_BUFFER_SIZE - old_pos);   // First copy data from the end of buffer
       if (pos > 0) {                                                    // Check and continue with beginning of buffer
-        memcpy(&ptr_debug[rx_buffer_R_len - old_pos], &rx_buffer_R[0], pos);                              // Copy remaining data
+        memcpy(&ptr_debug[SERIAL_BUFFER_SIZE - old_pos], &ch->rxBuf[0], pos);     // Copy remaining data
       }
-      usart_process_debug(ptr_debug, rx_buffer_R_len - old_pos + pos);        // Process data
+      usart_process_debug(ptr_debug, SERIAL_BUFFER_SIZE - old_pos + pos);         // Process data
     }
   }
-  #endif // DEBUG_SERIAL_USART3
-
-  #ifdef CONTROL_SERIAL_USART3
-  uint8_t *ptr;
-  if (pos != old_pos) {                                                 // Check change in received data
-    ptr = (uint8_t *)&commandR_raw;                                     // Initialize the pointer with command_raw address
-    if (pos > old_pos && (pos - old_pos) == commandR_len) {             // "Linear" buffer mode: check if current position is over previous one AND data length equals expected length
-      memcpy(ptr, &rx_buffer_R[old_pos], commandR_len);                 // Copy data. This is possible only if command_raw is contiguous! (meaning all the structure members have the same size)
-      usart_process_command(&commandR_raw, &commandR, 3);               // Process data
-    } else if ((rx_buffer_R_len - old_pos + pos) == commandR_len) {     // "Overflow" buffer mode: check if data length equals expected length
-      memcpy(ptr, &rx_buffer_R[old_pos], rx_buffer_R_len - old_pos);    // First copy data from the end of buffer
-      if (pos > 0) {                                                    // Check and continue with beginning of buffer
-        ptr += rx_buffer_R_len - old_pos;                               // Move to correct position in command_raw
-        memcpy(ptr, &rx_buffer_R[0], pos);                              // Copy remaining data
-      }
-      usart_process_command(&commandR_raw, &commandR, 3);               // Process data
-    }
-  }
-  #endif // CONTROL_SERIAL_USART3
-
-  #ifdef SIDEBOARD_SERIAL_USART3
-  uint8_t *ptr;
-  if (pos != old_pos) {                                                 // Check change in received data
-    ptr = (uint8_t *)&Sideboard_R_raw;                                  // Initialize the pointer with Sideboard_raw address
-    if (pos > old_pos && (pos - old_pos) == Sideboard_R_len) {          // "Linear" buffer mode: check if current position is over previous one AND data length equals expected length
-      memcpy(ptr, &rx_buffer_R[old_pos], Sideboard_R_len);              // Copy data. This is possible only if Sideboard_raw is contiguous! (meaning all the structure members have the same size)
-      usart_process_sideboard(&Sideboard_R_raw, &Sideboard_R, 3);       // Process data
-    } else if ((rx_buffer_R_len - old_pos + pos) == Sideboard_R_len) {  // "Overflow" buffer mode: check if data length equals expected length
-      memcpy(ptr, &rx_buffer_R[old_pos], rx_buffer_R_len - old_pos);    // First copy data from the end of buffer
-      if (pos > 0) {                                                    // Check and continue with beginning of buffer
-        ptr += rx_buffer_R_len - old_pos;                               // Move to correct position in Sideboard_raw
-        memcpy(ptr, &rx_buffer_R[0], pos);                              // Copy remaining data
-      }
-      usart_process_sideboard(&Sideboard_R_raw, &Sideboard_R, 3);       // Process data
-    }
+  #endif
+
+  #ifdef SERIAL_PARSER
+  if (ch->roles & (SERIAL_ROLE_INPUT | SERIAL_ROLE_FEEDBACK)) {         // Commands, sideboard frames and poll frames
+    serialParse(&ch->parser, pos);                                      // Decode all complete frames, a partial frame waits for the next call
+    serialRxFrames(ch);
   }
-  #endif // SIDEBOARD_SERIAL_USART3
+  #endif
+
+  ch->rxOld = (pos == SERIAL_BUFFER_SIZE) ? 0 : pos;                    // Update old position, wrap at the end of buffer
+}
 
-  #if defined(DEBUG_SERIAL_USART3) || defined(CONTROL_SERIAL_USART3) || defined(SIDEBOARD_SERIAL_USART3)
-  old_pos = pos;                                                        // Update old position
-  if (old_pos == rx_buffer_R_len) {                                     // Check and manually update if we reached end of buffer
-    old_pos = 0;
+/*
+ * USART interrupt, the same for every channel: HAL events, then the IDLE line, then a requested feedback frame
+ */
+void serialIRQHandler(SerialChannel *ch)
+{
+  HAL_UART_IRQHandler(ch->huart);
+  if (RESET != __HAL_UART_GET_IT_SOURCE(ch->huart, UART_IT_IDLE)) {     // Check for IDLE line interrupt
+    __HAL_UART_CLEAR_IDLEFLAG(ch->huart);                               // Clear IDLE line flag (otherwise it will continue to enter interrupt)
+    serialRxCheck(ch);                                                  // Check for data to process
   }
+  #ifdef SERIAL_FEEDBACK
+  serialTxCheck(ch);
   #endif
 }
+#endif
 
 /*
  * Process Rx debug user command input
@@ -1234,6 +1554,11 @@ void usart3_rx_check(void)
 #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
 void usart_process_debug(uint8_t *userCommand, uint32_t len)
 {
+  #ifdef DEBUG_SERIAL_BINARY
+    if (paramRx(userCommand, len)) {
+      return;                           // binary parameter request, see comms.h
+    }
+  #endif
   #ifdef DEBUG_SERIAL_PROTOCOL
     handle_input(userCommand, len);
   #endif
@@ -1242,85 +1567,164 @@ void usart_process_debug(uint8_t *userCommand, uint32_t len)
 #endif // SERIAL_DEBUG
 
 /*
- * Process command Rx data
- * - if the command_in data is valid (correct START_FRAME and checksum) copy the command_in to command_out
+ * Serial frame parser for the command and sideboard frames
+ * - works directly on the Rx DMA circular buffer: hunts the start frame, checks the checksum in place and
+ *   copies only valid frames to the output structure, then continues after the frame
+ * - decodes any number of frames per call. A partial frame stays in the buffer until the next call, a byte
+ *   that does not start a valid frame (noise, corrupted or truncated frame) is skipped to resynchronise
+ * - called on the USART IDLE line and on the Rx DMA half and full transfer interrupts, so continuous
+ *   back-to-back frames are decoded too
+ * - accepts up to SERIAL_FORMATS frame formats (start frame, length, checksum), e.g. the legacy and the v2 command
+ * - every valid frame increments frames, handleTimeout() resets the timeout of the channel on a change
+ * - a format without output is a request (poll) frame: it only increments polls, so it neither changes the
+ *   command nor keeps the timeout from expiring
  */
-#if defined(CONTROL_SERIAL_USART2) || defined(CONTROL_SERIAL_USART3)
-void usart_process_command(SerialCommand *command_in, SerialCommand *command_out, uint8_t usart_idx)
+#ifdef SERIAL_PARSER
+void serialParserInit(SerialParser *p, uint8_t *buf, uint16_t size)
 {
-  #ifdef CONTROL_IBUS
-    uint16_t ibus_chksum;
-    if (command_in->start == IBUS_LENGTH && command_in->type == IBUS_COMMAND) {
-      ibus_chksum = 0xFFFF - IBUS_LENGTH - IBUS_COMMAND;
-      for (uint8_t i = 0; i < (IBUS_NUM_CHANNELS * 2); i++) {
-        ibus_chksum -= command_in->channels[i];
-      }
-      if (ibus_chksum == (uint16_t)((command_in->checksumh << 8) + command_in->checksuml)) {
-        *command_out = *command_in;
-        if (usart_idx == 2) {             // Sideboard USART2
-          #ifdef CONTROL_SERIAL_USART2
-          timeoutFlgSerial_L = 0;         // Clear timeout flag
-          timeoutCntSerial_L = 0;         // Reset timeout counter
-          #endif
-        } else if (usart_idx == 3) {      // Sideboard USART3
-          #ifdef CONTROL_SERIAL_USART3
-          timeoutFlgSerial_R = 0;         // Clear timeout flag
-          timeoutCntSerial_R = 0;         // Reset timeout counter
-          #endif
+  p->buf        = buf;
+  p->size       = size;
+  p->rd         = 0;
+  p->nFmt       = 0;
+  p->minLen     = 0xFF;
+  p->last       = 0;
+  p->frames     = 0;
+  p->polls      = 0;
+  p->skipped    = 0;
+}
+
+// Accept one more frame format, the first one added has the index SERIAL_FMT_V1
+void serialParserAdd(SerialParser *p, uint8_t *out, uint8_t len, uint16_t start, uint8_t chk)
+{
+  if (p->nFmt >= SERIAL_FORMATS) {
+    return;
+  }
+  p->fmt[p->nFmt].out   = out;
+  p->fmt[p->nFmt].len   = len;
+  p->fmt[p->nFmt].start = start;
+  p->fmt[p->nFmt].chk   = chk;
+  p->nFmt++;
+  if (len < p->minLen) {
+    p->minLen = len;
+  }
+}
+
+static uint8_t rxByte(const SerialParser *p, uint16_t i)
+{
+  i += p->rd;
+  return p->buf[(i >= p->size) ? i - p->size : i];
+}
+
+static uint16_t rxWord(const SerialParser *p, uint16_t i)
+{
+  return (uint16_t)(rxByte(p, i) | (rxByte(p, i + 1) << 8));
+}
+
+static uint8_t rxFrameValid(const SerialParser *p, const SerialFormat *f)
+{
+  uint16_t chk;
+  uint16_t i, n, first;
+
+  if (f->chk == SERIAL_CHK_CRC16) {               // CRC over the bytes between the start frame and the CRC, in one or two blocks of the ring
+    i     = p->rd + 2;
+    i     = (i >= p->size) ? i - p->size : i;
+    n     = f->len - 4;
+    first = (n < p->size - i) ? n : p->size - i;
+    chk   = calcCRC16(&p->buf[i], first, 0xFFFF);
+    if (n > first) {
+      chk = calcCRC16(p->buf, n - first, chk);
+    }
+  } else if (f->chk == SERIAL_CHK_IBUS) {         // 0xFFFF minus the sum of all bytes before the checksum
+    chk = 0xFFFF;
+    for (i = 0; i < f->len - 2; i++) {
+      chk -= rxByte(p, i);
+    }
+  } else {                                        // XOR of all 16-bit words before the checksum
+    chk = 0;
+    for (i = 0; i < f->len - 2; i += 2) {
+      chk ^= rxWord(p, i);
+    }
+  }
+  return chk == rxWord(p, f->len - 2);
+}
+
+// Format of a valid frame at the read position, SERIAL_FORMATS if there is none, 0xFF to wait for the rest of a frame
+static uint8_t rxFrameMatch(const SerialParser *p, uint16_t avail)
+{
+  uint16_t start = rxWord(p, 0);
+  uint8_t  wait  = 0;
+
+  for (uint8_t k = 0; k < p->nFmt; k++) {
+    if (start != p->fmt[k].start) {
+      continue;
+    }
+    if (avail < p->fmt[k].len) {
+      wait = 1;                                   // partial frame, decided when more bytes arrive
+    } else if (rxFrameValid(p, &p->fmt[k])) {
+      return k;
+    }
+  }
+  return wait ? 0xFF : SERIAL_FORMATS;
+}
+
+void serialParse(SerialParser *p, uint16_t pos)
+{
+  uint16_t avail;
+  uint8_t  i, k;
+
+  if (pos >= p->size) {
+    pos = 0;
+  }
+  avail = (pos >= p->rd) ? pos - p->rd : pos + p->size - p->rd;
+
+  while (avail >= p->minLen) {
+    k = rxFrameMatch(p, avail);
+    if (k == 0xFF) {
+      break;
+    }
+    if (k < SERIAL_FORMATS) {
+      const SerialFormat *f = &p->fmt[k];
+      if (f->out == NULL) {
+        p->polls++;                               // request frame: only counted
+      } else {
+        for (i = 0; i < f->len; i++) {
+          f->out[i] = rxByte(p, i);               // frame structures are packed: all members are naturally aligned
         }
+        p->last = k;
+        p->frames++;
       }
+      p->rd  += f->len;
+      avail  -= f->len;
+    } else {
+      p->skipped++;                               // not a valid frame here, resynchronise on the next byte
+      p->rd++;
+      avail--;
     }
-  #else
-  uint16_t checksum;
-  if (command_in->start == SERIAL_START_FRAME) {
-    checksum = (uint16_t)(command_in->start ^ command_in->steer ^ command_in->speed);
-    if (command_in->checksum == checksum) {
-      *command_out = *command_in;
-      if (usart_idx == 2) {             // Sideboard USART2
-        #ifdef CONTROL_SERIAL_USART2
-        timeoutFlgSerial_L = 0;         // Clear timeout flag
-        timeoutCntSerial_L = 0;         // Reset timeout counter
-        #endif
-      } else if (usart_idx == 3) {      // Sideboard USART3
-        #ifdef CONTROL_SERIAL_USART3
-        timeoutFlgSerial_R = 0;         // Clear timeout flag
-        timeoutCntSerial_R = 0;         // Reset timeout counter
-        #endif
-      }
+    if (p->rd >= p->size) {
+      p->rd -= p->size;
     }
   }
-  #endif
 }
-#endif
 
 /*
- * Process Sideboard Rx data
- * - if the Sideboard_in data is valid (correct START_FRAME and checksum) copy the Sideboard_in to Sideboard_out
+ * Rx DMA half and full transfer: decode the frames received so far, also when the line never goes idle
  */
-#if defined(SIDEBOARD_SERIAL_USART2) || defined(SIDEBOARD_SERIAL_USART3)
-void usart_process_sideboard(SerialSideboard *Sideboard_in, SerialSideboard *Sideboard_out, uint8_t usart_idx)
+void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef *huart)
 {
-  uint16_t checksum;
-  if (Sideboard_in->start == SERIAL_START_FRAME) {
-    checksum = (uint16_t)(Sideboard_in->start ^ Sideboard_in->pitch ^ Sideboard_in->dPitch ^ Sideboard_in->cmd1 ^ Sideboard_in->cmd2 ^ Sideboard_in->sensors);
-    if (Sideboard_in->checksum == checksum) {
-      *Sideboard_out = *Sideboard_in;
-      if (usart_idx == 2) {             // Sideboard USART2
-        #ifdef SIDEBOARD_SERIAL_USART2
-        timeoutCntSerial_L  = 0;        // Reset timeout counter
-        timeoutFlgSerial_L = 0;         // Clear timeout flag
-        #endif
-      } else if (usart_idx == 3) {      // Sideboard USART3
-        #ifdef SIDEBOARD_SERIAL_USART3
-        timeoutCntSerial_R = 0;         // Reset timeout counter
-        timeoutFlgSerial_R = 0;         // Clear timeout flag
-        #endif
-      }
+  for (uint8_t i = 0; i < SERIAL_CHANNELS; i++) {
+    SerialChannel *ch = &serialCh[i];
+    if (ch->huart == huart && (ch->roles & (SERIAL_ROLE_INPUT | SERIAL_ROLE_FEEDBACK))) {
+      serialParse(&ch->parser, SERIAL_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(huart->hdmarx));
+      serialRxFrames(ch);
     }
   }
 }
-#endif
 
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+{
+  HAL_UART_RxHalfCpltCallback(huart);
+}
+#endif
 
 /* =========================== Sideboard Functions =========================== */
 
@@ -1406,13 +1810,8 @@ void sideboardSensors(uint8_t sensors) {
     static uint8_t sensor1_index;                                 // holds the press index number for sensor1, when used as a button
     static uint8_t sensor1_prev,  sensor2_prev;
     uint8_t sensor1_trig = 0, sensor2_trig = 0;
-    #if defined(SIDEBOARD_SERIAL_USART2)
-    uint8_t  sideboardIdx = SIDEBOARD_SERIAL_USART2;
-    uint16_t sideboardSns = Sideboard_L.sensors;
-    #else
-    uint8_t  sideboardIdx = SIDEBOARD_SERIAL_USART3;
-    uint16_t sideboardSns = Sideboard_R.sensors;
-    #endif
+    uint8_t  sideboardIdx = serialCh[SERIAL_CH_SIDEBOARD].inIdx;
+    uint16_t sideboardSns = serialCh[SERIAL_CH_SIDEBOARD].in.sideboard.sensors;
 
     if (inIdx == sideboardIdx) {                                  // Use Sideboard data
       sensor1_index = 2 + ((sideboardSns & SWB_SET) >> 9);        // SWB on RC transmitter is used to change Control Type
@@ -1451,6 +1850,10 @@ void sideboardSensors(uint8_t sensors) {
           rtP_Left.z_ctrlTypSel = rtP_Right.z_ctrlTypSel = COM_CTRL;
           break;
       }
+      #ifdef CTRL_TYP_FIXED                                       // The controller is built for CTRL_TYP_SEL only, keep only the mode change
+        rtP_Left.z_ctrlTypSel = rtP_Right.z_ctrlTypSel = CTRL_TYP_SEL;
+      #endif
+      ctrlParamCommit();
       if (inIdx == inIdx_prev) { beepShortMany(sensor1_index + 1, 1); }
       if (++sensor1_index > 4) { sensor1_index = 0; }
     }
@@ -1489,6 +1892,7 @@ void sideboardSensors(uint8_t sensors) {
               Input_Lim_Init();
               break; 
           }
+          ctrlParamCommit();
           if (inIdx == inIdx_prev) { beepShortMany(sensor2_index + 1, 1); }
           if (++sensor2_index > 1) { sensor2_index = 0; }
         }
@@ -1518,21 +1922,7 @@ void saveConfig() {
         printf("Saving configuration to EEprom\r\n");
       #endif
 
-      HAL_FLASH_Unlock();
-      EE_WriteVariable(VirtAddVarTab[0] , (uint16_t)FLASH_WRITE_KEY);
-      EE_WriteVariable(VirtAddVarTab[1] , (uint16_t)rtP_Left.i_max);
-      EE_WriteVariable(VirtAddVarTab[2] , (uint16_t)rtP_Left.n_max);
-      for (uint8_t i=0; i<INPUTS_NR; i++) {
-        EE_WriteVariable(VirtAddVarTab[ 3+8*i] , (uint16_t)input1[i].typ);
-        EE_WriteVariable(VirtAddVarTab[ 4+8*i] , (uint16_t)input1[i].min);
-        EE_WriteVariable(VirtAddVarTab[ 5+8*i] , (uint16_t)input1[i].mid);
-        EE_WriteVariable(VirtAddVarTab[ 6+8*i] , (uint16_t)input1[i].max);
-        EE_WriteVariable(VirtAddVarTab[ 7+8*i] , (uint16_t)input2[i].typ);
-        EE_WriteVariable(VirtAddVarTab[ 8+8*i] , (uint16_t)input2[i].min);
-        EE_WriteVariable(VirtAddVarTab[ 9+8*i] , (uint16_t)input2[i].mid);
-        EE_WriteVariable(VirtAddVarTab[10+8*i] , (uint16_t)input2[i].max);
-      }
-      HAL_FLASH_Lock();
+      paramSave();
     }
   #endif 
 }
@@ -1543,12 +1933,10 @@ void poweroff(void) {
   #if defined(DEBUG_SERIAL_USART2) || defined(DEBUG_SERIAL_USART3)
   printf("-- Motors disabled --\r\n");
   #endif
-  buzzerCount = 0;  // prevent interraction with beep counter
-  buzzerPattern = 0;
   for (int i = 0; i < 8; i++) {
-    buzzerFreq = (uint8_t)i;
-    HAL_Delay(100);
+    beepTone((uint8_t)i, 100);
   }
+  beepWait();
   saveConfig();
   HAL_GPIO_WritePin(OFF_PORT, OFF_PIN, GPIO_PIN_RESET);
   while(1) {}
@@ -1592,7 +1980,7 @@ void poweroffPressCheck(void) {
       enable = 0;
       while(HAL_GPIO_ReadPin(BUTTON_PORT, BUTTON_PIN)) { HAL_Delay(10); }
       beepShort(5);
-      HAL_Delay(300);
+      HAL_Delay(400);                                     // 100 ms beep + 300 ms, the beep does not wait any more
       if (HAL_GPIO_ReadPin(BUTTON_PORT, BUTTON_PIN)) {
         while(HAL_GPIO_ReadPin(BUTTON_PORT, BUTTON_PIN)) { HAL_Delay(10); }
         beepLong(5);
@@ -1766,3 +2154,26 @@ void multipleTapDet(int16_t u, uint32_t timeNow, MultipleTap *x) {
 }
 
 
+
+
+/* =========================== Checksum Functions =========================== */
+
+  /* calcCRC16(const uint8_t *data, uint32_t len, uint16_t crc)
+  * CRC-16/CCITT-FALSE (poly 0x1021, no reflection), processed a nibble at a time with a 16 entry table.
+  * Inputs:       data, len = bytes to check; crc = 0xFFFF to start, or the result of the previous block to continue
+  * Outputs:      CRC of the data
+  */
+uint16_t calcCRC16(const uint8_t *data, uint32_t len, uint16_t crc) {
+  static const uint16_t crcTab[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+  };
+
+  while (len--) {
+    crc = (uint16_t)((crc << 4) ^ crcTab[(crc >> 12) ^ (*data >> 4)]);
+    crc = (uint16_t)((crc << 4) ^ crcTab[(crc >> 12) ^ (*data & 0x0F)]);
+    data++;
+  }
+  return crc;
+}
+
@@ -0,0 +1,321 @@
+/**
+  * This file is part of the hoverboard-firmware-hack project.
+  *
+  * Decoder for the binary telemetry stream (DEBUG_SERIAL_TELEMETRY in config.h,
+  * frame format in Inc/telemetry.h) and the scope captures (DEBUG_SCOPE, Inc/scope.h).
+  * Reads a serial port or a capture file and writes one CSV row per sample.
+  * Frames with a bad CRC are skipped and the decoder resynchronises on the next
+  * start frame. Gaps in the sample index (samples dropped on the board) are reported.
+  *
+  * Build: g++ -std=c++17 -O2 -o telem_decode Tools/telem_decode.cpp
+  * Usage: telem_decode <port|file|-> [-b baud] [-o out.csv] [-s scope.csv] [-f pwm_freq]
+  *   telem_decode /dev/ttyUSB0 -b 460800 -o trace.csv     live, stop with Ctrl+C
+  *   telem_decode capture.bin > trace.csv                  offline
+  *   telem_decode /dev/ttyUSB0 -s scope.csv                scope captures, t_us = 0 at the trigger sample
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace {
+
+// Keep in sync with Inc/telemetry.h
+constexpr uint16_t kStartFrame   = 0xA55A;
+constexpr uint8_t  kVersion      = 1;
+constexpr size_t   kHeaderSize   = 10;
+constexpr size_t   kMaxSamples   = 64;
+constexpr int      kSignals      = 16;
+const char *const  kSignalName[kSignals] = {
+  "iqL", "idL", "nL", "angL", "iqR", "idR", "nR", "angR",
+  "bat", "iLA", "iLB", "iLDC", "iRB", "iRC", "iRDC", "err"
+};
+
+// Keep in sync with Inc/scope.h
+constexpr uint16_t kScopeStart   = 0xA55B;
+constexpr uint8_t  kScopeVersion = 1;
+constexpr size_t   kScopeHeader  = 12;
+constexpr size_t   kScopeMaxSamples = 64;
+constexpr int      kScopeSignals = 9;
+constexpr int      kScopeHall    = 3;                  // hall bits | z_errCode << 8
+const char *const  kScopeName[kScopeSignals] = {
+  "iAB", "iBC", "iDC", "hall", "dcA", "dcB", "dcC", "iq", "id"
+};
+
+volatile std::sig_atomic_t stopRequest = 0;
+
+uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF) {
+  while (len--) {
+    crc ^= static_cast<uint16_t>(*data++) << 8;
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+uint16_t getU16(const uint8_t *p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+speed_t toSpeed(long baud) {
+  switch (baud) {
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+    case 460800:  return B460800;
+    case 921600:  return B921600;
+    default:      return 0;
+  }
+}
+
+class Decoder {
+ public:
+  Decoder(FILE *out, FILE *scope, double pwmFreq) : out_(out), scope_(scope), pwmFreq_(pwmFreq) {}
+
+  void feed(const uint8_t *data, size_t len) {
+    buf_.insert(buf_.end(), data, data + len);
+    size_t pos = 0;
+    while (buf_.size() - pos >= kHeaderSize + 2) {
+      const uint8_t *p = &buf_[pos];
+      if (getU16(p) == kScopeStart && p[2] == kScopeVersion && p[3] != 0 && p[3] <= kScopeMaxSamples) {
+        const size_t frameLen = kScopeHeader + static_cast<size_t>(p[3]) * kScopeSignals * 2 + 2;
+        if (buf_.size() - pos < frameLen) {
+          break;
+        }
+        if (crc16(p + 2, frameLen - 4) != getU16(p + frameLen - 2)) {
+          crcErrors_++;
+          pos++;
+          skipped_++;
+          continue;
+        }
+        scopeFrame(p);
+        pos += frameLen;
+        continue;
+      }
+      if (getU16(p) != kStartFrame || p[2] != kVersion || p[3] == 0 || p[3] > kMaxSamples) {
+        pos++;
+        skipped_++;
+        continue;
+      }
+      const uint16_t mask    = getU16(p + 4);
+      const int      signals = __builtin_popcount(mask);
+      const size_t   frameLen = kHeaderSize + static_cast<size_t>(p[3]) * signals * 2 + 2;
+      if (buf_.size() - pos < frameLen) {
+        break;                                  // wait for the rest of the frame
+      }
+      if (signals == 0 || crc16(p + 2, frameLen - 4) != getU16(p + frameLen - 2)) {
+        crcErrors_++;
+        pos++;
+        skipped_++;
+        continue;
+      }
+      frame(p, mask, signals);
+      pos += frameLen;
+    }
+    buf_.erase(buf_.begin(), buf_.begin() + static_cast<std::ptrdiff_t>(pos));
+  }
+
+  void report() const {
+    std::fprintf(stderr, "%llu frames, %llu samples, %llu dropped on the board, %llu CRC errors, %llu bytes skipped\n",
+                 (unsigned long long)frames_, (unsigned long long)samples_, (unsigned long long)dropped_,
+                 (unsigned long long)crcErrors_, (unsigned long long)skipped_);
+    if (scopeFrames_ > 0) {
+      std::fprintf(stderr, "%llu scope frames, %llu scope samples\n",
+                   (unsigned long long)scopeFrames_, (unsigned long long)scopeSamples_);
+    }
+  }
+
+ private:
+  void frame(const uint8_t *p, uint16_t mask, int signals) {
+    const uint8_t  n     = p[3];
+    const uint16_t div   = getU16(p + 6);
+    const uint16_t index = getU16(p + 8);
+
+    if (mask != mask_) {                        // new signal set: (re)write the CSV header
+      if (mask_ != 0) std::fputc('\n', out_);
+      std::fputs("t_s,index", out_);
+      for (int k = 0; k < kSignals; k++) {
+        if (mask & (1U << k)) std::fprintf(out_, ",%s", kSignalName[k]);
+      }
+      std::fputc('\n', out_);
+      mask_ = mask;
+    }
+    if (frames_ > 0) {                          // unwrap the 16 bit index, count the gap
+      const uint16_t gap = static_cast<uint16_t>(index - static_cast<uint16_t>(lastIndex_ + 1));
+      dropped_   += gap;
+      lastIndex_ += 1 + gap;
+      t_         += (1.0 + gap) * div / pwmFreq_;
+    } else {
+      lastIndex_ = index;
+    }
+
+    const uint8_t *d = p + kHeaderSize;
+    for (uint8_t i = 0; i < n; i++) {
+      if (i > 0) {
+        lastIndex_++;
+        t_ += div / pwmFreq_;
+      }
+      std::fprintf(out_, "%.6f,%llu", t_, (unsigned long long)lastIndex_);
+      for (int k = 0; k < signals; k++, d += 2) {
+        std::fprintf(out_, ",%d", static_cast<int16_t>(getU16(d)));
+      }
+      std::fputc('\n', out_);
+    }
+    frames_++;
+    samples_ += n;
+  }
+
+  void scopeFrame(const uint8_t *p) {
+    const uint8_t  n       = p[3];
+    const uint16_t capture = getU16(p + 4);
+    const int16_t  offset  = static_cast<int16_t>(getU16(p + 6));
+    const uint16_t length  = getU16(p + 8);
+
+    if (capture != lastCapture_) {
+      std::fprintf(stderr, "scope capture %u: %u samples, trigger 0x%02X, motor %u\n", capture, length, p[10], p[11]);
+      lastCapture_ = capture;
+    }
+    scopeFrames_++;
+    scopeSamples_ += n;
+    if (scope_ == nullptr) {
+      return;
+    }
+    if (!scopeHeader_) {
+      std::fputs("capture,trigger,motor,t_us,offset", scope_);
+      for (int k = 0; k < kScopeSignals; k++) {
+        std::fprintf(scope_, k == kScopeHall ? ",%s,err" : ",%s", kScopeName[k]);
+      }
+      std::fputc('\n', scope_);
+      scopeHeader_ = true;
+    }
+    const uint8_t *d = p + kScopeHeader;
+    for (int i = 0; i < n; i++) {
+      const int off = offset + i;
+      std::fprintf(scope_, "%u,%u,%u,%.1f,%d", capture, p[10], p[11], off * 1e6 / pwmFreq_, off);
+      for (int k = 0; k < kScopeSignals; k++, d += 2) {
+        const uint16_t v = getU16(d);
+        if (k == kScopeHall) std::fprintf(scope_, ",%u,%u", v & 0xFFU, v >> 8);   // hall bits, error code
+        else                 std::fprintf(scope_, ",%d", static_cast<int16_t>(v));
+      }
+      std::fputc('\n', scope_);
+    }
+  }
+
+  FILE                 *out_;
+  FILE                 *scope_;
+  double                pwmFreq_;
+  std::vector<uint8_t>  buf_;
+  uint16_t              mask_      = 0;
+  uint64_t              lastIndex_ = 0;
+  double                t_         = 0.0;
+  uint64_t              frames_    = 0;
+  uint64_t              samples_   = 0;
+  uint64_t              dropped_   = 0;
+  uint64_t              crcErrors_ = 0;
+  uint64_t              skipped_   = 0;
+  bool                  scopeHeader_  = false;
+  int                   lastCapture_  = -1;
+  uint64_t              scopeFrames_  = 0;
+  uint64_t              scopeSamples_ = 0;
+};
+
+void usage(const char *prog) {
+  std::fprintf(stderr, "usage: %s <port|file|-> [-b baud] [-o out.csv] [-s scope.csv] [-f pwm_freq]\n", prog);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *in      = nullptr;
+  const char *outName = nullptr;
+  const char *scpName = nullptr;
+  long        baud    = 115200;
+  double      pwmFreq = 16000.0;
+
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "-b" && i + 1 < argc)      baud    = std::strtol(argv[++i], nullptr, 10);
+    else if (a == "-o" && i + 1 < argc) outName = argv[++i];
+    else if (a == "-s" && i + 1 < argc) scpName = argv[++i];
+    else if (a == "-f" && i + 1 < argc) pwmFreq = std::strtod(argv[++i], nullptr);
+    else if (in == nullptr)             in      = argv[i];
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (in == nullptr || pwmFreq <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  int fd = (std::strcmp(in, "-") == 0) ? STDIN_FILENO : open(in, O_RDONLY | O_NOCTTY);
+  if (fd < 0) {
+    std::perror(in);
+    return 1;
+  }
+  if (isatty(fd)) {
+    termios tio{};
+    speed_t speed = toSpeed(baud);
+    if (speed == 0 || tcgetattr(fd, &tio) != 0) {
+      std::fprintf(stderr, "%s: cannot set %ld baud\n", in, baud);
+      return 1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cc[VMIN]  = 1;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+    tcflush(fd, TCIFLUSH);
+  }
+
+  FILE *out = outName ? std::fopen(outName, "w") : stdout;
+  if (out == nullptr) {
+    std::perror(outName);
+    return 1;
+  }
+
+  FILE *scope = scpName ? std::fopen(scpName, "w") : nullptr;
+  if (scpName != nullptr && scope == nullptr) {
+    std::perror(scpName);
+    return 1;
+  }
+
+  std::signal(SIGINT, [](int) { stopRequest = 1; });
+  Decoder dec(out, scope, pwmFreq);
+  uint8_t chunk[4096];
+  while (!stopRequest) {
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n <= 0) break;
+    dec.feed(chunk, static_cast<size_t>(n));
+  }
+  dec.report();
+  if (out != stdout) std::fclose(out);
+  if (scope != nullptr) std::fclose(scope);
+  return 0;
+}